@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bench.h"
+
+#include <stdlib.h>
+
+bench_alloc_stats_t bench_alloc_stats;
+
+// Each allocation is prefixed with its size so that the live and peak
+// bytes can be tracked. The header is padded to keep the alignment of
+// malloc().
+typedef union bench_alloc_header_t {
+    size_t size;
+    void* p;
+    double d;
+    long double ld;
+    uint64_t u;
+} bench_alloc_header_t;
+
+static void* bench_alloc_track(bench_alloc_header_t* header, size_t size) {
+    if (header == NULL)
+        return NULL;
+    header->size = size;
+    bench_alloc_stats.bytes += size;
+    if (bench_alloc_stats.peak_bytes < bench_alloc_stats.bytes)
+        bench_alloc_stats.peak_bytes = bench_alloc_stats.bytes;
+    return header + 1;
+}
+
+void* bench_malloc(size_t size) {
+    ++bench_alloc_stats.allocs;
+    return bench_alloc_track((bench_alloc_header_t*)malloc(sizeof(bench_alloc_header_t) + size), size);
+}
+
+void* bench_realloc(void* p, size_t size) {
+    ++bench_alloc_stats.reallocs;
+    bench_alloc_header_t* header = NULL;
+    if (p != NULL) {
+        header = (bench_alloc_header_t*)p - 1;
+        bench_alloc_stats.bytes -= header->size;
+    }
+    bench_alloc_header_t* new_header = (bench_alloc_header_t*)realloc(header, sizeof(bench_alloc_header_t) + size);
+    if (new_header == NULL && header != NULL) {
+        // the old block is still valid
+        bench_alloc_stats.bytes += header->size;
+        return NULL;
+    }
+    return bench_alloc_track(new_header, size);
+}
+
+void bench_free(void* p) {
+    if (p == NULL)
+        return;
+    bench_alloc_header_t* header = (bench_alloc_header_t*)p - 1;
+    ++bench_alloc_stats.frees;
+    bench_alloc_stats.bytes -= header->size;
+    free(header);
+}
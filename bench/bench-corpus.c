@@ -0,0 +1,844 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Random number generation
+ */
+
+void bench_rng_seed(bench_rng_t* rng, uint64_t seed) {
+    // the state must not be zero
+    rng->state = seed ^ UINT64_C(0x9e3779b97f4a7c15);
+    if (rng->state == 0)
+        rng->state = 1;
+}
+
+uint64_t bench_rng_next(bench_rng_t* rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * UINT64_C(0x2545f4914f6cdd1d);
+}
+
+uint32_t bench_rng_range(bench_rng_t* rng, uint32_t min_value, uint32_t max_value) {
+    uint64_t span = (uint64_t)max_value - min_value + 1;
+    return min_value + (uint32_t)((bench_rng_next(rng) >> 11) % span);
+}
+
+double bench_rng_unit(bench_rng_t* rng) {
+    return (double)(bench_rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// writes a random lowercase string with a length in the given range
+static void bench_write_random_str(mpack_writer_t* writer, bench_rng_t* rng, uint32_t min_length, uint32_t max_length) {
+    char str[64];
+    uint32_t length = bench_rng_range(rng, min_length, max_length);
+    mpack_assert(length <= sizeof(str), "string is too long");
+    for (uint32_t i = 0; i < length; ++i)
+        str[i] = (char)('a' + bench_rng_range(rng, 0, 25));
+    mpack_write_str(writer, str, length);
+}
+
+/*
+ * Small RPC requests: a map of four keys with a short method name and a
+ * small array of parameters.
+ */
+
+static const char* const bench_rpc_methods[] = {
+    "get", "put", "delete", "list", "watch", "status", "ping", "subscribe",
+};
+
+static void bench_rpc_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    mpack_start_map(writer, 4);
+    mpack_write_cstr(writer, "id");
+    mpack_write_u64(writer, bench_rng_next(rng) >> bench_rng_range(rng, 0, 63));
+    mpack_write_cstr(writer, "method");
+    mpack_write_cstr(writer, bench_rpc_methods[bench_rng_range(rng, 0, 7)]);
+    mpack_write_cstr(writer, "params");
+    mpack_start_array(writer, 3);
+    mpack_write_i64(writer, (int64_t)bench_rng_range(rng, 0, 2000) - 1000);
+    mpack_write_double(writer, bench_rng_unit(rng) * 1000.0);
+    mpack_write_bool(writer, (bench_rng_next(rng) & 1) != 0);
+    mpack_finish_array(writer);
+    mpack_write_cstr(writer, "deadline");
+    mpack_write_u64(writer, UINT64_C(1500000000000) + bench_rng_range(rng, 0, 100000000));
+    mpack_finish_map(writer);
+}
+
+static uint64_t bench_rpc_expect(mpack_reader_t* reader) {
+    static const char* keys[] = {"id", "method", "params", "deadline"};
+    bool found[4] = {false, false, false, false};
+    char method[16];
+    uint64_t sum = 0;
+
+    uint32_t count = mpack_expect_map_max(reader, 16);
+    for (uint32_t i = 0; i < count && mpack_reader_error(reader) == mpack_ok; ++i) {
+        switch (mpack_expect_key_cstr(reader, keys, found, 4)) {
+            case 0:
+                sum += mpack_expect_u64(reader);
+                break;
+            case 1:
+                sum += mpack_expect_str_buf(reader, method, sizeof(method));
+                break;
+            case 2:
+                mpack_expect_array_match(reader, 3);
+                sum += (uint64_t)mpack_expect_i64(reader);
+                sum += (uint64_t)mpack_expect_double(reader);
+                sum += mpack_expect_bool(reader);
+                mpack_done_array(reader);
+                break;
+            case 3:
+                sum += mpack_expect_u64(reader);
+                break;
+            default:
+                mpack_discard(reader);
+                break;
+        }
+    }
+    mpack_done_map(reader);
+    return sum;
+}
+
+static uint64_t bench_rpc_lookup(mpack_node_t root) {
+    uint64_t sum = mpack_node_u64(mpack_node_map_cstr(root, "id"));
+    sum += mpack_node_strlen(mpack_node_map_cstr(root, "method"));
+    sum += (uint64_t)mpack_node_i64(mpack_node_array_at(mpack_node_map_cstr(root, "params"), 0));
+    sum += mpack_node_u64(mpack_node_map_cstr(root, "deadline"));
+    return sum;
+}
+
+/*
+ * Wide maps: a map of 200 fields with a mix of value types, such as a
+ * table row or a configuration object.
+ */
+
+#define BENCH_WIDE_FIELDS 200
+
+static void bench_wide_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    char key[16];
+    mpack_start_map(writer, BENCH_WIDE_FIELDS);
+    for (unsigned i = 0; i < BENCH_WIDE_FIELDS; ++i) {
+        snprintf(key, sizeof(key), "field%03u", i);
+        mpack_write_cstr(writer, key);
+        switch (i % 4) {
+            case 0:  mpack_write_u64(writer, bench_rng_next(rng) >> bench_rng_range(rng, 0, 63)); break;
+            case 1:  bench_write_random_str(writer, rng, 8, 24); break;
+            case 2:  mpack_write_double(writer, bench_rng_unit(rng)); break;
+            default: mpack_write_bool(writer, (bench_rng_next(rng) & 1) != 0); break;
+        }
+    }
+    mpack_finish_map(writer);
+}
+
+static uint64_t bench_wide_expect(mpack_reader_t* reader) {
+    char key[16];
+    char str[32];
+    uint64_t sum = 0;
+
+    uint32_t count = mpack_expect_map_max(reader, 1024);
+    for (uint32_t i = 0; i < count && mpack_reader_error(reader) == mpack_ok; ++i) {
+        sum += mpack_expect_str_buf(reader, key, sizeof(key));
+        switch (i % 4) {
+            case 0:  sum += mpack_expect_u64(reader); break;
+            case 1:  sum += mpack_expect_str_buf(reader, str, sizeof(str)); break;
+            case 2:  sum += (uint64_t)(mpack_expect_double(reader) * 1000.0); break;
+            default: sum += mpack_expect_bool(reader); break;
+        }
+    }
+    mpack_done_map(reader);
+    return sum;
+}
+
+static uint64_t bench_wide_lookup(mpack_node_t root) {
+    static const char* keys[] = {
+        "field000", "field025", "field050", "field075",
+        "field100", "field125", "field150", "field175",
+    };
+    uint64_t sum = 0;
+    for (size_t i = 0; i < sizeof(keys) / sizeof(*keys); ++i)
+        sum += (uint64_t)mpack_node_type(mpack_node_map_cstr(root, keys[i]));
+    return sum;
+}
+
+/*
+ * Deep nesting: a chain of maps 48 levels deep, such as a linked
+ * structure or a deeply nested document, ending in a small array.
+ */
+
+#define BENCH_DEEP_DEPTH 48
+
+static void bench_deep_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    for (unsigned i = 0; i < BENCH_DEEP_DEPTH; ++i) {
+        mpack_start_map(writer, 2);
+        mpack_write_cstr(writer, "level");
+        mpack_write_u32(writer, i);
+        mpack_write_cstr(writer, "child");
+    }
+    mpack_start_array(writer, 3);
+    for (unsigned i = 0; i < 3; ++i)
+        mpack_write_i64(writer, (int64_t)bench_rng_range(rng, 0, 100000) - 50000);
+    mpack_finish_array(writer);
+    for (unsigned i = 0; i < BENCH_DEEP_DEPTH; ++i)
+        mpack_finish_map(writer);
+}
+
+static uint64_t bench_deep_expect(mpack_reader_t* reader) {
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < BENCH_DEEP_DEPTH; ++i) {
+        mpack_expect_map_match(reader, 2);
+        mpack_expect_cstr_match(reader, "level");
+        sum += mpack_expect_u32(reader);
+        mpack_expect_cstr_match(reader, "child");
+    }
+    mpack_expect_array_match(reader, 3);
+    for (unsigned i = 0; i < 3; ++i)
+        sum += (uint64_t)mpack_expect_i64(reader);
+    mpack_done_array(reader);
+    for (unsigned i = 0; i < BENCH_DEEP_DEPTH; ++i)
+        mpack_done_map(reader);
+    return sum;
+}
+
+static uint64_t bench_deep_lookup(mpack_node_t root) {
+    uint64_t sum = 0;
+    mpack_node_t node = root;
+    while (mpack_node_type(node) == mpack_type_map) {
+        sum += mpack_node_u32(mpack_node_map_cstr(node, "level"));
+        node = mpack_node_map_cstr(node, "child");
+    }
+    return sum + (uint64_t)mpack_node_i64(mpack_node_array_at(node, 0));
+}
+
+/*
+ * String-heavy logs: structured log records with a free-form message
+ * of mostly ASCII text and some multi-byte UTF-8.
+ */
+
+static const char* const bench_log_levels[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+static const char* const bench_log_words[] = {
+    "request", "failed", "connection", "timeout", "user", "session", "cache",
+    "miss", "retry", "upstream", "latency", "ms", "ok", "error", "disk",
+    "queue", "flush", "the", "of", "for", "to", "from", "with", "id",
+    "caf\xc3\xa9", "na\xc3\xafve", "\xe6\x97\xa5\xe6\x9c\xac", // multi-byte UTF-8
+    "\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xf0\x9f\x93\xa6",
+};
+
+#define BENCH_LOG_WORD_COUNT (sizeof(bench_log_words) / sizeof(*bench_log_words))
+
+static void bench_log_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    char host[32];
+    char msg[256];
+
+    mpack_start_map(writer, 5);
+    mpack_write_cstr(writer, "ts");
+    mpack_write_u64(writer, UINT64_C(1500000000000000) + bench_rng_range(rng, 0, 0x7fffffff));
+    mpack_write_cstr(writer, "level");
+    mpack_write_cstr(writer, bench_log_levels[bench_rng_range(rng, 0, 3)]);
+    mpack_write_cstr(writer, "host");
+    snprintf(host, sizeof(host), "host-%02u.example.com", (unsigned)bench_rng_range(rng, 0, 99));
+    mpack_write_cstr(writer, host);
+
+    // the message is a run of words up to a random length
+    size_t target = bench_rng_range(rng, 40, 220);
+    size_t length = 0;
+    while (length < target) {
+        const char* word = bench_log_words[bench_rng_range(rng, 0, BENCH_LOG_WORD_COUNT - 1)];
+        size_t word_length = strlen(word);
+        if (length != 0)
+            msg[length++] = ' ';
+        memcpy(msg + length, word, word_length);
+        length += word_length;
+    }
+    mpack_write_cstr(writer, "msg");
+    mpack_write_str(writer, msg, (uint32_t)length);
+
+    mpack_write_cstr(writer, "tags");
+    mpack_start_array(writer, 2);
+    bench_write_random_str(writer, rng, 3, 10);
+    bench_write_random_str(writer, rng, 3, 10);
+    mpack_finish_array(writer);
+    mpack_finish_map(writer);
+}
+
+static uint64_t bench_log_expect(mpack_reader_t* reader) {
+    static const char* keys[] = {"ts", "level", "host", "msg", "tags"};
+    bool found[5] = {false, false, false, false, false};
+    char str[256];
+    uint64_t sum = 0;
+
+    uint32_t count = mpack_expect_map_max(reader, 16);
+    for (uint32_t i = 0; i < count && mpack_reader_error(reader) == mpack_ok; ++i) {
+        switch (mpack_expect_key_cstr(reader, keys, found, 5)) {
+            case 0:
+                sum += mpack_expect_u64(reader);
+                break;
+            case 1: // fallthrough
+            case 2:
+                sum += mpack_expect_str_buf(reader, str, sizeof(str));
+                break;
+            case 3:
+                sum += mpack_expect_utf8(reader, str, sizeof(str));
+                break;
+            case 4: {
+                uint32_t tags = mpack_expect_array_max(reader, 16);
+                for (uint32_t j = 0; j < tags; ++j)
+                    sum += mpack_expect_str_buf(reader, str, sizeof(str));
+                mpack_done_array(reader);
+                break;
+            }
+            default:
+                mpack_discard(reader);
+                break;
+        }
+    }
+    mpack_done_map(reader);
+    return sum;
+}
+
+static uint64_t bench_log_lookup(mpack_node_t root) {
+    uint64_t sum = mpack_node_u64(mpack_node_map_cstr(root, "ts"));
+    sum += mpack_node_strlen(mpack_node_map_cstr(root, "level"));
+    sum += mpack_node_strlen(mpack_node_map_cstr(root, "msg"));
+    sum += mpack_node_array_length(mpack_node_map_cstr(root, "tags"));
+    return sum;
+}
+
+/*
+ * Mixed-script text: paragraphs of European and Asian text in which
+ * multi-byte characters are frequent, unlike the mostly ASCII logs. A
+ * paragraph mixes ASCII and multi-byte characters every few bytes, or
+ * has no ASCII at all.
+ */
+
+#define BENCH_TEXT_PARAGRAPHS 4
+
+static const char* const bench_text_latin[] = {
+    "hello", "w\xc3\xb6rld", "\xe2\x80\xa6", "caf\xc3\xa9", "na\xc3\xafve", "\xc3\xbc" "ber",
+    "fa\xc3\xa7" "ade", "se\xc3\xb1or", "stra\xc3\x9f" "e", "\xc3\xa9t\xc3\xa9", "d\xc3\xa9j\xc3\xa0",
+    "the", "and", "a", "of",
+};
+
+static const char* const bench_text_cyrillic[] = {
+    "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xd0\xbc\xd0\xb8\xd1\x80", "\xd0\xb8",
+    "\xd1\x82\xd0\xb5\xd0\xba\xd1\x81\xd1\x82", "\xd0\xb4\xd0\xb0\xd0\xbd\xd0\xbd\xd1\x8b\xd0\xb5",
+    "\xd0\xb2", "\xd1\x8d\xd1\x82\xd0\xbe",
+    "\xce\x95\xce\xbb\xce\xbb\xce\xb7\xce\xbd\xce\xb9\xce\xba\xce\xac", "\xce\xba\xce\xb1\xce\xb9",
+    "\xcf\x84\xce\xbf",
+};
+
+static const char* const bench_text_cjk[] = {
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xe3\x81\xae", "\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88",
+    "\xe4\xb8\xad\xe6\x96\x87", "\xe6\x95\xb0\xe6\x8d\xae", "\xe3\x81\xaf", "\xe3\x80\x82", "\xe3\x80\x81",
+};
+
+typedef struct bench_text_script_t {
+    const char* const* words;
+    uint32_t count;
+    const char* separator;
+} bench_text_script_t;
+
+static const bench_text_script_t bench_text_scripts[] = {
+    {bench_text_latin,    sizeof(bench_text_latin) / sizeof(*bench_text_latin),       " "},
+    {bench_text_cyrillic, sizeof(bench_text_cyrillic) / sizeof(*bench_text_cyrillic), " "},
+    {bench_text_cjk,      sizeof(bench_text_cjk) / sizeof(*bench_text_cjk),           ""},
+};
+
+#define BENCH_TEXT_SCRIPT_COUNT (sizeof(bench_text_scripts) / sizeof(*bench_text_scripts))
+
+static void bench_text_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    char paragraph[512];
+
+    mpack_start_array(writer, BENCH_TEXT_PARAGRAPHS);
+    for (unsigned i = 0; i < BENCH_TEXT_PARAGRAPHS; ++i) {
+        const bench_text_script_t* script = &bench_text_scripts[bench_rng_range(rng, 0, BENCH_TEXT_SCRIPT_COUNT - 1)];
+        size_t separator_length = strlen(script->separator);
+
+        // the paragraph is a run of words up to a random length
+        size_t target = bench_rng_range(rng, 100, 400);
+        size_t length = 0;
+        while (length < target) {
+            const char* word = script->words[bench_rng_range(rng, 0, script->count - 1)];
+            size_t word_length = strlen(word);
+            if (length != 0) {
+                memcpy(paragraph + length, script->separator, separator_length);
+                length += separator_length;
+            }
+            memcpy(paragraph + length, word, word_length);
+            length += word_length;
+        }
+        mpack_write_str(writer, paragraph, (uint32_t)length);
+    }
+    mpack_finish_array(writer);
+}
+
+static uint64_t bench_text_expect(mpack_reader_t* reader) {
+    char str[512];
+    uint64_t sum = 0;
+    uint32_t count = mpack_expect_array_max(reader, 16);
+    for (uint32_t i = 0; i < count; ++i)
+        sum += mpack_expect_utf8(reader, str, sizeof(str));
+    mpack_done_array(reader);
+    return sum;
+}
+
+static uint64_t bench_text_lookup(mpack_node_t root) {
+    uint64_t sum = 0;
+    size_t count = mpack_node_array_length(root);
+    for (size_t i = 0; i < count; ++i) {
+        mpack_node_t node = mpack_node_array_at(root, i);
+        mpack_node_check_utf8(node);
+        sum += mpack_node_strlen(node);
+    }
+    return sum;
+}
+
+/*
+ * Numeric arrays: arrays of 512 numbers of mixed type, such as samples
+ * or coordinates.
+ */
+
+#define BENCH_NUMERIC_LENGTH 512
+
+static void bench_numeric_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    mpack_start_array(writer, BENCH_NUMERIC_LENGTH);
+    for (unsigned i = 0; i < BENCH_NUMERIC_LENGTH; ++i) {
+        switch (bench_rng_range(rng, 0, 3)) {
+            case 0:  mpack_write_double(writer, bench_rng_unit(rng) * 1000000.0); break;
+            case 1:  mpack_write_float(writer, (float)bench_rng_unit(rng)); break;
+            case 2:  mpack_write_u32(writer, bench_rng_range(rng, 0, 100000)); break;
+            default: mpack_write_i32(writer, -(int32_t)bench_rng_range(rng, 1, 100000)); break;
+        }
+    }
+    mpack_finish_array(writer);
+}
+
+static uint64_t bench_numeric_expect(mpack_reader_t* reader) {
+    double sum = 0;
+    uint32_t count = mpack_expect_array_max(reader, 4096);
+    for (uint32_t i = 0; i < count; ++i)
+        sum += mpack_expect_double(reader);
+    mpack_done_array(reader);
+    return (uint64_t)(int64_t)sum;
+}
+
+static uint64_t bench_numeric_lookup(mpack_node_t root) {
+    double sum = 0;
+    size_t length = mpack_node_array_length(root);
+    for (size_t i = 0; i < 16 && length != 0; ++i)
+        sum += mpack_node_double(mpack_node_array_at(root, (i * 31) % length));
+    return (uint64_t)(int64_t)sum;
+}
+
+/*
+ * Generator
+ */
+
+const char* const bench_gen_type_names[bench_gen_type_count] = {
+    "nil", "bool", "int", "uint", "float", "double", "str", "bin", "ext", "array", "map",
+};
+
+void bench_gen_options_init(bench_gen_options_t* options) {
+    static const unsigned weights[bench_gen_type_count] = {1, 2, 4, 4, 1, 2, 6, 1, 0, 2, 2};
+    options->min_nodes = 1;
+    options->max_nodes = 200;
+    options->max_depth = 6;
+    options->min_width = 0;
+    options->max_width = 12;
+    options->min_length = 0;
+    options->max_length = 32;
+    options->charset = bench_gen_charset_alnum;
+    memcpy(options->weights, weights, sizeof(weights));
+}
+
+bool bench_gen_parse_weights(bench_gen_options_t* options, const char* list) {
+    while (*list != '\0') {
+        const char* equals = strchr(list, '=');
+        if (equals == NULL)
+            return false;
+
+        size_t length = (size_t)(equals - list);
+        size_t type;
+        for (type = 0; type < bench_gen_type_count; ++type)
+            if (strlen(bench_gen_type_names[type]) == length && memcmp(bench_gen_type_names[type], list, length) == 0)
+                break;
+        if (type == bench_gen_type_count)
+            return false;
+
+        char* end;
+        unsigned long weight = strtoul(equals + 1, &end, 10);
+        if (end == equals + 1 || (*end != ',' && *end != '\0') || weight > 1000000)
+            return false;
+        options->weights[type] = (unsigned)weight;
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return true;
+}
+
+// picks a random type by weight among the first count types
+static bench_gen_type_t bench_gen_pick(bench_rng_t* rng, const unsigned* weights, size_t count) {
+    unsigned total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += weights[i];
+    if (total == 0)
+        return bench_gen_nil;
+
+    uint32_t value = bench_rng_range(rng, 0, total - 1);
+    for (size_t i = 0; i < count; ++i) {
+        if (value < weights[i])
+            return (bench_gen_type_t)i;
+        value -= weights[i];
+    }
+    return bench_gen_nil;
+}
+
+// appends a random UTF-8 character of the given encoded length
+static size_t bench_gen_utf8_char(bench_rng_t* rng, char* p, size_t length) {
+    uint32_t c;
+    switch (length) {
+        case 2:
+            c = bench_rng_range(rng, 0x80, 0x7ff);
+            p[0] = (char)(0xc0 | (c >> 6));
+            p[1] = (char)(0x80 | (c & 0x3f));
+            return 2;
+        case 3:
+            // skip the surrogates
+            c = bench_rng_range(rng, 0x800, 0xffff - 0x800);
+            if (c >= 0xd800)
+                c += 0x800;
+            p[0] = (char)(0xe0 | (c >> 12));
+            p[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+            p[2] = (char)(0x80 | (c & 0x3f));
+            return 3;
+        default:
+            c = bench_rng_range(rng, 0x10000, 0x10ffff);
+            p[0] = (char)(0xf0 | (c >> 18));
+            p[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+            p[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+            p[3] = (char)(0x80 | (c & 0x3f));
+            return 4;
+    }
+}
+
+// fills a chunk of str data in the given charset, or random bytes for bin and ext
+static void bench_gen_fill(bench_rng_t* rng, mpack_type_t type, bench_gen_charset_t charset, char* p, size_t count) {
+    static const char alnum[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t i = 0;
+    while (i < count) {
+        if (type != mpack_type_str) {
+            p[i++] = (char)bench_rng_next(rng);
+        } else if (charset == bench_gen_charset_alnum) {
+            p[i++] = alnum[bench_rng_range(rng, 0, sizeof(alnum) - 2)];
+        } else if (charset == bench_gen_charset_utf8 && bench_rng_range(rng, 0, 7) == 0) {
+            // multi-byte characters never straddle a chunk, so the whole str is valid
+            size_t length = bench_rng_range(rng, 2, 4);
+            if (length > count - i)
+                length = count - i;
+            if (length == 1)
+                p[i++] = alnum[bench_rng_range(rng, 0, sizeof(alnum) - 2)];
+            else
+                i += bench_gen_utf8_char(rng, p + i, length);
+        } else {
+            p[i++] = (char)bench_rng_range(rng, 0x20, 0x7e);
+        }
+    }
+}
+
+static void bench_gen_data(mpack_writer_t* writer, bench_rng_t* rng, mpack_type_t type,
+        bench_gen_charset_t charset, uint32_t length)
+{
+    char chunk[256];
+    switch (type) {
+        case mpack_type_str: mpack_start_str(writer, length); break;
+        case mpack_type_bin: mpack_start_bin(writer, length); break;
+        default: mpack_start_ext(writer, (int8_t)bench_rng_range(rng, 0, 127), length); break;
+    }
+    for (uint32_t left = length; left > 0;) {
+        size_t count = left < sizeof(chunk) ? left : sizeof(chunk);
+        bench_gen_fill(rng, type, charset, chunk, count);
+        mpack_write_bytes(writer, chunk, count);
+        left -= (uint32_t)count;
+    }
+    mpack_finish_type(writer, type);
+}
+
+static void bench_gen_value(mpack_writer_t* writer, bench_rng_t* rng, const bench_gen_options_t* options,
+        uint32_t depth, uint32_t* budget);
+
+// writes one element of an array, or one key-value pair of a map
+static void bench_gen_child(mpack_writer_t* writer, bench_rng_t* rng, const bench_gen_options_t* options,
+        bool map, uint32_t depth, uint32_t* budget)
+{
+    if (map) {
+        if (*budget > 0)
+            --*budget;
+        bench_gen_data(writer, rng, mpack_type_str, bench_gen_charset_alnum, bench_rng_range(rng, 1, 12));
+    }
+    bench_gen_value(writer, rng, options, depth, budget);
+}
+
+static void bench_gen_value(mpack_writer_t* writer, bench_rng_t* rng, const bench_gen_options_t* options,
+        uint32_t depth, uint32_t* budget)
+{
+    if (*budget > 0)
+        --*budget;
+
+    // containers are only chosen if they can be nested and there are nodes left to fill them
+    bench_gen_type_t type = bench_gen_pick(rng, options->weights, bench_gen_type_count);
+    if (type >= bench_gen_array && (depth >= options->max_depth || *budget == 0))
+        type = bench_gen_pick(rng, options->weights, bench_gen_array);
+
+    switch (type) {
+        case bench_gen_nil:    mpack_write_nil(writer); break;
+        case bench_gen_bool:   mpack_write_bool(writer, (bench_rng_next(rng) & 1) != 0); break;
+        case bench_gen_int:    mpack_write_i64(writer, -(int64_t)(bench_rng_next(rng) >> bench_rng_range(rng, 1, 63)) - 1); break;
+        case bench_gen_uint:   mpack_write_u64(writer, bench_rng_next(rng) >> bench_rng_range(rng, 0, 63)); break;
+        case bench_gen_float:  mpack_write_float(writer, (float)(bench_rng_unit(rng) * 2000.0 - 1000.0)); break;
+        case bench_gen_double: mpack_write_double(writer, bench_rng_unit(rng) * 1000000.0 - 500000.0); break;
+
+        case bench_gen_str:
+        case bench_gen_bin:
+        case bench_gen_ext: {
+            static const mpack_type_t types[] = {mpack_type_str, mpack_type_bin, mpack_type_ext};
+            bench_gen_data(writer, rng, types[type - bench_gen_str], options->charset,
+                    bench_rng_range(rng, options->min_length, options->max_length));
+            break;
+        }
+
+        default: {
+            bool map = type == bench_gen_map;
+            uint32_t width = bench_rng_range(rng, options->min_width, options->max_width);
+            uint32_t limit = map ? *budget / 2 : *budget;
+            if (width > limit)
+                width = limit;
+            if (map)
+                mpack_start_map(writer, width);
+            else
+                mpack_start_array(writer, width);
+            for (uint32_t i = 0; i < width; ++i)
+                bench_gen_child(writer, rng, options, map, depth + 1, budget);
+            mpack_finish_type(writer, map ? mpack_type_map : mpack_type_array);
+            break;
+        }
+    }
+}
+
+static void bench_gen_discard(mpack_writer_t* writer, const char* buffer, size_t count) {
+    MPACK_UNUSED(writer);
+    MPACK_UNUSED(buffer);
+    MPACK_UNUSED(count);
+}
+
+void bench_gen_write(mpack_writer_t* writer, bench_rng_t* rng, const bench_gen_options_t* options) {
+
+    // the node count is roughly log-uniform: pick a power of two up to
+    // the span, then a uniform value below it
+    uint32_t span = options->max_nodes - options->min_nodes;
+    uint32_t bits = 0;
+    while (bits < 32 && ((uint64_t)1 << bits) <= span)
+        ++bits;
+    uint32_t scale = bench_rng_range(rng, 0, bits);
+    uint64_t value = bench_rng_next(rng) & (((uint64_t)1 << scale) - 1);
+    uint32_t budget = options->min_nodes + (uint32_t)(value < span ? value : span);
+    if (budget > 0)
+        --budget; // the root
+
+    // the root is a container that holds all of the nodes
+    unsigned weights[2] = {options->weights[bench_gen_array], options->weights[bench_gen_map]};
+    bool map = bench_gen_pick(rng, weights, 2) == 1;
+
+    // we don't know how many children the root will have until we
+    // generate them, so we generate them once from a copy of the
+    // generator into a writer that discards them, then again for real
+    char scratch[MPACK_WRITER_MINIMUM_BUFFER_SIZE];
+    mpack_writer_t counter;
+    mpack_writer_init(&counter, scratch, sizeof(scratch));
+    mpack_writer_set_flush(&counter, bench_gen_discard);
+    bench_rng_t probe = *rng;
+    uint32_t probe_budget = budget;
+    uint32_t count = 0;
+    while (probe_budget > 0) {
+        bench_gen_child(&counter, &probe, options, map, 2, &probe_budget);
+        ++count;
+    }
+    mpack_writer_destroy(&counter);
+
+    if (map)
+        mpack_start_map(writer, count);
+    else
+        mpack_start_array(writer, count);
+    for (uint32_t i = 0; i < count; ++i)
+        bench_gen_child(writer, rng, options, map, 2, &budget);
+    mpack_finish_type(writer, map ? mpack_type_map : mpack_type_array);
+}
+
+/*
+ * Mixed documents: messages of arbitrary shape from the generator with
+ * its default options.
+ */
+
+static void bench_mixed_write(mpack_writer_t* writer, bench_rng_t* rng) {
+    bench_gen_options_t options;
+    bench_gen_options_init(&options);
+    bench_gen_write(writer, rng, &options);
+}
+
+/*
+ * Shapes
+ */
+
+const bench_shape_t bench_shapes[] = {
+    {"rpc",     "small RPC requests",   20000, bench_rpc_write,     bench_rpc_expect,     bench_rpc_lookup},
+    {"wide",    "200-field maps",         400, bench_wide_write,    bench_wide_expect,    bench_wide_lookup},
+    {"deep",    "48-level nested maps",  2000, bench_deep_write,    bench_deep_expect,    bench_deep_lookup},
+    {"logs",    "string-heavy logs",    10000, bench_log_write,     bench_log_expect,     bench_log_lookup},
+    {"text",    "mixed-script text",     5000, bench_text_write,    bench_text_expect,    bench_text_lookup},
+    {"numeric", "512-number arrays",      500, bench_numeric_write, bench_numeric_expect, bench_numeric_lookup},
+    {"mixed",   "generated documents",   5000, bench_mixed_write,   NULL,                 NULL},
+};
+
+const size_t bench_shape_count = sizeof(bench_shapes) / sizeof(*bench_shapes);
+
+const bench_shape_t* bench_shape_find(const char* name) {
+    for (size_t i = 0; i < bench_shape_count; ++i)
+        if (strcmp(bench_shapes[i].name, name) == 0)
+            return &bench_shapes[i];
+    return NULL;
+}
+
+/*
+ * Corpus
+ */
+
+bool bench_corpus_generate(bench_corpus_t* corpus, const bench_shape_t* shape, uint64_t seed, size_t count) {
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->shape = shape;
+    corpus->offsets = (size_t*)malloc(sizeof(size_t) * (count + 1));
+    if (corpus->offsets == NULL)
+        return false;
+
+    bench_rng_t rng;
+    bench_rng_seed(&rng, seed);
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        char* message;
+        size_t size;
+        mpack_writer_t writer;
+        mpack_writer_init_growable(&writer, &message, &size);
+        shape->write(&writer, &rng);
+        if (mpack_writer_destroy(&writer) != mpack_ok) {
+            bench_corpus_destroy(corpus);
+            return false;
+        }
+
+        if (corpus->size + size > capacity) {
+            size_t new_capacity = capacity == 0 ? 4096 : capacity;
+            while (new_capacity < corpus->size + size)
+                new_capacity *= 2;
+            char* data = (char*)realloc(corpus->data, new_capacity);
+            if (data == NULL) {
+                MPACK_FREE(message);
+                bench_corpus_destroy(corpus);
+                return false;
+            }
+            corpus->data = data;
+            capacity = new_capacity;
+        }
+
+        corpus->offsets[i] = corpus->size;
+        memcpy(corpus->data + corpus->size, message, size);
+        corpus->size += size;
+        corpus->count = i + 1;
+        MPACK_FREE(message);
+    }
+
+    corpus->offsets[count] = corpus->size;
+    return true;
+}
+
+bool bench_corpus_load(bench_corpus_t* corpus, const bench_shape_t* shape, const char* filename) {
+    memset(corpus, 0, sizeof(*corpus));
+    corpus->shape = shape;
+
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+        return false;
+    size_t capacity = 0;
+    for (;;) {
+        if (corpus->size == capacity) {
+            capacity = capacity == 0 ? 65536 : capacity * 2;
+            char* data = (char*)realloc(corpus->data, capacity);
+            if (data == NULL)
+                break;
+            corpus->data = data;
+        }
+        size_t count = fread(corpus->data + corpus->size, 1, capacity - corpus->size, file);
+        corpus->size += count;
+        if (count == 0)
+            break;
+    }
+    bool ok = ferror(file) == 0 && corpus->size != 0 && corpus->size < capacity;
+    fclose(file);
+    if (!ok) {
+        bench_corpus_destroy(corpus);
+        return false;
+    }
+
+    // find the offset of each message
+    size_t offset_capacity = 0;
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, corpus->data, corpus->size);
+    for (;;) {
+        if (corpus->count == offset_capacity) {
+            offset_capacity = offset_capacity == 0 ? 1024 : offset_capacity * 2;
+            size_t* offsets = (size_t*)realloc(corpus->offsets, sizeof(size_t) * (offset_capacity + 1));
+            if (offsets == NULL) {
+                mpack_reader_flag_error(&reader, mpack_error_memory);
+                break;
+            }
+            corpus->offsets = offsets;
+        }
+        size_t remaining = mpack_reader_remaining(&reader, NULL);
+        corpus->offsets[corpus->count] = corpus->size - remaining;
+        if (remaining == 0)
+            break;
+        mpack_discard(&reader);
+        ++corpus->count;
+    }
+    if (mpack_reader_destroy(&reader) != mpack_ok) {
+        bench_corpus_destroy(corpus);
+        return false;
+    }
+    return true;
+}
+
+void bench_corpus_destroy(bench_corpus_t* corpus) {
+    free(corpus->data);
+    free(corpus->offsets);
+    memset(corpus, 0, sizeof(*corpus));
+}
+
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * This is mpack-gen, a tool that generates reproducible corpora of
+ * random MessagePack messages for benchmarks and capacity planning. Run
+ * it with -h for options.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum bench_gen_format_t {
+    bench_gen_format_stream, // messages concatenated in one file
+    bench_gen_format_array,  // one file containing an array of all messages
+    bench_gen_format_files,  // one file per message in a directory
+} bench_gen_format_t;
+
+static void bench_gen_usage(const char* program) {
+    bench_gen_options_t defaults;
+    bench_gen_options_init(&defaults);
+
+    printf("Usage: %s [options] -o output\n", program);
+    printf("  -o path     output file, or directory for -f files\n");
+    printf("  -f format   stream (default), array or files\n");
+    printf("  -m count    number of messages (default 1000)\n");
+    printf("  -s seed     random seed (default 1)\n");
+    printf("  -c shape    generate a benchmark corpus shape instead:");
+    for (size_t i = 0; i < bench_shape_count; ++i)
+        printf(" %s", bench_shapes[i].name);
+    printf("\n");
+    printf("  -n min:max  nodes per message, log-uniform (default %u:%u)\n",
+            (unsigned)defaults.min_nodes, (unsigned)defaults.max_nodes);
+    printf("  -d depth    maximum nesting depth (default %u)\n", (unsigned)defaults.max_depth);
+    printf("  -w min:max  elements of nested arrays or pairs of nested maps (default %u:%u)\n",
+            (unsigned)defaults.min_width, (unsigned)defaults.max_width);
+    printf("  -l min:max  bytes of str, bin and ext data (default %u:%u)\n",
+            (unsigned)defaults.min_length, (unsigned)defaults.max_length);
+    printf("  -a charset  str charset: alnum (default), ascii or utf8\n");
+    printf("  -t weights  relative frequency of each type (default ");
+    for (size_t i = 0; i < bench_gen_type_count; ++i)
+        printf("%s%s=%u", i == 0 ? "" : ",", bench_gen_type_names[i], defaults.weights[i]);
+    printf(")\n");
+    printf("              e.g. -t double=10,ext=1 changes only those types\n");
+}
+
+// parses "min:max" into a range
+static bool bench_gen_parse_range(const char* value, uint32_t* min_value, uint32_t* max_value) {
+    char* end;
+    unsigned long low = strtoul(value, &end, 10);
+    if (end == value || *end != ':')
+        return false;
+    const char* high_str = end + 1;
+    unsigned long high = strtoul(high_str, &end, 10);
+    if (end == high_str || *end != '\0' || low > high || high > UINT32_MAX)
+        return false;
+    *min_value = (uint32_t)low;
+    *max_value = (uint32_t)high;
+    return true;
+}
+
+typedef struct bench_gen_t {
+    bench_gen_options_t options;
+    const bench_shape_t* shape; // a benchmark shape to generate, or NULL to use the options
+    bench_rng_t rng;
+} bench_gen_t;
+
+static void bench_gen_message(bench_gen_t* gen, mpack_writer_t* writer) {
+    if (gen->shape != NULL)
+        gen->shape->write(writer, &gen->rng);
+    else
+        bench_gen_write(writer, &gen->rng, &gen->options);
+}
+
+static bool bench_gen_file(bench_gen_t* gen, const char* filename, bench_gen_format_t format, uint32_t count) {
+    mpack_writer_t writer;
+    mpack_writer_init_file(&writer, filename);
+    if (format == bench_gen_format_array)
+        mpack_start_array(&writer, count);
+    for (uint32_t i = 0; i < count && mpack_writer_error(&writer) == mpack_ok; ++i)
+        bench_gen_message(gen, &writer);
+    if (format == bench_gen_format_array)
+        mpack_finish_array(&writer);
+
+    mpack_error_t error = mpack_writer_destroy(&writer);
+    if (error != mpack_ok) {
+        fprintf(stderr, "error writing %s: %s\n", filename, mpack_error_to_string(error));
+        return false;
+    }
+    return true;
+}
+
+static bool bench_gen_files(bench_gen_t* gen, const char* directory, uint32_t count) {
+    size_t length = strlen(directory) + 16;
+    char* filename = (char*)malloc(length);
+    if (filename == NULL)
+        return false;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < count; ++i) {
+        snprintf(filename, length, "%s/%06u.mp", directory, (unsigned)i);
+        ok = bench_gen_file(gen, filename, bench_gen_format_stream, 1);
+    }
+    free(filename);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    bench_gen_t gen;
+    bench_gen_options_init(&gen.options);
+    gen.shape = NULL;
+    const char* output = NULL;
+    bench_gen_format_t format = bench_gen_format_stream;
+    uint32_t count = 1000;
+    uint64_t seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bench_gen_options_t* options = &gen.options;
+        bool ok = value != NULL && arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0';
+
+        if (ok) {
+            switch (arg[1]) {
+                case 'o': output = value; break;
+                case 'm': count = (uint32_t)strtoul(value, NULL, 10); break;
+                case 's': seed = strtoull(value, NULL, 10); break;
+                case 'c': gen.shape = bench_shape_find(value); ok = gen.shape != NULL; break;
+                case 'n': ok = bench_gen_parse_range(value, &options->min_nodes, &options->max_nodes); break;
+                case 'w': ok = bench_gen_parse_range(value, &options->min_width, &options->max_width); break;
+                case 'l': ok = bench_gen_parse_range(value, &options->min_length, &options->max_length); break;
+                case 'd': options->max_depth = (uint32_t)strtoul(value, NULL, 10); break;
+                case 't': ok = bench_gen_parse_weights(options, value); break;
+                case 'f':
+                    if (strcmp(value, "stream") == 0)
+                        format = bench_gen_format_stream;
+                    else if (strcmp(value, "array") == 0)
+                        format = bench_gen_format_array;
+                    else if (strcmp(value, "files") == 0)
+                        format = bench_gen_format_files;
+                    else
+                        ok = false;
+                    break;
+                case 'a':
+                    if (strcmp(value, "alnum") == 0)
+                        options->charset = bench_gen_charset_alnum;
+                    else if (strcmp(value, "ascii") == 0)
+                        options->charset = bench_gen_charset_ascii;
+                    else if (strcmp(value, "utf8") == 0)
+                        options->charset = bench_gen_charset_utf8;
+                    else
+                        ok = false;
+                    break;
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+
+        if (!ok) {
+            bench_gen_usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    if (output == NULL || gen.options.min_nodes == 0) {
+        bench_gen_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench_rng_seed(&gen.rng, seed);
+    bool ok;
+    if (format == bench_gen_format_files)
+        ok = bench_gen_files(&gen, output, count);
+    else
+        ok = bench_gen_file(&gen, output, format, count);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
@@ -0,0 +1,1006 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * This is the MPack benchmark suite. It generates a corpus of each
+ * message shape, then measures the throughput of encoding and decoding
+ * it with each API. Run it with -h for options.
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Timing
+ */
+
+// returns the time in nanoseconds from an arbitrary start
+static uint64_t bench_now_ns(void) {
+    #if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+    #else
+    return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+    #endif
+}
+
+static double bench_now(void) {
+    return (double)bench_now_ns() * 1e-9;
+}
+
+// accumulates benchmark checksums so that the work can't be optimized away
+static volatile uint64_t bench_sink;
+
+/*
+ * Benchmark data
+ *
+ * Each benchmark runs against a corpus along with some data derived from
+ * it: the sequence of events in the corpus (which lets us encode it again
+ * without measuring how the values are produced), the corpus converted
+ * to JSON Lines, and a sample of parsed trees for lookups.
+ */
+
+typedef struct bench_event_t {
+    mpack_tag_t tag;
+    const char* data; // the data of a str, bin or ext
+    bool finish;      // whether this finishes the map or array in tag
+} bench_event_t;
+
+#define BENCH_SAMPLE_COUNT 256
+
+typedef struct bench_data_t {
+    bench_corpus_t corpus;
+
+    bench_event_t* events;
+    size_t event_count;
+    size_t event_capacity;
+    size_t* event_offsets; // the first event of each message; there are count + 1
+    size_t str_bytes; // total length of all str data
+
+    char* strings; // every str in the corpus, as a sequence of str objects
+    size_t strings_size;
+    size_t string_count;
+
+    char* output; // output buffer for encoding
+
+    char* json; // the corpus as JSON, one message per line
+    size_t json_size;
+
+    mpack_tree_t samples[BENCH_SAMPLE_COUNT];
+    size_t sample_count;
+    size_t sample_size; // total size of the sampled messages
+} bench_data_t;
+
+static bench_event_t* bench_event_add(bench_data_t* data) {
+    if (data->event_count == data->event_capacity) {
+        size_t capacity = data->event_capacity == 0 ? 1024 : data->event_capacity * 2;
+        bench_event_t* events = (bench_event_t*)realloc(data->events, sizeof(bench_event_t) * capacity);
+        if (events == NULL)
+            return NULL;
+        data->events = events;
+        data->event_capacity = capacity;
+    }
+    bench_event_t* event = &data->events[data->event_count++];
+    memset(event, 0, sizeof(*event));
+    return event;
+}
+
+static void bench_events_tag(mpack_reader_t* reader, void* context, mpack_tag_t tag) {
+    bench_event_t* event = bench_event_add((bench_data_t*)context);
+    if (event == NULL) {
+        mpack_reader_flag_error(reader, mpack_error_memory);
+        return;
+    }
+    event->tag = tag;
+    event->data = ""; // zero-length data has no bytes event
+}
+
+static void bench_events_bytes(mpack_reader_t* reader, void* context, const char* bytes, size_t count) {
+    MPACK_UNUSED(reader);
+    bench_data_t* data = (bench_data_t*)context;
+
+    // the corpus is read from a data buffer, so each object's data is
+    // delivered in one chunk that stays valid
+    bench_event_t* event = &data->events[data->event_count - 1];
+    event->data = bytes;
+    if (event->tag.type == mpack_type_str)
+        data->str_bytes += count;
+}
+
+static void bench_events_finish(mpack_reader_t* reader, void* context, mpack_type_t type) {
+    if (type != mpack_type_map && type != mpack_type_array)
+        return;
+    bench_event_t* event = bench_event_add((bench_data_t*)context);
+    if (event == NULL) {
+        mpack_reader_flag_error(reader, mpack_error_memory);
+        return;
+    }
+    event->tag.type = type;
+    event->finish = true;
+}
+
+// prepares the data derived from the corpus, which has already been generated or loaded
+static bool bench_data_init(bench_data_t* data) {
+    static const mpack_visitor_t visitor = {
+        bench_events_tag, bench_events_tag, bench_events_bytes, bench_events_finish
+    };
+    data->event_offsets = (size_t*)malloc(sizeof(size_t) * (data->corpus.count + 1));
+    if (data->event_offsets == NULL)
+        return false;
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i) {
+        data->event_offsets[i] = data->event_count;
+        mpack_parse_events(&reader, &visitor, data);
+    }
+    data->event_offsets[data->corpus.count] = data->event_count;
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return false;
+
+    data->output = (char*)malloc(data->corpus.size);
+    if (data->output == NULL)
+        return false;
+
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.newline = true;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &data->json, &data->json_size);
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        mpack_to_json(&reader, &writer, &options);
+    if (mpack_reader_destroy(&reader) != mpack_ok || mpack_writer_destroy(&writer) != mpack_ok)
+        return false;
+
+    mpack_writer_init_growable(&writer, &data->strings, &data->strings_size);
+    for (size_t i = 0; i < data->event_count; ++i) {
+        const bench_event_t* event = &data->events[i];
+        if (event->tag.type == mpack_type_str && !event->finish) {
+            mpack_write_str(&writer, event->data, event->tag.v.l);
+            ++data->string_count;
+        }
+    }
+    if (mpack_writer_destroy(&writer) != mpack_ok)
+        return false;
+
+    // lookups need to know the schema
+    if (data->corpus.shape->lookup == NULL)
+        return true;
+
+    while (data->sample_count < BENCH_SAMPLE_COUNT && data->sample_count < data->corpus.count) {
+        size_t offset = data->corpus.offsets[data->sample_count];
+        size_t size = data->corpus.offsets[data->sample_count + 1] - offset;
+        mpack_tree_t* tree = &data->samples[data->sample_count++];
+        mpack_tree_init(tree, data->corpus.data + offset, size);
+        if (mpack_tree_error(tree) != mpack_ok)
+            return false;
+        data->sample_size += size;
+    }
+
+    return true;
+}
+
+static void bench_data_destroy(bench_data_t* data) {
+    for (size_t i = 0; i < data->sample_count; ++i)
+        mpack_tree_destroy(&data->samples[i]);
+    free(data->output);
+    if (data->json)
+        MPACK_FREE(data->json);
+    if (data->strings)
+        MPACK_FREE(data->strings);
+    free(data->event_offsets);
+    free(data->events);
+    bench_corpus_destroy(&data->corpus);
+}
+
+/*
+ * Benchmarks
+ *
+ * Each benchmark function makes one pass over its data and returns a
+ * checksum.
+ */
+
+// writes the given range of events
+static void bench_replay(mpack_writer_t* writer, const bench_event_t* event, const bench_event_t* end) {
+    for (; event != end; ++event) {
+        if (event->finish) {
+            mpack_finish_type(writer, event->tag.type);
+            continue;
+        }
+        switch (event->tag.type) {
+            case mpack_type_nil:    mpack_write_nil(writer); break;
+            case mpack_type_bool:   mpack_write_bool(writer, event->tag.v.b); break;
+            case mpack_type_int:    mpack_write_int(writer, event->tag.v.i); break;
+            case mpack_type_uint:   mpack_write_uint(writer, event->tag.v.u); break;
+            case mpack_type_float:  mpack_write_float(writer, event->tag.v.f); break;
+            case mpack_type_double: mpack_write_double(writer, event->tag.v.d); break;
+            case mpack_type_str:    mpack_write_str(writer, event->data, event->tag.v.l); break;
+            case mpack_type_bin:    mpack_write_bin(writer, event->data, event->tag.v.l); break;
+            case mpack_type_ext:    mpack_write_ext(writer, event->tag.exttype, event->data, event->tag.v.l); break;
+            case mpack_type_array:  mpack_start_array(writer, event->tag.v.n); break;
+            case mpack_type_map:    mpack_start_map(writer, event->tag.v.n); break;
+        }
+    }
+}
+
+static uint64_t bench_encode(bench_data_t* data) {
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, data->output, data->corpus.size);
+    bench_replay(&writer, data->events, data->events + data->event_count);
+    uint64_t used = mpack_writer_buffer_used(&writer);
+    if (mpack_writer_destroy(&writer) != mpack_ok)
+        return 0;
+    return used;
+}
+
+static void bench_decode_scalar(mpack_reader_t* reader, void* context, mpack_tag_t tag) {
+    MPACK_UNUSED(reader);
+    *(uint64_t*)context += (uint64_t)tag.type;
+}
+
+static void bench_decode_start(mpack_reader_t* reader, void* context, mpack_tag_t tag) {
+    MPACK_UNUSED(reader);
+    *(uint64_t*)context += tag.v.l;
+}
+
+static void bench_decode_bytes(mpack_reader_t* reader, void* context, const char* bytes, size_t count) {
+    MPACK_UNUSED(reader);
+    *(uint64_t*)context += (uint64_t)(unsigned char)bytes[0] + count;
+}
+
+static uint64_t bench_decode(bench_data_t* data) {
+    static const mpack_visitor_t visitor = {
+        bench_decode_scalar, bench_decode_start, bench_decode_bytes, NULL
+    };
+    uint64_t sum = 0;
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        mpack_parse_events(&reader, &visitor, &sum);
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return sum;
+}
+
+static uint64_t bench_expect(bench_data_t* data) {
+    uint64_t sum = 0;
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        sum += data->corpus.shape->expect(&reader);
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return sum;
+}
+
+static uint64_t bench_discard(bench_data_t* data) {
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        mpack_discard(&reader);
+    uint64_t left = mpack_reader_remaining(&reader, NULL);
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return left + 1;
+}
+
+static uint64_t bench_tree(bench_data_t* data) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data->corpus.count; ++i) {
+        mpack_tree_t tree;
+        size_t offset = data->corpus.offsets[i];
+        mpack_tree_init(&tree, data->corpus.data + offset, data->corpus.offsets[i + 1] - offset);
+        sum += mpack_tree_size(&tree);
+        if (mpack_tree_destroy(&tree) != mpack_ok)
+            return 0;
+    }
+    return sum;
+}
+
+static uint64_t bench_lookup(bench_data_t* data) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data->sample_count; ++i)
+        sum += data->corpus.shape->lookup(mpack_tree_root(&data->samples[i]));
+    return sum;
+}
+
+static void bench_json_flush(mpack_writer_t* writer, const char* buffer, size_t count) {
+    MPACK_UNUSED(buffer);
+    *(uint64_t*)writer->context += count;
+}
+
+static uint64_t bench_json(bench_data_t* data) {
+    uint64_t written = 0;
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, data->output, data->corpus.size);
+    mpack_writer_set_flush(&writer, bench_json_flush);
+    mpack_writer_set_context(&writer, &written);
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->corpus.data, data->corpus.size);
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        mpack_to_json(&reader, &writer, NULL);
+    if (mpack_reader_destroy(&reader) != mpack_ok || mpack_writer_destroy(&writer) != mpack_ok)
+        return 0;
+    return written;
+}
+
+static uint64_t bench_from_json(bench_data_t* data) {
+    uint64_t written = 0;
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, data->output, data->corpus.size);
+    mpack_writer_set_flush(&writer, bench_json_flush);
+    mpack_writer_set_context(&writer, &written);
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.newline = true;
+    mpack_from_json(data->json, data->json_size, &writer, &options);
+    if (mpack_writer_destroy(&writer) != mpack_ok)
+        return 0;
+    return written;
+}
+
+// validates every str in the corpus in place through the reader
+static uint64_t bench_utf8(bench_data_t* data) {
+    uint64_t sum = 0;
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data->strings, data->strings_size);
+    for (size_t i = 0; i < data->string_count; ++i) {
+        uint32_t length = mpack_expect_str(&reader);
+        if (mpack_read_utf8_inplace(&reader, length) != NULL)
+            sum += length;
+        mpack_done_str(&reader);
+    }
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return sum;
+}
+
+#if MPACK_PIPELINE
+// the number of pipeline workers, or 0 for one per processor
+static size_t bench_threads;
+
+static void* bench_pipeline_decode(void* context, mpack_tree_t* tree) {
+    MPACK_UNUSED(context);
+    return (void*)(uintptr_t)mpack_tree_size(tree);
+}
+
+// results are delivered in order on the calling thread
+static void bench_pipeline_deliver(void* context, uint64_t index, void* result, mpack_error_t error) {
+    MPACK_UNUSED(index);
+    uint64_t* sum = (uint64_t*)context;
+    if (error == mpack_ok)
+        *sum += (uintptr_t)result;
+}
+
+static uint64_t bench_pipeline(bench_data_t* data) {
+    // each worker's node pool holds the largest message, so that the
+    // workers never allocate (the allocation counters aren't thread-safe)
+    size_t nodes = 1;
+    for (size_t i = 0; i < data->corpus.count; ++i)
+        if (nodes < data->corpus.offsets[i + 1] - data->corpus.offsets[i])
+            nodes = data->corpus.offsets[i + 1] - data->corpus.offsets[i];
+
+    mpack_pipeline_options_t options;
+    mpack_pipeline_options_init(&options);
+    options.threads = bench_threads;
+    options.nodes = nodes;
+
+    uint64_t sum = 0;
+    if (mpack_pipeline_run(data->corpus.data, data->corpus.size,
+                bench_pipeline_decode, bench_pipeline_deliver, &sum, &options) != mpack_ok)
+        return 0;
+    return sum;
+}
+#endif
+
+// what a benchmark pass is measured in
+typedef enum bench_unit_t {
+    bench_unit_corpus,  // every message in the corpus
+    bench_unit_strings, // the str data in the corpus
+    bench_unit_samples, // the sampled trees
+    bench_unit_json,    // every message of the corpus as JSON
+} bench_unit_t;
+
+typedef struct bench_t {
+    const char* name;
+    uint64_t (*run)(bench_data_t* data);
+    bench_unit_t unit;
+    bool schema; // whether the benchmark needs the read functions of the corpus shape
+} bench_t;
+
+static const bench_t bench_benchmarks[] = {
+    {"encode",   bench_encode,     bench_unit_corpus,  false},
+    {"decode",   bench_decode,     bench_unit_corpus,  false},
+    {"expect",   bench_expect,     bench_unit_corpus,  true},
+    {"discard",  bench_discard,    bench_unit_corpus,  false},
+    {"tree",     bench_tree,       bench_unit_corpus,  false},
+    #if MPACK_PIPELINE
+    {"pipeline", bench_pipeline,   bench_unit_corpus,  false},
+    #endif
+    {"lookup",   bench_lookup,     bench_unit_samples, true},
+    {"json",     bench_json,       bench_unit_corpus,  false},
+    {"fromjson", bench_from_json,  bench_unit_json,    false},
+    {"utf8",     bench_utf8,       bench_unit_strings, false},
+};
+
+#define BENCH_BENCHMARK_COUNT (sizeof(bench_benchmarks) / sizeof(*bench_benchmarks))
+
+static void bench_run(const bench_t* bench, bench_data_t* data, double min_time) {
+    size_t bytes, ops;
+    switch (bench->unit) {
+        case bench_unit_strings: bytes = data->str_bytes;   ops = data->corpus.count; break;
+        case bench_unit_samples: bytes = data->sample_size; ops = data->sample_count; break;
+        case bench_unit_json:    bytes = data->json_size;   ops = data->corpus.count; break;
+        default:                 bytes = data->corpus.size; ops = data->corpus.count; break;
+    }
+    if (bytes == 0 || (bench->schema && (data->corpus.shape->expect == NULL || data->corpus.shape->lookup == NULL))) {
+        printf("%-8s %-8s %12s\n", data->corpus.shape->name, bench->name, "-");
+        return;
+    }
+
+    // a warm-up pass also checks that the benchmark succeeds
+    uint64_t sum = bench->run(data);
+    if (sum == 0) {
+        printf("%-8s %-8s %12s\n", data->corpus.shape->name, bench->name, "FAILED");
+        return;
+    }
+
+    size_t passes = 0;
+    double start = bench_now();
+    double elapsed;
+    do {
+        sum += bench->run(data);
+        ++passes;
+        elapsed = bench_now() - start;
+    } while (elapsed < min_time);
+    bench_sink += sum;
+
+    double total_ops = (double)ops * (double)passes;
+    printf("%-8s %-8s %12.1f %14.0f %12.1f\n", data->corpus.shape->name, bench->name,
+            (double)bytes * (double)passes / elapsed / 1e6,
+            total_ops / elapsed,
+            elapsed * 1e9 / total_ops);
+}
+
+/*
+ * Latency mode
+ *
+ * Each operation is timed per message and recorded in a histogram with
+ * logarithmic buckets, each power of two split into 16 linear
+ * sub-buckets, so that every value is recorded to within about 6% with
+ * a fixed amount of memory. Allocations are counted per operation.
+ */
+
+#define BENCH_HISTOGRAM_SUB_BITS 4
+#define BENCH_HISTOGRAM_SUB_COUNT (1 << BENCH_HISTOGRAM_SUB_BITS)
+#define BENCH_HISTOGRAM_BUCKETS ((64 - BENCH_HISTOGRAM_SUB_BITS + 1) * BENCH_HISTOGRAM_SUB_COUNT)
+
+typedef struct bench_histogram_t {
+    uint64_t counts[BENCH_HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} bench_histogram_t;
+
+static size_t bench_histogram_index(uint64_t value) {
+    if (value < 2 * BENCH_HISTOGRAM_SUB_COUNT)
+        return (size_t)value;
+    size_t msb = 0;
+    while ((value >> msb) > 1)
+        ++msb;
+    size_t shift = msb - BENCH_HISTOGRAM_SUB_BITS;
+    return shift * BENCH_HISTOGRAM_SUB_COUNT + (size_t)(value >> shift);
+}
+
+// returns the largest value that is recorded in the given bucket
+static uint64_t bench_histogram_upper(size_t index) {
+    if (index < 2 * BENCH_HISTOGRAM_SUB_COUNT)
+        return index;
+    size_t shift = index / BENCH_HISTOGRAM_SUB_COUNT - 1;
+    uint64_t top = (uint64_t)(index % BENCH_HISTOGRAM_SUB_COUNT + BENCH_HISTOGRAM_SUB_COUNT);
+    return ((top + 1) << shift) - 1;
+}
+
+static void bench_histogram_record(bench_histogram_t* histogram, uint64_t value) {
+    ++histogram->counts[bench_histogram_index(value)];
+    ++histogram->total;
+    if (histogram->max < value)
+        histogram->max = value;
+}
+
+// returns an upper bound of the value at the given fraction of the recorded values
+static uint64_t bench_histogram_percentile(const bench_histogram_t* histogram, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)histogram->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BENCH_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t upper = bench_histogram_upper(i);
+            return upper < histogram->max ? upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/*
+ * Per-message operations, for the latency and memory modes. Each returns
+ * a non-zero checksum on success.
+ */
+
+static uint64_t bench_message_tree(bench_data_t* data, size_t i) {
+    mpack_tree_t tree;
+    size_t offset = data->corpus.offsets[i];
+    mpack_tree_init(&tree, data->corpus.data + offset, data->corpus.offsets[i + 1] - offset);
+    uint64_t size = mpack_tree_size(&tree);
+    if (mpack_tree_destroy(&tree) != mpack_ok)
+        return 0;
+    return size;
+}
+
+static uint64_t bench_message_expect(bench_data_t* data, size_t i) {
+    mpack_reader_t reader;
+    size_t offset = data->corpus.offsets[i];
+    mpack_reader_init_data(&reader, data->corpus.data + offset, data->corpus.offsets[i + 1] - offset);
+    uint64_t sum = data->corpus.shape->expect(&reader);
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return sum + 1;
+}
+
+static uint64_t bench_message_encode(bench_data_t* data, size_t i) {
+    char* buffer;
+    size_t size;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &buffer, &size);
+    bench_replay(&writer, data->events + data->event_offsets[i], data->events + data->event_offsets[i + 1]);
+    if (mpack_writer_destroy(&writer) != mpack_ok)
+        return 0;
+    MPACK_FREE(buffer);
+    return size;
+}
+
+#if MPACK_RING
+// each message is passed through the ring to ourselves, so this measures
+// encoding without allocating (compare with encode)
+#define BENCH_RING_SIZE (256 * 1024)
+static mpack_ring_t bench_ring;
+static char* bench_ring_buffer;
+
+static uint64_t bench_message_ring(bench_data_t* data, size_t i) {
+    if (bench_ring_buffer == NULL) {
+        bench_ring_buffer = (char*)malloc(BENCH_RING_SIZE);
+        if (bench_ring_buffer == NULL)
+            return 0;
+        mpack_ring_init(&bench_ring, bench_ring_buffer, BENCH_RING_SIZE);
+    }
+
+    mpack_writer_t* writer = mpack_ring_start(&bench_ring);
+    bench_replay(writer, data->events + data->event_offsets[i], data->events + data->event_offsets[i + 1]);
+    if (mpack_ring_finish(&bench_ring) != mpack_ok)
+        return 0;
+    size_t size;
+    if (mpack_ring_next(&bench_ring, &size) == NULL)
+        return 0;
+    return size;
+}
+#endif
+
+typedef struct bench_message_op_t {
+    const char* name;
+    uint64_t (*run)(bench_data_t* data, size_t message);
+    bool schema;  // whether the operation needs the read functions of the corpus shape
+    bool sampled; // whether the operation is measured only on the sampled messages
+} bench_message_op_t;
+
+static const bench_message_op_t bench_latencies[] = {
+    {"encode", bench_message_encode, false, false},
+    #if MPACK_RING
+    {"ring",   bench_message_ring,   false, false},
+    #endif
+    {"expect", bench_message_expect, true,  false},
+    {"tree",   bench_message_tree,   false, false},
+};
+
+#define BENCH_LATENCY_COUNT (sizeof(bench_latencies) / sizeof(*bench_latencies))
+
+// returns the smallest difference measured between two reads of the clock
+static uint64_t bench_timer_overhead(void) {
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t start = bench_now_ns();
+        uint64_t delta = bench_now_ns() - start;
+        if (overhead > delta)
+            overhead = delta;
+    }
+    return overhead;
+}
+
+static void bench_latency_run(const bench_message_op_t* latency, bench_data_t* data, double min_time) {
+    if (data->corpus.count == 0 || (latency->schema && data->corpus.shape->expect == NULL)) {
+        printf("%-8s %-8s %10s\n", data->corpus.shape->name, latency->name, "-");
+        return;
+    }
+
+    bench_histogram_t* histogram = (bench_histogram_t*)calloc(1, sizeof(bench_histogram_t));
+    if (histogram == NULL) {
+        printf("%-8s %-8s %10s\n", data->corpus.shape->name, latency->name, "FAILED");
+        return;
+    }
+
+    uint64_t sum = 0;
+    uint64_t total_allocs = 0;
+    uint64_t max_allocs = 0;
+    double start = bench_now();
+    do {
+        for (size_t i = 0; i < data->corpus.count; ++i) {
+            uint64_t allocs = bench_alloc_stats.allocs + bench_alloc_stats.reallocs;
+            uint64_t op_start = bench_now_ns();
+            uint64_t result = latency->run(data, i);
+            uint64_t op_end = bench_now_ns();
+            allocs = bench_alloc_stats.allocs + bench_alloc_stats.reallocs - allocs;
+
+            if (result == 0) {
+                printf("%-8s %-8s %10s\n", data->corpus.shape->name, latency->name, "FAILED");
+                free(histogram);
+                return;
+            }
+            sum += result;
+            bench_histogram_record(histogram, op_end - op_start);
+            total_allocs += allocs;
+            if (max_allocs < allocs)
+                max_allocs = allocs;
+        }
+    } while (bench_now() - start < min_time);
+    bench_sink += sum;
+
+    printf("%-8s %-8s %10llu %10llu %10llu %10llu %10.2f %10llu\n", data->corpus.shape->name, latency->name,
+            (unsigned long long)bench_histogram_percentile(histogram, 0.5),
+            (unsigned long long)bench_histogram_percentile(histogram, 0.99),
+            (unsigned long long)bench_histogram_percentile(histogram, 0.999),
+            (unsigned long long)histogram->max,
+            (double)total_allocs / (double)histogram->total,
+            (unsigned long long)max_allocs);
+    free(histogram);
+}
+
+/*
+ * Memory mode
+ *
+ * Each operation is run once per message and the allocations it makes
+ * are counted, along with the peak number of bytes it has allocated at
+ * once. This includes everything the operation allocates, such as the
+ * node pages and parse stack of a tree or the buffer of a growable
+ * writer.
+ */
+
+#define BENCH_MEMORY_FILENAME "mpack-bench-memory.tmp"
+
+static uint64_t bench_message_file(bench_data_t* data, size_t i) {
+    size_t offset = data->corpus.offsets[i];
+    size_t size = data->corpus.offsets[i + 1] - offset;
+    FILE* file = fopen(BENCH_MEMORY_FILENAME, "wb");
+    if (file == NULL)
+        return 0;
+    bool written = fwrite(data->corpus.data + offset, 1, size, file) == size;
+    if (fclose(file) != 0 || !written)
+        return 0;
+
+    mpack_tree_t tree;
+    mpack_tree_init_file(&tree, BENCH_MEMORY_FILENAME, 0);
+    uint64_t nodes = mpack_tree_size(&tree);
+    if (mpack_tree_destroy(&tree) != mpack_ok)
+        return 0;
+    return nodes;
+}
+
+typedef struct bench_alloc_list_t {
+    void** pointers;
+    size_t count;
+    size_t capacity;
+} bench_alloc_list_t;
+
+static void bench_alloc_list_add(mpack_reader_t* reader, bench_alloc_list_t* list, void* p) {
+    if (p == NULL)
+        return;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+        void** pointers = (void**)realloc(list->pointers, sizeof(void*) * capacity);
+        if (pointers == NULL) {
+            MPACK_FREE(p);
+            mpack_reader_flag_error(reader, mpack_error_memory);
+            return;
+        }
+        list->pointers = pointers;
+        list->capacity = capacity;
+    }
+    list->pointers[list->count++] = p;
+}
+
+// reads an element with the Expect API, allocating storage for all
+// str, bin and ext data and keeping it until the message is done, as a
+// decoder that builds its own objects would
+static void bench_expect_alloc_element(mpack_reader_t* reader, bench_alloc_list_t* list) {
+    mpack_tag_t tag = mpack_peek_tag(reader);
+    switch (tag.type) {
+        case mpack_type_str:
+            mpack_expect_str(reader);
+            bench_alloc_list_add(reader, list, mpack_read_bytes_alloc(reader, tag.v.l));
+            mpack_done_str(reader);
+            break;
+        case mpack_type_bin: {
+            size_t size;
+            bench_alloc_list_add(reader, list, mpack_expect_bin_alloc(reader, SIZE_MAX, &size));
+            break;
+        }
+        case mpack_type_ext:
+            mpack_read_tag(reader);
+            bench_alloc_list_add(reader, list, mpack_read_bytes_alloc(reader, tag.v.l));
+            mpack_done_ext(reader);
+            break;
+        case mpack_type_array:
+            mpack_expect_array(reader);
+            for (uint32_t i = 0; i < tag.v.n && mpack_reader_error(reader) == mpack_ok; ++i)
+                bench_expect_alloc_element(reader, list);
+            mpack_done_array(reader);
+            break;
+        case mpack_type_map:
+            mpack_expect_map(reader);
+            for (uint32_t i = 0; i < tag.v.n * 2 && mpack_reader_error(reader) == mpack_ok; ++i)
+                bench_expect_alloc_element(reader, list);
+            mpack_done_map(reader);
+            break;
+        default:
+            mpack_discard(reader);
+            break;
+    }
+}
+
+static uint64_t bench_message_expect_alloc(bench_data_t* data, size_t i) {
+    mpack_reader_t reader;
+    size_t offset = data->corpus.offsets[i];
+    mpack_reader_init_data(&reader, data->corpus.data + offset, data->corpus.offsets[i + 1] - offset);
+    bench_alloc_list_t list = {NULL, 0, 0};
+    bench_expect_alloc_element(&reader, &list);
+    uint64_t count = list.count;
+    for (size_t j = 0; j < list.count; ++j)
+        MPACK_FREE(list.pointers[j]);
+    free(list.pointers);
+    if (mpack_reader_destroy(&reader) != mpack_ok)
+        return 0;
+    return count + 1;
+}
+
+static const bench_message_op_t bench_memories[] = {
+    {"tree",     bench_message_tree,         false, false},
+    {"file",     bench_message_file,         false, true},
+    {"growable", bench_message_encode,       false, false},
+    {"alloc",    bench_message_expect_alloc, false, false},
+};
+
+#define BENCH_MEMORY_COUNT (sizeof(bench_memories) / sizeof(*bench_memories))
+
+static void bench_memory_run(const bench_message_op_t* memory, bench_data_t* data) {
+    size_t count = data->corpus.count;
+    if (memory->sampled && count > BENCH_SAMPLE_COUNT)
+        count = BENCH_SAMPLE_COUNT;
+    if (count == 0) {
+        printf("%-8s %-8s %10s\n", data->corpus.shape->name, memory->name, "-");
+        return;
+    }
+
+    uint64_t sum = 0;
+    uint64_t total_allocs = 0;
+    uint64_t total_peak = 0;
+    size_t max_peak = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t allocs = bench_alloc_stats.allocs + bench_alloc_stats.reallocs;
+        size_t bytes = bench_alloc_stats.bytes;
+        bench_alloc_stats.peak_bytes = bytes;
+        uint64_t result = memory->run(data, i);
+        size_t peak = bench_alloc_stats.peak_bytes - bytes;
+
+        if (result == 0 || bench_alloc_stats.bytes != bytes) {
+            printf("%-8s %-8s %10s\n", data->corpus.shape->name, memory->name,
+                    result == 0 ? "FAILED" : "LEAKED");
+            return;
+        }
+        sum += result;
+        total_allocs += bench_alloc_stats.allocs + bench_alloc_stats.reallocs - allocs;
+        total_peak += peak;
+        if (max_peak < peak)
+            max_peak = peak;
+    }
+    bench_sink += sum;
+
+    size_t wire_bytes = data->corpus.offsets[count] - data->corpus.offsets[0];
+    printf("%-8s %-8s %10.2f %12.0f %12llu %12.2f\n", data->corpus.shape->name, memory->name,
+            (double)total_allocs / (double)count,
+            (double)total_peak / (double)count,
+            (unsigned long long)max_peak,
+            (double)total_peak / (double)wire_bytes);
+}
+
+// which measurements mpack-bench makes
+typedef enum bench_mode_t {
+    bench_mode_throughput,
+    bench_mode_latency,
+    bench_mode_memory,
+} bench_mode_t;
+
+static void bench_usage(const char* program) {
+    printf("Usage: %s [-l | -m] [-t seconds] [-s seed] [-j threads] [-c corpus] [-b benchmark] [-f file]\n", program);
+    printf("  -l  measure the latency of each message instead of throughput\n");
+    printf("  -m  measure the allocations and peak memory of each message instead\n");
+    printf("  -t  minimum time to run each benchmark (default 0.5)\n");
+    printf("  -s  seed for generating corpora (default 1)\n");
+    #if MPACK_PIPELINE
+    printf("  -j  worker threads for the pipeline benchmark (default one per processor)\n");
+    #endif
+    printf("  -c  run only the given corpus:");
+    for (size_t i = 0; i < bench_shape_count; ++i)
+        printf(" %s", bench_shapes[i].name);
+    printf("\n  -b  run only the given benchmark:");
+    for (size_t i = 0; i < BENCH_BENCHMARK_COUNT; ++i)
+        printf(" %s", bench_benchmarks[i].name);
+    printf("\n      or with -l:");
+    for (size_t i = 0; i < BENCH_LATENCY_COUNT; ++i)
+        printf(" %s", bench_latencies[i].name);
+    printf("\n      or with -m:");
+    for (size_t i = 0; i < BENCH_MEMORY_COUNT; ++i)
+        printf(" %s", bench_memories[i].name);
+    printf("\n  -f  run on a file of concatenated messages instead, such as from mpack-gen\n");
+}
+
+// runs the benchmarks on the given corpus, then destroys it
+static bool bench_corpus(bench_data_t* data, const char* bench_name, double min_time, bench_mode_t mode) {
+    bool ok = bench_data_init(data);
+    if (!ok) {
+        fprintf(stderr, "failed to prepare %s corpus\n", data->corpus.shape->name);
+    } else {
+        printf("\n%s: %s, %i messages, %i bytes\n", data->corpus.shape->name, data->corpus.shape->description,
+                (int)data->corpus.count, (int)data->corpus.size);
+
+        if (mode == bench_mode_latency) {
+            for (size_t i = 0; i < BENCH_LATENCY_COUNT; ++i)
+                if (bench_name == NULL || strcmp(bench_name, bench_latencies[i].name) == 0)
+                    bench_latency_run(&bench_latencies[i], data, min_time);
+        } else if (mode == bench_mode_memory) {
+            for (size_t i = 0; i < BENCH_MEMORY_COUNT; ++i)
+                if (bench_name == NULL || strcmp(bench_name, bench_memories[i].name) == 0)
+                    bench_memory_run(&bench_memories[i], data);
+            remove(BENCH_MEMORY_FILENAME);
+        } else {
+            for (size_t i = 0; i < BENCH_BENCHMARK_COUNT; ++i)
+                if (bench_name == NULL || strcmp(bench_name, bench_benchmarks[i].name) == 0)
+                    bench_run(&bench_benchmarks[i], data, min_time);
+        }
+
+        // make sure encoding reproduces the corpus exactly
+        if (bench_encode(data) != data->corpus.size || memcmp(data->output, data->corpus.data, data->corpus.size) != 0) {
+            fprintf(stderr, "encoding the %s corpus did not reproduce it\n", data->corpus.shape->name);
+            ok = false;
+        }
+    }
+
+    bench_data_destroy(data);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    double min_time = 0.5;
+    uint64_t seed = 1;
+    const char* corpus_name = NULL;
+    const char* bench_name = NULL;
+    const char* filename = NULL;
+    bench_mode_t mode = bench_mode_throughput;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-l") == 0) {
+            mode = bench_mode_latency;
+            continue;
+        } else if (strcmp(arg, "-m") == 0) {
+            mode = bench_mode_memory;
+            continue;
+        } else if (value != NULL && strcmp(arg, "-t") == 0) {
+            min_time = atof(value);
+        } else if (value != NULL && strcmp(arg, "-s") == 0) {
+            seed = strtoull(value, NULL, 10);
+        #if MPACK_PIPELINE
+        } else if (value != NULL && strcmp(arg, "-j") == 0) {
+            bench_threads = (size_t)strtoul(value, NULL, 10);
+        #endif
+        } else if (value != NULL && strcmp(arg, "-c") == 0) {
+            corpus_name = value;
+        } else if (value != NULL && strcmp(arg, "-b") == 0) {
+            bench_name = value;
+        } else if (value != NULL && strcmp(arg, "-f") == 0) {
+            filename = value;
+        } else {
+            bench_usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    printf("%s benchmarks\n", MPACK_LIBRARY_STRING);
+    #if MPACK_READ_TRACKING || MPACK_WRITE_TRACKING
+    printf("tracking: read %s, write %s, %s stack\n\n", MPACK_READ_TRACKING ? "on" : "off",
+            MPACK_WRITE_TRACKING ? "on" : "off", MPACK_TRACKING_INLINE_DEPTH ? "inline" : "allocated");
+    #else
+    printf("tracking: off\n\n");
+    #endif
+    if (mode == bench_mode_memory) {
+        printf("%-8s %-8s %10s %12s %12s %12s\n", "corpus", "bench",
+                "allocs/msg", "mean peak", "max peak", "peak/byte");
+    } else if (mode == bench_mode_latency) {
+        printf("timer overhead: %i ns\n", (int)bench_timer_overhead());
+        printf("%-8s %-8s %10s %10s %10s %10s %10s %10s\n", "corpus", "bench",
+                "p50 ns", "p99 ns", "p99.9 ns", "max ns", "allocs/op", "max allocs");
+    } else {
+        printf("%-8s %-8s %12s %14s %12s\n", "corpus", "bench", "MB/s", "msgs/s", "ns/msg");
+    }
+
+    bench_data_t* data = (bench_data_t*)malloc(sizeof(bench_data_t));
+    if (data == NULL)
+        return EXIT_FAILURE;
+    bool ok = true;
+
+    if (filename != NULL) {
+        // a file has no schema, so it is only measured with the generic benchmarks
+        bench_shape_t shape = {"file", filename, 0, NULL, NULL, NULL};
+        memset(data, 0, sizeof(*data));
+        if (!bench_corpus_load(&data->corpus, &shape, filename)) {
+            fprintf(stderr, "failed to load %s\n", filename);
+            ok = false;
+        } else {
+            ok = bench_corpus(data, bench_name, min_time, mode);
+        }
+    }
+
+    for (size_t i = 0; ok && filename == NULL && i < bench_shape_count; ++i) {
+        const bench_shape_t* shape = &bench_shapes[i];
+        if (corpus_name != NULL && strcmp(corpus_name, shape->name) != 0)
+            continue;
+        memset(data, 0, sizeof(*data));
+        if (!bench_corpus_generate(&data->corpus, shape, seed, shape->count)) {
+            fprintf(stderr, "failed to generate %s corpus\n", shape->name);
+            ok = false;
+        } else {
+            ok = bench_corpus(data, bench_name, min_time, mode);
+        }
+    }
+
+    free(data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
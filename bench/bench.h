@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MPACK_BENCH_H
+#define MPACK_BENCH_H 1
+
+#include "mpack/mpack.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocation counters. MPack allocates through bench_malloc(),
+ * bench_realloc() and bench_free() (see mpack-config.h), which count
+ * their calls and the bytes allocated here.
+ */
+
+typedef struct bench_alloc_stats_t {
+    uint64_t allocs;
+    uint64_t reallocs;
+    uint64_t frees;
+    size_t bytes;      // bytes currently allocated
+    size_t peak_bytes; // high-water mark of bytes; reset it to bytes to start a measurement
+} bench_alloc_stats_t;
+
+extern bench_alloc_stats_t bench_alloc_stats;
+
+/*
+ * A seeded pseudo-random number generator (xorshift64*). Corpora are
+ * generated from a seed so that runs on different machines or versions
+ * of MPack measure exactly the same data.
+ */
+
+typedef struct bench_rng_t {
+    uint64_t state;
+} bench_rng_t;
+
+void bench_rng_seed(bench_rng_t* rng, uint64_t seed);
+uint64_t bench_rng_next(bench_rng_t* rng);
+
+// returns a number in the inclusive range [min_value, max_value]
+uint32_t bench_rng_range(bench_rng_t* rng, uint32_t min_value, uint32_t max_value);
+
+// returns a number in the range [0, 1)
+double bench_rng_unit(bench_rng_t* rng);
+
+/*
+ * A shape describes one kind of message: how to write a random message
+ * of that kind, and how an application would read it back with the
+ * expect API and with node lookups. The read functions return a checksum
+ * of what they read so the work can't be optimized away. Shapes without
+ * a fixed schema have no read functions.
+ */
+
+typedef struct bench_shape_t {
+    const char* name;
+    const char* description;
+    size_t count; // messages in a default corpus
+    void (*write)(mpack_writer_t* writer, bench_rng_t* rng);
+    uint64_t (*expect)(mpack_reader_t* reader);
+    uint64_t (*lookup)(mpack_node_t root);
+} bench_shape_t;
+
+/*
+ * The generator writes random messages of arbitrary shape. Each message
+ * is a map or array containing a random number of nodes, drawn from a
+ * log-uniform distribution so that there are many small messages and a
+ * long tail of large ones.
+ */
+
+typedef enum bench_gen_type_t {
+    bench_gen_nil,
+    bench_gen_bool,
+    bench_gen_int,
+    bench_gen_uint,
+    bench_gen_float,
+    bench_gen_double,
+    bench_gen_str,
+    bench_gen_bin,
+    bench_gen_ext,
+    bench_gen_array,
+    bench_gen_map,
+    bench_gen_type_count
+} bench_gen_type_t;
+
+extern const char* const bench_gen_type_names[bench_gen_type_count];
+
+typedef enum bench_gen_charset_t {
+    bench_gen_charset_alnum, // letters and digits
+    bench_gen_charset_ascii, // printable ASCII
+    bench_gen_charset_utf8,  // mostly ASCII with multi-byte UTF-8 characters
+} bench_gen_charset_t;
+
+typedef struct bench_gen_options_t {
+    uint32_t min_nodes;   // nodes per message
+    uint32_t max_nodes;
+    uint32_t max_depth;   // nesting depth of containers; the root is depth 1
+    uint32_t min_width;   // elements of nested arrays, or pairs of nested maps
+    uint32_t max_width;
+    uint32_t min_length;  // bytes of str, bin and ext data
+    uint32_t max_length;
+    bench_gen_charset_t charset;
+    unsigned weights[bench_gen_type_count]; // relative frequency of each type
+} bench_gen_options_t;
+
+// sets the default options
+void bench_gen_options_init(bench_gen_options_t* options);
+
+// parses a list of weights such as "int=4,str=2,ext=0"; returns false if it is invalid
+bool bench_gen_parse_weights(bench_gen_options_t* options, const char* list);
+
+// writes one random message
+void bench_gen_write(mpack_writer_t* writer, bench_rng_t* rng, const bench_gen_options_t* options);
+
+extern const bench_shape_t bench_shapes[];
+extern const size_t bench_shape_count;
+
+const bench_shape_t* bench_shape_find(const char* name);
+
+/*
+ * A corpus is a set of messages of one shape stored contiguously, with
+ * the offset of each message. There are count + 1 offsets; the last is
+ * the total size.
+ */
+
+typedef struct bench_corpus_t {
+    const bench_shape_t* shape;
+    char* data;
+    size_t size;
+    size_t* offsets;
+    size_t count;
+} bench_corpus_t;
+
+// generates count messages of the given shape; returns false on allocation failure
+bool bench_corpus_generate(bench_corpus_t* corpus, const bench_shape_t* shape, uint64_t seed, size_t count);
+
+// loads a file of concatenated messages; returns false if it can't be read or is invalid
+bool bench_corpus_load(bench_corpus_t* corpus, const bench_shape_t* shape, const char* filename);
+
+void bench_corpus_destroy(bench_corpus_t* corpus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BENCH_MPACK_CONFIG_H
+#define BENCH_MPACK_CONFIG_H 1
+
+#include <stddef.h>
+
+// The benchmarks count the allocations made by MPack. These wrap the
+// standard allocator and otherwise behave the same.
+#define MPACK_MALLOC bench_malloc
+#define MPACK_REALLOC bench_realloc
+#define MPACK_FREE bench_free
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void* bench_malloc(size_t size);
+void* bench_realloc(void* p, size_t size);
+void bench_free(void* p);
+#ifdef __cplusplus
+}
+#endif
+
+// The benchmarks otherwise use the default configuration so that they
+// measure what users get. The featureset is overridden by the SCons
+// buildsystem.
+#include "mpack-config.h.sample"
+
+#endif
+
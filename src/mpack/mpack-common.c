@@ -27,6 +27,21 @@
 #include <stdarg.h>
 #endif
 
+#if MPACK_STDIO && !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
+#if MPACK_MMAP
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#endif
+
 const char* mpack_error_to_string(mpack_error_t error) {
     #if MPACK_DEBUG
     switch (error) {
@@ -162,16 +177,38 @@ int mpack_tag_cmp(mpack_tag_t left, mpack_tag_t right) {
 #define MPACK_TRACKING_INITIAL_CAPACITY 8
 #endif
 
+#if MPACK_TRACKING_INLINE_DEPTH
+// the common cases are handled inline in mpack-common.h; these are
+// only called to report errors.
+#define MPACK_TRACK_SLOW(name) name##_slow
+#define MPACK_TRACK_CAPACITY(track) MPACK_TRACKING_INLINE_DEPTH
+#define MPACK_TRACK_ASSERT_ELEMENTS(track) ((void)0)
+#else
+#define MPACK_TRACK_SLOW(name) name
+#define MPACK_TRACK_CAPACITY(track) ((track)->capacity)
+#define MPACK_TRACK_ASSERT_ELEMENTS(track) mpack_assert((track)->elements, "null track elements!")
+#endif
+
 mpack_error_t mpack_track_init(mpack_track_t* track) {
     track->count = 0;
+    #if MPACK_TRACKING_INLINE_DEPTH
+    track->seen = 0;
+    return mpack_ok;
+    #else
     track->capacity = MPACK_TRACKING_INITIAL_CAPACITY;
     track->elements = (mpack_track_element_t*)MPACK_MALLOC(sizeof(mpack_track_element_t) * track->capacity);
     if (track->elements == NULL)
         return mpack_error_memory;
     return mpack_ok;
+    #endif
 }
 
 mpack_error_t mpack_track_grow(mpack_track_t* track) {
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // the inline stack cannot grow
+    MPACK_UNUSED(track);
+    return mpack_error_too_big;
+    #else
     mpack_assert(track->elements, "null track elements!");
     mpack_assert(track->count == track->capacity, "incorrect growing?");
 
@@ -185,18 +222,36 @@ mpack_error_t mpack_track_grow(mpack_track_t* track) {
     track->elements = new_elements;
     track->capacity = new_capacity;
     return mpack_ok;
+    #endif
 }
 
-mpack_error_t mpack_track_push(mpack_track_t* track, mpack_type_t type, uint64_t count) {
-    mpack_assert(track->elements, "null track elements!");
+// Returns the elements left in the given open map or array, or the bytes
+// left in the given open bin, str or ext.
+MPACK_STATIC_INLINE mpack_track_count_t mpack_track_left(mpack_track_t* track, mpack_track_element_t* element) {
+    #if MPACK_TRACKING_INLINE_DEPTH
+    if (element->type == mpack_type_map || element->type == mpack_type_array)
+        return (mpack_track_count_t)(element->left - (track->seen - element->seen));
+    #else
+    MPACK_UNUSED(track);
+    #endif
+    return element->left;
+}
+
+mpack_error_t MPACK_TRACK_SLOW(mpack_track_push)(mpack_track_t* track, mpack_type_t type, uint64_t count) {
+    MPACK_TRACK_ASSERT_ELEMENTS(track);
     mpack_log("track pushing %s count %i\n", mpack_type_to_string(type), (int)count);
 
     // maps have twice the number of elements (key/value pairs)
     if (type == mpack_type_map)
         count *= 2;
 
+    #if MPACK_TRACKING_INLINE_DEPTH
+    if (count > UINT32_MAX)
+        return mpack_error_too_big;
+    #endif
+
     // grow if needed
-    if (track->count == track->capacity) {
+    if (track->count == MPACK_TRACK_CAPACITY(track)) {
         mpack_error_t error = mpack_track_grow(track);
         if (error != mpack_ok)
             return error;
@@ -204,13 +259,16 @@ mpack_error_t mpack_track_push(mpack_track_t* track, mpack_type_t type, uint64_t
 
     // insert new track
     track->elements[track->count].type = type;
-    track->elements[track->count].left = count;
+    track->elements[track->count].left = (mpack_track_count_t)count;
+    #if MPACK_TRACKING_INLINE_DEPTH
+    track->elements[track->count].seen = track->seen;
+    #endif
     ++track->count;
     return mpack_ok;
 }
 
-mpack_error_t mpack_track_pop(mpack_track_t* track, mpack_type_t type) {
-    mpack_assert(track->elements, "null track elements!");
+mpack_error_t MPACK_TRACK_SLOW(mpack_track_pop)(mpack_track_t* track, mpack_type_t type) {
+    MPACK_TRACK_ASSERT_ELEMENTS(track);
     mpack_log("track popping %s\n", mpack_type_to_string(type));
 
     if (track->count == 0) {
@@ -226,20 +284,40 @@ mpack_error_t mpack_track_pop(mpack_track_t* track, mpack_type_t type) {
         return mpack_error_bug;
     }
 
-    if (element->left != 0) {
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // elements are checked here rather than as they are read or written
+    mpack_track_count_t seen = (mpack_track_count_t)(track->seen - element->seen);
+    if (type == mpack_type_map || type == mpack_type_array) {
+        if (seen > element->left) {
+            mpack_break("attempting to close a %s but %" PRIu64 " too many elements were in it",
+                    mpack_type_to_string(type), (uint64_t)(seen - element->left));
+            return mpack_error_bug;
+        }
+    } else if (seen != 0) {
+        mpack_break("attempting to close a %s but %" PRIu64 " elements were in it",
+                mpack_type_to_string(type), (uint64_t)seen);
+        return mpack_error_bug;
+    }
+    #endif
+
+    mpack_track_count_t left = mpack_track_left(track, element);
+    if (left != 0) {
         mpack_break("attempting to close a %s but there are %" PRIu64 " %s left",
-                mpack_type_to_string(type), element->left,
+                mpack_type_to_string(type), (uint64_t)left,
                 (type == mpack_type_map || type == mpack_type_array) ? "elements" : "bytes");
         return mpack_error_bug;
     }
 
+    #if MPACK_TRACKING_INLINE_DEPTH
+    track->seen = element->seen;
+    #endif
     --track->count;
     return mpack_ok;
 }
 
 mpack_error_t mpack_track_peek_element(mpack_track_t* track, bool read) {
     MPACK_UNUSED(read);
-    mpack_assert(track->elements, "null track elements!");
+    MPACK_TRACK_ASSERT_ELEMENTS(track);
 
     // if there are no open elements, that's fine, we can read/write elements at will
     if (track->count == 0)
@@ -253,7 +331,7 @@ mpack_error_t mpack_track_peek_element(mpack_track_t* track, bool read) {
         return mpack_error_bug;
     }
 
-    if (element->left == 0) {
+    if (mpack_track_left(track, element) == 0) {
         mpack_break("too many elements %s for %s", read ? "read" : "written",
                 mpack_type_to_string(element->type));
         return mpack_error_bug;
@@ -262,16 +340,18 @@ mpack_error_t mpack_track_peek_element(mpack_track_t* track, bool read) {
     return mpack_ok;
 }
 
+#if !MPACK_TRACKING_INLINE_DEPTH
 mpack_error_t mpack_track_element(mpack_track_t* track, bool read) {
     mpack_error_t error = mpack_track_peek_element(track, read);
     if (track->count > 0 && error == mpack_ok)
         --track->elements[track->count - 1].left;
     return error;
 }
+#endif
 
-mpack_error_t mpack_track_bytes(mpack_track_t* track, bool read, uint64_t count) {
+mpack_error_t MPACK_TRACK_SLOW(mpack_track_bytes)(mpack_track_t* track, bool read, uint64_t count) {
     MPACK_UNUSED(read);
-    mpack_assert(track->elements, "null track elements!");
+    MPACK_TRACK_ASSERT_ELEMENTS(track);
 
     if (track->count == 0) {
         mpack_break("bytes cannot be %s with no open bin, str or ext", read ? "read" : "written");
@@ -292,7 +372,7 @@ mpack_error_t mpack_track_bytes(mpack_track_t* track, bool read, uint64_t count)
         return mpack_error_bug;
     }
 
-    element->left -= count;
+    element->left = (mpack_track_count_t)(element->left - count);
     return mpack_ok;
 }
 
@@ -326,101 +406,180 @@ mpack_error_t mpack_track_check_empty(mpack_track_t* track) {
 
 mpack_error_t mpack_track_destroy(mpack_track_t* track, bool cancel) {
     mpack_error_t error = cancel ? mpack_ok : mpack_track_check_empty(track);
+    #if !MPACK_TRACKING_INLINE_DEPTH
     if (track->elements) {
         MPACK_FREE(track->elements);
         track->elements = NULL;
     }
+    #endif
     return error;
 }
 #endif
 
 
 
-static bool mpack_utf8_check_impl(const uint8_t* str, size_t count, bool allow_null) {
-    while (count > 0) {
-        uint8_t lead = str[0];
+#if !MPACK_OPTIMIZE_FOR_SIZE
+// The range of bytes validated byte-wise after the word test fails
+#define MPACK_UTF8_MIN_WINDOW (2 * sizeof(uint64_t))
+#define MPACK_UTF8_MAX_WINDOW 256
 
-        // NUL
-        if (!allow_null && lead == '\0') // we don't allow NUL bytes in MPack C-strings
-            return false;
+// Skips a run of ASCII at the start of the given string, sixteen bytes
+// at a time. Words are loaded with mpack_memcpy() so that the string
+// needn't be aligned. Any chunk containing a non-ASCII byte (or a NUL
+// if not allowed) is left for the byte-wise validator.
+static size_t mpack_utf8_ascii_prefix(const uint8_t* str, size_t count, bool allow_null) {
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+    const uint64_t highs = UINT64_C(0x8080808080808080);
+    size_t skipped = 0;
 
-        // ASCII
-        if (lead <= 0x7F) {
-            ++str;
-            --count;
+    while (count - skipped >= 2 * sizeof(uint64_t)) {
+        uint64_t a, b;
+        mpack_memcpy(&a, str + skipped, sizeof(a));
+        mpack_memcpy(&b, str + skipped + sizeof(a), sizeof(b));
 
-        // 2-byte sequence
-        } else if ((lead & 0xE0) == 0xC0) {
-            if (count < 2) // truncated sequence
-                return false;
+        if ((a | b) & highs)
+            break;
 
-            uint8_t cont = str[1];
-            if ((cont & 0xC0) != 0x80) // not a continuation byte
-                return false;
+        // with no high bits set, a word contains a zero byte if
+        // and only if subtracting one from each byte borrows.
+        if (!allow_null && ((a - ones) & highs || (b - ones) & highs))
+            break;
 
-            str += 2;
-            count -= 2;
+        skipped += 2 * sizeof(uint64_t);
+    }
 
-            uint32_t z = ((uint32_t)(lead & ~0xE0) << 6) |
-                          (uint32_t)(cont & ~0xC0);
+    return skipped;
+}
+#endif
 
-            if (z < 0x80) // overlong sequence
-                return false;
+// The checker below calls this once per character, so it is inlined there
+// rather than called through mpack_utf8_sequence().
+MPACK_STATIC_INLINE size_t mpack_utf8_sequence_impl(const uint8_t* str, size_t count) {
+    mpack_assert(count > 0, "cannot check an empty sequence");
+    uint8_t lead = str[0];
 
-        // 3-byte sequence
-        } else if ((lead & 0xF0) == 0xE0) {
-            if (count < 3) // truncated sequence
-                return false;
+    // ASCII
+    if (lead <= 0x7F)
+        return 1;
 
-            uint8_t cont1 = str[1];
-            if ((cont1 & 0xC0) != 0x80) // not a continuation byte
-                return false;
-            uint8_t cont2 = str[2];
-            if ((cont2 & 0xC0) != 0x80) // not a continuation byte
-                return false;
+    // 2-byte sequence
+    if ((lead & 0xE0) == 0xC0) {
+        if (count < 2) // truncated sequence
+            return 0;
 
-            str += 3;
-            count -= 3;
+        uint8_t cont = str[1];
+        if ((cont & 0xC0) != 0x80) // not a continuation byte
+            return 0;
 
-            uint32_t z = ((uint32_t)(lead  & ~0xF0) << 12) |
-                         ((uint32_t)(cont1 & ~0xC0) <<  6) |
-                          (uint32_t)(cont2 & ~0xC0);
+        uint32_t z = ((uint32_t)(lead & ~0xE0) << 6) |
+                      (uint32_t)(cont & ~0xC0);
 
-            if (z < 0x800) // overlong sequence
-                return false;
-            if (z >= 0xD800 && z <= 0xDFFF) // surrogate
-                return false;
+        if (z < 0x80) // overlong sequence
+            return 0;
+        return 2;
+    }
 
-        // 4-byte sequence
-        } else if ((lead & 0xF8) == 0xF0) {
-            if (count < 4) // truncated sequence
-                return false;
+    // 3-byte sequence
+    if ((lead & 0xF0) == 0xE0) {
+        if (count < 3) // truncated sequence
+            return 0;
 
-            uint8_t cont1 = str[1];
-            if ((cont1 & 0xC0) != 0x80) // not a continuation byte
-                return false;
-            uint8_t cont2 = str[2];
-            if ((cont2 & 0xC0) != 0x80) // not a continuation byte
-                return false;
-            uint8_t cont3 = str[3];
-            if ((cont3 & 0xC0) != 0x80) // not a continuation byte
-                return false;
+        uint8_t cont1 = str[1];
+        if ((cont1 & 0xC0) != 0x80) // not a continuation byte
+            return 0;
+        uint8_t cont2 = str[2];
+        if ((cont2 & 0xC0) != 0x80) // not a continuation byte
+            return 0;
 
-            str += 4;
-            count -= 4;
+        uint32_t z = ((uint32_t)(lead  & ~0xF0) << 12) |
+                     ((uint32_t)(cont1 & ~0xC0) <<  6) |
+                      (uint32_t)(cont2 & ~0xC0);
 
-            uint32_t z = ((uint32_t)(lead  & ~0xF8) << 18) |
-                         ((uint32_t)(cont1 & ~0xC0) << 12) |
-                         ((uint32_t)(cont2 & ~0xC0) <<  6) |
-                          (uint32_t)(cont3 & ~0xC0);
+        if (z < 0x800) // overlong sequence
+            return 0;
+        if (z >= 0xD800 && z <= 0xDFFF) // surrogate
+            return 0;
+        return 3;
+    }
 
-            if (z < 0x10000) // overlong sequence
-                return false;
-            if (z > 0x10FFFF) // codepoint limit
-                return false;
+    // 4-byte sequence
+    if ((lead & 0xF8) == 0xF0) {
+        if (count < 4) // truncated sequence
+            return 0;
+
+        uint8_t cont1 = str[1];
+        if ((cont1 & 0xC0) != 0x80) // not a continuation byte
+            return 0;
+        uint8_t cont2 = str[2];
+        if ((cont2 & 0xC0) != 0x80) // not a continuation byte
+            return 0;
+        uint8_t cont3 = str[3];
+        if ((cont3 & 0xC0) != 0x80) // not a continuation byte
+            return 0;
+
+        uint32_t z = ((uint32_t)(lead  & ~0xF8) << 18) |
+                     ((uint32_t)(cont1 & ~0xC0) << 12) |
+                     ((uint32_t)(cont2 & ~0xC0) <<  6) |
+                      (uint32_t)(cont3 & ~0xC0);
+
+        if (z < 0x10000) // overlong sequence
+            return 0;
+        if (z > 0x10FFFF) // codepoint limit
+            return 0;
+        return 4;
+    }
 
+    return 0; // continuation byte without a lead, or lead for a 5-byte sequence or longer
+}
+
+size_t mpack_utf8_sequence(const uint8_t* str, size_t count) {
+    return mpack_utf8_sequence_impl(str, count);
+}
+
+// This is inlined into both checkers so that allow_null is a constant.
+MPACK_STATIC_INLINE bool mpack_utf8_check_impl(const uint8_t* str, size_t count, bool allow_null) {
+    #if !MPACK_OPTIMIZE_FOR_SIZE
+    size_t window = MPACK_UTF8_MIN_WINDOW;
+    #endif
+
+    while (count > 0) {
+        // the number of bytes left when the byte-wise loop below stops
+        size_t stop = 0;
+
+        #if !MPACK_OPTIMIZE_FOR_SIZE
+        size_t ascii = mpack_utf8_ascii_prefix(str, count, allow_null);
+        str += ascii;
+        count -= ascii;
+
+        // The word test failed on the next chunk, so we validate at least
+        // that whole chunk byte-wise before trying words again. Otherwise
+        // text with frequent non-ASCII would pay for a failed word test
+        // after every character. Each failure in a row doubles the window
+        // so that text with no ASCII runs at all stays byte-wise.
+        if (ascii == 0) {
+            if (window < MPACK_UTF8_MAX_WINDOW)
+                window *= 2;
         } else {
-            return false; // continuation byte without a lead, or lead for a 5-byte sequence or longer
+            window = MPACK_UTF8_MIN_WINDOW;
+        }
+        stop = count < window ? 0 : count - window;
+        #endif
+
+        while (count > stop) {
+            // ASCII
+            if (str[0] <= 0x7F) {
+                if (!allow_null && str[0] == '\0') // we don't allow NUL bytes in MPack C-strings
+                    return false;
+                ++str;
+                --count;
+                continue;
+            }
+
+            size_t length = mpack_utf8_sequence_impl(str, count);
+            if (length == 0)
+                return false;
+            str += length;
+            count -= length;
         }
     }
     return true;
@@ -441,3 +600,118 @@ bool mpack_str_check_no_null(const char* str, size_t bytes) {
     return true;
 }
 
+#if MPACK_STDIO
+mpack_error_t mpack_file_seek(FILE* file, uint64_t offset) {
+    #ifdef _WIN32
+    if (offset > (uint64_t)INT64_MAX)
+        return mpack_error_too_big;
+    if (_fseeki64(file, (__int64)offset, SEEK_SET) != 0)
+        return mpack_error_io;
+    #else
+    off_t position = (off_t)offset;
+    if (position < 0 || (uint64_t)position != offset)
+        return mpack_error_too_big;
+    if (fseeko(file, position, SEEK_SET) != 0)
+        return mpack_error_io;
+    #endif
+    return mpack_ok;
+}
+
+mpack_error_t mpack_file_size(FILE* file, uint64_t* size) {
+    #ifdef _WIN32
+    __int64 end = -1;
+    if (_fseeki64(file, 0, SEEK_END) == 0)
+        end = _ftelli64(file);
+    #else
+    off_t end = -1;
+    if (fseeko(file, 0, SEEK_END) == 0)
+        end = ftello(file);
+    #endif
+    if (end < 0)
+        return mpack_error_io;
+    *size = (uint64_t)end;
+    return mpack_ok;
+}
+#endif
+
+#if MPACK_MMAP
+mpack_error_t mpack_mmap_file(const char* filename, char** data, size_t* length) {
+    *data = NULL;
+    *length = 0;
+
+    #ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return mpack_error_io;
+
+    LARGE_INTEGER filesize;
+    if (!GetFileSizeEx(file, &filesize)) {
+        CloseHandle(file);
+        return mpack_error_io;
+    }
+    uint64_t size = (uint64_t)filesize.QuadPart;
+    #else
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return mpack_error_io;
+
+    struct stat st;
+    if (fstat(file, &st) != 0 || st.st_size < 0) {
+        close(file);
+        return mpack_error_io;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    #endif
+
+    // the file must fit in our address space
+    if (size != (uint64_t)(size_t)size) {
+        #ifdef _WIN32
+        CloseHandle(file);
+        #else
+        close(file);
+        #endif
+        return mpack_error_too_big;
+    }
+
+    // zero-length mappings are not allowed
+    if (size == 0) {
+        #ifdef _WIN32
+        CloseHandle(file);
+        #else
+        close(file);
+        #endif
+        return mpack_ok;
+    }
+
+    // the mapping remains valid after the file is closed
+    #ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return mpack_error_io;
+    void* map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (map == NULL)
+        return mpack_error_io;
+    #else
+    void* map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (map == MAP_FAILED)
+        return mpack_error_io;
+    #endif
+
+    *data = (char*)map;
+    *length = (size_t)size;
+    return mpack_ok;
+}
+
+bool mpack_munmap_file(char* data, size_t length) {
+    #ifdef _WIN32
+    MPACK_UNUSED(length);
+    return UnmapViewOfFile(data) != 0;
+    #else
+    return munmap(data, length) == 0;
+    #endif
+}
+#endif
@@ -336,6 +336,161 @@ MPACK_INLINE bool mpack_tag_equal(mpack_tag_t left, mpack_tag_t right) {
  * @}
  */
 
+/**
+ * @name Struct Descriptors
+ *
+ * Descriptor tables describe how the fields of a C struct map to the
+ * string keys of a MessagePack map. They are used by mpack_expect_struct()
+ * to decode a map directly into a struct, and by mpack_write_struct() to
+ * encode a struct as a map.
+ *
+ * Descriptors are normally declared as static const tables with the
+ * MPACK_FIELD() family of macros:
+ *
+ * @code{.c}
+ * typedef struct point_t { int32_t x, y; char label[16]; } point_t;
+ *
+ * static const mpack_field_t point_fields[] = {
+ *     MPACK_FIELD(point_t, x, mpack_field_i32, 0),
+ *     MPACK_FIELD(point_t, y, mpack_field_i32, 0),
+ *     MPACK_FIELD(point_t, label, mpack_field_utf8_cstr, MPACK_FIELD_OPTIONAL),
+ * };
+ * static const mpack_struct_t point_desc = MPACK_STRUCT(point_fields);
+ * @endcode
+ *
+ * @{
+ */
+
+/**
+ * The C type of a struct field described by an mpack_field_t.
+ */
+typedef enum mpack_field_type_t {
+    mpack_field_bool,      /**< A bool. */
+    mpack_field_u8,        /**< A uint8_t. */
+    mpack_field_u16,       /**< A uint16_t. */
+    mpack_field_u32,       /**< A uint32_t. */
+    mpack_field_u64,       /**< A uint64_t. */
+    mpack_field_i8,        /**< An int8_t. */
+    mpack_field_i16,       /**< An int16_t. */
+    mpack_field_i32,       /**< An int32_t. */
+    mpack_field_i64,       /**< An int64_t. */
+    mpack_field_float,     /**< A float. */
+    mpack_field_double,    /**< A double. */
+    mpack_field_cstr,      /**< A null-terminated string in a fixed-size char array. */
+    mpack_field_utf8_cstr, /**< A null-terminated UTF-8 string in a fixed-size char array. */
+    mpack_field_struct,    /**< A nested struct with its own descriptor. */
+} mpack_field_type_t;
+
+/**
+ * Field flag indicating the key may be missing from the map. The value
+ * may also be nil. In either case the field is left unchanged.
+ */
+#define MPACK_FIELD_OPTIONAL 0x1
+
+/**
+ * Field flag indicating a numeric value must be between the field's
+ * min and max (inclusive.)
+ */
+#define MPACK_FIELD_RANGE 0x2
+
+struct mpack_struct_t;
+
+/**
+ * Describes a single field of a struct.
+ */
+typedef struct mpack_field_t {
+    const char* name;                   /**< The map key for this field. */
+    uint32_t name_len;                  /**< The length of the map key in bytes. */
+    mpack_field_type_t type;            /**< The C type of this field. */
+    size_t offset;                      /**< The offset of this field within the struct. */
+    size_t size;                        /**< The size of this field (the buffer size for strings.) */
+    unsigned int flags;                 /**< A combination of MPACK_FIELD_* flags. */
+    int64_t min;                        /**< The minimum value if MPACK_FIELD_RANGE is set. */
+    int64_t max;                        /**< The maximum value if MPACK_FIELD_RANGE is set. */
+    const struct mpack_struct_t* desc;  /**< The descriptor of a nested struct field. */
+} mpack_field_t;
+
+/**
+ * Describes a struct as a table of fields.
+ */
+typedef struct mpack_struct_t {
+    const mpack_field_t* fields; /**< The fields of the struct. */
+    size_t count;                /**< The number of fields. */
+} mpack_struct_t;
+
+/** @cond */
+#define MPACK_FIELD_IMPL(structure, member, field_type, flags, min, max, desc) \
+    { #member, sizeof(#member) - 1, field_type, offsetof(structure, member), \
+        sizeof(((structure*)0)->member), flags, min, max, desc }
+/** @endcond */
+
+/**
+ * Declares an mpack_field_t for the given member of the given struct type.
+ */
+#define MPACK_FIELD(structure, member, field_type, flags) \
+    MPACK_FIELD_IMPL(structure, member, field_type, flags, 0, 0, NULL)
+
+/**
+ * Declares an mpack_field_t for a numeric member of the given struct type
+ * which must be between min and max (inclusive.)
+ */
+#define MPACK_FIELD_RANGED(structure, member, field_type, flags, min, max) \
+    MPACK_FIELD_IMPL(structure, member, field_type, (flags) | MPACK_FIELD_RANGE, min, max, NULL)
+
+/**
+ * Declares an mpack_field_t for a member of the given struct type which
+ * is itself a struct described by the given mpack_struct_t.
+ */
+#define MPACK_FIELD_STRUCT(structure, member, nested_desc, flags) \
+    MPACK_FIELD_IMPL(structure, member, mpack_field_struct, flags, 0, 0, &(nested_desc))
+
+/**
+ * Declares an mpack_struct_t for the given array of mpack_field_t.
+ */
+#define MPACK_STRUCT(fields) { fields, sizeof(fields) / sizeof(fields[0]) }
+
+/**
+ * @}
+ */
+
+
+
+#if MPACK_STDIO
+
+/**
+ * @name Files
+ * @{
+ */
+
+/**
+ * Seeks the given file to the given absolute offset.
+ *
+ * Unlike fseek(), this uses 64-bit offsets, so it works for files over
+ * 2 GB including on platforms where long is 32 bits.
+ *
+ * @return mpack_ok on success, mpack_error_too_big if the offset cannot
+ *     be represented by the platform, or mpack_error_io if the seek fails.
+ */
+mpack_error_t mpack_file_seek(FILE* file, uint64_t offset);
+
+/**
+ * Gets the size in bytes of the given file by seeking to its end.
+ *
+ * Unlike ftell(), this uses 64-bit offsets, so it works for files over
+ * 2 GB including on platforms where long is 32 bits. The file is left
+ * positioned at its end.
+ *
+ * @return mpack_ok on success, or mpack_error_io if the size could not
+ *     be determined.
+ */
+mpack_error_t mpack_file_size(FILE* file, uint64_t* size);
+
+/**
+ * @}
+ */
+
+#endif
+
 
 
 /** @cond */
@@ -543,28 +698,131 @@ MPACK_INLINE void mpack_store_double(char* p, double value) {
 /* strings, binary blobs and extension types) */
 /** @cond */
 
+#if MPACK_TRACKING_INLINE_DEPTH
+// the inline stack uses 32-bit counts to keep the tracker small. maps
+// too large to be counted this way are flagged as too big.
+typedef uint32_t mpack_track_count_t;
+#else
+// we need 64-bit because (2 * INT32_MAX) elements can be stored in a map
+typedef uint64_t mpack_track_count_t;
+#endif
+
 typedef struct mpack_track_element_t {
     mpack_type_t type;
-    uint64_t left; // we need 64-bit because (2 * INT32_MAX) elements can be stored in a map
+    mpack_track_count_t left;
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // The tracker's seen count when this was opened. The elements of
+    // an inline tracked map or array are counted by the tracker rather
+    // than by its left count, which stays at the total.
+    mpack_track_count_t seen;
+    #endif
 } mpack_track_element_t;
 
 typedef struct mpack_track_t {
     size_t count;
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // The number of elements read or written, without the contents of
+    // closed maps and arrays. It is allowed to wrap around.
+    mpack_track_count_t seen;
+    mpack_track_element_t elements[MPACK_TRACKING_INLINE_DEPTH];
+    #else
     size_t capacity;
     mpack_track_element_t* elements;
+    #endif
 } mpack_track_t;
 
+#if MPACK_TRACKING_INLINE_DEPTH
+// The common case of each operation on an inline stack. These return
+// false without changing the stack if they can't handle an operation.
+// They are used by the inline functions of the reader and writer.
+//
+// Elements are only counted, so each one costs a single increment. They
+// are checked when their map or array is closed: too few or too many
+// leave the wrong count, as does any element within a bin, str or ext.
+
+MPACK_INLINE bool mpack_track_push_fast(mpack_track_t* track, mpack_type_t type, uint64_t count) {
+    uint64_t total = (type == mpack_type_map) ? count * 2 : count;
+    if (total > UINT32_MAX || track->count == MPACK_TRACKING_INLINE_DEPTH)
+        return false;
+    mpack_track_element_t* element = &track->elements[track->count];
+    element->type = type;
+    element->left = (mpack_track_count_t)total;
+    element->seen = track->seen;
+    ++track->count;
+    return true;
+}
+
+MPACK_INLINE bool mpack_track_pop_fast(mpack_track_t* track, mpack_type_t type) {
+    if (track->count == 0)
+        return false;
+    mpack_track_element_t* element = &track->elements[track->count - 1];
+    mpack_track_count_t seen = (mpack_track_count_t)(track->seen - element->seen);
+    if (element->type != type)
+        return false;
+    if (type == mpack_type_map || type == mpack_type_array) {
+        if (seen != element->left)
+            return false;
+    } else if ((seen | element->left) != 0) {
+        return false;
+    }
+    track->seen = element->seen;
+    --track->count;
+    return true;
+}
+
+MPACK_INLINE void mpack_track_element_fast(mpack_track_t* track) {
+    ++track->seen;
+}
+
+MPACK_INLINE bool mpack_track_bytes_fast(mpack_track_t* track, uint64_t count) {
+    if (track->count == 0)
+        return false;
+    mpack_track_element_t* element = &track->elements[track->count - 1];
+    if (element->left < count || element->type == mpack_type_array || element->type == mpack_type_map)
+        return false;
+    element->left = (mpack_track_count_t)(element->left - count);
+    return true;
+}
+#endif
+
 #if MPACK_INTERNAL
 mpack_error_t mpack_track_init(mpack_track_t* track);
 mpack_error_t mpack_track_grow(mpack_track_t* track);
-mpack_error_t mpack_track_push(mpack_track_t* track, mpack_type_t type, uint64_t count);
-mpack_error_t mpack_track_pop(mpack_track_t* track, mpack_type_t type);
-mpack_error_t mpack_track_element(mpack_track_t* track, bool read);
 mpack_error_t mpack_track_peek_element(mpack_track_t* track, bool read);
-mpack_error_t mpack_track_bytes(mpack_track_t* track, bool read, uint64_t count);
 mpack_error_t mpack_track_str_bytes_all(mpack_track_t* track, bool read, uint64_t count);
 mpack_error_t mpack_track_check_empty(mpack_track_t* track);
 mpack_error_t mpack_track_destroy(mpack_track_t* track, bool cancel);
+
+#if !MPACK_TRACKING_INLINE_DEPTH
+mpack_error_t mpack_track_push(mpack_track_t* track, mpack_type_t type, uint64_t count);
+mpack_error_t mpack_track_pop(mpack_track_t* track, mpack_type_t type);
+mpack_error_t mpack_track_element(mpack_track_t* track, bool read);
+mpack_error_t mpack_track_bytes(mpack_track_t* track, bool read, uint64_t count);
+#else
+// With an inline stack, the common case of each operation is handled
+// inline. The _slow functions re-check everything to report errors.
+mpack_error_t mpack_track_push_slow(mpack_track_t* track, mpack_type_t type, uint64_t count);
+mpack_error_t mpack_track_pop_slow(mpack_track_t* track, mpack_type_t type);
+mpack_error_t mpack_track_bytes_slow(mpack_track_t* track, bool read, uint64_t count);
+
+MPACK_INLINE mpack_error_t mpack_track_push(mpack_track_t* track, mpack_type_t type, uint64_t count) {
+    return mpack_track_push_fast(track, type, count) ? mpack_ok : mpack_track_push_slow(track, type, count);
+}
+
+MPACK_INLINE mpack_error_t mpack_track_pop(mpack_track_t* track, mpack_type_t type) {
+    return mpack_track_pop_fast(track, type) ? mpack_ok : mpack_track_pop_slow(track, type);
+}
+
+MPACK_INLINE mpack_error_t mpack_track_element(mpack_track_t* track, bool read) {
+    MPACK_UNUSED(read);
+    mpack_track_element_fast(track);
+    return mpack_ok;
+}
+
+MPACK_INLINE mpack_error_t mpack_track_bytes(mpack_track_t* track, bool read, uint64_t count) {
+    return mpack_track_bytes_fast(track, count) ? mpack_ok : mpack_track_bytes_slow(track, read, count);
+}
+#endif
 #endif
 
 /** @endcond */
@@ -594,6 +852,33 @@ bool mpack_utf8_check_no_null(const char* str, size_t bytes);
  */
 bool mpack_str_check_no_null(const char* str, size_t bytes);
 
+/**
+ * Returns the length of the valid UTF-8 sequence at the start of the
+ * given non-empty string, or zero if it is not valid. The sequence may
+ * be a NUL byte.
+ */
+size_t mpack_utf8_sequence(const uint8_t* str, size_t count);
+
+
+
+#if MPACK_MMAP
+
+/* Memory-mapped files */
+
+/**
+ * Maps the given file read-only in its entirety. An empty file is not
+ * mapped; it results in NULL data with a length of zero.
+ */
+mpack_error_t mpack_mmap_file(const char* filename, char** data, size_t* length);
+
+/**
+ * Unmaps a file mapped with mpack_mmap_file(). Returns false if it could
+ * not be unmapped.
+ */
+bool mpack_munmap_file(char* data, size_t length);
+
+#endif
+
 
 
 /** @endcond */
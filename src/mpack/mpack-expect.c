@@ -662,6 +662,42 @@ size_t mpack_expect_key_uint(mpack_reader_t* reader, bool found[], size_t count)
     return (size_t)value;
 }
 
+// reads a string key in-place, discarding any other type of key.
+// NULL is returned if the key is not a string or an error occurs.
+static const char* mpack_expect_key_str_inplace(mpack_reader_t* reader, size_t* keylen) {
+
+    // the key is only recognized if it is a string
+    if (mpack_peek_tag(reader).type != mpack_type_str) {
+        mpack_discard(reader);
+        return NULL;
+    }
+
+    // read the string in-place
+    *keylen = mpack_expect_str(reader);
+    const char* key = mpack_read_bytes_inplace(reader, *keylen);
+    if (mpack_reader_error(reader) != mpack_ok)
+        return NULL;
+    mpack_done_str(reader);
+    return key;
+}
+
+// marks the key at index i as found, flagging an error if it is a duplicate
+static size_t mpack_expect_key_found(mpack_reader_t* reader, bool found[], size_t i, size_t count) {
+
+    // unrecognized keys are fine, we just return count
+    if (i == count)
+        return count;
+
+    // check if this key is a duplicate
+    if (found[i]) {
+        mpack_reader_flag_error(reader, mpack_error_invalid);
+        return count;
+    }
+
+    found[i] = true;
+    return i;
+}
+
 size_t mpack_expect_key_cstr(mpack_reader_t* reader, const char* keys[], bool found[], size_t count) {
     if (mpack_reader_error(reader) != mpack_ok)
         return count;
@@ -674,18 +710,10 @@ size_t mpack_expect_key_cstr(mpack_reader_t* reader, const char* keys[], bool fo
     mpack_assert(keys != NULL, "keys cannot be NULL");
     mpack_assert(found != NULL, "found cannot be NULL");
 
-    // the key is only recognized if it is a string
-    if (mpack_peek_tag(reader).type != mpack_type_str) {
-        mpack_discard(reader);
-        return count;
-    }
-
-    // read the string in-place
-    size_t keylen = mpack_expect_str(reader);
-    const char* key = mpack_read_bytes_inplace(reader, keylen);
-    if (mpack_reader_error(reader) != mpack_ok)
+    size_t keylen;
+    const char* key = mpack_expect_key_str_inplace(reader, &keylen);
+    if (key == NULL)
         return count;
-    mpack_done_str(reader);
 
     // find what key it matches
     size_t i = 0;
@@ -696,19 +724,299 @@ size_t mpack_expect_key_cstr(mpack_reader_t* reader, const char* keys[], bool fo
             break;
     }
 
-    // unrecognized keys are fine, we just return count
-    if (i == count)
+    return mpack_expect_key_found(reader, found, i, count);
+}
+
+#ifdef MPACK_MALLOC
+// The number of hash seeds to try when building a keyset. Most small
+// keysets find a collision-free seed within the first few attempts.
+#define MPACK_KEYSET_SEED_ATTEMPTS 16
+
+// FNV-1a, with the seed mixed into the offset basis
+static uint32_t mpack_keyset_hash(const char* key, size_t len, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 16);
+}
+
+// fills the hash table using the given seed, returning the maximum
+// number of probes needed for any key, or zero if a key is duplicated.
+static uint32_t mpack_keyset_build(mpack_keyset_t* keyset, uint32_t seed) {
+    mpack_memset(keyset->slots, 0, sizeof(uint32_t) * ((size_t)keyset->mask + 1));
+    keyset->seed = seed;
+
+    uint32_t max_probes = 1;
+    for (size_t i = 0; i < keyset->count; ++i) {
+        const char* key = keyset->keys[i];
+        uint32_t len = keyset->lengths[i];
+        uint32_t slot = mpack_keyset_hash(key, len, seed) & keyset->mask;
+        uint32_t probes = 1;
+
+        while (keyset->slots[slot] != 0) {
+            size_t other = keyset->slots[slot] - 1;
+            if (keyset->lengths[other] == len && mpack_memcmp(keyset->keys[other], key, len) == 0)
+                return 0;
+            slot = (slot + 1) & keyset->mask;
+            ++probes;
+        }
+
+        keyset->slots[slot] = (uint32_t)(i + 1);
+        if (probes > max_probes)
+            max_probes = probes;
+    }
+
+    return max_probes;
+}
+
+mpack_error_t mpack_keyset_init(mpack_keyset_t* keyset, const char* keys[], size_t count) {
+    mpack_memset(keyset, 0, sizeof(*keyset));
+
+    if (count == 0) {
+        mpack_break("count cannot be zero; no keys are valid!");
+        return mpack_error_bug;
+    }
+    mpack_assert(keys != NULL, "keys cannot be NULL");
+
+    if (count > UINT32_MAX / 4)
+        return mpack_error_too_big;
+
+    // the table is kept at most half full so that probe chains are short
+    size_t slot_count = 4;
+    while (slot_count < count * 2)
+        slot_count *= 2;
+
+    // the key lengths and the hash table share a single allocation
+    keyset->lengths = (uint32_t*)MPACK_MALLOC(sizeof(uint32_t) * (count + slot_count));
+    if (keyset->lengths == NULL)
+        return mpack_error_memory;
+    keyset->slots = keyset->lengths + count;
+    keyset->keys = keys;
+    keyset->count = count;
+    keyset->mask = (uint32_t)(slot_count - 1);
+
+    for (size_t i = 0; i < count; ++i) {
+        mpack_assert(keys[i] != NULL, "key %i is NULL", (int)i);
+
+        // longer keys could never match a MessagePack string
+        size_t len = mpack_strlen(keys[i]);
+        if (len > UINT32_MAX) {
+            mpack_keyset_destroy(keyset);
+            return mpack_error_too_big;
+        }
+        keyset->lengths[i] = (uint32_t)len;
+    }
+
+    // try several seeds, keeping the one with the shortest probe chains
+    uint32_t best_seed = 0;
+    uint32_t best_probes = UINT32_MAX;
+    for (uint32_t seed = 0; seed < MPACK_KEYSET_SEED_ATTEMPTS; ++seed) {
+        uint32_t probes = mpack_keyset_build(keyset, seed);
+        if (probes == 0) {
+            mpack_break("keys in a keyset must be unique!");
+            mpack_keyset_destroy(keyset);
+            return mpack_error_bug;
+        }
+        if (probes < best_probes) {
+            best_seed = seed;
+            best_probes = probes;
+            if (probes == 1)
+                break;
+        }
+    }
+
+    if (keyset->seed != best_seed)
+        mpack_keyset_build(keyset, best_seed);
+    keyset->probes = best_probes;
+    return mpack_ok;
+}
+
+void mpack_keyset_destroy(mpack_keyset_t* keyset) {
+    if (keyset->lengths)
+        MPACK_FREE(keyset->lengths);
+    mpack_memset(keyset, 0, sizeof(*keyset));
+}
+
+size_t mpack_keyset_find(const mpack_keyset_t* keyset, const char* key, size_t len) {
+    uint32_t slot = mpack_keyset_hash(key, len, keyset->seed) & keyset->mask;
+
+    for (uint32_t i = 0; i < keyset->probes; ++i) {
+        uint32_t entry = keyset->slots[slot];
+        if (entry == 0)
+            break;
+        size_t index = entry - 1;
+        if (keyset->lengths[index] == len && mpack_memcmp(keyset->keys[index], key, len) == 0)
+            return index;
+        slot = (slot + 1) & keyset->mask;
+    }
+
+    return keyset->count;
+}
+
+size_t mpack_expect_key_set(mpack_reader_t* reader, const mpack_keyset_t* keyset, bool found[]) {
+    size_t count = keyset->count;
+    if (mpack_reader_error(reader) != mpack_ok)
         return count;
 
-    // check if this key is a duplicate
-    if (found[i]) {
-        mpack_reader_flag_error(reader, mpack_error_invalid);
+    if (count == 0) {
+        mpack_break("keyset is empty or not initialized!");
+        mpack_reader_flag_error(reader, mpack_error_bug);
         return count;
     }
+    mpack_assert(found != NULL, "found cannot be NULL");
 
-    found[i] = true;
-    return i;
+    size_t keylen;
+    const char* key = mpack_expect_key_str_inplace(reader, &keylen);
+    if (key == NULL)
+        return count;
+
+    return mpack_expect_key_found(reader, found, mpack_keyset_find(keyset, key, keylen), count);
+}
+#endif
+
+#ifndef MPACK_STRUCT_MAX_FIELDS
+// the number of fields for which mpack_expect_struct() can track found
+// flags on the stack. this is one bit per field.
+#define MPACK_STRUCT_MAX_FIELDS 256
+#endif
+
+// resolves a struct field key, returning the struct's field count if the
+// key is unrecognized. fields are normally encoded in declared order, so
+// we start at the field following the previous one.
+static size_t mpack_expect_struct_key(mpack_reader_t* reader, const mpack_struct_t* desc, size_t next) {
+    size_t count = desc->count;
+    size_t keylen;
+    const char* key = mpack_expect_key_str_inplace(reader, &keylen);
+    if (key == NULL)
+        return count;
+
+    size_t i = next;
+    for (size_t n = 0; n < count; ++n, ++i) {
+        if (i == count)
+            i = 0;
+        const mpack_field_t* field = &desc->fields[i];
+        if (field->name_len == keylen && mpack_memcmp(field->name, key, keylen) == 0)
+            return i;
+    }
+
+    return count;
 }
 
+#define MPACK_EXPECT_FIELD(ctype, suffix) do { \
+    mpack_assert(field->size == sizeof(ctype), "field %s has size %i, expected %i", \
+            field->name, (int)field->size, (int)sizeof(ctype)); \
+    ctype value = (field->flags & MPACK_FIELD_RANGE) ? \
+            mpack_expect_##suffix##_range(reader, (ctype)field->min, (ctype)field->max) : \
+            mpack_expect_##suffix(reader); \
+    if (mpack_reader_error(reader) == mpack_ok) \
+        mpack_memcpy(p, &value, sizeof(value)); \
+} while (0)
+
+static void mpack_expect_field(mpack_reader_t* reader, const mpack_field_t* field, char* p) {
+
+    // optional fields are left unchanged when nil
+    if ((field->flags & MPACK_FIELD_OPTIONAL) && mpack_peek_tag(reader).type == mpack_type_nil) {
+        mpack_expect_nil(reader);
+        return;
+    }
+
+    switch (field->type) {
+        case mpack_field_bool: {
+            mpack_assert(field->size == sizeof(bool), "field %s has size %i, expected %i",
+                    field->name, (int)field->size, (int)sizeof(bool));
+            bool value = mpack_expect_bool(reader);
+            if (mpack_reader_error(reader) == mpack_ok)
+                mpack_memcpy(p, &value, sizeof(value));
+            return;
+        }
+
+        case mpack_field_u8:     MPACK_EXPECT_FIELD(uint8_t, u8);     return;
+        case mpack_field_u16:    MPACK_EXPECT_FIELD(uint16_t, u16);   return;
+        case mpack_field_u32:    MPACK_EXPECT_FIELD(uint32_t, u32);   return;
+        case mpack_field_u64:    MPACK_EXPECT_FIELD(uint64_t, u64);   return;
+        case mpack_field_i8:     MPACK_EXPECT_FIELD(int8_t, i8);      return;
+        case mpack_field_i16:    MPACK_EXPECT_FIELD(int16_t, i16);    return;
+        case mpack_field_i32:    MPACK_EXPECT_FIELD(int32_t, i32);    return;
+        case mpack_field_i64:    MPACK_EXPECT_FIELD(int64_t, i64);    return;
+        case mpack_field_float:  MPACK_EXPECT_FIELD(float, float);    return;
+        case mpack_field_double: MPACK_EXPECT_FIELD(double, double);  return;
+
+        case mpack_field_cstr:
+            mpack_expect_cstr(reader, p, field->size);
+            return;
+
+        case mpack_field_utf8_cstr:
+            mpack_expect_utf8_cstr(reader, p, field->size);
+            return;
+
+        case mpack_field_struct:
+            mpack_assert(field->desc != NULL, "field %s has no nested descriptor", field->name);
+            mpack_expect_struct(reader, field->desc, p);
+            return;
+    }
+
+    mpack_break("field %s has invalid type %i", field->name, (int)field->type);
+    mpack_reader_flag_error(reader, mpack_error_bug);
+}
+
+#undef MPACK_EXPECT_FIELD
+
+void mpack_expect_struct(mpack_reader_t* reader, const mpack_struct_t* desc, void* out) {
+    if (mpack_reader_error(reader) != mpack_ok)
+        return;
+    mpack_assert(desc != NULL, "desc cannot be NULL");
+    mpack_assert(out != NULL, "out cannot be NULL");
+
+    size_t count = desc->count;
+    if (count > MPACK_STRUCT_MAX_FIELDS) {
+        mpack_break("struct has %i fields, but the maximum is %i",
+                (int)count, (int)MPACK_STRUCT_MAX_FIELDS);
+        mpack_reader_flag_error(reader, mpack_error_bug);
+        return;
+    }
+
+    uint8_t found[(MPACK_STRUCT_MAX_FIELDS + 7) / 8];
+    mpack_memset(found, 0, (count + 7) / 8);
+
+    char* base = (char*)out;
+    size_t next = 0;
+    for (size_t i = mpack_expect_map(reader); i > 0; --i) {
+        size_t index = mpack_expect_struct_key(reader, desc, next);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+
+        // values of unrecognized keys are ignored
+        if (index == count) {
+            mpack_discard(reader);
+            continue;
+        }
+
+        uint8_t bit = (uint8_t)(1u << (index % 8));
+        if (found[index / 8] & bit) {
+            mpack_reader_flag_error(reader, mpack_error_invalid);
+            return;
+        }
+        found[index / 8] |= bit;
+
+        const mpack_field_t* field = &desc->fields[index];
+        mpack_expect_field(reader, field, base + field->offset);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+        next = index + 1;
+    }
+    mpack_done_map(reader);
+
+    // all fields that are not optional must be present
+    for (size_t i = 0; i < count; ++i) {
+        if (!(found[i / 8] & (1u << (i % 8))) && !(desc->fields[i].flags & MPACK_FIELD_OPTIONAL)) {
+            mpack_reader_flag_error(reader, mpack_error_data);
+            return;
+        }
+    }
+}
+
+
 #endif
 
@@ -1131,6 +1131,128 @@ size_t mpack_expect_key_uint(mpack_reader_t* reader, bool found[], size_t count)
 size_t mpack_expect_key_cstr(mpack_reader_t* reader, const char* keys[],
         bool found[], size_t count);
 
+#ifdef MPACK_MALLOC
+/**
+ * A precompiled set of string keys for fast lookup of map keys.
+ *
+ * A keyset is built once from an array of keys with mpack_keyset_init()
+ * and can then be used to resolve string keys in constant time with
+ * mpack_expect_key_set() or mpack_keyset_find(). The key lengths are
+ * precomputed, and a hash seed is chosen that spreads the keys across
+ * the hash table with as few collisions as possible.
+ *
+ * A keyset is immutable once built, so it can be shared by any number
+ * of readers (including on different threads.)
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_keyset_t {
+    /** @cond */
+    const char** keys; /* Borrowed array of keys */
+    uint32_t* lengths; /* Length of each key */
+    uint32_t* slots;   /* Hash table of key index plus one, or zero if empty */
+    size_t count;      /* Number of keys */
+    uint32_t mask;     /* Hash table size minus one */
+    uint32_t seed;     /* Seed for the hash function */
+    uint32_t probes;   /* Maximum number of probes for any key */
+    /** @endcond */
+} mpack_keyset_t;
+
+/**
+ * Initializes a keyset with the given array of keys, allocating its
+ * hash table with MPACK_MALLOC.
+ *
+ * The keys array is not copied; it must outlive the keyset. The index
+ * of each key in the array is the value returned when it is found.
+ *
+ * The keyset must be destroyed with mpack_keyset_destroy() if and only
+ * if this returns mpack_ok.
+ *
+ * @param keyset The keyset to initialize
+ * @param keys An array of unique string keys of length count
+ * @param count The number of keys
+ * @return mpack_ok on success, mpack_error_memory if an allocation failure
+ *     occurs, or mpack_error_bug if the keys are not unique.
+ */
+mpack_error_t mpack_keyset_init(mpack_keyset_t* keyset, const char* keys[], size_t count);
+
+/**
+ * Frees the memory held by a keyset.
+ */
+void mpack_keyset_destroy(mpack_keyset_t* keyset);
+
+/**
+ * Finds the index of the given key in the keyset, returning the keyset's
+ * count if the key is not found.
+ *
+ * @param keyset The keyset
+ * @param key The key bytes (not necessarily null-terminated)
+ * @param len The length of the key in bytes
+ */
+size_t mpack_keyset_find(const mpack_keyset_t* keyset, const char* key, size_t len);
+
+/**
+ * Returns the number of keys in the keyset.
+ */
+MPACK_INLINE size_t mpack_keyset_count(const mpack_keyset_t* keyset) {
+    return keyset->count;
+}
+
+/**
+ * Expects a string map key matching one of the keys in the given keyset,
+ * marking it as found in the given bool array and returning its index.
+ *
+ * This behaves exactly like mpack_expect_key_cstr(), except that the key
+ * is resolved with a single hash lookup rather than by comparing it
+ * against each possible key. Prefer it for maps with many keys.
+ *
+ * The found array must have one flag for each key in the keyset, and
+ * should be cleared before expecting a key. If the key is unrecognized,
+ * the keyset's count is returned and no error is flagged.
+ *
+ * @param reader The reader
+ * @param keyset The keyset of expected string keys
+ * @param found An array of bool flags with one flag per key in the keyset
+ *
+ * @see mpack_expect_key_cstr()
+ */
+size_t mpack_expect_key_set(mpack_reader_t* reader, const mpack_keyset_t* keyset,
+        bool found[]);
+#endif
+
+/**
+ * Expects a map and decodes it into the given struct according to the
+ * given descriptor table.
+ *
+ * Each key in the map is matched against the names of the fields in the
+ * descriptor, and its value is read into the struct at the field's offset
+ * as the field's type. Keys are expected in declared order first, so maps
+ * whose keys follow the order of the descriptor decode fastest, but any
+ * order is accepted. Values of unrecognized keys are discarded.
+ *
+ * Fields that are not found in the map are left unchanged, so the struct
+ * should be initialized with any defaults beforehand. If an error occurs,
+ * fields decoded before the error keep their new values.
+ *
+ * The struct can have at most MPACK_STRUCT_MAX_FIELDS fields (256 by
+ * default.) Nested struct fields are decoded recursively.
+ *
+ * @throws mpack_error_type If the data is not a map, or a value does not
+ *     match the type or range of its field
+ * @throws mpack_error_invalid If the map contains a duplicate key
+ * @throws mpack_error_data If a field that is not optional is missing
+ * @throws mpack_error_too_big If a string does not fit in its field's char
+ *     array with a null-terminator
+ *
+ * @param reader The reader
+ * @param desc The descriptor of the struct
+ * @param out The struct into which to decode
+ *
+ * @see mpack_write_struct()
+ */
+void mpack_expect_struct(mpack_reader_t* reader, const mpack_struct_t* desc, void* out);
+
 /**
  * @}
  */
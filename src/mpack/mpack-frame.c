@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MPACK_INTERNAL 1
+
+#include "mpack-frame.h"
+
+#if MPACK_FRAME && defined(MPACK_MALLOC)
+
+#if defined(MPACK_UNIT_TESTS)
+size_t mpack_frame_test_measured;
+#endif
+
+// Returns a buffer capacity of at least the given size, doubling the
+// given capacity.
+static size_t mpack_frame_grow_capacity(size_t capacity, size_t size) {
+    if (capacity == 0)
+        capacity = MPACK_BUFFER_SIZE;
+    while (capacity < size) {
+        if (capacity > SIZE_MAX / 2)
+            return size;
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+
+// Frame Writer
+
+static void mpack_frame_writer_flag_error(mpack_frame_writer_t* writer, mpack_error_t error) {
+    mpack_log("frame writer %p setting error %i: %s\n", writer, (int)error, mpack_error_to_string(error));
+    if (writer->error == mpack_ok)
+        writer->error = error;
+}
+
+// Grows the frame writer's buffer to at least the given size, keeping the
+// given number of bytes of its contents.
+static bool mpack_frame_writer_reserve(mpack_frame_writer_t* writer, size_t size, size_t keep) {
+    if (size <= writer->capacity)
+        return true;
+
+    size_t capacity = mpack_frame_grow_capacity(writer->capacity, size);
+    char* buffer;
+    if (writer->buffer == NULL)
+        buffer = (char*)MPACK_MALLOC(capacity);
+    else
+        buffer = (char*)mpack_realloc(writer->buffer, keep, capacity);
+    if (buffer == NULL)
+        return false;
+
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return true;
+}
+
+static void mpack_frame_writer_flush_frame(mpack_writer_t* writer, const char* data, size_t count) {
+    mpack_frame_writer_t* frames = (mpack_frame_writer_t*)writer->context;
+
+    // This is an intrusive flush function like the growable writer's: it
+    // grows the frame writer's buffer rather than emptying the writer's
+    // buffer, since the frame can't be sent until its size is known. See
+    // mpack_growable_writer_flush() for how it's called.
+
+    if (data == writer->buffer) {
+
+        // finishing, the frame is already in place
+        if (writer->used == count)
+            return;
+
+        // keep the data in the buffer and make room for more
+        writer->used = count;
+        count = 0;
+    }
+
+    size_t size = writer->used + count;
+    if (frames->max_size != 0 && size > frames->max_size) {
+        mpack_writer_flag_error(writer, mpack_error_too_big);
+        return;
+    }
+
+    // the frame starts after the frames batched before it and its prefix
+    size_t offset = frames->used + frames->prefix;
+    if (!mpack_frame_writer_reserve(frames, offset + size + MPACK_WRITER_MINIMUM_BUFFER_SIZE,
+                offset + writer->used))
+    {
+        mpack_writer_flag_error(writer, mpack_error_memory);
+        return;
+    }
+    writer->buffer = frames->buffer + offset;
+    writer->size = frames->capacity - offset;
+
+    if (count > 0) {
+        mpack_memcpy(writer->buffer + writer->used, data, count);
+        writer->used += count;
+    }
+}
+
+void mpack_frame_writer_init(mpack_frame_writer_t* writer, mpack_frame_mode_t mode,
+        mpack_frame_flush_t flush, void* context)
+{
+    mpack_assert(flush != NULL, "flush function is NULL");
+    mpack_memset(writer, 0, sizeof(*writer));
+    writer->flush = flush;
+    writer->context = context;
+    writer->mode = mode;
+    writer->prefix = (mode == mpack_frame_prefixed) ? MPACK_FRAME_PREFIX_SIZE : 0;
+}
+
+mpack_writer_t* mpack_frame_start(mpack_frame_writer_t* writer) {
+    if (writer->framing) {
+        mpack_break("a frame is already in progress!");
+        mpack_writer_flag_error(&writer->writer, mpack_error_bug);
+        return &writer->writer;
+    }
+    writer->framing = true;
+
+    if (writer->error != mpack_ok) {
+        mpack_writer_init_error(&writer->writer, writer->error);
+        return &writer->writer;
+    }
+
+    size_t offset = writer->used + writer->prefix;
+    if (!mpack_frame_writer_reserve(writer, offset + MPACK_WRITER_MINIMUM_BUFFER_SIZE, writer->used)) {
+        mpack_writer_init_error(&writer->writer, mpack_error_memory);
+        return &writer->writer;
+    }
+
+    mpack_writer_init(&writer->writer, writer->buffer + offset, writer->capacity - offset);
+    mpack_writer_set_context(&writer->writer, writer);
+    mpack_writer_set_flush(&writer->writer, mpack_frame_writer_flush_frame);
+    return &writer->writer;
+}
+
+mpack_error_t mpack_frame_finish(mpack_frame_writer_t* writer) {
+    if (!writer->framing) {
+        mpack_break("no frame is in progress!");
+        return mpack_error_bug;
+    }
+    writer->framing = false;
+
+    mpack_error_t error = mpack_writer_destroy(&writer->writer);
+    if (error != mpack_ok)
+        return error;
+
+    size_t size = writer->writer.used;
+    if (size == 0) {
+        mpack_break("no object was written to the frame!");
+        return mpack_error_bug;
+    }
+    if (writer->max_size != 0 && size > writer->max_size)
+        return mpack_error_too_big;
+    #if SIZE_MAX > UINT32_MAX
+    if (writer->mode == mpack_frame_prefixed && size > UINT32_MAX)
+        return mpack_error_too_big;
+    #endif
+
+    // the frame is already in place; fill in its prefix
+    if (writer->mode == mpack_frame_prefixed)
+        mpack_store_u32(writer->buffer + writer->used, (uint32_t)size);
+    writer->used += writer->prefix + size;
+
+    if (writer->used >= writer->batch)
+        mpack_frame_writer_flush(writer);
+    return writer->error;
+}
+
+mpack_error_t mpack_frame_append(mpack_frame_writer_t* writer, const char* data, size_t count) {
+    mpack_write_object_bytes(mpack_frame_start(writer), data, count);
+    return mpack_frame_finish(writer);
+}
+
+void mpack_frame_writer_flush(mpack_frame_writer_t* writer) {
+    if (writer->framing) {
+        mpack_break("cannot flush while a frame is in progress!");
+        mpack_frame_writer_flag_error(writer, mpack_error_bug);
+        return;
+    }
+
+    if (writer->error == mpack_ok && writer->used != 0 &&
+            !writer->flush(writer->context, writer->buffer, writer->used))
+        mpack_frame_writer_flag_error(writer, mpack_error_io);
+    writer->used = 0;
+}
+
+mpack_error_t mpack_frame_writer_destroy(mpack_frame_writer_t* writer) {
+    if (writer->framing) {
+        mpack_break("cannot destroy a frame writer while a frame is in progress!");
+        mpack_writer_destroy(&writer->writer);
+        writer->framing = false;
+        mpack_frame_writer_flag_error(writer, mpack_error_bug);
+    }
+
+    mpack_frame_writer_flush(writer);
+    if (writer->buffer != NULL) {
+        MPACK_FREE(writer->buffer);
+        writer->buffer = NULL;
+    }
+    return writer->error;
+}
+
+
+// Frame Reader
+
+static void mpack_frame_reader_flag_error(mpack_frame_reader_t* reader, mpack_error_t error) {
+    mpack_log("frame reader %p setting error %i: %s\n", reader, (int)error, mpack_error_to_string(error));
+    if (reader->error == mpack_ok)
+        reader->error = error;
+}
+
+void mpack_frame_reader_init(mpack_frame_reader_t* reader, mpack_frame_mode_t mode,
+        size_t capacity, mpack_frame_fill_t fill, void* context)
+{
+    mpack_assert(fill != NULL, "fill function is NULL");
+    mpack_memset(reader, 0, sizeof(*reader));
+    reader->fill = fill;
+    reader->context = context;
+    reader->mode = mode;
+
+    if (capacity == 0)
+        capacity = MPACK_BUFFER_SIZE;
+    reader->buffer = (char*)MPACK_MALLOC(capacity);
+    if (reader->buffer == NULL) {
+        reader->error = mpack_error_memory;
+        return;
+    }
+    reader->capacity = capacity;
+}
+
+// Finds the next frame in the buffer. Returns false if more data is needed
+// or an error occurs.
+static bool mpack_frame_reader_find(mpack_frame_reader_t* reader, mpack_frame_t* frame) {
+    const char* p = reader->buffer + reader->start;
+    size_t left = reader->length - reader->start;
+    size_t total;
+
+    if (reader->mode == mpack_frame_prefixed) {
+        if (left < MPACK_FRAME_PREFIX_SIZE) {
+            reader->need = MPACK_FRAME_PREFIX_SIZE;
+            return false;
+        }
+
+        // the size is checked before any of the frame is buffered
+        uint32_t size = mpack_load_u32(p);
+        bool too_big = reader->max_size != 0 && size > reader->max_size;
+        #if SIZE_MAX <= UINT32_MAX
+        too_big = too_big || size > SIZE_MAX - MPACK_FRAME_PREFIX_SIZE;
+        #endif
+        if (too_big) {
+            mpack_frame_reader_flag_error(reader, mpack_error_too_big);
+            return false;
+        }
+        reader->need = total = MPACK_FRAME_PREFIX_SIZE + (size_t)size;
+        if (left < total)
+            return false;
+        frame->data = p + MPACK_FRAME_PREFIX_SIZE;
+        frame->size = size;
+
+    } else {
+
+        // Measuring a partial frame from its start after every fill would
+        // take quadratic time for a frame received in many fills, so it's
+        // only measured again once the data received of it has doubled or
+        // reached the maximum size, or the stream has ended.
+        if (left < reader->need && !reader->end)
+            return false;
+
+        #if defined(MPACK_UNIT_TESTS)
+        mpack_frame_test_measured += left;
+        #endif
+        size_t size = 0;
+        mpack_error_t error = (left == 0) ? mpack_error_io : mpack_measure_object(p, left, &size);
+        if (error == mpack_error_io) {
+            // the frame is larger than what has been received
+            if (reader->max_size != 0 && left >= reader->max_size) {
+                mpack_frame_reader_flag_error(reader, mpack_error_too_big);
+                return false;
+            }
+            reader->need = (left > SIZE_MAX / 2) ? SIZE_MAX : left * 2;
+            if (reader->max_size != 0 && reader->need > reader->max_size)
+                reader->need = reader->max_size;
+            return false;
+        }
+        if (error == mpack_ok && reader->max_size != 0 && size > reader->max_size)
+            error = mpack_error_too_big;
+        if (error != mpack_ok) {
+            mpack_frame_reader_flag_error(reader, error);
+            return false;
+        }
+        reader->need = 0;
+        frame->data = p;
+        frame->size = total = size;
+    }
+
+    reader->start += total;
+    return true;
+}
+
+// Reads more of the stream, first moving the partial frame at the end of
+// the buffer to the start and growing the buffer if the frame is larger.
+// Returns false at the end of the stream or on error.
+static bool mpack_frame_reader_fill(mpack_frame_reader_t* reader) {
+    size_t left = reader->length - reader->start;
+    if (reader->end) {
+        if (left != 0)
+            mpack_frame_reader_flag_error(reader, mpack_error_io);
+        return false;
+    }
+
+    // frames before the partial frame have been returned, and are released
+    // by this call
+    if (reader->start != 0) {
+        if (left != 0)
+            mpack_memmove(reader->buffer, reader->buffer + reader->start, left);
+        reader->start = 0;
+        reader->length = left;
+    }
+
+    size_t need = (reader->need > left) ? reader->need : left + 1;
+    if (need > reader->capacity) {
+        size_t capacity = mpack_frame_grow_capacity(reader->capacity, need);
+        char* buffer = (char*)mpack_realloc(reader->buffer, left, capacity);
+        if (buffer == NULL) {
+            mpack_frame_reader_flag_error(reader, mpack_error_memory);
+            return false;
+        }
+        reader->buffer = buffer;
+        reader->capacity = capacity;
+    }
+
+    size_t space = reader->capacity - reader->length;
+    size_t count = reader->fill(reader->context, reader->buffer + reader->length, space);
+    if (count == 0) {
+        reader->end = true;
+    } else if (count > space) {
+        // the fill function returned an error code rather than a size
+        mpack_frame_reader_flag_error(reader, mpack_error_io);
+        return false;
+    } else {
+        reader->length += count;
+    }
+    return true;
+}
+
+size_t mpack_frame_next_batch(mpack_frame_reader_t* reader, mpack_frame_t* frames, size_t count) {
+    size_t found = 0;
+    while (found < count && reader->error == mpack_ok) {
+        if (mpack_frame_reader_find(reader, &frames[found])) {
+            ++found;
+            continue;
+        }
+
+        // only fill if nothing was found, since filling releases the
+        // frames found so far
+        if (found != 0 || reader->error != mpack_ok || !mpack_frame_reader_fill(reader))
+            break;
+    }
+    return found;
+}
+
+const char* mpack_frame_next(mpack_frame_reader_t* reader, size_t* size) {
+    mpack_frame_t frame;
+    if (mpack_frame_next_batch(reader, &frame, 1) == 0) {
+        *size = 0;
+        return NULL;
+    }
+    *size = frame.size;
+    return frame.data;
+}
+
+void mpack_frame_next_reader(mpack_frame_reader_t* reader, mpack_reader_t* message_reader) {
+    size_t size;
+    const char* data = mpack_frame_next(reader, &size);
+    if (data == NULL) {
+        mpack_reader_init_error(message_reader, reader->error != mpack_ok ? reader->error : mpack_error_data);
+        return;
+    }
+    mpack_reader_init_data(message_reader, data, size);
+}
+
+#if MPACK_NODE
+void mpack_frame_next_tree(mpack_frame_reader_t* reader, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count)
+{
+    size_t size;
+    const char* data = mpack_frame_next(reader, &size);
+    if (data == NULL) {
+        mpack_tree_init_error(tree, reader->error != mpack_ok ? reader->error : mpack_error_data);
+        return;
+    }
+
+    if (node_pool != NULL)
+        mpack_tree_init_pool(tree, data, size, node_pool, node_pool_count);
+    else
+        mpack_tree_init(tree, data, size);
+    if (mpack_tree_error(tree) == mpack_ok && mpack_tree_size(tree) != size)
+        mpack_tree_flag_error(tree, mpack_error_invalid);
+}
+#endif
+
+mpack_error_t mpack_frame_reader_destroy(mpack_frame_reader_t* reader) {
+    if (reader->buffer != NULL) {
+        MPACK_FREE(reader->buffer);
+        reader->buffer = NULL;
+    }
+    return reader->error;
+}
+
+#endif
+
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ *
+ * Declares the MPack frame writer and frame reader, which send and
+ * receive streams of framed messages.
+ */
+
+#ifndef MPACK_FRAME_H
+#define MPACK_FRAME_H 1
+
+#include "mpack-reader.h"
+#include "mpack-writer.h"
+#include "mpack-node.h"
+
+MPACK_HEADER_START
+
+#if MPACK_FRAME
+
+#if !MPACK_READER || !MPACK_WRITER
+#error "MPACK_FRAME requires MPACK_READER and MPACK_WRITER."
+#endif
+
+#ifdef MPACK_MALLOC
+
+/**
+ * @defgroup frame Framing
+ *
+ * Frames are messages sent over a stream such as a socket or pipe, one
+ * MessagePack object per frame.
+ *
+ * A @ref mpack_frame_writer_t encodes each frame directly into a buffer
+ * that is reused for all frames, then passes whole frames to a flush
+ * function. In prefixed mode it reserves space for the length prefix
+ * before the frame and fills it in once the frame is finished, so the
+ * frame is never copied.
+ *
+ * A @ref mpack_frame_reader_t reads the stream from a fill function into
+ * a buffer that is reused for all frames, and returns each frame in place
+ * once it has been received completely. Each fill reads as much as the
+ * buffer has room for, so a fill can receive many frames at once, and
+ * mpack_frame_next_batch() returns all of them together.
+ *
+ * Framing is available when MPACK_FRAME is enabled. It requires
+ * MPACK_MALLOC.
+ *
+ * @{
+ */
+
+/**
+ * The number of bytes of the length prefix of a frame in prefixed mode.
+ */
+#define MPACK_FRAME_PREFIX_SIZE 4
+
+/**
+ * How frames are delimited in a stream.
+ */
+typedef enum mpack_frame_mode_t {
+
+    /**
+     * Each frame is preceded by its length as a big-endian 32-bit
+     * unsigned integer. The frame reader can find the end of a frame
+     * without looking at its contents.
+     */
+    mpack_frame_prefixed,
+
+    /**
+     * Frames are concatenated without anything between them, so the
+     * stream is a plain MessagePack stream. The frame reader finds the
+     * end of each frame with mpack_measure_object().
+     */
+    mpack_frame_delimited
+
+} mpack_frame_mode_t;
+
+/**
+ * @name Frame Writer
+ * @{
+ */
+
+/**
+ * A function that sends data from a frame writer, for example by writing
+ * it to a socket. It must send all of the data.
+ *
+ * @param context The context passed to the frame writer
+ * @param data The data to send, which holds one or more whole frames
+ * @param count The number of bytes to send
+ * @return true if the data was sent, or false on error
+ */
+typedef bool (*mpack_frame_flush_t)(void* context, const char* data, size_t count);
+
+/**
+ * A frame writer encodes frames into a reused buffer and sends them with
+ * a flush function.
+ *
+ * @see mpack_frame_writer_init()
+ */
+typedef struct mpack_frame_writer_t mpack_frame_writer_t;
+
+/* Hide internals from documentation */
+/** @cond */
+
+struct mpack_frame_writer_t {
+    mpack_writer_t writer;      /* Writer of the frame being written */
+    mpack_frame_flush_t flush;  /* Function to send frames */
+    void* context;              /* Context of the flush function */
+    mpack_frame_mode_t mode;    /* How frames are delimited */
+    size_t prefix;              /* Bytes reserved before each frame */
+    char* buffer;               /* Buffer of frames waiting to be sent */
+    size_t capacity;            /* Size of the buffer */
+    size_t used;                /* Bytes of whole frames in the buffer */
+    size_t batch;               /* Bytes to buffer before sending */
+    size_t max_size;            /* Maximum size of a frame, or 0 */
+    bool framing;               /* Whether a frame is being written */
+    mpack_error_t error;        /* Error state */
+};
+
+/** @endcond */
+
+/**
+ * Initializes a frame writer that sends frames with the given flush
+ * function.
+ *
+ * By default each frame is sent as soon as it is finished; see
+ * mpack_frame_writer_set_batch() to send several at once.
+ *
+ * The frame writer must be destroyed with mpack_frame_writer_destroy().
+ *
+ * @param writer The frame writer to initialize
+ * @param mode How frames are delimited
+ * @param flush The function that sends frames
+ * @param context An arbitrary pointer passed to the flush function
+ */
+void mpack_frame_writer_init(mpack_frame_writer_t* writer, mpack_frame_mode_t mode,
+        mpack_frame_flush_t flush, void* context);
+
+/**
+ * Sets the number of bytes of frames to buffer before sending them. Frames
+ * are then sent together with a single call to the flush function once at
+ * least this many bytes are buffered, or when the frame writer is flushed
+ * or destroyed.
+ *
+ * The default is 0, which sends each frame as soon as it is finished.
+ */
+MPACK_INLINE void mpack_frame_writer_set_batch(mpack_frame_writer_t* writer, size_t batch) {
+    writer->batch = batch;
+}
+
+/**
+ * Sets the maximum size of a frame (not counting its length prefix), or 0
+ * for no limit. A larger frame fails with mpack_error_too_big. Frames in
+ * prefixed mode are additionally limited to UINT32_MAX bytes.
+ *
+ * The default is 0.
+ */
+MPACK_INLINE void mpack_frame_writer_set_max_size(mpack_frame_writer_t* writer, size_t max_size) {
+    writer->max_size = max_size;
+}
+
+/**
+ * Starts writing a frame, returning a writer to which exactly one
+ * MessagePack object must be written. Call mpack_frame_finish() once the
+ * object is complete.
+ *
+ * The writer encodes directly into the frame writer's buffer, which grows
+ * as needed. Don't destroy it or change its callbacks.
+ */
+mpack_writer_t* mpack_frame_start(mpack_frame_writer_t* writer);
+
+/**
+ * Finishes the frame started with mpack_frame_start(), sending it unless
+ * frames are being batched.
+ *
+ * If the frame's writer is in an error state (for example if the frame
+ * exceeds the maximum size), the frame is discarded and the stream is
+ * otherwise unaffected. Errors sending frames are flagged on the frame
+ * writer, after which nothing more is sent.
+ *
+ * @return The error encoding or sending the frame, or mpack_ok.
+ */
+mpack_error_t mpack_frame_finish(mpack_frame_writer_t* writer);
+
+/**
+ * Writes a frame that is already encoded. The data must contain exactly
+ * one MessagePack object.
+ *
+ * @see mpack_frame_finish()
+ */
+mpack_error_t mpack_frame_append(mpack_frame_writer_t* writer, const char* data, size_t count);
+
+/**
+ * Sends any batched frames.
+ */
+void mpack_frame_writer_flush(mpack_frame_writer_t* writer);
+
+/**
+ * Returns the error state of the frame writer.
+ */
+MPACK_INLINE mpack_error_t mpack_frame_writer_error(mpack_frame_writer_t* writer) {
+    return writer->error;
+}
+
+/**
+ * Sends any batched frames and frees the frame writer's buffer. Returns
+ * the final error state of the frame writer.
+ *
+ * A frame must not be in progress.
+ */
+mpack_error_t mpack_frame_writer_destroy(mpack_frame_writer_t* writer);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Frame Reader
+ * @{
+ */
+
+/**
+ * A function that reads more of a frame reader's stream, for example from
+ * a socket. It works like a reader's fill function, except that it is not
+ * given a reader.
+ *
+ * @param context The context passed to the frame reader
+ * @param buffer The buffer to fill
+ * @param count The size of the buffer
+ * @return The number of bytes read, or 0 at the end of the stream or on
+ *     error.
+ */
+typedef size_t (*mpack_frame_fill_t)(void* context, char* buffer, size_t count);
+
+/**
+ * A frame returned by mpack_frame_next_batch().
+ */
+typedef struct mpack_frame_t {
+    const char* data; /**< The frame's data, in the frame reader's buffer */
+    size_t size;      /**< The size of the frame in bytes */
+} mpack_frame_t;
+
+/**
+ * A frame reader reads frames from a fill function into a reused buffer.
+ *
+ * @see mpack_frame_reader_init()
+ */
+typedef struct mpack_frame_reader_t mpack_frame_reader_t;
+
+/* Hide internals from documentation */
+/** @cond */
+
+struct mpack_frame_reader_t {
+    mpack_frame_fill_t fill;    /* Function to read the stream */
+    void* context;              /* Context of the fill function */
+    mpack_frame_mode_t mode;    /* How frames are delimited */
+    char* buffer;               /* Buffer of data read from the stream */
+    size_t capacity;            /* Size of the buffer */
+    size_t start;               /* Offset of the next frame in the buffer */
+    size_t length;              /* Bytes of data in the buffer */
+    size_t need;                /* Bytes needed from start to look for the next frame */
+    size_t max_size;            /* Maximum size of a frame, or 0 */
+    bool end;                   /* Whether the fill function reached the end */
+    mpack_error_t error;        /* Error state */
+};
+
+/** @endcond */
+
+/**
+ * Initializes a frame reader that reads frames from the given fill
+ * function.
+ *
+ * The frame reader must be destroyed with mpack_frame_reader_destroy(),
+ * even if initialization fails.
+ *
+ * @throws mpack_error_memory if the buffer cannot be allocated
+ *
+ * @param reader The frame reader to initialize
+ * @param mode How frames are delimited
+ * @param capacity The initial size of the buffer, or 0 for
+ *     MPACK_BUFFER_SIZE. The fill function is asked for up to this many
+ *     bytes at a time. The buffer grows if a frame is larger.
+ * @param fill The function that reads the stream
+ * @param context An arbitrary pointer passed to the fill function
+ */
+void mpack_frame_reader_init(mpack_frame_reader_t* reader, mpack_frame_mode_t mode,
+        size_t capacity, mpack_frame_fill_t fill, void* context);
+
+/**
+ * Sets the maximum size of a frame (not counting its length prefix), or 0
+ * for no limit. A larger frame fails with mpack_error_too_big as soon as
+ * its length is known, so the buffer never grows beyond this.
+ *
+ * The default is 0. A limit should be set when reading from an untrusted
+ * source, since a length prefix can otherwise request up to 4 GiB.
+ */
+MPACK_INLINE void mpack_frame_reader_set_max_size(mpack_frame_reader_t* reader, size_t max_size) {
+    reader->max_size = max_size;
+}
+
+/**
+ * Reads the next frame, returning it in place in the frame reader's
+ * buffer. The frame is valid until the next frame is read or the frame
+ * reader is destroyed.
+ *
+ * Returns NULL at the end of the stream or on error. The error state of
+ * the frame reader is mpack_ok at a clean end of the stream,
+ * mpack_error_io if the stream ends in the middle of a frame or the fill
+ * function returns an invalid size, mpack_error_invalid if a frame is not
+ * valid MessagePack (in delimited mode), mpack_error_too_big if a frame
+ * exceeds the maximum size, or mpack_error_memory if the buffer cannot
+ * grow.
+ *
+ * @param reader The frame reader
+ * @param size [out] The size of the frame, or zero if none is returned
+ */
+const char* mpack_frame_next(mpack_frame_reader_t* reader, size_t* size);
+
+/**
+ * Reads up to the given number of frames, returning the number read.
+ *
+ * All of the complete frames already in the buffer are returned (up to
+ * the given count) without calling the fill function, which is only
+ * called when no complete frame is buffered. The frames are valid until
+ * the next frames are read or the frame reader is destroyed.
+ *
+ * Returns 0 at the end of the stream or on error.
+ *
+ * @see mpack_frame_next()
+ */
+size_t mpack_frame_next_batch(mpack_frame_reader_t* reader, mpack_frame_t* frames, size_t count);
+
+/**
+ * Reads the next frame and initializes the given reader to read it in
+ * place. At the end of the stream or on error, the reader is placed in
+ * the frame reader's error state, or mpack_error_data at a clean end of
+ * the stream.
+ *
+ * @see mpack_frame_next()
+ */
+void mpack_frame_next_reader(mpack_frame_reader_t* reader, mpack_reader_t* message_reader);
+
+#if MPACK_NODE
+/**
+ * Reads the next frame and parses it in place into the given tree.
+ *
+ * The tree must be destroyed with mpack_tree_destroy(), even if parsing
+ * fails. At the end of the stream or on error, the tree is placed in the
+ * frame reader's error state, or mpack_error_data at a clean end of the
+ * stream. If the frame is not exactly one MessagePack object, the tree is
+ * placed in the mpack_error_invalid error state.
+ *
+ * @param reader The frame reader
+ * @param tree The tree to initialize
+ * @param node_pool A node pool for the tree, or NULL to allocate nodes as
+ *     needed
+ * @param node_pool_count The number of nodes in the node pool
+ *
+ * @see mpack_frame_next()
+ * @see mpack_tree_init_pool()
+ */
+void mpack_frame_next_tree(mpack_frame_reader_t* reader, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count);
+#endif
+
+/**
+ * Returns the error state of the frame reader.
+ */
+MPACK_INLINE mpack_error_t mpack_frame_reader_error(mpack_frame_reader_t* reader) {
+    return reader->error;
+}
+
+/**
+ * Frees the frame reader's buffer. Returns the final error state of the
+ * frame reader.
+ */
+mpack_error_t mpack_frame_reader_destroy(mpack_frame_reader_t* reader);
+
+#if defined(MPACK_UNIT_TESTS)
+/** @cond */
+// The number of bytes passed to mpack_measure_object() by frame readers.
+// The unit tests use it to check that partial frames aren't re-measured
+// after every fill.
+extern size_t mpack_frame_test_measured;
+/** @endcond */
+#endif
+
+/**
+ * @}
+ */
+
+/**
+ * @}
+ */
+
+#endif
+
+#endif
+
+MPACK_HEADER_END
+
+#endif
+
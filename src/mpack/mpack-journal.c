@@ -0,0 +1,1010 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MPACK_INTERNAL 1
+
+#include "mpack-journal.h"
+
+#if MPACK_JOURNAL && MPACK_STDIO
+
+
+// Index format
+
+// The index header is the array ["mpack-journal", 1, interval] with the
+// interval encoded as a uint32. This is the encoding of everything but
+// the interval.
+static const char mpack_journal_magic[] = "\x93\xad" "mpack-journal" "\x01\xce";
+
+#define MPACK_JOURNAL_MAGIC_SIZE (sizeof(mpack_journal_magic) - 1)
+
+// skips an object with the event parser
+static const mpack_visitor_t mpack_journal_skip_visitor = {NULL, NULL, NULL, NULL};
+
+typedef struct mpack_journal_entry_t {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t count;
+    uint32_t crc;
+} mpack_journal_entry_t;
+
+static char* mpack_journal_index_filename(const char* filename) {
+    size_t length = mpack_strlen(filename);
+    char* index_filename = (char*)MPACK_MALLOC(length + sizeof(".idx"));
+    if (index_filename != NULL) {
+        mpack_memcpy(index_filename, filename, length);
+        mpack_memcpy(index_filename + length, ".idx", sizeof(".idx"));
+    }
+    return index_filename;
+}
+
+static void mpack_journal_store_header(char* p, uint32_t interval) {
+    mpack_memcpy(p, mpack_journal_magic, MPACK_JOURNAL_MAGIC_SIZE);
+    mpack_store_u32(p + MPACK_JOURNAL_MAGIC_SIZE, interval);
+}
+
+static bool mpack_journal_load_header(const char* p, uint32_t* interval) {
+    if (mpack_memcmp(p, mpack_journal_magic, MPACK_JOURNAL_MAGIC_SIZE) != 0)
+        return false;
+    *interval = mpack_load_u32(p + MPACK_JOURNAL_MAGIC_SIZE);
+    return *interval != 0;
+}
+
+// Entries are the array [offset, size, count, crc] with each element
+// encoded at its full width so that entries can be found by position.
+static void mpack_journal_store_entry(char* p, const mpack_journal_entry_t* entry) {
+    mpack_store_u8(p, 0x94);
+    mpack_store_u8(p + 1, 0xcf);
+    mpack_store_u64(p + 2, entry->offset);
+    mpack_store_u8(p + 10, 0xcf);
+    mpack_store_u64(p + 11, entry->size);
+    mpack_store_u8(p + 19, 0xce);
+    mpack_store_u32(p + 20, entry->count);
+    mpack_store_u8(p + 24, 0xce);
+    mpack_store_u32(p + 25, entry->crc);
+}
+
+static bool mpack_journal_load_entry(const char* p, uint32_t interval, mpack_journal_entry_t* entry) {
+    if (mpack_load_u8(p) != 0x94 || mpack_load_u8(p + 1) != 0xcf || mpack_load_u8(p + 10) != 0xcf ||
+            mpack_load_u8(p + 19) != 0xce || mpack_load_u8(p + 24) != 0xce)
+        return false;
+    entry->offset = mpack_load_u64(p + 2);
+    entry->size = mpack_load_u64(p + 11);
+    entry->count = mpack_load_u32(p + 20);
+    entry->crc = mpack_load_u32(p + 25);
+
+    // every record is at least one byte
+    return entry->count != 0 && entry->count <= interval &&
+        entry->size >= entry->count && entry->offset + entry->size >= entry->offset;
+}
+
+
+
+// Checksums
+
+// The CRC-32C (Castagnoli) table for the reflected polynomial 0x82F63B78
+static const uint32_t mpack_journal_crc_table[256] = {
+    0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+    0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+    0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+    0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+    0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+    0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+    0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+    0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+    0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+    0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+    0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+    0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+    0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+    0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+    0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+    0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+    0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+    0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+    0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+    0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+    0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+    0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+    0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+    0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+    0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+    0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+    0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+    0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+    0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+    0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+    0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+    0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+    0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+    0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+    0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+    0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+    0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+    0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+    0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+    0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+    0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+    0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+    0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+#define MPACK_JOURNAL_CRC_INIT 0xffffffff
+
+static uint32_t mpack_journal_crc(uint32_t crc, const char* data, size_t count) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < count; ++i)
+        crc = mpack_journal_crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+
+
+// Journal Writer
+
+void mpack_journal_writer_flag_error(mpack_journal_writer_t* journal, mpack_error_t error) {
+    mpack_log("journal writer %p setting error %i: %s\n", journal, (int)error, mpack_error_to_string(error));
+
+    if (journal->error == mpack_ok) {
+        journal->error = error;
+
+        // the record writer is flagged as well so that writes to it are
+        // ignored
+        mpack_writer_flag_error(&journal->writer, error);
+    }
+}
+
+static void mpack_journal_writer_flush_record(mpack_writer_t* writer, const char* buffer, size_t count) {
+    mpack_journal_writer_t* journal = (mpack_journal_writer_t*)writer->context;
+    if (fwrite((const void*)buffer, 1, count, journal->log) != count) {
+        mpack_writer_flag_error(writer, mpack_error_io);
+        return;
+    }
+    journal->block_crc = mpack_journal_crc(journal->block_crc, buffer, count);
+    journal->record_size += count;
+}
+
+static void mpack_journal_writer_teardown_record(mpack_writer_t* writer) {
+    MPACK_FREE(writer->buffer);
+    writer->buffer = NULL;
+}
+
+static bool mpack_journal_writer_seek(mpack_journal_writer_t* journal, FILE* file, uint64_t offset) {
+    mpack_error_t error = mpack_file_seek(file, offset);
+    if (error != mpack_ok) {
+        mpack_journal_writer_flag_error(journal, error);
+        return false;
+    }
+    return true;
+}
+
+static bool mpack_journal_writer_file_size(mpack_journal_writer_t* journal, FILE* file, uint64_t* size) {
+    mpack_error_t error = mpack_file_size(file, size);
+    if (error != mpack_ok) {
+        mpack_journal_writer_flag_error(journal, error);
+        return false;
+    }
+    return true;
+}
+
+static bool mpack_journal_writer_read(mpack_journal_writer_t* journal, FILE* file, char* p, size_t count) {
+    if (fread((void*)p, 1, count, file) == count)
+        return true;
+
+    // a short read without a read error means the file is truncated
+    mpack_journal_writer_flag_error(journal, ferror(file) ? mpack_error_io : mpack_error_invalid);
+    return false;
+}
+
+static bool mpack_journal_writer_write(mpack_journal_writer_t* journal, FILE* file, const char* p, size_t count) {
+    if (fwrite((const void*)p, 1, count, file) == count)
+        return true;
+    mpack_journal_writer_flag_error(journal, mpack_error_io);
+    return false;
+}
+
+static void mpack_journal_writer_current_entry(mpack_journal_writer_t* journal, mpack_journal_entry_t* entry) {
+    entry->offset = journal->block_offset;
+    entry->size = journal->size - journal->block_offset;
+    entry->count = journal->block_count;
+    entry->crc = journal->block_crc ^ MPACK_JOURNAL_CRC_INIT;
+}
+
+// Writes the pending entries to the index, followed by the entry of the
+// current partial block if requested. The log is flushed first so that
+// the index never covers data that has not been written.
+static void mpack_journal_writer_write_index(mpack_journal_writer_t* journal, bool partial) {
+    if (fflush(journal->log) != 0) {
+        mpack_journal_writer_flag_error(journal, mpack_error_io);
+        return;
+    }
+
+    uint64_t first = journal->block - journal->pending;
+    if (!mpack_journal_writer_seek(journal, journal->index,
+                MPACK_JOURNAL_HEADER_SIZE + first * MPACK_JOURNAL_ENTRY_SIZE))
+        return;
+    if (!mpack_journal_writer_write(journal, journal->index, journal->entries,
+                journal->pending * MPACK_JOURNAL_ENTRY_SIZE))
+        return;
+    journal->pending = 0;
+
+    // the partial entry is rewritten in place as its block grows
+    if (partial && journal->block_count != 0) {
+        mpack_journal_entry_t entry;
+        char encoded[MPACK_JOURNAL_ENTRY_SIZE];
+        mpack_journal_writer_current_entry(journal, &entry);
+        mpack_journal_store_entry(encoded, &entry);
+        mpack_journal_writer_write(journal, journal->index, encoded, sizeof(encoded));
+    }
+}
+
+static void mpack_journal_writer_end_block(mpack_journal_writer_t* journal) {
+    mpack_journal_entry_t entry;
+    mpack_journal_writer_current_entry(journal, &entry);
+    mpack_journal_store_entry(journal->entries + journal->pending * MPACK_JOURNAL_ENTRY_SIZE, &entry);
+    ++journal->pending;
+
+    ++journal->block;
+    journal->block_offset = journal->size;
+    journal->block_count = 0;
+    journal->block_crc = MPACK_JOURNAL_CRC_INIT;
+
+    if (journal->pending == MPACK_JOURNAL_PENDING_ENTRIES)
+        mpack_journal_writer_write_index(journal, false);
+}
+
+static void mpack_journal_writer_create(mpack_journal_writer_t* journal, const char* filename,
+        const char* index_filename, uint32_t interval)
+{
+    // a log without an index is not a journal, so we refuse to truncate it
+    FILE* existing = fopen(filename, "rb");
+    if (existing != NULL) {
+        uint64_t size;
+        bool empty = mpack_journal_writer_file_size(journal, existing, &size) && size == 0;
+        fclose(existing);
+        if (!empty) {
+            mpack_journal_writer_flag_error(journal, mpack_error_invalid);
+            return;
+        }
+    }
+
+    journal->log = fopen(filename, "wb");
+    if (journal->log == NULL) {
+        mpack_journal_writer_flag_error(journal, mpack_error_io);
+        return;
+    }
+    journal->index = fopen(index_filename, "w+b");
+    if (journal->index == NULL) {
+        mpack_journal_writer_flag_error(journal, mpack_error_io);
+        return;
+    }
+
+    char header[MPACK_JOURNAL_HEADER_SIZE];
+    mpack_journal_store_header(header, interval);
+    if (!mpack_journal_writer_write(journal, journal->index, header, sizeof(header)))
+        return;
+    journal->interval = interval;
+}
+
+static void mpack_journal_writer_open(mpack_journal_writer_t* journal, const char* filename,
+        const char* index_filename, uint32_t interval)
+{
+    journal->index = fopen(index_filename, "r+b");
+    if (journal->index == NULL) {
+        mpack_journal_writer_create(journal, filename, index_filename, interval);
+        return;
+    }
+
+    char header[MPACK_JOURNAL_HEADER_SIZE];
+    if (!mpack_journal_writer_read(journal, journal->index, header, sizeof(header)))
+        return;
+    if (!mpack_journal_load_header(header, &journal->interval)) {
+        mpack_journal_writer_flag_error(journal, mpack_error_invalid);
+        return;
+    }
+
+    // a partial entry at the end of the index was torn by an interrupted
+    // write; it is ignored and overwritten
+    uint64_t index_size;
+    if (!mpack_journal_writer_file_size(journal, journal->index, &index_size))
+        return;
+    uint64_t blocks = (index_size - MPACK_JOURNAL_HEADER_SIZE) / MPACK_JOURNAL_ENTRY_SIZE;
+
+    // we continue from the last entry. if its block is partial, we keep
+    // appending to it and resume its checksum.
+    if (blocks != 0) {
+        char encoded[MPACK_JOURNAL_ENTRY_SIZE];
+        mpack_journal_entry_t entry;
+        if (!mpack_journal_writer_seek(journal, journal->index,
+                    MPACK_JOURNAL_HEADER_SIZE + (blocks - 1) * MPACK_JOURNAL_ENTRY_SIZE))
+            return;
+        if (!mpack_journal_writer_read(journal, journal->index, encoded, sizeof(encoded)))
+            return;
+        if (!mpack_journal_load_entry(encoded, journal->interval, &entry) ||
+                (blocks == 1 && entry.offset != 0)) {
+            mpack_journal_writer_flag_error(journal, mpack_error_invalid);
+            return;
+        }
+
+        journal->count = (blocks - 1) * journal->interval + entry.count;
+        journal->size = entry.offset + entry.size;
+        if (entry.count == journal->interval) {
+            journal->block = blocks;
+            journal->block_offset = journal->size;
+            journal->block_crc = MPACK_JOURNAL_CRC_INIT;
+        } else {
+            journal->block = blocks - 1;
+            journal->block_offset = entry.offset;
+            journal->block_count = entry.count;
+            journal->block_crc = entry.crc ^ MPACK_JOURNAL_CRC_INIT;
+        }
+    }
+
+    // anything in the log past the indexed records is overwritten
+    journal->log = fopen(filename, "r+b");
+    if (journal->log == NULL) {
+        mpack_journal_writer_flag_error(journal, mpack_error_io);
+        return;
+    }
+    uint64_t log_size;
+    if (!mpack_journal_writer_file_size(journal, journal->log, &log_size))
+        return;
+    if (log_size < journal->size) {
+        mpack_journal_writer_flag_error(journal, mpack_error_invalid);
+        return;
+    }
+    mpack_journal_writer_seek(journal, journal->log, journal->size);
+}
+
+void mpack_journal_writer_init(mpack_journal_writer_t* journal, const char* filename, uint32_t interval) {
+    mpack_assert(filename != NULL, "filename is NULL");
+    mpack_memset(journal, 0, sizeof(*journal));
+    journal->block_crc = MPACK_JOURNAL_CRC_INIT;
+
+    size_t capacity = MPACK_BUFFER_SIZE;
+    char* buffer = (char*)MPACK_MALLOC(capacity);
+    if (buffer == NULL) {
+        mpack_writer_init_error(&journal->writer, mpack_error_memory);
+        journal->error = mpack_error_memory;
+        return;
+    }
+
+    mpack_writer_init(&journal->writer, buffer, capacity);
+    mpack_writer_set_context(&journal->writer, journal);
+    mpack_writer_set_flush(&journal->writer, mpack_journal_writer_flush_record);
+    mpack_writer_set_teardown(&journal->writer, mpack_journal_writer_teardown_record);
+
+    if (interval == 0) {
+        mpack_break("interval cannot be zero!");
+        mpack_journal_writer_flag_error(journal, mpack_error_bug);
+        return;
+    }
+
+    char* index_filename = mpack_journal_index_filename(filename);
+    if (index_filename == NULL) {
+        mpack_journal_writer_flag_error(journal, mpack_error_memory);
+        return;
+    }
+    mpack_journal_writer_open(journal, filename, index_filename, interval);
+    MPACK_FREE(index_filename);
+}
+
+mpack_writer_t* mpack_journal_start(mpack_journal_writer_t* journal) {
+    if (journal->error == mpack_ok) {
+        if (journal->recording) {
+            mpack_break("a record is already in progress!");
+            mpack_journal_writer_flag_error(journal, mpack_error_bug);
+        } else {
+            journal->recording = true;
+            journal->record_size = 0;
+        }
+    }
+    return &journal->writer;
+}
+
+void mpack_journal_finish(mpack_journal_writer_t* journal) {
+    if (journal->error != mpack_ok)
+        return;
+    if (!journal->recording) {
+        mpack_break("no record is in progress!");
+        mpack_journal_writer_flag_error(journal, mpack_error_bug);
+        return;
+    }
+    journal->recording = false;
+
+    mpack_writer_t* writer = &journal->writer;
+    #if MPACK_WRITE_TRACKING
+    if (writer->error == mpack_ok)
+        mpack_writer_flag_error(writer, mpack_track_check_empty(&writer->track));
+    #endif
+
+    // the rest of the record is flushed so that the record writer's
+    // buffer is empty between records
+    if (writer->error == mpack_ok && writer->used != 0) {
+        mpack_journal_writer_flush_record(writer, writer->buffer, writer->used);
+        writer->used = 0;
+    }
+
+    if (writer->error != mpack_ok) {
+        mpack_journal_writer_flag_error(journal, writer->error);
+        return;
+    }
+    if (journal->record_size == 0) {
+        mpack_break("no object was written to the record!");
+        mpack_journal_writer_flag_error(journal, mpack_error_bug);
+        return;
+    }
+
+    ++journal->count;
+    journal->size += journal->record_size;
+    if (++journal->block_count == journal->interval)
+        mpack_journal_writer_end_block(journal);
+}
+
+void mpack_journal_append(mpack_journal_writer_t* journal, const char* data, size_t count) {
+    mpack_write_object_bytes(mpack_journal_start(journal), data, count);
+    mpack_journal_finish(journal);
+}
+
+void mpack_journal_flush(mpack_journal_writer_t* journal) {
+    if (journal->error != mpack_ok)
+        return;
+    mpack_journal_writer_write_index(journal, true);
+    if (journal->error == mpack_ok && fflush(journal->index) != 0)
+        mpack_journal_writer_flag_error(journal, mpack_error_io);
+}
+
+mpack_error_t mpack_journal_writer_destroy(mpack_journal_writer_t* journal) {
+    if (journal->error == mpack_ok && journal->recording) {
+        mpack_break("a record is still in progress!");
+        mpack_journal_writer_flag_error(journal, mpack_error_bug);
+    }
+
+    mpack_journal_flush(journal);
+
+    // the record writer's buffer is empty between records, so this only
+    // frees it
+    mpack_error_t error = mpack_writer_destroy(&journal->writer);
+    if (error != mpack_ok)
+        mpack_journal_writer_flag_error(journal, error);
+
+    if (journal->log != NULL) {
+        if (fclose(journal->log) != 0)
+            mpack_journal_writer_flag_error(journal, mpack_error_io);
+        journal->log = NULL;
+    }
+    if (journal->index != NULL) {
+        if (fclose(journal->index) != 0)
+            mpack_journal_writer_flag_error(journal, mpack_error_io);
+        journal->index = NULL;
+    }
+
+    return journal->error;
+}
+
+
+
+// Journal Reader
+
+#if MPACK_MMAP
+
+void mpack_journal_flag_error(mpack_journal_t* journal, mpack_error_t error) {
+    mpack_log("journal %p setting error %i: %s\n", journal, (int)error, mpack_error_to_string(error));
+
+    if (journal->error == mpack_ok)
+        journal->error = error;
+}
+
+// Loads and checks the entry of the given block. Entries are checked as
+// they are used rather than when the journal is opened. Each is checked
+// against its predecessor so that the blocks are contiguous.
+static bool mpack_journal_load_block(mpack_journal_t* journal, uint64_t block, mpack_journal_entry_t* entry) {
+    mpack_assert(block < journal->blocks, "block %" PRIu64 " is out of range", block);
+    const char* p = journal->index + MPACK_JOURNAL_HEADER_SIZE + block * MPACK_JOURNAL_ENTRY_SIZE;
+
+    bool ok = mpack_journal_load_entry(p, journal->interval, entry) &&
+        entry->offset + entry->size <= (uint64_t)journal->log_size &&
+        (block == journal->blocks - 1 || entry->count == journal->interval);
+
+    if (ok) {
+        if (block == 0) {
+            ok = entry->offset == 0;
+        } else {
+            mpack_journal_entry_t previous;
+            ok = mpack_journal_load_entry(p - MPACK_JOURNAL_ENTRY_SIZE, journal->interval, &previous) &&
+                previous.offset + previous.size == entry->offset;
+        }
+    }
+
+    if (!ok)
+        mpack_journal_flag_error(journal, mpack_error_invalid);
+    return ok;
+}
+
+static bool mpack_journal_enter_block(mpack_journal_t* journal, uint64_t block) {
+    mpack_journal_entry_t entry;
+    if (!mpack_journal_load_block(journal, block, &entry))
+        return false;
+
+    journal->record = block * journal->interval;
+    journal->offset = (size_t)entry.offset;
+    journal->block_end = (size_t)(entry.offset + entry.size);
+    journal->block_left = entry.count;
+
+    if (journal->verify && journal->verified != block + 1) {
+        uint32_t crc = mpack_journal_crc(MPACK_JOURNAL_CRC_INIT,
+                journal->log + journal->offset, (size_t)entry.size) ^ MPACK_JOURNAL_CRC_INIT;
+        if (crc != entry.crc) {
+            mpack_journal_flag_error(journal, mpack_error_invalid);
+            return false;
+        }
+        journal->verified = block + 1;
+    }
+
+    return true;
+}
+
+// Prepares the cursor to read a record, entering the next block if the
+// current one is exhausted. Returns false at the end of the journal.
+static bool mpack_journal_prepare(mpack_journal_t* journal) {
+    if (journal->error != mpack_ok || journal->record == journal->count)
+        return false;
+    if (journal->block_left == 0)
+        return mpack_journal_enter_block(journal, journal->record / journal->interval);
+    return true;
+}
+
+// Returns the size of the record at the cursor, or zero if it is corrupt.
+// The last record of a block is the remainder of it; other records are
+// parsed to find their size.
+static size_t mpack_journal_measure(mpack_journal_t* journal) {
+    size_t left = journal->block_end - journal->offset;
+    if (left == 0) {
+        mpack_journal_flag_error(journal, mpack_error_invalid);
+        return 0;
+    }
+    if (journal->block_left == 1)
+        return left;
+
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, journal->log + journal->offset, left);
+    mpack_parse_events(&reader, &mpack_journal_skip_visitor, NULL);
+    size_t remaining = mpack_reader_remaining(&reader, NULL);
+    mpack_error_t error = mpack_reader_destroy(&reader);
+    if (error == mpack_ok && remaining == 0)
+        error = mpack_error_invalid;
+    if (error != mpack_ok) {
+        mpack_journal_flag_error(journal, error);
+        return 0;
+    }
+    return left - remaining;
+}
+
+static void mpack_journal_advance(mpack_journal_t* journal, size_t size) {
+    journal->offset += size;
+    ++journal->record;
+    --journal->block_left;
+}
+
+void mpack_journal_init(mpack_journal_t* journal, const char* filename, bool verify) {
+    mpack_assert(filename != NULL, "filename is NULL");
+    mpack_memset(journal, 0, sizeof(*journal));
+    journal->verify = verify;
+
+    mpack_error_t error = mpack_mmap_file(filename, &journal->log, &journal->log_size);
+    if (error != mpack_ok) {
+        mpack_journal_flag_error(journal, error);
+        return;
+    }
+
+    char* index_filename = mpack_journal_index_filename(filename);
+    if (index_filename == NULL) {
+        mpack_journal_flag_error(journal, mpack_error_memory);
+        return;
+    }
+    error = mpack_mmap_file(index_filename, &journal->index, &journal->index_size);
+    MPACK_FREE(index_filename);
+    if (error != mpack_ok) {
+        mpack_journal_flag_error(journal, error);
+        return;
+    }
+
+    if (journal->index_size < MPACK_JOURNAL_HEADER_SIZE ||
+            !mpack_journal_load_header(journal->index, &journal->interval))
+    {
+        mpack_journal_flag_error(journal, mpack_error_invalid);
+        return;
+    }
+
+    // the last entry gives the record count and the end of the records
+    journal->blocks = (journal->index_size - MPACK_JOURNAL_HEADER_SIZE) / MPACK_JOURNAL_ENTRY_SIZE;
+    if (journal->blocks != 0) {
+        mpack_journal_entry_t entry;
+        if (!mpack_journal_load_block(journal, journal->blocks - 1, &entry))
+            return;
+        journal->count = (journal->blocks - 1) * journal->interval + entry.count;
+        journal->end = (size_t)(entry.offset + entry.size);
+    }
+}
+
+void mpack_journal_seek(mpack_journal_t* journal, uint64_t record) {
+    if (journal->error != mpack_ok)
+        return;
+
+    if (record > journal->count) {
+        mpack_journal_flag_error(journal, mpack_error_data);
+        return;
+    }
+    if (record == journal->count) {
+        journal->record = record;
+        journal->offset = journal->end;
+        journal->block_left = 0;
+        return;
+    }
+
+    if (!mpack_journal_enter_block(journal, record / journal->interval))
+        return;
+    while (journal->record < record) {
+        size_t size = mpack_journal_measure(journal);
+        if (size == 0)
+            return;
+        mpack_journal_advance(journal, size);
+    }
+}
+
+const char* mpack_journal_next(mpack_journal_t* journal, size_t* size) {
+    *size = 0;
+    if (!mpack_journal_prepare(journal))
+        return NULL;
+
+    size_t record_size = mpack_journal_measure(journal);
+    if (record_size == 0)
+        return NULL;
+
+    const char* data = journal->log + journal->offset;
+    mpack_journal_advance(journal, record_size);
+    *size = record_size;
+    return data;
+}
+
+#if MPACK_NODE && defined(MPACK_MALLOC)
+void mpack_journal_next_tree(mpack_journal_t* journal, mpack_tree_t* tree) {
+    if (!mpack_journal_prepare(journal)) {
+        mpack_tree_init_error(tree, journal->error != mpack_ok ? journal->error : mpack_error_data);
+        return;
+    }
+
+    // the tree ignores the data past the record, so it is parsed only once
+    size_t left = journal->block_end - journal->offset;
+    mpack_tree_init(tree, journal->log + journal->offset, left);
+    if (mpack_tree_error(tree) != mpack_ok) {
+        mpack_journal_flag_error(journal, mpack_tree_error(tree));
+        return;
+    }
+
+    size_t size = mpack_tree_size(tree);
+    if (journal->block_left == 1 && size != left) {
+        mpack_tree_flag_error(tree, mpack_error_invalid);
+        mpack_journal_flag_error(journal, mpack_error_invalid);
+        return;
+    }
+    mpack_journal_advance(journal, size);
+}
+#endif
+
+mpack_error_t mpack_journal_destroy(mpack_journal_t* journal) {
+    if (journal->log != NULL) {
+        if (!mpack_munmap_file(journal->log, journal->log_size))
+            mpack_journal_flag_error(journal, mpack_error_io);
+        journal->log = NULL;
+    }
+    if (journal->index != NULL) {
+        if (!mpack_munmap_file(journal->index, journal->index_size))
+            mpack_journal_flag_error(journal, mpack_error_io);
+        journal->index = NULL;
+    }
+    return journal->error;
+}
+
+#endif
+
+
+
+// Array Index
+
+// The array index header is the array ["mpack-array-index", 1, interval,
+// count, size] with the interval encoded as a uint32 and the count and
+// file size as uint64s. This is the encoding up to the interval.
+static const char mpack_array_index_magic[] = "\x95\xb1" "mpack-array-index" "\x01\xce";
+
+#define MPACK_ARRAY_INDEX_MAGIC_SIZE (sizeof(mpack_array_index_magic) - 1)
+
+static mpack_error_t mpack_array_index_file_size(const char* filename, uint64_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+        return mpack_error_io;
+    mpack_error_t error = mpack_file_size(file, size);
+    if (fclose(file) != 0 && error == mpack_ok)
+        error = mpack_error_io;
+    return error;
+}
+
+// Reads the array from the reader, writing the header and an entry for
+// every interval'th element to the writer
+static void mpack_array_index_write(mpack_reader_t* reader, mpack_writer_t* writer,
+        uint32_t interval, uint64_t size)
+{
+    mpack_tag_t tag = mpack_read_tag(reader);
+    if (mpack_reader_error(reader) != mpack_ok)
+        return;
+    if (tag.type != mpack_type_array) {
+        mpack_reader_flag_error(reader, mpack_error_type);
+        return;
+    }
+
+    char header[MPACK_ARRAY_INDEX_HEADER_SIZE];
+    mpack_memcpy(header, mpack_array_index_magic, MPACK_ARRAY_INDEX_MAGIC_SIZE);
+    mpack_store_u32(header + MPACK_ARRAY_INDEX_MAGIC_SIZE, interval);
+    mpack_store_u8(header + 25, 0xcf);
+    mpack_store_u64(header + 26, tag.v.n);
+    mpack_store_u8(header + 34, 0xcf);
+    mpack_store_u64(header + 35, size);
+    mpack_write_object_bytes(writer, header, sizeof(header));
+
+    char entry[MPACK_ARRAY_INDEX_ENTRY_SIZE];
+    mpack_store_u8(entry, 0xcf);
+    for (uint32_t i = 0; i < tag.v.n && mpack_reader_error(reader) == mpack_ok; ++i) {
+
+        // the array hasn't been fully read, so a write error is flagged
+        // on the reader as well
+        if (mpack_writer_error(writer) != mpack_ok) {
+            mpack_reader_flag_error(reader, mpack_writer_error(writer));
+            return;
+        }
+
+        if (i % interval == 0) {
+            mpack_store_u64(entry + 1, mpack_reader_error_position(reader));
+            mpack_write_object_bytes(writer, entry, sizeof(entry));
+        }
+        mpack_parse_events(reader, &mpack_journal_skip_visitor, NULL);
+    }
+    mpack_done_array(reader);
+
+    // the array must be the whole file
+    if (mpack_reader_error(reader) == mpack_ok && mpack_reader_error_position(reader) != size)
+        mpack_reader_flag_error(reader, mpack_error_invalid);
+}
+
+mpack_error_t mpack_array_index_build(const char* filename, uint32_t interval) {
+    mpack_assert(filename != NULL, "filename is NULL");
+    if (interval == 0) {
+        mpack_break("interval cannot be zero!");
+        return mpack_error_bug;
+    }
+
+    uint64_t size = 0;
+    mpack_error_t error = mpack_array_index_file_size(filename, &size);
+    if (error != mpack_ok)
+        return error;
+
+    char* index_filename = mpack_journal_index_filename(filename);
+    if (index_filename == NULL)
+        return mpack_error_memory;
+
+    mpack_reader_t reader;
+    mpack_reader_init_file(&reader, filename);
+    mpack_writer_t writer;
+    mpack_writer_init_file(&writer, index_filename);
+
+    if (mpack_reader_error(&reader) == mpack_ok && mpack_writer_error(&writer) == mpack_ok)
+        mpack_array_index_write(&reader, &writer, interval, size);
+
+    error = mpack_reader_destroy(&reader);
+    mpack_error_t write_error = mpack_writer_destroy(&writer);
+    if (error == mpack_ok)
+        error = write_error;
+
+    // an incomplete index is never left behind
+    if (error != mpack_ok)
+        remove(index_filename);
+    MPACK_FREE(index_filename);
+    return error;
+}
+
+#if MPACK_MMAP
+
+void mpack_array_index_flag_error(mpack_array_index_t* index, mpack_error_t error) {
+    mpack_log("array index %p setting error %i: %s\n", index, (int)error, mpack_error_to_string(error));
+
+    if (index->error == mpack_ok)
+        index->error = error;
+}
+
+void mpack_array_index_init(mpack_array_index_t* index, const char* filename) {
+    mpack_assert(filename != NULL, "filename is NULL");
+    mpack_memset(index, 0, sizeof(*index));
+
+    mpack_error_t error = mpack_mmap_file(filename, &index->data, &index->size);
+    if (error != mpack_ok) {
+        mpack_array_index_flag_error(index, error);
+        return;
+    }
+
+    char* index_filename = mpack_journal_index_filename(filename);
+    if (index_filename == NULL) {
+        mpack_array_index_flag_error(index, mpack_error_memory);
+        return;
+    }
+    error = mpack_mmap_file(index_filename, &index->index, &index->index_size);
+    MPACK_FREE(index_filename);
+    if (error != mpack_ok) {
+        mpack_array_index_flag_error(index, error);
+        return;
+    }
+
+    const char* p = index->index;
+    if (index->index_size < MPACK_ARRAY_INDEX_HEADER_SIZE ||
+            mpack_memcmp(p, mpack_array_index_magic, MPACK_ARRAY_INDEX_MAGIC_SIZE) != 0 ||
+            mpack_load_u8(p + 25) != 0xcf || mpack_load_u8(p + 34) != 0xcf)
+    {
+        mpack_array_index_flag_error(index, mpack_error_invalid);
+        return;
+    }
+    index->interval = mpack_load_u32(p + MPACK_ARRAY_INDEX_MAGIC_SIZE);
+    index->count = mpack_load_u64(p + 26);
+
+    // the index must have exactly one entry per interval and must match
+    // the size of the file. each element is at least one byte.
+    if (index->interval == 0 || index->count > (uint64_t)index->size ||
+            mpack_load_u64(p + 35) != (uint64_t)index->size)
+    {
+        mpack_array_index_flag_error(index, mpack_error_invalid);
+        return;
+    }
+    index->entries = (index->count + index->interval - 1) / index->interval;
+    if ((index->index_size - MPACK_ARRAY_INDEX_HEADER_SIZE) / MPACK_ARRAY_INDEX_ENTRY_SIZE != index->entries ||
+            (index->index_size - MPACK_ARRAY_INDEX_HEADER_SIZE) % MPACK_ARRAY_INDEX_ENTRY_SIZE != 0)
+    {
+        mpack_array_index_flag_error(index, mpack_error_invalid);
+        return;
+    }
+}
+
+static bool mpack_array_index_load_offset(mpack_array_index_t* index, uint64_t entry, size_t* offset) {
+    if (entry == index->entries) {
+        *offset = index->size;
+        return true;
+    }
+    const char* p = index->index + MPACK_ARRAY_INDEX_HEADER_SIZE + entry * MPACK_ARRAY_INDEX_ENTRY_SIZE;
+    if (mpack_load_u8(p) != 0xcf)
+        return false;
+    uint64_t value = mpack_load_u64(p + 1);
+    if (value > (uint64_t)index->size)
+        return false;
+    *offset = (size_t)value;
+    return true;
+}
+
+// Finds the start of the given element and the end of its block, which
+// is the end of the element if it is the last of its block. Entries are
+// checked as they are used.
+static bool mpack_array_index_locate(mpack_array_index_t* index, uint64_t element,
+        size_t* start, size_t* end, bool* last)
+{
+    if (index->error != mpack_ok)
+        return false;
+    if (element >= index->count) {
+        mpack_array_index_flag_error(index, mpack_error_data);
+        return false;
+    }
+
+    uint64_t entry = element / index->interval;
+    uint64_t skip = element % index->interval;
+    if (!mpack_array_index_load_offset(index, entry, start) ||
+            !mpack_array_index_load_offset(index, entry + 1, end) ||
+            *start >= *end || (entry == 0 && *start == 0))
+    {
+        mpack_array_index_flag_error(index, mpack_error_invalid);
+        return false;
+    }
+    *last = (element + 1 == index->count) || (skip + 1 == index->interval);
+
+    if (skip != 0) {
+        mpack_reader_t reader;
+        mpack_reader_init_data(&reader, index->data + *start, *end - *start);
+        for (uint64_t i = 0; i < skip && mpack_reader_error(&reader) == mpack_ok; ++i)
+            mpack_parse_events(&reader, &mpack_journal_skip_visitor, NULL);
+        size_t remaining = mpack_reader_remaining(&reader, NULL);
+        mpack_error_t error = mpack_reader_destroy(&reader);
+        if (error == mpack_ok && remaining == 0)
+            error = mpack_error_invalid;
+        if (error != mpack_ok) {
+            mpack_array_index_flag_error(index, error);
+            return false;
+        }
+        *start = *end - remaining;
+    }
+
+    return true;
+}
+
+const char* mpack_array_index_element(mpack_array_index_t* index, uint64_t element, size_t* size) {
+    *size = 0;
+    size_t start, end;
+    bool last;
+    if (!mpack_array_index_locate(index, element, &start, &end, &last))
+        return NULL;
+
+    if (!last) {
+        mpack_reader_t reader;
+        mpack_reader_init_data(&reader, index->data + start, end - start);
+        mpack_parse_events(&reader, &mpack_journal_skip_visitor, NULL);
+        size_t remaining = mpack_reader_remaining(&reader, NULL);
+        mpack_error_t error = mpack_reader_destroy(&reader);
+        if (error != mpack_ok) {
+            mpack_array_index_flag_error(index, error);
+            return NULL;
+        }
+        end -= remaining;
+    }
+
+    *size = end - start;
+    return index->data + start;
+}
+
+#if MPACK_NODE && defined(MPACK_MALLOC)
+void mpack_tree_init_element(mpack_tree_t* tree, mpack_array_index_t* index, uint64_t element) {
+    size_t start, end;
+    bool last;
+    if (!mpack_array_index_locate(index, element, &start, &end, &last)) {
+        mpack_tree_init_error(tree, index->error);
+        return;
+    }
+
+    // the tree ignores the data past the element, so it is parsed only once
+    mpack_tree_init(tree, index->data + start, end - start);
+    if (mpack_tree_error(tree) != mpack_ok) {
+        mpack_array_index_flag_error(index, mpack_tree_error(tree));
+        return;
+    }
+    if (last && mpack_tree_size(tree) != end - start) {
+        mpack_tree_flag_error(tree, mpack_error_invalid);
+        mpack_array_index_flag_error(index, mpack_error_invalid);
+    }
+}
+#endif
+
+mpack_error_t mpack_array_index_destroy(mpack_array_index_t* index) {
+    if (index->data != NULL) {
+        if (!mpack_munmap_file(index->data, index->size))
+            mpack_array_index_flag_error(index, mpack_error_io);
+        index->data = NULL;
+    }
+    if (index->index != NULL) {
+        if (!mpack_munmap_file(index->index, index->index_size))
+            mpack_array_index_flag_error(index, mpack_error_io);
+        index->index = NULL;
+    }
+    return index->error;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ *
+ * Declares the MPack journal, an append-only log of MessagePack records,
+ * and the array index, which gives random access to the elements of a
+ * large array file.
+ */
+
+#ifndef MPACK_JOURNAL_H
+#define MPACK_JOURNAL_H 1
+
+#include "mpack-reader.h"
+#include "mpack-writer.h"
+#include "mpack-node.h"
+
+MPACK_HEADER_START
+
+#if MPACK_JOURNAL
+
+#if !MPACK_READER || !MPACK_WRITER
+#error "MPACK_JOURNAL requires MPACK_READER and MPACK_WRITER."
+#endif
+
+/**
+ * @defgroup journal Journal
+ *
+ * A journal is an append-only log of MessagePack records with an index
+ * for random access.
+ *
+ * The log is a file of concatenated MessagePack objects, one per record,
+ * so it can be read by anything that reads a MessagePack stream. Next to
+ * it is an index file with the same name plus ".idx". The records are
+ * grouped into blocks of a fixed number of records (the interval), and
+ * the index holds one fixed-size entry per block with the offset and
+ * size of the block in the log, its record count and a CRC-32C checksum
+ * of its data. The index is itself MessagePack: a header array followed
+ * by one array per entry, each encoded with fixed-width types.
+ *
+ * Records are appended with a @ref mpack_journal_writer_t. The index
+ * only ever covers data that has been flushed to the log, so a journal
+ * that is interrupted while appending loses at most the records since
+ * it was last flushed.
+ *
+ * A @ref mpack_journal_t maps both files into memory. It finds the block
+ * of any record in constant time, and parses at most one block's worth of
+ * records to reach it. Records are returned in place in the mapping, so
+ * they can be parsed into trees without copying.
+ *
+ * The journal writer is available when MPACK_STDIO is enabled, and the
+ * journal reader when MPACK_MMAP is enabled.
+ *
+ * @{
+ */
+
+/**
+ * The default number of records per block of a new journal.
+ */
+#ifndef MPACK_JOURNAL_DEFAULT_INTERVAL
+#define MPACK_JOURNAL_DEFAULT_INTERVAL 64
+#endif
+
+/** @cond */
+
+// the encoded size of the index header: ["mpack-journal", version, interval]
+#define MPACK_JOURNAL_HEADER_SIZE 21
+
+// the encoded size of an index entry: [offset, size, count, checksum]
+#define MPACK_JOURNAL_ENTRY_SIZE 29
+
+#ifndef MPACK_JOURNAL_PENDING_ENTRIES
+// the number of complete index entries a journal writer buffers before
+// flushing the log and writing them to the index
+#define MPACK_JOURNAL_PENDING_ENTRIES 64
+#endif
+
+/** @endcond */
+
+#if MPACK_STDIO
+
+/**
+ * @name Appending Records
+ * @{
+ */
+
+/**
+ * A journal writer appends records to a journal.
+ *
+ * @see mpack_journal_writer_init()
+ */
+typedef struct mpack_journal_writer_t mpack_journal_writer_t;
+
+/* Hide internals from documentation */
+/** @cond */
+
+struct mpack_journal_writer_t {
+    mpack_writer_t writer;    /* Writer of the record being appended */
+    FILE* log;                /* The log file */
+    FILE* index;              /* The index file */
+    uint32_t interval;        /* Records per block */
+    uint64_t count;           /* Records in the journal */
+    uint64_t size;            /* Bytes of records in the log */
+    uint64_t block;           /* Number of the current block */
+    uint64_t block_offset;    /* Offset of the current block in the log */
+    uint32_t block_count;     /* Records in the current block */
+    uint32_t block_crc;       /* Running checksum of the current block */
+    uint64_t record_size;     /* Bytes of the record being appended */
+    bool recording;           /* Whether a record is being appended */
+    mpack_error_t error;      /* Error state */
+
+    // Entries of complete blocks that have not been written to the
+    // index, starting with block number (block - pending)
+    size_t pending;
+    char entries[MPACK_JOURNAL_PENDING_ENTRIES * MPACK_JOURNAL_ENTRY_SIZE];
+};
+
+/** @endcond */
+
+/**
+ * Opens the journal with the given log filename for appending, creating
+ * it if it doesn't exist.
+ *
+ * The index filename is the log filename plus ".idx". A new journal
+ * groups records into blocks of the given interval, so the index has one
+ * entry per interval records. An existing journal keeps the interval it
+ * was created with.
+ *
+ * If the log has data past the end of its last indexed record (for
+ * example if a process appending to it was interrupted), that data is
+ * overwritten by new records.
+ *
+ * The journal writer must be destroyed with mpack_journal_writer_destroy(),
+ * even if opening fails.
+ *
+ * @throws mpack_error_io if a file cannot be opened or read
+ * @throws mpack_error_invalid if the index is corrupt, or if the log
+ *     exists and is not empty but the index does not
+ * @throws mpack_error_memory if allocation fails
+ *
+ * @param journal The journal writer to initialize
+ * @param filename The filename of the log
+ * @param interval The number of records per block of a new journal. It
+ *     must not be zero.
+ */
+void mpack_journal_writer_init(mpack_journal_writer_t* journal, const char* filename, uint32_t interval);
+
+/**
+ * Starts appending a record, returning a writer to which exactly one
+ * MessagePack object must be written. Call mpack_journal_finish() once
+ * the object is complete.
+ *
+ * The writer flushes the record to the log as its buffer fills. Don't
+ * destroy it or change its callbacks. Errors flagged on it are flagged on
+ * the journal writer when the record is finished.
+ */
+mpack_writer_t* mpack_journal_start(mpack_journal_writer_t* journal);
+
+/**
+ * Finishes appending the record started with mpack_journal_start().
+ */
+void mpack_journal_finish(mpack_journal_writer_t* journal);
+
+/**
+ * Appends a record that is already encoded. The data must contain exactly
+ * one MessagePack object.
+ */
+void mpack_journal_append(mpack_journal_writer_t* journal, const char* data, size_t count);
+
+/**
+ * Flushes the appended records to the log, then writes the index entries
+ * that cover them.
+ *
+ * This writes the data to the operating system with fflush(). It does
+ * not sync it to storage.
+ */
+void mpack_journal_flush(mpack_journal_writer_t* journal);
+
+/**
+ * Returns the number of records in the journal, including those appended
+ * but not yet flushed.
+ */
+MPACK_INLINE uint64_t mpack_journal_writer_count(mpack_journal_writer_t* journal) {
+    return journal->count;
+}
+
+/**
+ * Returns the error state of the journal writer.
+ */
+MPACK_INLINE mpack_error_t mpack_journal_writer_error(mpack_journal_writer_t* journal) {
+    return journal->error;
+}
+
+/**
+ * Places the journal writer in the given error state. Nothing more is
+ * appended and nothing more is flushed.
+ */
+void mpack_journal_writer_flag_error(mpack_journal_writer_t* journal, mpack_error_t error);
+
+/**
+ * Flushes the journal writer and closes its files. Returns the final
+ * error state of the journal writer.
+ *
+ * A record must not be in progress unless the journal writer is in an
+ * error state.
+ */
+mpack_error_t mpack_journal_writer_destroy(mpack_journal_writer_t* journal);
+
+/**
+ * @}
+ */
+
+#endif
+
+#if MPACK_MMAP
+
+/**
+ * @name Reading Records
+ * @{
+ */
+
+/**
+ * A journal maps a journal's log and index for reading.
+ *
+ * @see mpack_journal_init()
+ */
+typedef struct mpack_journal_t mpack_journal_t;
+
+/* Hide internals from documentation */
+/** @cond */
+
+struct mpack_journal_t {
+    char* log;             /* Mapping of the log */
+    size_t log_size;       /* Size of the log mapping */
+    char* index;           /* Mapping of the index */
+    size_t index_size;     /* Size of the index mapping */
+    uint32_t interval;     /* Records per block */
+    uint64_t blocks;       /* Entries in the index */
+    uint64_t count;        /* Records in the journal */
+    size_t end;            /* End of the last indexed record in the log */
+    bool verify;           /* Whether to check the checksum of each block */
+    uint64_t verified;     /* One plus the last verified block, or zero */
+    mpack_error_t error;   /* Error state */
+
+    // The cursor
+    uint64_t record;       /* Number of the next record */
+    size_t offset;         /* Offset of the next record */
+    size_t block_end;      /* End of the block of the next record */
+    uint32_t block_left;   /* Records left in the block, including the next */
+};
+
+/** @endcond */
+
+/**
+ * Opens the journal with the given log filename for reading, mapping its
+ * log and index into memory. The index filename is the log filename plus
+ * ".idx".
+ *
+ * The journal contains the records that had been flushed when it was
+ * opened. Opening it takes constant time: the index is not read in full,
+ * and entries are checked for consistency as they are used.
+ *
+ * If verify is true, the checksum of each block is checked the first time
+ * a record in it is read. Sequential reads check each block once; random
+ * reads may check a block each time they enter it.
+ *
+ * The journal must be destroyed with mpack_journal_destroy(), even if
+ * opening fails.
+ *
+ * @throws mpack_error_io if a file cannot be opened or mapped
+ * @throws mpack_error_invalid if the index is corrupt or does not match
+ *     the log
+ * @throws mpack_error_memory if allocation fails
+ *
+ * @param journal The journal to initialize
+ * @param filename The filename of the log
+ * @param verify Whether to check the checksums of blocks as they are read
+ */
+void mpack_journal_init(mpack_journal_t* journal, const char* filename, bool verify);
+
+/**
+ * Returns the number of records in the journal.
+ */
+MPACK_INLINE uint64_t mpack_journal_count(mpack_journal_t* journal) {
+    return journal->count;
+}
+
+/**
+ * Moves the cursor to the record with the given number, counting from
+ * zero, so that it is the next record read. A number equal to the record
+ * count moves the cursor to the end of the journal.
+ *
+ * This finds the record's block in constant time, then skips the records
+ * before it in the block.
+ *
+ * @throws mpack_error_data if the number is past the end of the journal
+ * @throws mpack_error_invalid if the index or the data is corrupt
+ */
+void mpack_journal_seek(mpack_journal_t* journal, uint64_t record);
+
+/**
+ * Returns the record at the cursor in place in the mapping and moves the
+ * cursor past it, or returns NULL at the end of the journal or if an
+ * error occurs.
+ *
+ * The data is valid until the journal is destroyed.
+ *
+ * @param journal The journal
+ * @param size [out] The size of the record, or zero if none is returned
+ */
+const char* mpack_journal_next(mpack_journal_t* journal, size_t* size);
+
+#if MPACK_NODE && defined(MPACK_MALLOC)
+/**
+ * Parses the record at the cursor into the given tree and moves the
+ * cursor past it.
+ *
+ * The tree references the data of the record in place in the mapping,
+ * so it must be destroyed before the journal. The record is only parsed
+ * once; this is faster than parsing the data returned by
+ * mpack_journal_next(), which may need to parse the record to find its
+ * size.
+ *
+ * The tree must be destroyed with mpack_tree_destroy(), even if parsing
+ * fails. At the end of the journal, the tree is placed in the
+ * mpack_error_data error state. If the journal is in an error state, the
+ * tree is placed in the same state.
+ */
+void mpack_journal_next_tree(mpack_journal_t* journal, mpack_tree_t* tree);
+#endif
+
+/**
+ * Returns the error state of the journal.
+ */
+MPACK_INLINE mpack_error_t mpack_journal_error(mpack_journal_t* journal) {
+    return journal->error;
+}
+
+/**
+ * Places the journal in the given error state. No more records are
+ * returned.
+ */
+void mpack_journal_flag_error(mpack_journal_t* journal, mpack_error_t error);
+
+/**
+ * Unmaps the journal's files. Returns the final error state of the
+ * journal.
+ */
+mpack_error_t mpack_journal_destroy(mpack_journal_t* journal);
+
+/**
+ * @}
+ */
+
+#endif
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup array_index Array Index
+ *
+ * An array index gives random access to the elements of a file that
+ * contains a single large array, such as a snapshot of many records.
+ *
+ * The index is built in one pass over the file and stored next to it
+ * in a file with the same name plus ".idx". It holds the offset of every
+ * interval'th element, so an element is found with one index lookup and
+ * by skipping fewer than interval elements. The index records the size
+ * of the file, so an index that is stale because the file was replaced
+ * is detected when it is opened.
+ *
+ * Building an index is available when MPACK_STDIO is enabled, and
+ * reading elements when MPACK_MMAP is enabled.
+ *
+ * @{
+ */
+
+/** @cond */
+
+// the encoded size of the array index header:
+// ["mpack-array-index", version, interval, count, file size]
+#define MPACK_ARRAY_INDEX_HEADER_SIZE 43
+
+// the encoded size of an array index entry, a uint64 offset
+#define MPACK_ARRAY_INDEX_ENTRY_SIZE 9
+
+/** @endcond */
+
+#if MPACK_STDIO
+/**
+ * Builds the index of the array in the given file and writes it to the
+ * file's name plus ".idx", replacing any existing index.
+ *
+ * The file is read as a stream, so it can be larger than memory. It must
+ * contain exactly one array and nothing else. The index is removed if
+ * building it fails.
+ *
+ * @param filename The filename of the array
+ * @param interval The number of elements per index entry. An interval of
+ *     1 indexes every element. It must not be zero.
+ * @return mpack_ok if the index was written. mpack_error_type if the file
+ *     does not contain an array, mpack_error_invalid if the array is
+ *     invalid or followed by other data, mpack_error_io if the file cannot
+ *     be read (as when it is truncated) or the index cannot be written.
+ */
+mpack_error_t mpack_array_index_build(const char* filename, uint32_t interval);
+#endif
+
+#if MPACK_MMAP
+
+/**
+ * An array index maps an indexed array file and its index for reading.
+ *
+ * @see mpack_array_index_init()
+ */
+typedef struct mpack_array_index_t mpack_array_index_t;
+
+/* Hide internals from documentation */
+/** @cond */
+
+struct mpack_array_index_t {
+    char* data;            /* Mapping of the array file */
+    size_t size;           /* Size of the array file mapping */
+    char* index;           /* Mapping of the index */
+    size_t index_size;     /* Size of the index mapping */
+    uint32_t interval;     /* Elements per entry */
+    uint64_t count;        /* Elements in the array */
+    uint64_t entries;      /* Entries in the index */
+    mpack_error_t error;   /* Error state */
+};
+
+/** @endcond */
+
+/**
+ * Opens the array file with the given filename and its index for
+ * reading, mapping both into memory. The index must have been built with
+ * mpack_array_index_build().
+ *
+ * Opening takes constant time. Index entries are checked for consistency
+ * as they are used.
+ *
+ * The array index must be destroyed with mpack_array_index_destroy(),
+ * even if opening fails.
+ *
+ * @throws mpack_error_io if a file cannot be opened or mapped
+ * @throws mpack_error_invalid if the index is corrupt or does not match
+ *     the file
+ * @throws mpack_error_memory if allocation fails
+ */
+void mpack_array_index_init(mpack_array_index_t* index, const char* filename);
+
+/**
+ * Returns the number of elements in the array.
+ */
+MPACK_INLINE uint64_t mpack_array_index_count(mpack_array_index_t* index) {
+    return index->count;
+}
+
+/**
+ * Returns the element at the given index in place in the mapping, or NULL
+ * if an error occurs. The data is valid until the array index is
+ * destroyed.
+ *
+ * @throws mpack_error_data if the element index is out of range
+ * @throws mpack_error_invalid if the index or the data is corrupt
+ *
+ * @param index The array index
+ * @param element The index of the element in the array
+ * @param size [out] The size of the element, or zero if none is returned
+ */
+const char* mpack_array_index_element(mpack_array_index_t* index, uint64_t element, size_t* size);
+
+#if MPACK_NODE && defined(MPACK_MALLOC)
+/**
+ * Parses the element at the given index of an indexed array into the
+ * given tree. Only that element is parsed.
+ *
+ * The tree references the data in place in the mapping, so it must be
+ * destroyed before the array index. It must be destroyed with
+ * mpack_tree_destroy(), even if parsing fails. If an error is flagged on
+ * the array index, the tree is placed in the same error state.
+ */
+void mpack_tree_init_element(mpack_tree_t* tree, mpack_array_index_t* index, uint64_t element);
+#endif
+
+/**
+ * Returns the error state of the array index.
+ */
+MPACK_INLINE mpack_error_t mpack_array_index_error(mpack_array_index_t* index) {
+    return index->error;
+}
+
+/**
+ * Places the array index in the given error state. No more elements are
+ * returned.
+ */
+void mpack_array_index_flag_error(mpack_array_index_t* index, mpack_error_t error);
+
+/**
+ * Unmaps the array file and its index. Returns the final error state of
+ * the array index.
+ */
+mpack_error_t mpack_array_index_destroy(mpack_array_index_t* index);
+
+#endif
+
+/**
+ * @}
+ */
+
+#endif
+
+MPACK_HEADER_END
+
+#endif
+
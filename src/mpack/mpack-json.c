@@ -0,0 +1,1751 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MPACK_INTERNAL 1
+
+#include "mpack-json.h"
+
+#if MPACK_JSON
+
+
+// Helpers
+
+void mpack_json_options_init(mpack_json_options_t* options) {
+    mpack_memset(options, 0, sizeof(*options));
+    options->bytes = mpack_json_bytes_base64;
+    options->keys = mpack_json_keys_stringify;
+    options->newline = false;
+    options->floats = true;
+}
+
+MPACK_STATIC_INLINE void mpack_json_write_char(mpack_writer_t* writer, char c) {
+    if (writer->used < writer->size)
+        writer->buffer[writer->used++] = c;
+    else
+        mpack_write_native_straddle(writer, &c, 1);
+}
+
+// Stops reading if writing has failed. The object hasn't been fully
+// read, so the writer's error is flagged on the reader as well.
+MPACK_STATIC_INLINE bool mpack_json_writer_ok(mpack_reader_t* reader, mpack_writer_t* writer) {
+    if (mpack_writer_error(writer) == mpack_ok)
+        return true;
+    mpack_reader_flag_error(reader, mpack_writer_error(writer));
+    return false;
+}
+
+#define MPACK_JSON_WRITE_LITERAL(writer, literal) \
+    mpack_write_native(writer, literal, sizeof(literal) - 1)
+
+
+
+// Numbers
+
+static const char mpack_json_digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Formats the digits of value backwards from end, returning the first
+// digit. Two digits are produced per division.
+static char* mpack_json_format_u64(char* end, uint64_t value) {
+    while (value >= 100) {
+        size_t i = (size_t)(value % 100) * 2;
+        value /= 100;
+        end -= 2;
+        end[0] = mpack_json_digit_pairs[i];
+        end[1] = mpack_json_digit_pairs[i + 1];
+    }
+    if (value >= 10) {
+        size_t i = (size_t)value * 2;
+        end -= 2;
+        end[0] = mpack_json_digit_pairs[i];
+        end[1] = mpack_json_digit_pairs[i + 1];
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+static void mpack_json_write_integer(mpack_writer_t* writer, uint64_t magnitude, bool negative, bool quoted) {
+    char buffer[24]; // quote, sign, 20 digits, quote
+    char* end = buffer + sizeof(buffer);
+    if (quoted)
+        *--end = '"';
+    char* start = mpack_json_format_u64(end, magnitude);
+    if (negative)
+        *--start = '-';
+    if (quoted)
+        *--start = '"';
+    mpack_write_native(writer, start, (size_t)(buffer + sizeof(buffer) - start));
+}
+
+
+
+// Real numbers
+//
+// Reals are converted to decimal with the Grisu2 algorithm from Florian
+// Loitsch's "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers" (2010), following the implementation in RapidJSON by Milo
+// Yip. It uses only 64-bit integer arithmetic. The digits it produces
+// always read back to the same value, and are the shortest possible in
+// all but a tiny fraction of cases.
+
+// A floating-point number f * 2^e with a 64-bit significand
+typedef struct mpack_json_fp_t {
+    uint64_t f;
+    int e;
+} mpack_json_fp_t;
+
+// The normalized significands and binary exponents of 10^k for
+// k = -348, -340, ..., 340
+static const uint64_t mpack_json_cached_powers_f[] = {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+    UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+    UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+    UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+    UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+    UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+    UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+    UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+    UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+    UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+    UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+    UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+    UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+    UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+    UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+    UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+    UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+    UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+    UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+    UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+    UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+    UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+
+static const int16_t mpack_json_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t mpack_json_pow10[] = {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+    UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+    UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+    UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+    UINT64_C(1000000000000000), UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000), UINT64_C(10000000000000000000),
+};
+
+// Multiplies the significands, keeping the rounded upper 64 bits
+MPACK_STATIC_INLINE mpack_json_fp_t mpack_json_fp_multiply(mpack_json_fp_t x, mpack_json_fp_t y) {
+    const uint64_t mask = UINT64_C(0xffffffff);
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (UINT64_C(1) << 31);
+    mpack_json_fp_t result;
+    result.f = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+MPACK_STATIC_INLINE mpack_json_fp_t mpack_json_fp_normalize(mpack_json_fp_t x) {
+    while (!(x.f & (UINT64_C(1) << 63))) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+// Returns a cached power of ten c = 10^-k such that multiplying a
+// number with binary exponent e by it gives an exponent in [-60, -32]
+static mpack_json_fp_t mpack_json_cached_power(int e, int* k) {
+    double dk = (double)(-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - (double)ik > 0.0)
+        ++ik;
+    size_t index = (size_t)((ik >> 3) + 1);
+    *k = 348 - (int)(index << 3);
+    mpack_json_fp_t power;
+    power.f = mpack_json_cached_powers_f[index];
+    power.e = mpack_json_cached_powers_e[index];
+    return power;
+}
+
+// Moves the last digit towards the exact value while it stays within
+// the bounds of the values that read back the same
+static void mpack_json_grisu_round(char* digits, int length, uint64_t delta, uint64_t rest,
+        uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+            (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        --digits[length - 1];
+        rest += ten_kappa;
+    }
+}
+
+// Generates the shortest digits of w that are within delta below the
+// upper bound mp. Returns the number of digits and adjusts the decimal
+// exponent k.
+static int mpack_json_grisu_digits(mpack_json_fp_t w, mpack_json_fp_t mp, uint64_t delta, char* digits, int* k) {
+    int shift = -mp.e;
+    uint64_t one = UINT64_C(1) << shift;
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    int length = 0;
+
+    // digits of the integral part
+    int kappa = 10;
+    while (kappa > 1 && p1 < mpack_json_pow10[kappa - 1])
+        --kappa;
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)mpack_json_pow10[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d != 0 || length != 0)
+            digits[length++] = (char)('0' + d);
+        --kappa;
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            mpack_json_grisu_round(digits, length, delta, rest, mpack_json_pow10[kappa] << shift, wp_w);
+            return length;
+        }
+    }
+
+    // digits of the fractional part
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        uint32_t d = (uint32_t)(p2 >> shift);
+        if (d != 0 || length != 0)
+            digits[length++] = (char)('0' + d);
+        p2 &= one - 1;
+        --kappa;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            mpack_json_grisu_round(digits, length, delta, p2, one,
+                    index < 20 ? wp_w * mpack_json_pow10[index] : 0);
+            return length;
+        }
+    }
+}
+
+// Generates the digits of the non-zero value f * 2^e, returning their
+// count and placing their decimal exponent in k. The lower bound is
+// closer if the value is a power of two with a smaller one below it.
+static int mpack_json_grisu2(uint64_t f, int e, bool lower_closer, char* digits, int* k) {
+    mpack_json_fp_t v = {f, e};
+
+    // the bounds are halfway to the neighbouring values
+    mpack_json_fp_t plus = {(f << 1) + 1, e - 1};
+    plus = mpack_json_fp_normalize(plus);
+    mpack_json_fp_t minus;
+    if (lower_closer) {
+        minus.f = (f << 2) - 1;
+        minus.e = e - 2;
+    } else {
+        minus.f = (f << 1) - 1;
+        minus.e = e - 1;
+    }
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    mpack_json_fp_t power = mpack_json_cached_power(plus.e, k);
+    mpack_json_fp_t w = mpack_json_fp_multiply(mpack_json_fp_normalize(v), power);
+    mpack_json_fp_t wp = mpack_json_fp_multiply(plus, power);
+    mpack_json_fp_t wm = mpack_json_fp_multiply(minus, power);
+    ++wm.f;
+    --wp.f;
+    return mpack_json_grisu_digits(w, wp, wp.f - wm.f, digits, k);
+}
+
+// Formats the digits with decimal exponent k like JavaScript does,
+// except that a fraction is kept on integral values so that they still
+// read back as real numbers. Returns the length.
+static size_t mpack_json_format_digits(char* out, const char* digits, int length, int k) {
+    int point = length + k; // the position of the decimal point
+    size_t pos = 0;
+
+    if (k >= 0 && point <= 21) {
+        // 1234e2 -> 123400.0
+        mpack_memcpy(out, digits, (size_t)length);
+        pos = (size_t)length;
+        for (int i = 0; i < k; ++i)
+            out[pos++] = '0';
+        out[pos++] = '.';
+        out[pos++] = '0';
+
+    } else if (point > 0 && point <= 21) {
+        // 1234e-2 -> 12.34
+        mpack_memcpy(out, digits, (size_t)point);
+        pos = (size_t)point;
+        out[pos++] = '.';
+        mpack_memcpy(out + pos, digits + point, (size_t)(length - point));
+        pos += (size_t)(length - point);
+
+    } else if (point > -6 && point <= 0) {
+        // 1234e-6 -> 0.001234
+        out[pos++] = '0';
+        out[pos++] = '.';
+        for (int i = point; i < 0; ++i)
+            out[pos++] = '0';
+        mpack_memcpy(out + pos, digits, (size_t)length);
+        pos += (size_t)length;
+
+    } else {
+        // 1234e30 -> 1.234e33
+        out[pos++] = digits[0];
+        if (length > 1) {
+            out[pos++] = '.';
+            mpack_memcpy(out + pos, digits + 1, (size_t)(length - 1));
+            pos += (size_t)(length - 1);
+        }
+        out[pos++] = 'e';
+        int exponent = point - 1;
+        if (exponent < 0) {
+            out[pos++] = '-';
+            exponent = -exponent;
+        }
+        char buffer[4];
+        char* end = buffer + sizeof(buffer);
+        char* start = mpack_json_format_u64(end, (uint64_t)exponent);
+        mpack_memcpy(out + pos, start, (size_t)(end - start));
+        pos += (size_t)(end - start);
+    }
+
+    return pos;
+}
+
+static void mpack_json_write_null(mpack_writer_t* writer, bool quoted) {
+    if (quoted)
+        MPACK_JSON_WRITE_LITERAL(writer, "\"null\"");
+    else
+        MPACK_JSON_WRITE_LITERAL(writer, "null");
+}
+
+// Writes the finite real number f * 2^e
+static void mpack_json_write_real(mpack_writer_t* writer, bool negative, uint64_t f, int e,
+        bool lower_closer, bool quoted)
+{
+    char out[48];
+    size_t pos = 0;
+    if (quoted)
+        out[pos++] = '"';
+    if (negative)
+        out[pos++] = '-';
+
+    if (f == 0) {
+        out[pos++] = '0';
+        out[pos++] = '.';
+        out[pos++] = '0';
+    } else {
+        char digits[24];
+        int k = 0;
+        int length = mpack_json_grisu2(f, e, lower_closer, digits, &k);
+        pos += mpack_json_format_digits(out + pos, digits, length, k);
+    }
+
+    if (quoted)
+        out[pos++] = '"';
+    mpack_write_native(writer, out, pos);
+}
+
+// JSON has no infinities or NaN, so these are written as null.
+static void mpack_json_write_double(mpack_writer_t* writer, double value, bool quoted) {
+    uint64_t bits;
+    mpack_memcpy(&bits, &value, sizeof(bits));
+    uint32_t exponent = (uint32_t)(bits >> 52) & 0x7ff;
+    uint64_t significand = bits & ((UINT64_C(1) << 52) - 1);
+    if (exponent == 0x7ff) {
+        mpack_json_write_null(writer, quoted);
+    } else if (exponent == 0) {
+        mpack_json_write_real(writer, (bits >> 63) != 0, significand, -1074, false, quoted);
+    } else {
+        mpack_json_write_real(writer, (bits >> 63) != 0, significand | (UINT64_C(1) << 52),
+                (int)exponent - 1075, significand == 0 && exponent > 1, quoted);
+    }
+}
+
+static void mpack_json_write_float(mpack_writer_t* writer, float value, bool quoted) {
+    uint32_t bits;
+    mpack_memcpy(&bits, &value, sizeof(bits));
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t significand = bits & ((UINT32_C(1) << 23) - 1);
+    if (exponent == 0xff) {
+        mpack_json_write_null(writer, quoted);
+    } else if (exponent == 0) {
+        mpack_json_write_real(writer, (bits >> 31) != 0, significand, -149, false, quoted);
+    } else {
+        mpack_json_write_real(writer, (bits >> 31) != 0, significand | (UINT32_C(1) << 23),
+                (int)exponent - 150, significand == 0 && exponent > 1, quoted);
+    }
+}
+
+
+// Strings
+
+// Returns whether a byte must be escaped in a JSON string
+MPACK_STATIC_INLINE bool mpack_json_needs_escape(uint8_t c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Returns the length of the prefix of the given data that contains no
+// control characters, quotes or backslashes, nor any non-ASCII bytes if
+// ascii is set. Eight bytes are checked at a time with the usual bit
+// tricks: for each byte b, (b - n) & ~b has its high bit set if b < n
+// (or if a lower byte borrowed, so a match is always confirmed one byte
+// at a time.)
+MPACK_STATIC_INLINE size_t mpack_json_prefix(const char* data, size_t count, bool ascii) {
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+    const uint64_t highs = ones * 0x80;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t)) {
+        uint64_t v;
+        mpack_memcpy(&v, data + i, sizeof(v));
+        uint64_t quotes = v ^ (ones * '"');
+        uint64_t backslashes = v ^ (ones * '\\');
+        uint64_t matches = ((v - ones * 0x20) & ~v) |
+                ((quotes - ones) & ~quotes) |
+                ((backslashes - ones) & ~backslashes);
+        if (ascii)
+            matches |= v;
+        if (matches & highs)
+            break;
+    }
+    while (i < count && !mpack_json_needs_escape((uint8_t)data[i]) && (!ascii || (uint8_t)data[i] < 0x80))
+        ++i;
+    return i;
+}
+
+// Returns the length of the prefix of the given data that can be copied
+// to a JSON string unchanged
+static size_t mpack_json_safe_prefix(const char* data, size_t count) {
+    return mpack_json_prefix(data, count, false);
+}
+
+static void mpack_json_write_escape(mpack_writer_t* writer, uint8_t c) {
+    static const char hex[] = "0123456789abcdef";
+    char escape[6] = {'\\', 0, 0, 0, 0, 0};
+    switch (c) {
+        case '"':  escape[1] = '"';  break;
+        case '\\': escape[1] = '\\'; break;
+        case '\b': escape[1] = 'b';  break;
+        case '\f': escape[1] = 'f';  break;
+        case '\n': escape[1] = 'n';  break;
+        case '\r': escape[1] = 'r';  break;
+        case '\t': escape[1] = 't';  break;
+        default:
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xf];
+            mpack_write_native(writer, escape, 6);
+            return;
+    }
+    mpack_write_native(writer, escape, 2);
+}
+
+static void mpack_json_write_str(mpack_reader_t* reader, mpack_writer_t* writer, size_t length) {
+    mpack_json_write_char(writer, '"');
+    while (length > 0) {
+        if (!mpack_json_writer_ok(reader, writer))
+            return;
+        size_t count;
+        const char* data = mpack_read_bytes_chunk(reader, length, &count);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+        length -= count;
+
+        while (count > 0) {
+            size_t safe = mpack_json_safe_prefix(data, count);
+            mpack_write_native(writer, data, safe);
+            if (safe == count)
+                break;
+            mpack_json_write_escape(writer, (uint8_t)data[safe]);
+            data += safe + 1;
+            count -= safe + 1;
+        }
+    }
+    mpack_json_write_char(writer, '"');
+    mpack_done_str(reader);
+}
+
+// Writes the data of a bin or ext as a string in the given encoding. The
+// data is encoded through a small buffer; base64 carries up to two bytes
+// from one chunk of the reader to the next.
+static void mpack_json_write_encoded(mpack_reader_t* reader, mpack_writer_t* writer,
+        mpack_json_bytes_t encoding, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char out[256];
+    size_t used = 0;
+    uint32_t carry = 0;
+    size_t carried = 0;
+
+    mpack_json_write_char(writer, '"');
+    while (length > 0) {
+        if (!mpack_json_writer_ok(reader, writer))
+            return;
+        size_t count;
+        const char* data = mpack_read_bytes_chunk(reader, length, &count);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+        length -= count;
+
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t c = (uint8_t)data[i];
+            if (encoding == mpack_json_bytes_hex) {
+                out[used++] = hex[c >> 4];
+                out[used++] = hex[c & 0xf];
+            } else {
+                carry = (carry << 8) | c;
+                if (++carried < 3)
+                    continue;
+                out[used++] = base64[(carry >> 18) & 0x3f];
+                out[used++] = base64[(carry >> 12) & 0x3f];
+                out[used++] = base64[(carry >> 6) & 0x3f];
+                out[used++] = base64[carry & 0x3f];
+                carry = 0;
+                carried = 0;
+            }
+            if (used > sizeof(out) - 4) {
+                mpack_write_native(writer, out, used);
+                used = 0;
+            }
+        }
+    }
+
+    if (carried != 0) {
+        carry <<= (3 - carried) * 8;
+        out[used++] = base64[(carry >> 18) & 0x3f];
+        out[used++] = base64[(carry >> 12) & 0x3f];
+        out[used++] = carried == 2 ? base64[(carry >> 6) & 0x3f] : '=';
+        out[used++] = '=';
+    }
+    mpack_write_native(writer, out, used);
+    mpack_json_write_char(writer, '"');
+}
+
+
+// MessagePack to JSON
+
+void mpack_to_json(mpack_reader_t* reader, mpack_writer_t* writer, const mpack_json_options_t* options) {
+    mpack_json_options_t defaults;
+    if (options == NULL) {
+        mpack_json_options_init(&defaults);
+        options = &defaults;
+    }
+
+    mpack_event_stack_t stack;
+    mpack_event_level_t stack_local[MPACK_EVENT_STACK_LOCAL_DEPTH]; // no VLAs in VS 2013
+    mpack_event_stack_init(&stack, stack_local);
+
+    while (mpack_reader_error(reader) == mpack_ok && mpack_json_writer_ok(reader, writer)) {
+
+        // A map's elements alternate between keys and values, and a key
+        // is next when an even number are left.
+        bool key = stack.level > 0 && stack.levels[stack.level - 1].type == mpack_type_map &&
+                stack.levels[stack.level - 1].left % 2 == 0;
+
+        mpack_tag_t tag = mpack_read_tag(reader);
+        if (mpack_reader_error(reader) != mpack_ok)
+            break;
+
+        if (key && tag.type != mpack_type_str && (options->keys == mpack_json_keys_error ||
+                    tag.type == mpack_type_array || tag.type == mpack_type_map || tag.type == mpack_type_ext))
+        {
+            mpack_reader_flag_error(reader, mpack_error_type);
+            break;
+        }
+
+        switch (tag.type) {
+            case mpack_type_nil:
+                mpack_json_write_null(writer, key);
+                break;
+
+            case mpack_type_bool:
+                if (key)
+                    mpack_json_write_char(writer, '"');
+                if (tag.v.b)
+                    MPACK_JSON_WRITE_LITERAL(writer, "true");
+                else
+                    MPACK_JSON_WRITE_LITERAL(writer, "false");
+                if (key)
+                    mpack_json_write_char(writer, '"');
+                break;
+
+            case mpack_type_int:
+                mpack_json_write_integer(writer, tag.v.i < 0 ? (uint64_t)0 - (uint64_t)tag.v.i : (uint64_t)tag.v.i,
+                        tag.v.i < 0, key);
+                break;
+
+            case mpack_type_uint:
+                mpack_json_write_integer(writer, tag.v.u, false, key);
+                break;
+
+            case mpack_type_float:
+                mpack_json_write_float(writer, tag.v.f, key);
+                break;
+
+            case mpack_type_double:
+                mpack_json_write_double(writer, tag.v.d, key);
+                break;
+
+            case mpack_type_str:
+                mpack_json_write_str(reader, writer, tag.v.l);
+                break;
+
+            case mpack_type_bin:
+                mpack_json_write_encoded(reader, writer, options->bytes, tag.v.l);
+                mpack_done_bin(reader);
+                break;
+
+            case mpack_type_ext:
+                MPACK_JSON_WRITE_LITERAL(writer, "{\"ext\":");
+                mpack_json_write_integer(writer,
+                        tag.exttype < 0 ? (uint64_t)(-(int)tag.exttype) : (uint64_t)tag.exttype,
+                        tag.exttype < 0, false);
+                MPACK_JSON_WRITE_LITERAL(writer, ",\"data\":");
+                mpack_json_write_encoded(reader, writer, options->bytes, tag.v.l);
+                mpack_json_write_char(writer, '}');
+                mpack_done_ext(reader);
+                break;
+
+            case mpack_type_array:
+            case mpack_type_map: {
+                bool map = tag.type == mpack_type_map;
+                if (tag.v.n == 0) {
+                    if (map)
+                        MPACK_JSON_WRITE_LITERAL(writer, "{}");
+                    else
+                        MPACK_JSON_WRITE_LITERAL(writer, "[]");
+                    mpack_done_type(reader, tag.type);
+                    break;
+                }
+                mpack_json_write_char(writer, map ? '{' : '[');
+                mpack_error_t error = mpack_event_stack_push(&stack, tag.type, map ? (uint64_t)tag.v.n * 2 : tag.v.n);
+                if (error != mpack_ok)
+                    mpack_reader_flag_error(reader, error);
+                continue;
+            }
+        }
+
+        // An element is complete; write the separator that follows it,
+        // or close the containers it completes
+        while (stack.level > 0 && mpack_reader_error(reader) == mpack_ok) {
+            mpack_event_level_t* level = &stack.levels[stack.level - 1];
+            if (--level->left != 0) {
+                mpack_json_write_char(writer, (level->type == mpack_type_map && level->left % 2 == 1) ? ':' : ',');
+                break;
+            }
+            mpack_json_write_char(writer, level->type == mpack_type_map ? '}' : ']');
+            mpack_done_type(reader, level->type);
+            --stack.level;
+        }
+
+        if (stack.level == 0)
+            break;
+    }
+
+    mpack_event_stack_destroy(&stack);
+
+    if (options->newline && mpack_reader_error(reader) == mpack_ok)
+        mpack_json_write_char(writer, '\n');
+}
+
+mpack_error_t mpack_to_json_data(const char* data, size_t length, mpack_writer_t* writer,
+        const mpack_json_options_t* options)
+{
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, length);
+    mpack_to_json(&reader, writer, options);
+    mpack_error_t error = mpack_reader_destroy(&reader);
+    if (error != mpack_ok)
+        return error;
+    return mpack_writer_error(writer);
+}
+
+
+// Parsing real numbers
+//
+// Decimal numbers are converted to the nearest double. Most have few
+// enough digits to be converted exactly with a single floating-point
+// multiplication or division. The rest are approximated with the cached
+// powers of ten above, tracking the error as RapidJSON does, and only
+// when the approximation is too close to halfway between two doubles
+// is it checked against the exact value with big integers.
+
+// The significant digits of a decimal number, which are split by the
+// decimal point
+typedef struct mpack_json_decimal_t {
+    const char* integer;
+    size_t integer_length;
+    const char* fraction;
+    size_t fraction_length;
+    size_t first; // index of the first significant digit
+    size_t count; // number of significant digits
+    int exponent; // the value is the significant digits times 10^exponent
+    bool truncated; // whether non-zero digits were dropped past the maximum
+} mpack_json_decimal_t;
+
+// The most significant digits that are used in converting a number. This
+// is enough to correctly round all but numbers contrived to be within
+// 10^-768 of halfway between two doubles.
+#define MPACK_JSON_MAX_DIGITS 768
+
+MPACK_STATIC_INLINE unsigned mpack_json_decimal_digit(const mpack_json_decimal_t* decimal, size_t index) {
+    char c = (index < decimal->integer_length) ? decimal->integer[index] :
+            decimal->fraction[index - decimal->integer_length];
+    return (unsigned)(c - '0');
+}
+
+static const double mpack_json_exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static double mpack_json_double_from_bits(uint64_t bits) {
+    double value;
+    mpack_memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint64_t mpack_json_double_bits(double value) {
+    uint64_t bits;
+    mpack_memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+#define MPACK_JSON_DOUBLE_INFINITY UINT64_C(0x7ff0000000000000)
+
+// Approximates the decimal as the double f * 2^e with 64-bit arithmetic,
+// returning true if the result is certainly correctly rounded.
+static bool mpack_json_strtod_approx(const mpack_json_decimal_t* decimal, double* result) {
+    static const mpack_json_fp_t small_powers[] = {
+        {UINT64_C(0xa000000000000000), -60}, // 10^1
+        {UINT64_C(0xc800000000000000), -57}, // 10^2
+        {UINT64_C(0xfa00000000000000), -54}, // 10^3
+        {UINT64_C(0x9c40000000000000), -50}, // 10^4
+        {UINT64_C(0xc350000000000000), -47}, // 10^5
+        {UINT64_C(0xf424000000000000), -44}, // 10^6
+        {UINT64_C(0x9896800000000000), -40}, // 10^7
+    };
+
+    // Take as many digits as fit, rounding by the next one. Errors are
+    // measured in eighths of the last place of the significand.
+    const uint64_t limit = UINT64_C(0x1999999999999999);
+    uint64_t significand = 0;
+    size_t i = 0;
+    for (; i < decimal->count; ++i) {
+        unsigned digit = mpack_json_decimal_digit(decimal, decimal->first + i);
+        if (significand > limit || (significand == limit && digit > 5))
+            break;
+        significand = significand * 10 + digit;
+    }
+    size_t remaining = decimal->count - i;
+    if (remaining > 0 && mpack_json_decimal_digit(decimal, decimal->first + i) >= 5)
+        ++significand;
+
+    const int ulp_shift = 3;
+    const int64_t ulp = 1 << ulp_shift;
+    int64_t error = (remaining == 0 && !decimal->truncated) ? 0 : ulp / 2;
+
+    mpack_json_fp_t v;
+    v.f = significand;
+    v.e = 0;
+    v = mpack_json_fp_normalize(v);
+    error <<= -v.e;
+
+    // Multiply by the cached power at or below the exponent, and by the
+    // exact small power that makes up the difference
+    int exponent = decimal->exponent + (int)remaining;
+    size_t index = (size_t)((exponent + 348) / 8);
+    int cached_exponent = -348 + (int)(index * 8);
+    if (cached_exponent != exponent) {
+        int adjustment = exponent - cached_exponent;
+        v = mpack_json_fp_multiply(v, small_powers[adjustment - 1]);
+        if (decimal->count + (size_t)adjustment > 19)
+            error += ulp / 2;
+    }
+    mpack_json_fp_t power;
+    power.f = mpack_json_cached_powers_f[index];
+    power.e = mpack_json_cached_powers_e[index];
+    v = mpack_json_fp_multiply(v, power);
+    error += ulp + (error == 0 ? 0 : 1);
+
+    int old_e = v.e;
+    v = mpack_json_fp_normalize(v);
+    error <<= old_e - v.e;
+
+    // Values below half the smallest subnormal round to zero, unless the
+    // error could put them at or above it
+    int order = 64 + v.e;
+    if (order < -1074) {
+        *result = 0.0;
+        return ~v.f > (uint64_t)error;
+    }
+
+    // Find how many of the 64 bits will be rounded away; more than 11
+    // for subnormal results
+    int significand_bits = (order >= -1021) ? 53 : order + 1074;
+    int precision = 64 - significand_bits;
+    if (precision + ulp_shift >= 64) {
+        int scale = (precision + ulp_shift) - 63;
+        v.f >>= scale;
+        v.e += scale;
+        error = (error >> scale) + 1 + ulp;
+        precision -= scale;
+    }
+
+    uint64_t rounded = v.f >> precision;
+    int rounded_e = v.e + precision;
+    uint64_t precision_bits = (v.f & ((UINT64_C(1) << precision) - 1)) * (uint64_t)ulp;
+    uint64_t half = (UINT64_C(1) << (precision - 1)) * (uint64_t)ulp;
+    if (precision_bits >= half + (uint64_t)error) {
+        ++rounded;
+        if (rounded & (UINT64_C(1) << 53)) {
+            rounded >>= 1;
+            ++rounded_e;
+        }
+    }
+
+    // Assemble the double, which may have overflowed
+    const uint64_t hidden = UINT64_C(1) << 52;
+    uint64_t biased = (rounded_e == -1074 && !(rounded & hidden)) ? 0 : (uint64_t)(rounded_e + 1075);
+    if (biased >= 0x7ff)
+        *result = mpack_json_double_from_bits(MPACK_JSON_DOUBLE_INFINITY);
+    else
+        *result = mpack_json_double_from_bits((rounded & (hidden - 1)) | (biased << 52));
+
+    return half - (uint64_t)error >= precision_bits || precision_bits >= half + (uint64_t)error;
+}
+
+// An unsigned big integer with enough room for the comparisons below
+#define MPACK_JSON_BIGINT_WORDS 128
+
+typedef struct mpack_json_bigint_t {
+    uint32_t words[MPACK_JSON_BIGINT_WORDS]; // least significant first
+    size_t count;
+} mpack_json_bigint_t;
+
+static void mpack_json_bigint_init(mpack_json_bigint_t* bigint, uint64_t value) {
+    bigint->count = 0;
+    while (value != 0) {
+        bigint->words[bigint->count++] = (uint32_t)value;
+        value >>= 32;
+    }
+}
+
+static void mpack_json_bigint_multiply_add(mpack_json_bigint_t* bigint, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (size_t i = 0; i < bigint->count; ++i) {
+        uint64_t word = (uint64_t)bigint->words[i] * factor + carry;
+        bigint->words[i] = (uint32_t)word;
+        carry = word >> 32;
+    }
+    if (carry != 0) {
+        mpack_assert(bigint->count < MPACK_JSON_BIGINT_WORDS, "big integer overflow");
+        bigint->words[bigint->count++] = (uint32_t)carry;
+    }
+}
+
+static void mpack_json_bigint_multiply_pow5(mpack_json_bigint_t* bigint, unsigned exponent) {
+    for (; exponent >= 13; exponent -= 13)
+        mpack_json_bigint_multiply_add(bigint, UINT32_C(1220703125), 0); // 5^13
+    uint32_t factor = 1;
+    for (; exponent > 0; --exponent)
+        factor *= 5;
+    mpack_json_bigint_multiply_add(bigint, factor, 0);
+}
+
+static void mpack_json_bigint_shift_left(mpack_json_bigint_t* bigint, unsigned shift) {
+    if (bigint->count == 0)
+        return;
+    size_t words = shift / 32;
+    unsigned bits = shift % 32;
+    mpack_assert(bigint->count + words < MPACK_JSON_BIGINT_WORDS, "big integer overflow");
+
+    bigint->words[bigint->count] = 0;
+    for (size_t i = bigint->count + 1; i-- > 0;) {
+        uint32_t word = bigint->words[i] << bits;
+        if (bits != 0 && i > 0)
+            word |= bigint->words[i - 1] >> (32 - bits);
+        bigint->words[i + words] = word;
+    }
+    for (size_t i = 0; i < words; ++i)
+        bigint->words[i] = 0;
+    bigint->count += words + 1;
+    while (bigint->count > 0 && bigint->words[bigint->count - 1] == 0)
+        --bigint->count;
+}
+
+static int mpack_json_bigint_compare(const mpack_json_bigint_t* left, const mpack_json_bigint_t* right) {
+    if (left->count != right->count)
+        return left->count < right->count ? -1 : 1;
+    for (size_t i = left->count; i-- > 0;)
+        if (left->words[i] != right->words[i])
+            return left->words[i] < right->words[i] ? -1 : 1;
+    return 0;
+}
+
+// Corrects an approximation that was close to halfway between it and
+// the next double by comparing the decimal with that halfway point.
+static double mpack_json_strtod_exact(const mpack_json_decimal_t* decimal, double approx) {
+    uint64_t bits = mpack_json_double_bits(approx);
+    uint64_t biased = bits >> 52;
+    uint64_t significand = bits & ((UINT64_C(1) << 52) - 1);
+    if (biased == 0x7ff)
+        return approx; // overflowed by more than the error
+    int exponent = -1074;
+    if (biased != 0) {
+        significand |= UINT64_C(1) << 52;
+        exponent = (int)biased - 1075;
+    }
+
+    // Compare digits * 10^exponent with (2 * significand + 1) * 2^(exponent - 1),
+    // moving the factors of negative exponents to the other side.
+    int decimal_exponent = decimal->exponent;
+    unsigned left_pow5 = 0, left_pow2 = 0, right_pow5 = 0, right_pow2 = 0;
+    if (decimal_exponent >= 0) {
+        left_pow5 = left_pow2 = (unsigned)decimal_exponent;
+    } else {
+        right_pow5 = right_pow2 = (unsigned)-decimal_exponent;
+    }
+    if (exponent - 1 >= 0)
+        right_pow2 += (unsigned)(exponent - 1);
+    else
+        left_pow2 += (unsigned)(1 - exponent);
+    unsigned common = left_pow2 < right_pow2 ? left_pow2 : right_pow2;
+    left_pow2 -= common;
+    right_pow2 -= common;
+
+    mpack_json_bigint_t left;
+    mpack_json_bigint_init(&left, 0);
+    size_t i = 0;
+    while (i < decimal->count) {
+        uint32_t chunk = 0;
+        uint32_t factor = 1;
+        for (size_t j = 0; j < 9 && i < decimal->count; ++j, ++i) {
+            chunk = chunk * 10 + mpack_json_decimal_digit(decimal, decimal->first + i);
+            factor *= 10;
+        }
+        if (left.count == 0)
+            mpack_json_bigint_init(&left, chunk);
+        else
+            mpack_json_bigint_multiply_add(&left, factor, chunk);
+    }
+    mpack_json_bigint_multiply_pow5(&left, left_pow5);
+    mpack_json_bigint_shift_left(&left, left_pow2);
+
+    mpack_json_bigint_t right;
+    mpack_json_bigint_init(&right, significand * 2 + 1);
+    mpack_json_bigint_multiply_pow5(&right, right_pow5);
+    mpack_json_bigint_shift_left(&right, right_pow2);
+
+    // Round up past the halfway point, or to even at it. Dropped digits
+    // put the decimal just above it.
+    int compare = mpack_json_bigint_compare(&left, &right);
+    if (compare > 0 || (compare == 0 && (decimal->truncated || (significand & 1))))
+        return mpack_json_double_from_bits(bits + 1);
+    return approx;
+}
+
+// Converts a decimal number to the nearest double, given its digits and
+// the exponent that follows them
+static double mpack_json_strtod(mpack_json_decimal_t* decimal, int64_t exponent) {
+    size_t total = decimal->integer_length + decimal->fraction_length;
+    size_t first = 0;
+    while (first < total && mpack_json_decimal_digit(decimal, first) == 0)
+        ++first;
+    if (first == total)
+        return 0.0;
+    size_t last = total;
+    while (mpack_json_decimal_digit(decimal, last - 1) == 0)
+        --last;
+
+    // Numbers outside the range of doubles become infinity or zero. The
+    // value is at least 10^order and less than 10^(order + 1).
+    int64_t shift = exponent - (int64_t)decimal->fraction_length + (int64_t)(total - last);
+    int64_t order = shift + (int64_t)(last - first) - 1;
+    if (order > 308)
+        return mpack_json_double_from_bits(MPACK_JSON_DOUBLE_INFINITY);
+    if (order < -325)
+        return 0.0;
+
+    decimal->first = first;
+    decimal->count = last - first;
+    decimal->truncated = false;
+    if (decimal->count > MPACK_JSON_MAX_DIGITS) {
+        shift += (int64_t)(decimal->count - MPACK_JSON_MAX_DIGITS);
+        decimal->count = MPACK_JSON_MAX_DIGITS;
+        decimal->truncated = true; // the last digit is never zero
+    }
+    decimal->exponent = (int)shift;
+
+    // Integers of up to 53 bits times exact powers of ten are exact
+    if (decimal->count <= 19) {
+        uint64_t significand = 0;
+        for (size_t i = 0; i < decimal->count; ++i)
+            significand = significand * 10 + mpack_json_decimal_digit(decimal, first + i);
+        const uint64_t max_exact = UINT64_C(1) << 53;
+        int e = decimal->exponent;
+        if (significand <= max_exact && e >= -22 && e <= 22 + 15) {
+            if (e > 22) {
+                // move some of the power into the significand if it fits
+                uint64_t scale = mpack_json_pow10[e - 22];
+                if (significand <= max_exact / scale)
+                    return (double)(significand * scale) * mpack_json_exact_pow10[22];
+            } else if (e >= 0) {
+                return (double)significand * mpack_json_exact_pow10[e];
+            } else {
+                return (double)significand / mpack_json_exact_pow10[-e];
+            }
+        }
+    }
+
+    double result;
+    if (!mpack_json_strtod_approx(decimal, &result))
+        result = mpack_json_strtod_exact(decimal, result);
+    return result;
+}
+
+
+
+// JSON to MessagePack
+
+// The number of containers whose element counts are kept in the parser
+// itself. With MPACK_MALLOC they move to the heap when there are more;
+// without it, this is the most that are kept at once.
+#define MPACK_JSON_COUNT_LOCAL 64
+
+#if defined(MPACK_UNIT_TESTS)
+size_t mpack_json_test_scanned;
+#endif
+
+typedef struct mpack_json_parser_t {
+    const char* p;
+    const char* end;
+    mpack_writer_t* writer;
+    bool floats;
+
+    // the element counts of the containers found by the scan ahead of the
+    // parser, in the order they are opened. next is the parser's.
+    uint32_t* counts;
+    size_t capacity;
+    size_t next;
+    size_t filled;
+
+    // the position of the scan and the indices in counts of the
+    // containers it has open
+    const char* scan;
+    size_t* open;
+    size_t open_capacity;
+    size_t open_count;
+
+    // the depth of open containers that were skipped since there was no
+    // room for their counts
+    size_t skipped;
+    bool truncated;
+
+    uint32_t counts_local[MPACK_JSON_COUNT_LOCAL];
+    size_t open_local[MPACK_JSON_COUNT_LOCAL];
+} mpack_json_parser_t;
+
+MPACK_STATIC_INLINE bool mpack_json_is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+MPACK_STATIC_INLINE bool mpack_json_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+MPACK_STATIC_INLINE const char* mpack_json_skip_space(const char* p, const char* end) {
+    while (p != end && mpack_json_is_space(*p))
+        ++p;
+    return p;
+}
+
+static void mpack_json_invalid(mpack_json_parser_t* parser) {
+    mpack_writer_flag_error(parser->writer, mpack_error_invalid);
+}
+
+#ifdef MPACK_MALLOC
+// Doubles the capacity of one of the parser's count arrays, moving it from
+// the given local array to the heap if needed. Returns the new array, or
+// NULL (flagging an error) if it can't grow.
+static void* mpack_json_count_grow(mpack_json_parser_t* parser, void* array,
+        const void* local, size_t* capacity, size_t element_size)
+{
+    if (*capacity > SIZE_MAX / 2 / element_size) {
+        mpack_writer_flag_error(parser->writer, mpack_error_memory);
+        return NULL;
+    }
+    size_t new_capacity = *capacity * 2;
+
+    void* grown;
+    if (array == local) {
+        grown = MPACK_MALLOC(element_size * new_capacity);
+        if (grown)
+            mpack_memcpy(grown, array, element_size * *capacity);
+    } else {
+        grown = mpack_realloc(array, element_size * *capacity, element_size * new_capacity);
+    }
+    if (!grown) {
+        mpack_writer_flag_error(parser->writer, mpack_error_memory);
+        return NULL;
+    }
+
+    *capacity = new_capacity;
+    return grown;
+}
+#endif
+
+// Makes room for the count of another container, returning false if
+// there is none.
+static bool mpack_json_count_reserve(mpack_json_parser_t* parser) {
+    if (parser->filled == parser->capacity) {
+
+        // Drop the counts the parser has used. With MPACK_MALLOC this is
+        // only done once they are half the array so that moving the rest
+        // stays linear overall.
+        size_t used = parser->next;
+        #ifdef MPACK_MALLOC
+        if (used < parser->capacity / 2)
+            used = 0;
+        #endif
+        if (used > 0) {
+            mpack_memmove(parser->counts, parser->counts + used,
+                    sizeof(uint32_t) * (parser->filled - used));
+            for (size_t i = 0; i < parser->open_count; ++i) {
+                mpack_assert(parser->open[i] >= used, "an open container was already used");
+                parser->open[i] -= used;
+            }
+            parser->next -= used;
+            parser->filled -= used;
+
+        } else {
+            #ifdef MPACK_MALLOC
+            uint32_t* counts = (uint32_t*)mpack_json_count_grow(parser, parser->counts,
+                    parser->counts_local, &parser->capacity, sizeof(uint32_t));
+            if (!counts)
+                return false;
+            parser->counts = counts;
+            #else
+            return false;
+            #endif
+        }
+    }
+
+    if (parser->open_count == parser->open_capacity) {
+        #ifdef MPACK_MALLOC
+        size_t* open = (size_t*)mpack_json_count_grow(parser, parser->open,
+                parser->open_local, &parser->open_capacity, sizeof(size_t));
+        if (!open)
+            return false;
+        parser->open = open;
+        #else
+        return false;
+        #endif
+    }
+
+    return true;
+}
+
+// Saves the position where the scan stopped
+MPACK_STATIC_INLINE void mpack_json_count_stop(mpack_json_parser_t* parser, const char* p) {
+    #if defined(MPACK_UNIT_TESTS)
+    mpack_json_test_scanned += (size_t)(p - parser->scan);
+    #endif
+    parser->scan = p;
+}
+
+// MessagePack containers are prefixed with their element count, so the
+// data is scanned ahead of the parser to count the elements of each
+// container. The scan records the count of every container it opens and
+// stops once the container at the parser's position is closed; it
+// resumes from there when the parser needs another count, so the data is
+// scanned only once. Only brackets, commas and strings matter to the
+// scan; anything invalid is found by the parser.
+//
+// Without MPACK_MALLOC, containers opened when there is no room for their
+// counts are skipped, and the scan starts over from the parser's position
+// once the parser reaches them. This is bounded by the parser's maximum
+// depth without MPACK_MALLOC (MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC.)
+static void mpack_json_count(mpack_json_parser_t* parser) {
+    mpack_assert(*parser->p == '[' || *parser->p == '{', "not at a container");
+
+    if (parser->next == parser->filled && (parser->truncated || parser->scan == NULL)) {
+        parser->scan = parser->p;
+        parser->next = 0;
+        parser->filled = 0;
+        parser->open_count = 0;
+        parser->skipped = 0;
+        parser->truncated = false;
+    }
+
+    const char* p = parser->scan;
+    const char* end = parser->end;
+    bool pending = false; // whether a container was just opened
+
+    while (p != end && (parser->next == parser->filled ||
+                (parser->open_count > 0 && parser->open[0] == parser->next)))
+    {
+        char c = *p;
+        if (mpack_json_is_space(c)) {
+            ++p;
+            continue;
+        }
+
+        // a container has at least one element if anything but its
+        // closing bracket follows its opening bracket
+        if (pending) {
+            if (c != ']' && c != '}')
+                parser->counts[parser->filled - 1] = 1;
+            pending = false;
+        }
+
+        switch (c) {
+            case '"':
+                ++p;
+                while (p != end) {
+                    p += mpack_json_safe_prefix(p, (size_t)(end - p));
+                    if (p == end)
+                        break;
+                    c = *p;
+                    if (c == '"')
+                        break;
+                    p += (c == '\\' && end - p > 1) ? 2 : 1;
+                }
+                break;
+
+            case '[':
+            case '{':
+                if (parser->truncated || !mpack_json_count_reserve(parser)) {
+                    if (mpack_writer_error(parser->writer) != mpack_ok) {
+                        mpack_json_count_stop(parser, p);
+                        return;
+                    }
+                    parser->truncated = true;
+                    ++parser->skipped;
+                    break;
+                }
+                parser->counts[parser->filled] = 0;
+                parser->open[parser->open_count++] = parser->filled++;
+                pending = true;
+                break;
+
+            case ']':
+            case '}':
+                // a close with nothing open belongs to a container the
+                // parser is already in
+                if (parser->skipped > 0)
+                    --parser->skipped;
+                else if (parser->open_count > 0)
+                    --parser->open_count;
+                break;
+
+            case ',':
+                if (parser->skipped == 0 && parser->open_count > 0) {
+                    uint32_t* count = &parser->counts[parser->open[parser->open_count - 1]];
+                    if (*count != UINT32_MAX)
+                        ++*count;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        if (p != end)
+            ++p;
+    }
+
+    mpack_json_count_stop(parser, p);
+}
+
+// Returns the element count of the container at the current position
+MPACK_STATIC_INLINE uint32_t mpack_json_next_count(mpack_json_parser_t* parser) {
+    if (parser->next == parser->filled ||
+            (parser->open_count > 0 && parser->open[0] == parser->next))
+        mpack_json_count(parser);
+
+    // the data ended or an error occurred; the parser will find it
+    if (parser->next == parser->filled)
+        return 0;
+    return parser->counts[parser->next++];
+}
+
+static int mpack_json_hex4(const char* p) {
+    int value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Decodes the escape sequence at the start of the given data into out as
+// UTF-8, placing the length of the sequence in consumed. Returns the
+// number of bytes decoded, or 0 if the sequence is invalid.
+static size_t mpack_json_unescape(const char* p, const char* end, char* out, size_t* consumed) {
+    mpack_assert(*p == '\\', "not an escape sequence");
+    if (end - p < 2)
+        return 0;
+    *consumed = 2;
+    switch (p[1]) {
+        case '"':  *out = '"';  return 1;
+        case '\\': *out = '\\'; return 1;
+        case '/':  *out = '/';  return 1;
+        case 'b':  *out = '\b'; return 1;
+        case 'f':  *out = '\f'; return 1;
+        case 'n':  *out = '\n'; return 1;
+        case 'r':  *out = '\r'; return 1;
+        case 't':  *out = '\t'; return 1;
+        case 'u':  break;
+        default:   return 0;
+    }
+
+    if (end - p < 6)
+        return 0;
+    int unit = mpack_json_hex4(p + 2);
+    if (unit < 0)
+        return 0;
+    uint32_t codepoint = (uint32_t)unit;
+    *consumed = 6;
+
+    // characters outside the BMP are escaped as surrogate pairs
+    if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+        return 0;
+    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        if (end - p < 12 || p[6] != '\\' || p[7] != 'u')
+            return 0;
+        int low = mpack_json_hex4(p + 8);
+        if (low < 0xDC00 || low > 0xDFFF)
+            return 0;
+        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + ((uint32_t)low - 0xDC00);
+        *consumed = 12;
+    }
+
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    }
+    if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    }
+    if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Parses the string at the current position and writes it as a str.
+// The string is scanned once to validate it and find its length, which
+// is also where UTF-8 is validated; if it has no escapes its data is
+// then written as is.
+static void mpack_json_parse_string(mpack_json_parser_t* parser) {
+    const char* start = parser->p + 1;
+    const char* end = parser->end;
+    const char* p = start;
+    size_t shrink = 0; // the bytes saved by unescaping
+    char decoded[4];
+    size_t consumed;
+
+    for (;;) {
+        p += mpack_json_prefix(p, (size_t)(end - p), true);
+        if (p == end) {
+            mpack_json_invalid(parser);
+            return;
+        }
+
+        uint8_t c = (uint8_t)*p;
+        if (c == '"')
+            break;
+
+        size_t length;
+        if (c == '\\') {
+            length = mpack_json_unescape(p, end, decoded, &consumed);
+            if (length == 0) {
+                mpack_json_invalid(parser);
+                return;
+            }
+            shrink += consumed - length;
+            length = consumed;
+        } else if (c < 0x20) {
+            length = 0;
+        } else {
+            length = mpack_utf8_sequence((const uint8_t*)p, (size_t)(end - p));
+        }
+        if (length == 0) {
+            mpack_json_invalid(parser);
+            return;
+        }
+        p += length;
+    }
+
+    parser->p = p + 1;
+    size_t length = (size_t)(p - start) - shrink;
+    if (length > UINT32_MAX) {
+        mpack_writer_flag_error(parser->writer, mpack_error_too_big);
+        return;
+    }
+
+    // every escape sequence is longer than what it decodes to
+    if (shrink == 0) {
+        mpack_write_str(parser->writer, start, (uint32_t)length);
+        return;
+    }
+
+    mpack_start_str(parser->writer, (uint32_t)length);
+    while (start != p) {
+        size_t run = mpack_json_safe_prefix(start, (size_t)(p - start));
+        if (run > 0) {
+            mpack_write_bytes(parser->writer, start, run);
+            start += run;
+            continue;
+        }
+        size_t count = mpack_json_unescape(start, p, decoded, &consumed);
+        mpack_write_bytes(parser->writer, decoded, count);
+        start += consumed;
+    }
+    mpack_finish_str(parser->writer);
+}
+
+// Parses the number at the current position. Integers in the range of
+// int64_t or uint64_t are written as integers in their smallest form;
+// anything else is written as a real.
+static void mpack_json_parse_number(mpack_json_parser_t* parser) {
+    const char* p = parser->p;
+    const char* end = parser->end;
+
+    bool negative = false;
+    if (p != end && *p == '-') {
+        negative = true;
+        ++p;
+    }
+
+    mpack_json_decimal_t decimal;
+    decimal.integer = p;
+    uint64_t magnitude = 0;
+    bool overflow = false;
+    if (p == end || !mpack_json_is_digit(*p)) {
+        mpack_json_invalid(parser);
+        return;
+    }
+    if (*p == '0') {
+        ++p;
+    } else {
+        // the magnitude stops changing once it overflows
+        const uint64_t limit = UINT64_C(1844674407370955161);
+        for (; p != end && mpack_json_is_digit(*p); ++p) {
+            unsigned digit = (unsigned)(*p - '0');
+            if (magnitude >= limit && (overflow || magnitude > limit || digit > 5))
+                overflow = true;
+            else
+                magnitude = magnitude * 10 + digit;
+        }
+    }
+    decimal.integer_length = (size_t)(p - decimal.integer);
+    bool integer = !overflow;
+
+    decimal.fraction = p;
+    decimal.fraction_length = 0;
+    if (p != end && *p == '.') {
+        decimal.fraction = ++p;
+        while (p != end && mpack_json_is_digit(*p))
+            ++p;
+        decimal.fraction_length = (size_t)(p - decimal.fraction);
+        if (decimal.fraction_length == 0) {
+            mpack_json_invalid(parser);
+            return;
+        }
+        integer = false;
+    }
+
+    int64_t exponent = 0;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exponent = false;
+        if (p != end && (*p == '+' || *p == '-'))
+            negative_exponent = *p++ == '-';
+        if (p == end || !mpack_json_is_digit(*p)) {
+            mpack_json_invalid(parser);
+            return;
+        }
+        for (; p != end && mpack_json_is_digit(*p); ++p)
+            if (exponent < 100000) // far past the range of doubles
+                exponent = exponent * 10 + (*p - '0');
+        if (negative_exponent)
+            exponent = -exponent;
+        integer = false;
+    }
+    parser->p = p;
+
+    if (integer) {
+        if (!negative) {
+            mpack_write_uint(parser->writer, magnitude);
+            return;
+        }
+        const uint64_t min_magnitude = UINT64_C(1) << 63;
+        if (magnitude < min_magnitude) {
+            mpack_write_int(parser->writer, -(int64_t)magnitude);
+            return;
+        }
+        if (magnitude == min_magnitude) {
+            mpack_write_int(parser->writer, INT64_MIN);
+            return;
+        }
+    }
+
+    double value = mpack_json_strtod(&decimal, exponent);
+    if (negative)
+        value = -value;
+
+    // a float is used if it holds exactly the same value
+    if (parser->floats && value >= -3.4028234663852886e38 && value <= 3.4028234663852886e38) {
+        float f = (float)value;
+        if ((double)f == value) {
+            mpack_write_float(parser->writer, f);
+            return;
+        }
+    }
+    mpack_write_double(parser->writer, value);
+}
+
+static void mpack_json_parse_literal(mpack_json_parser_t* parser, const char* literal, size_t length) {
+    if ((size_t)(parser->end - parser->p) < length || mpack_memcmp(parser->p, literal, length) != 0) {
+        mpack_json_invalid(parser);
+        return;
+    }
+    parser->p += length;
+}
+
+// Parses a JSON value and everything it contains, writing it to the
+// writer. Nesting is tracked on the given stack rather than by recursion.
+static void mpack_json_parse(mpack_json_parser_t* parser, mpack_event_stack_t* stack) {
+    mpack_writer_t* writer = parser->writer;
+    bool key = false;
+
+    while (mpack_writer_error(writer) == mpack_ok) {
+        parser->p = mpack_json_skip_space(parser->p, parser->end);
+        if (parser->p == parser->end || (key && *parser->p != '"')) {
+            mpack_json_invalid(parser);
+            return;
+        }
+
+        switch (*parser->p) {
+            case '[':
+            case '{': {
+                bool map = *parser->p == '{';
+                uint32_t count = mpack_json_next_count(parser);
+                ++parser->p;
+                if (map)
+                    mpack_start_map(writer, count);
+                else
+                    mpack_start_array(writer, count);
+                if (count > 0) {
+                    mpack_error_t error = mpack_event_stack_push(stack,
+                            map ? mpack_type_map : mpack_type_array, map ? (uint64_t)count * 2 : count);
+                    if (error != mpack_ok)
+                        mpack_writer_flag_error(writer, error);
+                    key = map;
+                    continue;
+                }
+                parser->p = mpack_json_skip_space(parser->p, parser->end);
+                if (parser->p == parser->end || *parser->p != (map ? '}' : ']')) {
+                    mpack_json_invalid(parser);
+                    return;
+                }
+                ++parser->p;
+                if (map)
+                    mpack_finish_map(writer);
+                else
+                    mpack_finish_array(writer);
+                break;
+            }
+
+            case '"':
+                mpack_json_parse_string(parser);
+                break;
+
+            case 't':
+                mpack_json_parse_literal(parser, "true", 4);
+                mpack_write_true(writer);
+                break;
+
+            case 'f':
+                mpack_json_parse_literal(parser, "false", 5);
+                mpack_write_false(writer);
+                break;
+
+            case 'n':
+                mpack_json_parse_literal(parser, "null", 4);
+                mpack_write_nil(writer);
+                break;
+
+            default:
+                mpack_json_parse_number(parser);
+                break;
+        }
+
+        // An element is complete; parse the separator that follows it,
+        // or close the containers it completes
+        key = false;
+        while (stack->level > 0 && mpack_writer_error(writer) == mpack_ok) {
+            mpack_event_level_t* level = &stack->levels[stack->level - 1];
+            bool map = level->type == mpack_type_map;
+            --level->left;
+
+            char expected;
+            if (map && level->left % 2 == 1)
+                expected = ':';
+            else if (level->left != 0)
+                expected = ',';
+            else
+                expected = map ? '}' : ']';
+
+            parser->p = mpack_json_skip_space(parser->p, parser->end);
+            if (parser->p == parser->end || *parser->p != expected) {
+                mpack_json_invalid(parser);
+                return;
+            }
+            ++parser->p;
+
+            if (expected == ':')
+                break;
+            if (expected == ',') {
+                key = map;
+                break;
+            }
+            if (map)
+                mpack_finish_map(writer);
+            else
+                mpack_finish_array(writer);
+            --stack->level;
+        }
+
+        if (stack->level == 0)
+            return;
+    }
+}
+
+mpack_error_t mpack_from_json(const char* data, size_t length, mpack_writer_t* writer,
+        const mpack_json_options_t* options)
+{
+    mpack_json_options_t defaults;
+    if (options == NULL) {
+        mpack_json_options_init(&defaults);
+        options = &defaults;
+    }
+
+    mpack_json_parser_t parser;
+    parser.p = data;
+    parser.end = data + length;
+    parser.writer = writer;
+    parser.floats = options->floats;
+    parser.counts = parser.counts_local;
+    parser.capacity = MPACK_JSON_COUNT_LOCAL;
+    parser.next = 0;
+    parser.filled = 0;
+    parser.scan = NULL;
+    parser.open = parser.open_local;
+    parser.open_capacity = MPACK_JSON_COUNT_LOCAL;
+    parser.open_count = 0;
+    parser.skipped = 0;
+    parser.truncated = false;
+
+    mpack_event_stack_t stack;
+    mpack_event_level_t stack_local[MPACK_EVENT_STACK_LOCAL_DEPTH]; // no VLAs in VS 2013
+    mpack_event_stack_init(&stack, stack_local);
+
+    // With the newline option, any number of values are parsed as long as
+    // they are separated by whitespace. Otherwise there must be exactly
+    // one value.
+    parser.p = mpack_json_skip_space(parser.p, parser.end);
+    if (parser.p == parser.end && !options->newline)
+        mpack_json_invalid(&parser);
+    while (parser.p != parser.end && mpack_writer_error(writer) == mpack_ok) {
+        mpack_json_parse(&parser, &stack);
+        const char* value_end = parser.p;
+        parser.p = mpack_json_skip_space(parser.p, parser.end);
+        if (parser.p != parser.end && (!options->newline || parser.p == value_end))
+            mpack_json_invalid(&parser);
+    }
+
+    mpack_event_stack_destroy(&stack);
+    #ifdef MPACK_MALLOC
+    if (parser.counts != parser.counts_local)
+        MPACK_FREE(parser.counts);
+    if (parser.open != parser.open_local)
+        MPACK_FREE(parser.open);
+    #endif
+    return mpack_writer_error(writer);
+}
+
+
+#endif
+
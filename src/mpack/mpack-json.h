@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ *
+ * Declares the MPack JSON transcoders.
+ */
+
+#ifndef MPACK_JSON_H
+#define MPACK_JSON_H 1
+
+#include "mpack-reader.h"
+#include "mpack-writer.h"
+
+MPACK_HEADER_START
+
+#if MPACK_JSON
+
+#if !MPACK_READER || !MPACK_WRITER
+#error "MPACK_JSON requires MPACK_READER and MPACK_WRITER."
+#endif
+
+/**
+ * @defgroup json JSON Transcoding
+ *
+ * The JSON transcoders convert between MessagePack and JSON without
+ * building a tree. MessagePack is read with a @ref mpack_reader_t and
+ * both directions write to a @ref mpack_writer_t, so they work with any
+ * of the readers' and writers' data sources and destinations (buffers,
+ * growable buffers, files and custom fill and flush functions.) Nesting
+ * is handled iteratively, so deeply nested data does not consume the
+ * call stack.
+ *
+ * @{
+ */
+
+/**
+ * How the data of bin and ext objects is encoded in JSON strings.
+ */
+typedef enum mpack_json_bytes_t {
+    mpack_json_bytes_base64, /**< Standard base64 with padding (RFC 4648.) */
+    mpack_json_bytes_hex,    /**< Lowercase hexadecimal, two characters per byte. */
+} mpack_json_bytes_t;
+
+/**
+ * How map keys that are not strings are converted to JSON.
+ */
+typedef enum mpack_json_keys_t {
+
+    /**
+     * Nil, bool and number keys are converted to strings of their JSON
+     * representation, and bin keys to strings of their encoded data. Map,
+     * array and ext keys raise @ref mpack_error_type.
+     */
+    mpack_json_keys_stringify,
+
+    /** Keys that are not strings raise @ref mpack_error_type. */
+    mpack_json_keys_error,
+
+} mpack_json_keys_t;
+
+/**
+ * Options for converting between MessagePack and JSON.
+ *
+ * Initialize this with mpack_json_options_init() before changing any
+ * options, so that options added in future versions get their defaults.
+ */
+typedef struct mpack_json_options_t {
+
+    /** The encoding of bin and ext data. The default is base64. */
+    mpack_json_bytes_t bytes;
+
+    /** The conversion of keys that are not strings. The default is to stringify them. */
+    mpack_json_keys_t keys;
+
+    /**
+     * If true, a newline is written after each object so that a
+     * sequence of objects forms JSON Lines, and when converting from
+     * JSON, any number of whitespace-separated values are accepted.
+     * The default is false.
+     */
+    bool newline;
+
+    /**
+     * If true, reals converted from JSON are written as floats when a
+     * float holds exactly the same value, and as doubles otherwise. If
+     * false they are always written as doubles. The default is true.
+     */
+    bool floats;
+
+} mpack_json_options_t;
+
+/**
+ * Initializes JSON options to their defaults.
+ */
+void mpack_json_options_init(mpack_json_options_t* options);
+
+/**
+ * @name MessagePack to JSON
+ * @{
+ */
+
+/**
+ * Reads the next object (including all contained data if it is a
+ * compound type) from the reader and writes it to the writer as JSON.
+ *
+ * Compact JSON is written with no whitespace. Objects are converted
+ * as follows:
+ *
+ * - Integers are written exactly.
+ * - Floats and doubles are written with digits that read back to the
+ *   same value, which are the fewest possible in nearly all cases, with
+ *   a decimal point or exponent so that they remain real numbers.
+ *   Infinities and NaN are written as null since JSON cannot represent
+ *   them.
+ * - The data of a str is copied with the characters that JSON
+ *   requires to be escaped replaced by escape sequences. It is not
+ *   checked for valid UTF-8.
+ * - A bin is written as a string of its encoded data.
+ * - An ext is written as an object with its type and encoded data,
+ *   such as `{"ext":5,"data":"AQID"}`.
+ * - Map keys that are not strings are converted according to the
+ *   options.
+ *
+ * Errors in the data, including keys that can't be converted, are
+ * flagged on the reader. Errors writing are flagged on the writer, and
+ * on the reader as well since the object is then not fully read.
+ * Conversion stops at the first error, so the JSON written may be
+ * incomplete if either is in an error state afterwards.
+ *
+ * Note that the writer's tracking is not used for JSON, so the writer
+ * cannot be in the middle of writing a MessagePack map or array.
+ *
+ * @param reader The reader from which to read the object
+ * @param writer The writer to which to write the JSON
+ * @param options The conversion options, or NULL to use the defaults
+ */
+void mpack_to_json(mpack_reader_t* reader, mpack_writer_t* writer, const mpack_json_options_t* options);
+
+/**
+ * Converts the MessagePack object at the start of the given data buffer
+ * to JSON. As with a node tree, any data following the object is
+ * ignored.
+ *
+ * @return mpack_ok if the object was converted, the error in the data
+ *     if it could not be read, or the writer's error otherwise.
+ *
+ * @see mpack_to_json()
+ */
+mpack_error_t mpack_to_json_data(const char* data, size_t length, mpack_writer_t* writer,
+        const mpack_json_options_t* options);
+
+/**
+ * @}
+ */
+
+/**
+ * @name JSON to MessagePack
+ * @{
+ */
+
+/**
+ * Parses the given JSON and writes it to the writer as MessagePack.
+ *
+ * No tree is built. Since MessagePack maps and arrays are prefixed with
+ * their size, the JSON is scanned ahead of the parser to count the
+ * elements of upcoming containers. The scan never passes over the same
+ * data twice, so conversion takes linear time however deeply the JSON is
+ * nested; it keeps the counts of the containers between the parser and
+ * the scan, which grows on the heap with MPACK_MALLOC. Values are
+ * converted as follows:
+ *
+ * - Integers that fit in an int64_t or uint64_t are written as integers
+ *   in their smallest encoding.
+ * - Other numbers are converted to the nearest double, and written as a
+ *   float if the options allow and it holds the same value. Numbers too
+ *   large for a double become infinity.
+ * - Strings are unescaped and written as str. They must be valid UTF-8,
+ *   which is checked as they are parsed.
+ * - Objects are written as maps with str keys, keeping their order and
+ *   any duplicate keys.
+ *
+ * Invalid JSON (including invalid UTF-8 and unpaired surrogates in
+ * strings) flags @ref mpack_error_invalid on the writer, so nothing
+ * partially written is flushed as valid. Nesting deeper than the parser's
+ * stack can grow flags @ref mpack_error_too_big.
+ *
+ * Unless the newline option is set, the data must contain exactly one
+ * JSON value, with optional surrounding whitespace.
+ *
+ * @param data The JSON data, which is not null-terminated
+ * @param length The length of the JSON data in bytes
+ * @param writer The writer to which to write the MessagePack
+ * @param options The conversion options, or NULL to use the defaults
+ *
+ * @return The writer's error state
+ */
+mpack_error_t mpack_from_json(const char* data, size_t length, mpack_writer_t* writer,
+        const mpack_json_options_t* options);
+
+#if defined(MPACK_UNIT_TESTS)
+/** @cond */
+// The number of bytes examined by the scans that count container elements
+// for mpack_from_json(). The unit tests use it to check that the scans
+// are linear.
+extern size_t mpack_json_test_scanned;
+/** @endcond */
+#endif
+
+/**
+ * @}
+ */
+
+/**
+ * @}
+ */
+
+#endif
+
+MPACK_HEADER_END
+
+#endif
+
@@ -81,6 +81,9 @@ typedef struct mpack_tree_parser_t {
     size_t depth;
     mpack_level_t* stack;
     bool stack_owned;
+
+    // The validation to perform on each node, or NULL if none
+    const mpack_tree_validation_t* validation;
 } mpack_tree_parser_t;
 
 MPACK_STATIC_INLINE uint8_t mpack_tree_u8(mpack_tree_parser_t* parser) {
@@ -200,12 +203,29 @@ static void mpack_tree_push_stack(mpack_tree_parser_t* parser, mpack_node_data_t
     ++parser->level;
     parser->stack[parser->level].child = first_child;
     parser->stack[parser->level].left = total;
+
+    #if MPACK_STATS
+    if (parser->tree->stats.max_depth < parser->level)
+        parser->tree->stats.max_depth = parser->level;
+    #endif
 }
 
 static void mpack_tree_parse_children(mpack_tree_parser_t* parser, mpack_node_data_t* node) {
     mpack_type_t type = node->type;
     size_t total = node->len;
 
+    // The node being parsed is at the current level, so its children
+    // are one deeper. A root container has a depth of one.
+    const mpack_tree_validation_t* validation = parser->validation;
+    if (validation != NULL) {
+        if ((validation->max_depth != 0 && parser->level + 1 > validation->max_depth) ||
+                (validation->max_length != 0 && node->len > validation->max_length))
+        {
+            mpack_tree_flag_error(parser->tree, mpack_error_too_big);
+            return;
+        }
+    }
+
     // Calculate total elements to read
     if (type == mpack_type_map) {
         if ((uint64_t)total * 2 > (uint64_t)SIZE_MAX) {
@@ -222,6 +242,7 @@ static void mpack_tree_parse_children(mpack_tree_parser_t* parser, mpack_node_da
         return;
     }
     parser->possible_nodes_left -= total;
+    MPACK_STATS_ADD(parser->tree->stats.nodes, total);
 
     // If there are enough nodes left in the current page, no need to grow
     if (total <= parser->nodes_left) {
@@ -251,12 +272,14 @@ static void mpack_tree_parse_children(mpack_tree_parser_t* parser, mpack_node_da
         mpack_tree_page_t* page;
 
         if (total > MPACK_NODES_PER_PAGE || parser->nodes_left > MPACK_NODES_PER_PAGE / 8) {
-            page = (mpack_tree_page_t*)MPACK_MALLOC(
-                    sizeof(mpack_tree_page_t) + sizeof(mpack_node_data_t) * (total - 1));
+            size_t page_size = sizeof(mpack_tree_page_t) + sizeof(mpack_node_data_t) * (total - 1);
+            page = (mpack_tree_page_t*)MPACK_MALLOC(page_size);
             if (page == NULL) {
                 mpack_tree_flag_error(parser->tree, mpack_error_memory);
                 return;
             }
+            MPACK_STATS_ADD(parser->tree->stats.pages, 1);
+            MPACK_STATS_ADD(parser->tree->stats.page_bytes, page_size);
             mpack_log("allocated seperate page %p for %i children, %i left in page of %i total\n",
                     page, (int)total, (int)parser->nodes_left, (int)MPACK_NODES_PER_PAGE);
 
@@ -268,6 +291,9 @@ static void mpack_tree_parse_children(mpack_tree_parser_t* parser, mpack_node_da
                 mpack_tree_flag_error(parser->tree, mpack_error_memory);
                 return;
             }
+            MPACK_STATS_ADD(parser->tree->stats.pages, 1);
+            MPACK_STATS_ADD(parser->tree->stats.page_bytes, MPACK_PAGE_ALLOC_SIZE);
+            MPACK_STATS_ADD(parser->tree->stats.wasted_nodes, parser->nodes_left);
             mpack_log("allocated new page %p for %i children, wasting %i in page of %i total\n",
                     page, (int)total, (int)parser->nodes_left, (int)MPACK_NODES_PER_PAGE);
 
@@ -298,6 +324,21 @@ static void mpack_tree_parse_bytes(mpack_tree_parser_t* parser, mpack_node_data_
     node->value.bytes = parser->data;
     parser->data += length;
     parser->possible_nodes_left -= length;
+
+    const mpack_tree_validation_t* validation = parser->validation;
+    if (validation != NULL) {
+        if (validation->max_length != 0 && node->len > validation->max_length) {
+            mpack_tree_flag_error(parser->tree, mpack_error_too_big);
+            return;
+        }
+        if (node->type == mpack_type_str && validation->utf8) {
+            bool valid = validation->utf8_no_null ?
+                    mpack_utf8_check_no_null(node->value.bytes, length) :
+                    mpack_utf8_check(node->value.bytes, length);
+            if (!valid)
+                mpack_tree_flag_error(parser->tree, mpack_error_type);
+        }
+    }
 }
 
 static void mpack_tree_parse_node(mpack_tree_parser_t* parser, mpack_node_data_t* node) {
@@ -664,6 +705,56 @@ static void mpack_tree_parse_elements(mpack_tree_parser_t* parser) {
     }
 }
 
+// appends a string to the error path, truncating it if necessary. non-printable
+// characters are replaced so that the path is always safe to print.
+static size_t mpack_tree_error_path_append(mpack_tree_t* tree, size_t pos, const char* str, size_t len) {
+    size_t i;
+    for (i = 0; i < len && pos < MPACK_TREE_ERROR_PATH_SIZE - 1; ++i) {
+        char c = str[i];
+        tree->error_path[pos++] = (c >= 0x20 && c < 0x7f) ? c : '?';
+    }
+    return pos;
+}
+
+static size_t mpack_tree_error_path_index(mpack_tree_t* tree, size_t pos, char open, size_t index, char close) {
+    char digits[24];
+    size_t count = sizeof(digits);
+    digits[--count] = close;
+    do {
+        digits[--count] = (char)('0' + index % 10);
+        index /= 10;
+    } while (index != 0);
+    digits[--count] = open;
+    return mpack_tree_error_path_append(tree, pos, digits + count, sizeof(digits) - count);
+}
+
+// records the position and path of a parse error from the parse stack. the
+// node being parsed at each level is the one just before that level's child.
+static void mpack_tree_parse_error_location(mpack_tree_parser_t* parser, const char* data) {
+    mpack_tree_t* tree = parser->tree;
+    tree->error_position = (size_t)(parser->data - data);
+
+    size_t pos = 0;
+    size_t level;
+    for (level = 1; level <= parser->level; ++level) {
+        mpack_node_data_t* parent = parser->stack[level - 1].child - 1;
+        size_t index = (size_t)(parser->stack[level].child - 1 - parent->value.children);
+
+        if (parent->type == mpack_type_array) {
+            pos = mpack_tree_error_path_index(tree, pos, '[', index, ']');
+        } else {
+            mpack_node_data_t* key = parent->value.children + (index & ~(size_t)1);
+            if ((index & 1) && key->type == mpack_type_str) {
+                pos = mpack_tree_error_path_append(tree, pos, ".", 1);
+                pos = mpack_tree_error_path_append(tree, pos, key->value.bytes, key->len);
+            } else {
+                pos = mpack_tree_error_path_index(tree, pos, '{', index / 2, '}');
+            }
+        }
+    }
+    tree->error_path[pos] = '\0';
+}
+
 static void mpack_tree_parse(mpack_tree_t* tree, const char* data, size_t length,
         mpack_node_data_t* initial_nodes, size_t initial_nodes_count)
 {
@@ -687,6 +778,8 @@ static void mpack_tree_parse(mpack_tree_t* tree, const char* data, size_t length
     parser.data = data;
     parser.nodes = initial_nodes + 1;
     parser.nodes_left = initial_nodes_count - 1;
+    if (tree->validation.utf8 || tree->validation.max_depth != 0 || tree->validation.max_length != 0)
+        parser.validation = &tree->validation;
 
     // We read nodes in a loop instead of recursively for maximum
     // performance. The stack holds the amount of children left to
@@ -710,11 +803,14 @@ static void mpack_tree_parse(mpack_tree_t* tree, const char* data, size_t length
     // configure the root node
     --parser.possible_nodes_left;
     tree->node_count = 1;
+    MPACK_STATS_ADD(tree->stats.nodes, 1);
     parser.level = 0;
     parser.stack[0].child = tree->root;
     parser.stack[0].left = 1;
 
     mpack_tree_parse_elements(&parser);
+    if (mpack_tree_error(tree) != mpack_ok)
+        mpack_tree_parse_error_location(&parser, data);
 
     #ifdef MPACK_MALLOC
     if (parser.stack_owned)
@@ -744,10 +840,17 @@ static void mpack_tree_init_clear(mpack_tree_t* tree) {
     tree->nil_node.type = mpack_type_nil;
 }
 
-#ifdef MPACK_MALLOC
-void mpack_tree_init(mpack_tree_t* tree, const char* data, size_t length) {
-    mpack_tree_init_clear(tree);
+// stores the validation to perform when the tree is parsed
+static void mpack_tree_set_validation(mpack_tree_t* tree, const mpack_tree_validation_t* validation) {
+    mpack_assert(validation != NULL, "validation is NULL");
+    tree->validation = *validation;
+    if (tree->validation.utf8_no_null)
+        tree->validation.utf8 = true;
+}
 
+#ifdef MPACK_MALLOC
+// parses into allocated pages; the tree has already been cleared
+static void mpack_tree_init_paged(mpack_tree_t* tree, const char* data, size_t length) {
     MPACK_STATIC_ASSERT(MPACK_NODE_PAGE_SIZE >= sizeof(mpack_tree_page_t),
             "MPACK_NODE_PAGE_SIZE is too small");
 
@@ -764,18 +867,33 @@ void mpack_tree_init(mpack_tree_t* tree, const char* data, size_t length) {
     }
     page->next = NULL;
     tree->next = page;
+    MPACK_STATS_ADD(tree->stats.pages, 1);
+    MPACK_STATS_ADD(tree->stats.page_bytes, MPACK_PAGE_ALLOC_SIZE);
 
     mpack_log("===========================\n");
     mpack_log("initializing tree with data of size %i\n", (int)length);
 
     mpack_tree_parse(tree, data, length, page->nodes, MPACK_NODES_PER_PAGE);
 }
+
+void mpack_tree_init(mpack_tree_t* tree, const char* data, size_t length) {
+    mpack_tree_init_clear(tree);
+    mpack_tree_init_paged(tree, data, length);
+}
+
+void mpack_tree_init_validated(mpack_tree_t* tree, const char* data, size_t length,
+        const mpack_tree_validation_t* validation)
+{
+    mpack_tree_init_clear(tree);
+    mpack_tree_set_validation(tree, validation);
+    mpack_tree_init_paged(tree, data, length);
+}
 #endif
 
-void mpack_tree_init_pool(mpack_tree_t* tree, const char* data, size_t length,
+// parses into the given pool; the tree has already been cleared
+static void mpack_tree_init_pooled(mpack_tree_t* tree, const char* data, size_t length,
         mpack_node_data_t* node_pool, size_t node_pool_count)
 {
-    mpack_tree_init_clear(tree);
     #ifdef MPACK_MALLOC
     tree->next = NULL;
     #endif
@@ -786,6 +904,22 @@ void mpack_tree_init_pool(mpack_tree_t* tree, const char* data, size_t length,
     mpack_tree_parse(tree, data, length, node_pool, node_pool_count);
 }
 
+void mpack_tree_init_pool(mpack_tree_t* tree, const char* data, size_t length,
+        mpack_node_data_t* node_pool, size_t node_pool_count)
+{
+    mpack_tree_init_clear(tree);
+    mpack_tree_init_pooled(tree, data, length, node_pool, node_pool_count);
+}
+
+void mpack_tree_init_pool_validated(mpack_tree_t* tree, const char* data, size_t length,
+        mpack_node_data_t* node_pool, size_t node_pool_count,
+        const mpack_tree_validation_t* validation)
+{
+    mpack_tree_init_clear(tree);
+    mpack_tree_set_validation(tree, validation);
+    mpack_tree_init_pooled(tree, data, length, node_pool, node_pool_count);
+}
+
 void mpack_tree_init_error(mpack_tree_t* tree, mpack_error_t error) {
     mpack_tree_init_clear(tree);
     tree->error = error;
@@ -1080,7 +1214,8 @@ void mpack_node_check_utf8(mpack_node_t node) {
     if (mpack_node_error(node) != mpack_ok)
         return;
     mpack_node_data_t* data = node.data;
-    if (data->type != mpack_type_str || !mpack_utf8_check(data->value.bytes, data->len))
+    if (data->type != mpack_type_str || (!node.tree->validation.utf8 &&
+                !mpack_utf8_check(data->value.bytes, data->len)))
         mpack_node_flag_error(node, mpack_error_type);
 }
 
@@ -1088,7 +1223,8 @@ void mpack_node_check_utf8_cstr(mpack_node_t node) {
     if (mpack_node_error(node) != mpack_ok)
         return;
     mpack_node_data_t* data = node.data;
-    if (data->type != mpack_type_str || !mpack_utf8_check_no_null(data->value.bytes, data->len))
+    if (data->type != mpack_type_str || (!node.tree->validation.utf8_no_null &&
+                !mpack_utf8_check_no_null(data->value.bytes, data->len)))
         mpack_node_flag_error(node, mpack_error_type);
 }
 
@@ -1130,7 +1266,7 @@ size_t mpack_node_copy_utf8(mpack_node_t node, char* buffer, size_t bufsize) {
         return 0;
     }
 
-    if (!mpack_utf8_check(node.data->value.bytes, node.data->len)) {
+    if (!node.tree->validation.utf8 && !mpack_utf8_check(node.data->value.bytes, node.data->len)) {
         mpack_node_flag_error(node, mpack_error_type);
         return 0;
     }
@@ -1197,7 +1333,8 @@ void mpack_node_copy_utf8_cstr(mpack_node_t node, char* buffer, size_t bufsize)
         return;
     }
 
-    if (!mpack_utf8_check_no_null(node.data->value.bytes, node.data->len)) {
+    if (!node.tree->validation.utf8_no_null &&
+            !mpack_utf8_check_no_null(node.data->value.bytes, node.data->len)) {
         buffer[0] = '\0';
         mpack_node_flag_error(node, mpack_error_type);
         return;
@@ -1292,7 +1429,8 @@ char* mpack_node_utf8_cstr_alloc(mpack_node_t node, size_t maxlen) {
         return NULL;
     }
 
-    if (!mpack_utf8_check_no_null(node.data->value.bytes, node.data->len)) {
+    if (!node.tree->validation.utf8_no_null &&
+            !mpack_utf8_check_no_null(node.data->value.bytes, node.data->len)) {
         mpack_node_flag_error(node, mpack_error_type);
         return NULL;
     }
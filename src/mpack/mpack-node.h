@@ -101,7 +101,79 @@ typedef void (*mpack_tree_error_t)(mpack_tree_t* tree, mpack_error_t error);
  */
 typedef void (*mpack_tree_teardown_t)(mpack_tree_t* tree);
 
+/**
+ * Validation to perform while parsing a tree with mpack_tree_init_validated()
+ * or mpack_tree_init_pool_validated().
+ *
+ * Validating during the parse checks each value once, as it is parsed. The
+ * tree remembers which checks were performed so that node functions can
+ * skip them; for example mpack_node_check_utf8() no longer scans strings
+ * in a tree parsed with utf8 validation.
+ *
+ * Any fields left zero perform no validation.
+ */
+typedef struct mpack_tree_validation_t {
+
+    /**
+     * If true, all str nodes are checked to contain valid UTF-8, as with
+     * mpack_node_check_utf8(). mpack_error_type is flagged otherwise.
+     */
+    bool utf8;
+
+    /**
+     * If true, all str nodes are checked to contain valid UTF-8 with no
+     * NUL bytes, as with mpack_node_check_utf8_cstr(). This implies utf8.
+     */
+    bool utf8_no_null;
+
+    /**
+     * The maximum nesting depth of arrays and maps, or zero for no limit.
+     * An array or map at the root of the tree has a depth of one.
+     * mpack_error_too_big is flagged if this is exceeded.
+     */
+    size_t max_depth;
+
+    /**
+     * The maximum number of bytes in a str, bin or ext, and the maximum
+     * number of elements in an array or key/value pairs in a map, or zero
+     * for no limit. mpack_error_too_big is flagged if this is exceeded.
+     */
+    uint32_t max_length;
+
+} mpack_tree_validation_t;
+
+
 
+/**
+ * @def MPACK_TREE_ERROR_PATH_SIZE
+ *
+ * The size of the buffer in each tree that holds the path to the node
+ * at which a parse error occurred, including its null-terminator. Longer
+ * paths are truncated.
+ *
+ * @see mpack_tree_error_path()
+ */
+#ifndef MPACK_TREE_ERROR_PATH_SIZE
+#define MPACK_TREE_ERROR_PATH_SIZE 64
+#endif
+
+#if MPACK_STATS
+/**
+ * Statistics counted by a tree when MPACK_STATS is enabled.
+ *
+ * Pages are only allocated by trees initialized with mpack_tree_init()
+ * or its variants; a tree parsed into a node pool allocates none.
+ *
+ * @see mpack_tree_stats()
+ */
+typedef struct mpack_tree_stats_t {
+    uint64_t pages;        /**< Node pages allocated. */
+    uint64_t page_bytes;   /**< Bytes allocated for node pages. */
+    uint64_t nodes;        /**< Nodes parsed, including the root. */
+    uint64_t wasted_nodes; /**< Node slots left unused when starting a new page. */
+    uint64_t max_depth;    /**< Deepest nesting of non-empty containers; a non-empty root container has a depth of one. */
+} mpack_tree_stats_t;
+#endif
 
 /* Hide internals from documentation */
 /** @cond */
@@ -145,12 +217,20 @@ struct mpack_tree_t {
 
     mpack_node_data_t nil_node; /* a nil node to be returned in case of error */
     mpack_error_t error;
+    size_t error_position; /* offset in the data of a parse error */
+    char error_path[MPACK_TREE_ERROR_PATH_SIZE]; /* path to the node of a parse error */
 
     size_t node_count;
     size_t size;
 
     mpack_node_data_t* root;
 
+    mpack_tree_validation_t validation; /* Validation performed during the parse */
+
+    #if MPACK_STATS
+    mpack_tree_stats_t stats; /* Statistics counters */
+    #endif
+
     #ifdef MPACK_MALLOC
     mpack_tree_page_t* next;
     #endif
@@ -206,6 +286,32 @@ void mpack_tree_init(mpack_tree_t* tree, const char* data, size_t length);
  */
 void mpack_tree_init_pool(mpack_tree_t* tree, const char* data, size_t length, mpack_node_data_t* node_pool, size_t node_pool_count);
 
+#ifdef MPACK_MALLOC
+/**
+ * Initializes a tree by parsing the given data buffer, performing the given
+ * validation on each node as it is parsed. The tree must be destroyed with
+ * mpack_tree_destroy(), even if parsing or validation fails.
+ *
+ * @see mpack_tree_init()
+ * @see mpack_tree_validation_t
+ */
+void mpack_tree_init_validated(mpack_tree_t* tree, const char* data, size_t length,
+        const mpack_tree_validation_t* validation);
+#endif
+
+/**
+ * Initializes a tree by parsing the given data buffer into the given node
+ * data pool, performing the given validation on each node as it is parsed.
+ * The tree must be destroyed with mpack_tree_destroy(), even if parsing or
+ * validation fails.
+ *
+ * @see mpack_tree_init_pool()
+ * @see mpack_tree_validation_t
+ */
+void mpack_tree_init_pool_validated(mpack_tree_t* tree, const char* data, size_t length,
+        mpack_node_data_t* node_pool, size_t node_pool_count,
+        const mpack_tree_validation_t* validation);
+
 /**
  * Initializes an MPack tree directly into an error state. Use this if you
  * are writing a wrapper to mpack_tree_init() which can fail its setup.
@@ -240,6 +346,51 @@ MPACK_INLINE mpack_error_t mpack_tree_error(mpack_tree_t* tree) {
     return tree->error;
 }
 
+/**
+ * Returns the byte offset in the data at which a parse error occurred.
+ *
+ * This is the offset the parser had reached when the error was flagged,
+ * which is within or just past the offending element. It is zero if no
+ * error occurred, or if the error was flagged after parsing (for example
+ * by a node function.)
+ */
+MPACK_INLINE size_t mpack_tree_error_position(mpack_tree_t* tree) {
+    return tree->error_position;
+}
+
+/**
+ * Returns the path from the root to the node at which a parse error
+ * occurred, as a null-terminated string.
+ *
+ * The path is built from the parse stack only when an error occurs, so it
+ * costs nothing otherwise. Each element of the path is one of:
+ *
+ * - `[i]` for the element at index i of an array;
+ * - `.key` for the value of a string key in a map;
+ * - `{i}` for the key, or the value of a non-string key, of the pair at
+ *   index i of a map.
+ *
+ * For example, an error in the third element of an array under the key
+ * "items" in the root map has the path ".items[2]". The path is empty if
+ * the error is in the root node, if no error occurred, or if the error
+ * was flagged after parsing. Paths longer than MPACK_TREE_ERROR_PATH_SIZE
+ * are truncated.
+ */
+MPACK_INLINE const char* mpack_tree_error_path(mpack_tree_t* tree) {
+    return tree->error_path;
+}
+
+#if MPACK_STATS
+/**
+ * Returns the statistics counted by the tree while parsing.
+ *
+ * This is only available when MPACK_STATS is enabled.
+ */
+MPACK_INLINE const mpack_tree_stats_t* mpack_tree_stats(mpack_tree_t* tree) {
+    return &tree->stats;
+}
+#endif
+
 /**
  * Returns the number of bytes used in the buffer when the tree was
  * parsed. If there is something in the buffer after the MessagePack
@@ -1261,6 +1412,137 @@ bool mpack_node_map_contains_str(mpack_node_t node, const char* str, size_t leng
  */
 bool mpack_node_map_contains_cstr(mpack_node_t node, const char* cstr);
 
+/**
+ * @}
+ */
+
+/**
+ * @name Unchecked Node Functions
+ * @{
+ */
+
+/*
+ * These functions skip the error and type checks of the corresponding node
+ * functions. They are intended for hot loops over trees whose structure has
+ * already been checked, for example with mpack_tree_init_validated() and a
+ * single pass of the checked functions.
+ *
+ * The tree must not be in an error state, and the node must have the type
+ * that each function requires. This is asserted in debug builds only; in
+ * release builds, misuse is undefined behavior.
+ */
+
+/**
+ * Returns the bool value of a bool node without checking its type.
+ */
+MPACK_INLINE bool mpack_node_bool_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_bool, "node is not a bool");
+    return node.data->value.b;
+}
+
+/**
+ * Returns the value of a uint node, or of an int node with a non-negative
+ * value, without checking its type.
+ */
+MPACK_INLINE uint64_t mpack_node_u64_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_uint ||
+            (node.data->type == mpack_type_int && node.data->value.i >= 0),
+            "node is not a non-negative integer");
+    return node.data->value.u;
+}
+
+/**
+ * Returns the value of an int node, or of a uint node with a value of at
+ * most INT64_MAX, without checking its type.
+ */
+MPACK_INLINE int64_t mpack_node_i64_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_int ||
+            (node.data->type == mpack_type_uint && node.data->value.u <= (uint64_t)INT64_MAX),
+            "node is not a signed integer in range");
+    return node.data->value.i;
+}
+
+/**
+ * Returns the value of a float or double node as a double without checking
+ * its type.
+ */
+MPACK_INLINE double mpack_node_double_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_float || node.data->type == mpack_type_double,
+            "node is not a float or double");
+    if (node.data->type == mpack_type_float)
+        return (double)node.data->value.f;
+    return node.data->value.d;
+}
+
+/**
+ * Returns the length of a str, bin or ext node without checking its type.
+ */
+MPACK_INLINE uint32_t mpack_node_data_len_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_str || node.data->type == mpack_type_bin ||
+            node.data->type == mpack_type_ext, "node is not a str, bin or ext");
+    return node.data->len;
+}
+
+/**
+ * Returns a pointer to the data of a str, bin or ext node without checking
+ * its type. As with mpack_node_data(), the data is not null-terminated.
+ */
+MPACK_INLINE const char* mpack_node_data_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_str || node.data->type == mpack_type_bin ||
+            node.data->type == mpack_type_ext, "node is not a str, bin or ext");
+    return node.data->value.bytes;
+}
+
+/**
+ * Returns the length of an array node without checking its type.
+ */
+MPACK_INLINE size_t mpack_node_array_length_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_array, "node is not an array");
+    return (size_t)node.data->len;
+}
+
+/**
+ * Returns the node in an array at the given index without checking the
+ * type of the node or the bounds of the index.
+ */
+MPACK_INLINE mpack_node_t mpack_node_array_at_unchecked(mpack_node_t node, size_t index) {
+    mpack_assert(node.data->type == mpack_type_array, "node is not an array");
+    mpack_assert(index < node.data->len, "index %i out of bounds for array of length %i",
+            (int)index, (int)node.data->len);
+    return mpack_node(node.tree, mpack_node_child(node, index));
+}
+
+/**
+ * Returns the number of key/value pairs in a map node without checking its
+ * type.
+ */
+MPACK_INLINE size_t mpack_node_map_count_unchecked(mpack_node_t node) {
+    mpack_assert(node.data->type == mpack_type_map, "node is not a map");
+    return (size_t)node.data->len;
+}
+
+/**
+ * Returns the key node in a map at the given index without checking the
+ * type of the node or the bounds of the index.
+ */
+MPACK_INLINE mpack_node_t mpack_node_map_key_at_unchecked(mpack_node_t node, size_t index) {
+    mpack_assert(node.data->type == mpack_type_map, "node is not a map");
+    mpack_assert(index < node.data->len, "index %i out of bounds for map of count %i",
+            (int)index, (int)node.data->len);
+    return mpack_node(node.tree, mpack_node_child(node, index * 2));
+}
+
+/**
+ * Returns the value node in a map at the given index without checking the
+ * type of the node or the bounds of the index.
+ */
+MPACK_INLINE mpack_node_t mpack_node_map_value_at_unchecked(mpack_node_t node, size_t index) {
+    mpack_assert(node.data->type == mpack_type_map, "node is not a map");
+    mpack_assert(index < node.data->len, "index %i out of bounds for map of count %i",
+            (int)index, (int)node.data->len);
+    return mpack_node(node.tree, mpack_node_child(node, index * 2 + 1));
+}
+
 /**
  * @}
  */
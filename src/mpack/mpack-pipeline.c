@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MPACK_INTERNAL 1
+
+#include "mpack-pipeline.h"
+
+#if MPACK_PIPELINE && defined(MPACK_MALLOC)
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+
+// Atomics
+
+#define MPACK_PIPELINE_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MPACK_PIPELINE_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define MPACK_PIPELINE_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#if defined(__i386__) || defined(__x86_64__)
+#define MPACK_PIPELINE_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define MPACK_PIPELINE_PAUSE() __asm__ __volatile__("yield")
+#else
+#define MPACK_PIPELINE_PAUSE() ((void)0)
+#endif
+
+// how long a thread looks for work before it blocks
+#define MPACK_PIPELINE_SPINS 256
+#define MPACK_PIPELINE_YIELDS 16
+
+// the number of buffers a fill function is read into
+#define MPACK_PIPELINE_CHUNKS 4
+
+// counters written by different threads are kept on separate cache lines
+#define MPACK_PIPELINE_CACHE_LINE 64
+
+
+// Pipeline state
+
+// A slot in the ring holds one message from the time it is split from
+// the stream until it is delivered. The slot of message n is
+// n & mask. Each slot has two stamps: done is set to n + 1 once message
+// n has been decoded, and released is set to n + 1 once it has been
+// delivered, after which the slot can be reused for message n + capacity.
+typedef union mpack_pipeline_slot_t {
+    struct {
+        const char* data;
+        size_t size;
+        void* result;
+        mpack_error_t error;
+        uint64_t done;
+        uint64_t released;
+    } s;
+    char line[MPACK_PIPELINE_CACHE_LINE];
+} mpack_pipeline_slot_t;
+
+// A buffer of data read from a fill function. It can be reused once the
+// messages from first to end have been delivered.
+typedef struct mpack_pipeline_chunk_t {
+    char* buffer;
+    size_t capacity;
+    size_t length;
+    uint64_t first;
+    uint64_t end;
+} mpack_pipeline_chunk_t;
+
+typedef struct mpack_pipeline_t mpack_pipeline_t;
+
+typedef struct mpack_pipeline_worker_t {
+    mpack_pipeline_t* pipeline;
+    pthread_t thread;
+    mpack_node_data_t* pool;
+} mpack_pipeline_worker_t;
+
+struct mpack_pipeline_t {
+    // written only by the calling thread
+    uint64_t produced; // the number of messages split from the stream
+    uint64_t end;      // the total number of messages once splitting has finished
+    char padding0[MPACK_PIPELINE_CACHE_LINE];
+
+    // written by the workers
+    uint64_t claimed;  // the next message to be claimed by a worker
+    char padding1[MPACK_PIPELINE_CACHE_LINE];
+    size_t sleepers;   // the number of threads blocked on the condition
+    char padding2[MPACK_PIPELINE_CACHE_LINE];
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    mpack_pipeline_slot_t* slots;
+    uint64_t capacity;
+    uint64_t mask;
+    size_t batch;
+    size_t nodes;
+    bool ordered;
+
+    mpack_pipeline_decode_t decode;
+    mpack_pipeline_deliver_t deliver;
+    void* context;
+
+    // the state of the splitter, used only by the calling thread
+    mpack_pipeline_fill_t fill;
+    mpack_pipeline_chunk_t chunks[MPACK_PIPELINE_CHUNKS];
+    size_t chunk;       // the chunk being split
+    size_t pos;         // the position of the next message in the chunk
+    size_t chunk_size;
+    size_t max_size;
+    bool eof;           // whether the stream has been read entirely
+    bool waiting_chunk; // whether splitting is blocked on the next chunk
+    bool finished;      // whether splitting has finished
+    mpack_error_t error;
+    uint64_t delivered; // the number of messages delivered in order
+};
+
+void mpack_pipeline_options_init(mpack_pipeline_options_t* options) {
+    mpack_memset(options, 0, sizeof(*options));
+    options->capacity = MPACK_PIPELINE_DEFAULT_CAPACITY;
+    options->batch = MPACK_PIPELINE_DEFAULT_BATCH;
+    options->nodes = MPACK_PIPELINE_DEFAULT_NODES;
+    options->chunk_size = MPACK_PIPELINE_DEFAULT_CHUNK_SIZE;
+    options->ordered = true;
+}
+
+
+// Waiting
+
+// A thread that finds nothing to do spins for a while, then blocks on the
+// condition until the predicate is true. Threads that change the state
+// wake blocked threads only if there are any, so the common case costs a
+// fence rather than a lock.
+typedef bool (*mpack_pipeline_ready_t)(mpack_pipeline_t* pipeline, uint64_t arg);
+
+static void mpack_pipeline_wait(mpack_pipeline_t* pipeline, mpack_pipeline_ready_t ready, uint64_t arg) {
+    for (int i = 0; i < MPACK_PIPELINE_SPINS; ++i) {
+        if (ready(pipeline, arg))
+            return;
+        MPACK_PIPELINE_PAUSE();
+    }
+    for (int i = 0; i < MPACK_PIPELINE_YIELDS; ++i) {
+        if (ready(pipeline, arg))
+            return;
+        sched_yield();
+    }
+
+    __atomic_add_fetch(&pipeline->sleepers, 1, __ATOMIC_SEQ_CST);
+    MPACK_PIPELINE_FENCE();
+    pthread_mutex_lock(&pipeline->mutex);
+    while (!ready(pipeline, arg))
+        pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+    pthread_mutex_unlock(&pipeline->mutex);
+    __atomic_sub_fetch(&pipeline->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void mpack_pipeline_wake(mpack_pipeline_t* pipeline) {
+    MPACK_PIPELINE_FENCE();
+    if (__atomic_load_n(&pipeline->sleepers, __ATOMIC_RELAXED) != 0) {
+        pthread_mutex_lock(&pipeline->mutex);
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+}
+
+MPACK_STATIC_INLINE mpack_pipeline_slot_t* mpack_pipeline_slot(mpack_pipeline_t* pipeline, uint64_t index) {
+    return &pipeline->slots[index & pipeline->mask];
+}
+
+// whether the given message has been delivered. a slot is only reused
+// once its message is delivered, so a later stamp also means delivered.
+MPACK_STATIC_INLINE bool mpack_pipeline_delivered(mpack_pipeline_t* pipeline, uint64_t index) {
+    return MPACK_PIPELINE_LOAD(&mpack_pipeline_slot(pipeline, index)->s.released) > index;
+}
+
+// whether all messages from first to end have been delivered. only the
+// last capacity of them need to be checked since earlier slots have
+// been reused.
+static bool mpack_pipeline_range_delivered(mpack_pipeline_t* pipeline, uint64_t first, uint64_t end) {
+    if (end - first > pipeline->capacity)
+        first = end - pipeline->capacity;
+    for (uint64_t i = first; i < end; ++i)
+        if (!mpack_pipeline_delivered(pipeline, i))
+            return false;
+    return true;
+}
+
+
+// Workers
+
+static bool mpack_pipeline_worker_ready(mpack_pipeline_t* pipeline, uint64_t index) {
+    return index < MPACK_PIPELINE_LOAD(&pipeline->produced) || index >= MPACK_PIPELINE_LOAD(&pipeline->end);
+}
+
+static void mpack_pipeline_release(mpack_pipeline_t* pipeline, mpack_pipeline_slot_t* slot, uint64_t index) {
+    MPACK_PIPELINE_STORE(&slot->s.released, index + 1);
+    mpack_pipeline_wake(pipeline);
+}
+
+static void mpack_pipeline_decode(mpack_pipeline_worker_t* worker, uint64_t index) {
+    mpack_pipeline_t* pipeline = worker->pipeline;
+    mpack_pipeline_slot_t* slot = mpack_pipeline_slot(pipeline, index);
+
+    // the node pool is reused for every message. if it's too small, the
+    // message is parsed again into a tree that allocates its own pages.
+    mpack_tree_t tree;
+    mpack_tree_init_pool(&tree, slot->s.data, slot->s.size, worker->pool, pipeline->nodes);
+    if (mpack_tree_error(&tree) == mpack_error_too_big) {
+        mpack_tree_destroy(&tree);
+        mpack_tree_init(&tree, slot->s.data, slot->s.size);
+    }
+
+    void* result = NULL;
+    if (mpack_tree_error(&tree) == mpack_ok && pipeline->decode != NULL)
+        result = pipeline->decode(pipeline->context, &tree);
+    mpack_error_t error = mpack_tree_destroy(&tree);
+
+    if (!pipeline->ordered) {
+        pipeline->deliver(pipeline->context, index, result, error);
+        mpack_pipeline_release(pipeline, slot, index);
+        return;
+    }
+
+    slot->s.result = result;
+    slot->s.error = error;
+    MPACK_PIPELINE_STORE(&slot->s.done, index + 1);
+    mpack_pipeline_wake(pipeline);
+}
+
+static void* mpack_pipeline_worker(void* arg) {
+    mpack_pipeline_worker_t* worker = (mpack_pipeline_worker_t*)arg;
+    mpack_pipeline_t* pipeline = worker->pipeline;
+
+    while (true) {
+        uint64_t first = __atomic_fetch_add(&pipeline->claimed, (uint64_t)pipeline->batch, __ATOMIC_RELAXED);
+        for (uint64_t index = first; index < first + pipeline->batch; ++index) {
+            mpack_pipeline_wait(pipeline, mpack_pipeline_worker_ready, index);
+
+            // splitting has finished before this message
+            if (index >= MPACK_PIPELINE_LOAD(&pipeline->produced))
+                return NULL;
+
+            mpack_pipeline_decode(worker, index);
+        }
+    }
+}
+
+
+// Splitting
+
+static void mpack_pipeline_finish(mpack_pipeline_t* pipeline, mpack_error_t error) {
+    pipeline->finished = true;
+    pipeline->error = error;
+    MPACK_PIPELINE_STORE(&pipeline->end, pipeline->produced);
+    mpack_pipeline_wake(pipeline);
+}
+
+// moves the partial message at the end of the current chunk to the start
+// of the next one. returns false if the next chunk is still in use.
+static bool mpack_pipeline_next_chunk(mpack_pipeline_t* pipeline) {
+    mpack_pipeline_chunk_t* chunk = &pipeline->chunks[pipeline->chunk];
+    size_t next_index = (pipeline->chunk + 1) % MPACK_PIPELINE_CHUNKS;
+    mpack_pipeline_chunk_t* next = &pipeline->chunks[next_index];
+
+    size_t left = chunk->length - pipeline->pos;
+    if (pipeline->max_size != 0 && left >= pipeline->max_size) {
+        mpack_pipeline_finish(pipeline, mpack_error_too_big);
+        return true;
+    }
+
+    pipeline->waiting_chunk = !mpack_pipeline_range_delivered(pipeline, next->first, next->end);
+    if (pipeline->waiting_chunk)
+        return false;
+
+    // the next chunk must have room for more than the partial message.
+    // its contents are no longer needed, so it is replaced rather than
+    // reallocated.
+    if (next->capacity <= left) {
+        size_t capacity = pipeline->chunk_size;
+        while (capacity <= left)
+            capacity *= 2;
+        char* buffer = (char*)MPACK_MALLOC(capacity);
+        if (buffer == NULL) {
+            mpack_pipeline_finish(pipeline, mpack_error_memory);
+            return true;
+        }
+        if (next->buffer != NULL)
+            MPACK_FREE(next->buffer);
+        next->buffer = buffer;
+        next->capacity = capacity;
+    }
+
+    if (left != 0)
+        mpack_memcpy(next->buffer, chunk->buffer + pipeline->pos, left);
+    next->length = left;
+    chunk->end = pipeline->produced;
+    next->first = pipeline->produced;
+    pipeline->chunk = next_index;
+    pipeline->pos = 0;
+    return true;
+}
+
+// reads more data into the current chunk, or moves to the next chunk if
+// it is full. returns false if no progress can be made yet.
+static bool mpack_pipeline_read(mpack_pipeline_t* pipeline) {
+    mpack_pipeline_chunk_t* chunk = &pipeline->chunks[pipeline->chunk];
+    if (chunk->length == chunk->capacity)
+        return mpack_pipeline_next_chunk(pipeline);
+
+    size_t space = chunk->capacity - chunk->length;
+    size_t count = pipeline->fill(pipeline->context, chunk->buffer + chunk->length, space);
+    if (count == 0) {
+        pipeline->eof = true;
+    } else if (count > space) {
+        // the fill function returned an error code rather than a size
+        mpack_pipeline_finish(pipeline, mpack_error_io);
+    } else {
+        chunk->length += count;
+    }
+    return true;
+}
+
+// splits the next message from the stream. returns false if no progress
+// can be made yet.
+static bool mpack_pipeline_split(mpack_pipeline_t* pipeline) {
+    if (pipeline->finished)
+        return false;
+
+    // the slot must be free of the message capacity before this one
+    uint64_t index = pipeline->produced;
+    if (index >= pipeline->capacity && !mpack_pipeline_delivered(pipeline, index - pipeline->capacity))
+        return false;
+
+    mpack_pipeline_chunk_t* chunk = &pipeline->chunks[pipeline->chunk];
+    size_t size = 0;
+    mpack_error_t error = mpack_error_io;
+    if (pipeline->pos != chunk->length)
+        error = mpack_measure_object(chunk->buffer + pipeline->pos, chunk->length - pipeline->pos, &size);
+    if (error == mpack_ok && pipeline->max_size != 0 && size > pipeline->max_size)
+        error = mpack_error_too_big;
+
+    if (error == mpack_ok) {
+        mpack_pipeline_slot_t* slot = mpack_pipeline_slot(pipeline, index);
+        slot->s.data = chunk->buffer + pipeline->pos;
+        slot->s.size = size;
+        pipeline->pos += size;
+        MPACK_PIPELINE_STORE(&pipeline->produced, index + 1);
+        mpack_pipeline_wake(pipeline);
+        return true;
+    }
+
+    if (error != mpack_error_io) {
+        mpack_pipeline_finish(pipeline, error);
+        return true;
+    }
+
+    // the message is incomplete
+    if (pipeline->eof) {
+        mpack_pipeline_finish(pipeline, pipeline->pos == chunk->length ? mpack_ok : mpack_error_io);
+        return true;
+    }
+    return mpack_pipeline_read(pipeline);
+}
+
+
+// Delivery
+
+// delivers the decoded messages at the front of the ring in order.
+// returns whether any were delivered.
+static bool mpack_pipeline_deliver(mpack_pipeline_t* pipeline) {
+    bool delivered = false;
+    while (pipeline->delivered < pipeline->produced) {
+        uint64_t index = pipeline->delivered;
+        mpack_pipeline_slot_t* slot = mpack_pipeline_slot(pipeline, index);
+        if (MPACK_PIPELINE_LOAD(&slot->s.done) != index + 1)
+            break;
+        pipeline->deliver(pipeline->context, index, slot->s.result, slot->s.error);
+        mpack_pipeline_release(pipeline, slot, index);
+        pipeline->delivered = index + 1;
+        delivered = true;
+    }
+    return delivered;
+}
+
+static bool mpack_pipeline_drained(mpack_pipeline_t* pipeline) {
+    return pipeline->finished && mpack_pipeline_range_delivered(pipeline, 0, pipeline->produced);
+}
+
+// whether the calling thread has something to do
+static bool mpack_pipeline_main_ready(mpack_pipeline_t* pipeline, uint64_t arg) {
+    MPACK_UNUSED(arg);
+
+    if (pipeline->ordered && pipeline->delivered < pipeline->produced &&
+            MPACK_PIPELINE_LOAD(&mpack_pipeline_slot(pipeline, pipeline->delivered)->s.done) == pipeline->delivered + 1)
+        return true;
+
+    if (pipeline->finished)
+        return mpack_pipeline_drained(pipeline);
+
+    if (pipeline->waiting_chunk) {
+        const mpack_pipeline_chunk_t* next = &pipeline->chunks[(pipeline->chunk + 1) % MPACK_PIPELINE_CHUNKS];
+        return mpack_pipeline_range_delivered(pipeline, next->first, next->end);
+    }
+
+    uint64_t index = pipeline->produced;
+    return index < pipeline->capacity || mpack_pipeline_delivered(pipeline, index - pipeline->capacity);
+}
+
+
+// Lifecycle
+
+static mpack_error_t mpack_pipeline_execute(mpack_pipeline_t* pipeline, const mpack_pipeline_options_t* options) {
+    mpack_pipeline_options_t defaults;
+    if (options == NULL) {
+        mpack_pipeline_options_init(&defaults);
+        options = &defaults;
+    }
+
+    size_t thread_count = options->threads;
+    if (thread_count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (size_t)online : 1;
+    }
+
+    pipeline->capacity = 1;
+    while (pipeline->capacity < options->capacity)
+        pipeline->capacity *= 2;
+    pipeline->mask = pipeline->capacity - 1;
+    pipeline->batch = options->batch != 0 ? options->batch : 1;
+    pipeline->nodes = options->nodes != 0 ? options->nodes : 1;
+    pipeline->chunk_size = options->chunk_size != 0 ? options->chunk_size : MPACK_PIPELINE_DEFAULT_CHUNK_SIZE;
+    if (pipeline->fill != NULL)
+        pipeline->max_size = options->max_size;
+    pipeline->ordered = options->ordered;
+    pipeline->end = UINT64_MAX;
+
+    if (pipeline->capacity > SIZE_MAX / sizeof(mpack_pipeline_slot_t) ||
+            thread_count > SIZE_MAX / sizeof(mpack_pipeline_worker_t) ||
+            pipeline->nodes > SIZE_MAX / sizeof(mpack_node_data_t))
+        return mpack_error_memory;
+
+    pipeline->slots = (mpack_pipeline_slot_t*)MPACK_MALLOC((size_t)pipeline->capacity * sizeof(mpack_pipeline_slot_t));
+    if (pipeline->slots == NULL)
+        return mpack_error_memory;
+    mpack_memset(pipeline->slots, 0, (size_t)pipeline->capacity * sizeof(mpack_pipeline_slot_t));
+
+    mpack_pipeline_worker_t* workers = (mpack_pipeline_worker_t*)MPACK_MALLOC(thread_count * sizeof(mpack_pipeline_worker_t));
+    if (workers == NULL) {
+        MPACK_FREE(pipeline->slots);
+        return mpack_error_memory;
+    }
+
+    if (pthread_mutex_init(&pipeline->mutex, NULL) != 0) {
+        MPACK_FREE(workers);
+        MPACK_FREE(pipeline->slots);
+        return mpack_error_memory;
+    }
+    if (pthread_cond_init(&pipeline->cond, NULL) != 0) {
+        pthread_mutex_destroy(&pipeline->mutex);
+        MPACK_FREE(workers);
+        MPACK_FREE(pipeline->slots);
+        return mpack_error_memory;
+    }
+
+    // start the workers. if any can't be started, the ones that were
+    // are stopped by finishing with no messages.
+    size_t started = 0;
+    for (; started < thread_count; ++started) {
+        mpack_pipeline_worker_t* worker = &workers[started];
+        worker->pipeline = pipeline;
+        worker->pool = (mpack_node_data_t*)MPACK_MALLOC(pipeline->nodes * sizeof(mpack_node_data_t));
+        if (worker->pool == NULL)
+            break;
+        if (pthread_create(&worker->thread, NULL, mpack_pipeline_worker, worker) != 0) {
+            MPACK_FREE(worker->pool);
+            break;
+        }
+    }
+    if (started < thread_count)
+        mpack_pipeline_finish(pipeline, mpack_error_memory);
+
+    // the calling thread splits the stream and delivers ordered results
+    while (!mpack_pipeline_drained(pipeline)) {
+        bool progress = pipeline->ordered && mpack_pipeline_deliver(pipeline);
+        for (int i = 0; i < 64 && mpack_pipeline_split(pipeline); ++i)
+            progress = true;
+        if (!progress)
+            mpack_pipeline_wait(pipeline, mpack_pipeline_main_ready, 0);
+    }
+
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        MPACK_FREE(workers[i].pool);
+    }
+    pthread_cond_destroy(&pipeline->cond);
+    pthread_mutex_destroy(&pipeline->mutex);
+    MPACK_FREE(workers);
+    MPACK_FREE(pipeline->slots);
+    return pipeline->error;
+}
+
+mpack_error_t mpack_pipeline_run(const char* data, size_t length,
+        mpack_pipeline_decode_t decode, mpack_pipeline_deliver_t deliver,
+        void* context, const mpack_pipeline_options_t* options)
+{
+    mpack_assert(deliver != NULL, "deliver function is NULL");
+    mpack_assert(data != NULL || length == 0, "data is NULL");
+
+    mpack_pipeline_t pipeline;
+    mpack_memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.decode = decode;
+    pipeline.deliver = deliver;
+    pipeline.context = context;
+
+    // the data is a single chunk that is never refilled
+    pipeline.chunks[0].buffer = (char*)data;
+    pipeline.chunks[0].capacity = length;
+    pipeline.chunks[0].length = length;
+    pipeline.eof = true;
+
+    return mpack_pipeline_execute(&pipeline, options);
+}
+
+mpack_error_t mpack_pipeline_run_fill(mpack_pipeline_fill_t fill,
+        mpack_pipeline_decode_t decode, mpack_pipeline_deliver_t deliver,
+        void* context, const mpack_pipeline_options_t* options)
+{
+    mpack_assert(fill != NULL, "fill function is NULL");
+    mpack_assert(deliver != NULL, "deliver function is NULL");
+
+    mpack_pipeline_t pipeline;
+    mpack_memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.decode = decode;
+    pipeline.deliver = deliver;
+    pipeline.context = context;
+    pipeline.fill = fill;
+
+    size_t chunk_size = MPACK_PIPELINE_DEFAULT_CHUNK_SIZE;
+    if (options != NULL && options->chunk_size != 0)
+        chunk_size = options->chunk_size;
+    pipeline.chunks[0].buffer = (char*)MPACK_MALLOC(chunk_size);
+    if (pipeline.chunks[0].buffer == NULL)
+        return mpack_error_memory;
+    pipeline.chunks[0].capacity = chunk_size;
+
+    mpack_error_t error = mpack_pipeline_execute(&pipeline, options);
+    for (size_t i = 0; i < MPACK_PIPELINE_CHUNKS; ++i)
+        if (pipeline.chunks[i].buffer != NULL)
+            MPACK_FREE(pipeline.chunks[i].buffer);
+    return error;
+}
+
+#endif
+
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ *
+ * Declares the MPack decode pipeline, which parses a stream of
+ * concatenated messages on a pool of threads.
+ */
+
+#ifndef MPACK_PIPELINE_H
+#define MPACK_PIPELINE_H 1
+
+#include "mpack-reader.h"
+#include "mpack-node.h"
+
+MPACK_HEADER_START
+
+#if MPACK_PIPELINE
+
+#if !MPACK_READER || !MPACK_NODE
+#error "MPACK_PIPELINE requires MPACK_READER and MPACK_NODE."
+#endif
+
+#if defined(_WIN32) || !defined(__ATOMIC_ACQUIRE)
+#error "MPACK_PIPELINE requires POSIX threads and GCC-compatible atomic builtins."
+#endif
+
+#ifdef MPACK_MALLOC
+
+/**
+ * @defgroup pipeline Decode Pipeline
+ *
+ * The decode pipeline parses a stream of concatenated MessagePack
+ * messages on a pool of worker threads.
+ *
+ * The calling thread splits the stream into messages with
+ * mpack_measure_object(), which skips over the structure of each message
+ * without parsing it. The messages are handed to the workers through a
+ * bounded ring. Each worker parses a message into a tree backed by its
+ * own node pool, which is reused for every message it parses, and passes
+ * the tree to a decode callback that converts it to a result of the
+ * caller's choosing. The results are then delivered to a deliver
+ * callback, either in stream order on the calling thread or as soon as
+ * they are decoded on the workers.
+ *
+ * The ring is lock-free: threads claim and complete messages with atomic
+ * counters, and only block on a condition variable after spinning for a
+ * while without finding work. Workers claim messages in batches to keep
+ * contention on the shared counters low.
+ *
+ * The pipeline is available when MPACK_PIPELINE is enabled. It requires
+ * POSIX threads (so programs must be linked with -pthread) and
+ * GCC-compatible atomic builtins.
+ *
+ * @{
+ */
+
+/**
+ * The default number of messages that can be in flight in a pipeline.
+ */
+#ifndef MPACK_PIPELINE_DEFAULT_CAPACITY
+#define MPACK_PIPELINE_DEFAULT_CAPACITY 1024
+#endif
+
+/**
+ * The default number of messages a pipeline worker claims at a time.
+ */
+#ifndef MPACK_PIPELINE_DEFAULT_BATCH
+#define MPACK_PIPELINE_DEFAULT_BATCH 8
+#endif
+
+/**
+ * The default number of nodes in each pipeline worker's node pool.
+ */
+#ifndef MPACK_PIPELINE_DEFAULT_NODES
+#define MPACK_PIPELINE_DEFAULT_NODES 1024
+#endif
+
+/**
+ * The default number of bytes a pipeline reads at a time from a fill
+ * function.
+ */
+#ifndef MPACK_PIPELINE_DEFAULT_CHUNK_SIZE
+#define MPACK_PIPELINE_DEFAULT_CHUNK_SIZE (1024 * 1024)
+#endif
+
+/**
+ * Options for a decode pipeline.
+ *
+ * Initialize this with mpack_pipeline_options_init() before changing any
+ * options, so that options added in future versions get their defaults.
+ */
+typedef struct mpack_pipeline_options_t {
+
+    /**
+     * The number of worker threads, or 0 to start one per online
+     * processor. The default is 0.
+     */
+    size_t threads;
+
+    /**
+     * The number of messages that can be in flight between being split
+     * from the stream and being delivered. This is rounded up to a power
+     * of two, and should be several times threads * batch so that
+     * workers are not left waiting for a slow message to be delivered.
+     * The default is MPACK_PIPELINE_DEFAULT_CAPACITY.
+     */
+    size_t capacity;
+
+    /**
+     * The number of consecutive messages a worker claims at a time. The
+     * default is MPACK_PIPELINE_DEFAULT_BATCH.
+     */
+    size_t batch;
+
+    /**
+     * The number of nodes in each worker's node pool. A message with more
+     * nodes than this is parsed into a tree that allocates its own pages.
+     * The default is MPACK_PIPELINE_DEFAULT_NODES.
+     */
+    size_t nodes;
+
+    /**
+     * The number of bytes to read at a time from a fill function. Four
+     * buffers of this size are used (unless messages are larger.) The
+     * default is MPACK_PIPELINE_DEFAULT_CHUNK_SIZE.
+     */
+    size_t chunk_size;
+
+    /**
+     * The maximum size of a message read from a fill function, or 0 for
+     * no limit. The default is 0.
+     */
+    size_t max_size;
+
+    /**
+     * If true, results are delivered in stream order on the calling
+     * thread. If false, each result is delivered on the worker that
+     * decoded it as soon as it is decoded, so the deliver callback must
+     * be thread-safe. The default is true.
+     */
+    bool ordered;
+
+} mpack_pipeline_options_t;
+
+/**
+ * Initializes pipeline options to their defaults.
+ */
+void mpack_pipeline_options_init(mpack_pipeline_options_t* options);
+
+/**
+ * A function that converts a parsed message to a result. It is called on
+ * a worker thread, concurrently with other calls.
+ *
+ * The tree and its data are only valid until the function returns. It
+ * can flag an error on the tree (for example by reading a node with the
+ * wrong type), in which case the error is delivered with the result.
+ *
+ * @param context The context passed to the pipeline
+ * @param tree The parsed message
+ * @return The result to deliver
+ */
+typedef void* (*mpack_pipeline_decode_t)(void* context, mpack_tree_t* tree);
+
+/**
+ * A function that receives the result of each message.
+ *
+ * @param context The context passed to the pipeline
+ * @param index The index of the message in the stream
+ * @param result The result of the decode function, or NULL if the
+ *     message could not be parsed or there is no decode function
+ * @param error mpack_ok, or the error that occurred parsing or decoding
+ *     the message
+ */
+typedef void (*mpack_pipeline_deliver_t)(void* context, uint64_t index, void* result, mpack_error_t error);
+
+/**
+ * A function that reads more of a pipeline's stream. It works like a
+ * reader's fill function, except that it is not given a reader.
+ *
+ * @param context The context passed to the pipeline
+ * @param buffer The buffer to fill
+ * @param count The size of the buffer
+ * @return The number of bytes read, or 0 at the end of the stream or on
+ *     error.
+ */
+typedef size_t (*mpack_pipeline_fill_t)(void* context, char* buffer, size_t count);
+
+/**
+ * Decodes each message in the given buffer of concatenated messages on a
+ * pool of worker threads, returning once all messages have been
+ * delivered.
+ *
+ * Messages are parsed in place, so the data must remain valid and
+ * unchanged until this returns. It is well suited to a memory-mapped
+ * file (see mpack_mmap_file().)
+ *
+ * Errors in individual messages (such as a message with more nodes than
+ * a tree allows) are delivered with the message. Errors in the stream
+ * itself stop splitting it; all messages before the error are still
+ * delivered.
+ *
+ * @param data The messages to decode
+ * @param length The length of the data in bytes
+ * @param decode The function that converts each message to a result, or
+ *     NULL to deliver NULL results
+ * @param deliver The function that receives each result
+ * @param context An arbitrary pointer passed to the callbacks
+ * @param options The pipeline options, or NULL to use the defaults
+ * @return mpack_ok if the data was entirely decoded, mpack_error_invalid
+ *     if it is not valid MessagePack, mpack_error_io if it ends with a
+ *     truncated message, or mpack_error_memory if memory or threads could
+ *     not be allocated.
+ */
+mpack_error_t mpack_pipeline_run(const char* data, size_t length,
+        mpack_pipeline_decode_t decode, mpack_pipeline_deliver_t deliver,
+        void* context, const mpack_pipeline_options_t* options);
+
+/**
+ * Decodes each message read from the given fill function on a pool of
+ * worker threads, returning once the fill function reaches the end of
+ * the stream and all messages have been delivered.
+ *
+ * The stream is read into a few buffers of the chunk size in the
+ * options, which are reused once the messages in them have been
+ * delivered. The fill function is called on the calling thread, which
+ * also delivers ordered results, so a fill function that blocks delays
+ * delivery.
+ *
+ * This otherwise works like mpack_pipeline_run(). It additionally
+ * returns mpack_error_too_big if a message exceeds the maximum size in
+ * the options.
+ *
+ * @see mpack_pipeline_run()
+ */
+mpack_error_t mpack_pipeline_run_fill(mpack_pipeline_fill_t fill,
+        mpack_pipeline_decode_t decode, mpack_pipeline_deliver_t deliver,
+        void* context, const mpack_pipeline_options_t* options);
+
+/**
+ * @}
+ */
+
+#endif
+
+#endif
+
+MPACK_HEADER_END
+
+#endif
+
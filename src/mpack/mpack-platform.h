@@ -47,6 +47,21 @@
 #define _CRT_SECURE_NO_WARNINGS 1
 #endif
 
+/* POSIX file mapping functions are hidden by strict C modes (e.g. -std=c99) */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE) && defined(MPACK_INTERNAL) && MPACK_INTERNAL
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+/* and files over 2 GB need a 64-bit off_t for fseeko() on 32-bit platforms */
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS) && defined(MPACK_INTERNAL) && MPACK_INTERNAL
+#define _FILE_OFFSET_BITS 64
+#endif
+
+/* as is syscall(), which shared rings use for futexes on Linux */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE) && defined(MPACK_INTERNAL) && MPACK_INTERNAL
+#define _DEFAULT_SOURCE 1
+#endif
+
 
 
 #include "mpack-config.h"
@@ -69,6 +84,21 @@
 #ifndef MPACK_WRITER
 #define MPACK_WRITER 0
 #endif
+#ifndef MPACK_JSON
+#define MPACK_JSON 0
+#endif
+#ifndef MPACK_JOURNAL
+#define MPACK_JOURNAL 0
+#endif
+#ifndef MPACK_PIPELINE
+#define MPACK_PIPELINE 0
+#endif
+#ifndef MPACK_RING
+#define MPACK_RING 0
+#endif
+#ifndef MPACK_FRAME
+#define MPACK_FRAME 0
+#endif
 
 #ifndef MPACK_STDLIB
 #define MPACK_STDLIB 0
@@ -96,6 +126,12 @@
 #ifndef MPACK_NO_TRACKING
 #define MPACK_NO_TRACKING 0
 #endif
+#ifndef MPACK_TRACKING_INLINE_DEPTH
+#define MPACK_TRACKING_INLINE_DEPTH 0
+#endif
+#ifndef MPACK_STATS
+#define MPACK_STATS 0
+#endif
 #ifndef MPACK_OPTIMIZE_FOR_SIZE
 #define MPACK_OPTIMIZE_FOR_SIZE 0
 #endif
@@ -116,6 +152,31 @@
 #define MPACK_NO_BUILTINS 0
 #endif
 
+/*
+ * Memory-mapped files are supported wherever stdio is available on
+ * Windows and POSIX systems. Pre-define MPACK_MMAP to 0 to disable them.
+ */
+#ifndef MPACK_MMAP
+    #if MPACK_STDIO && (defined(_WIN32) || defined(__unix__) || (defined(__APPLE__) && defined(__MACH__)))
+        #define MPACK_MMAP 1
+    #else
+        #define MPACK_MMAP 0
+    #endif
+#endif
+
+/*
+ * Shared memory message rings use futexes, so they are supported on Linux
+ * when the message ring is enabled. Pre-define MPACK_SHARED_RING to 0 to
+ * disable them.
+ */
+#ifndef MPACK_SHARED_RING
+    #if MPACK_RING && defined(__linux__)
+        #define MPACK_SHARED_RING 1
+    #else
+        #define MPACK_SHARED_RING 0
+    #endif
+#endif
+
 
 
 /* System headers (based on configuration) */
@@ -216,6 +277,13 @@ MPACK_HEADER_START
 
 #define MPACK_UNUSED(var) ((void)(var))
 
+// adds to a statistics counter; the counter is not evaluated without MPACK_STATS
+#if MPACK_STATS
+#define MPACK_STATS_ADD(stat, count) ((void)((stat) += (count)))
+#else
+#define MPACK_STATS_ADD(stat, count) ((void)0)
+#endif
+
 #define MPACK_STRINGIFY_IMPL(arg) #arg
 #define MPACK_STRINGIFY(arg) MPACK_STRINGIFY_IMPL(arg)
 
@@ -639,11 +707,11 @@ size_t mpack_strlen(const char* s);
     #if MPACK_STDIO
         #error "MPACK_STDIO requires preprocessor definitions for MPACK_MALLOC and MPACK_FREE."
     #endif
-    #if MPACK_READ_TRACKING
-        #error "MPACK_READ_TRACKING requires preprocessor definitions for MPACK_MALLOC and MPACK_FREE."
+    #if MPACK_READ_TRACKING && !MPACK_TRACKING_INLINE_DEPTH
+        #error "MPACK_READ_TRACKING requires preprocessor definitions for MPACK_MALLOC and MPACK_FREE, or MPACK_TRACKING_INLINE_DEPTH."
     #endif
-    #if MPACK_WRITE_TRACKING
-        #error "MPACK_WRITE_TRACKING requires preprocessor definitions for MPACK_MALLOC and MPACK_FREE."
+    #if MPACK_WRITE_TRACKING && !MPACK_TRACKING_INLINE_DEPTH
+        #error "MPACK_WRITE_TRACKING requires preprocessor definitions for MPACK_MALLOC and MPACK_FREE, or MPACK_TRACKING_INLINE_DEPTH."
     #endif
 #endif
 
@@ -34,6 +34,7 @@ void mpack_reader_init(mpack_reader_t* reader, char* buffer, size_t size, size_t
     reader->buffer = buffer;
     reader->size = size;
     reader->left = count;
+    reader->fetched = count;
 
     #if MPACK_READ_TRACKING
     mpack_reader_flag_if_error(reader, mpack_track_init(&reader->track));
@@ -56,6 +57,7 @@ void mpack_reader_init_data(mpack_reader_t* reader, const char* data, size_t cou
 
     mpack_memset(reader, 0, sizeof(*reader));
     reader->left = count;
+    reader->fetched = count;
 
     // unfortunately we have to cast away the const to store the buffer,
     // but we won't be modifying it because there's no fill function.
@@ -130,6 +132,9 @@ static void mpack_file_reader_skip(mpack_reader_t* reader, size_t count) {
     }
 
     // If the stream is not seekable, fall back to the fill function.
+    // The skipped bytes were already counted, and the fill will count
+    // them again.
+    reader->fetched -= count;
     mpack_reader_skip_using_fill(reader, count);
 }
 #endif
@@ -177,6 +182,52 @@ void mpack_reader_init_file(mpack_reader_t* reader, const char* filename) {
 }
 #endif
 
+#if MPACK_MMAP
+static void mpack_mmap_reader_teardown(mpack_reader_t* reader) {
+    size_t* length = (size_t*)reader->context;
+
+    if (length) {
+        bool unmapped = mpack_munmap_file(reader->buffer, *length);
+        MPACK_FREE(length);
+        reader->context = NULL;
+        if (!unmapped)
+            mpack_reader_flag_error(reader, mpack_error_io);
+    }
+
+    reader->buffer = NULL;
+}
+
+void mpack_reader_init_mmap(mpack_reader_t* reader, const char* filename) {
+    mpack_assert(filename != NULL, "filename is NULL");
+
+    // the mapping length is needed to unmap the file on teardown
+    size_t* length = (size_t*)MPACK_MALLOC(sizeof(size_t));
+    if (length == NULL) {
+        mpack_reader_init_error(reader, mpack_error_memory);
+        return;
+    }
+
+    char* data;
+    mpack_error_t error = mpack_mmap_file(filename, &data, length);
+    if (error != mpack_ok) {
+        MPACK_FREE(length);
+        mpack_reader_init_error(reader, error);
+        return;
+    }
+
+    // an empty file is read as empty data
+    if (data == NULL) {
+        MPACK_FREE(length);
+        mpack_reader_init_data(reader, "", 0);
+        return;
+    }
+
+    mpack_reader_init_data(reader, data, *length);
+    mpack_reader_set_context(reader, length);
+    mpack_reader_set_teardown(reader, mpack_mmap_reader_teardown);
+}
+#endif
+
 mpack_error_t mpack_reader_destroy(mpack_reader_t* reader) {
 
     // clean up tracking, asserting if we're not already in an error state
@@ -210,6 +261,7 @@ void mpack_reader_flag_error(mpack_reader_t* reader, mpack_error_t error) {
 
     if (reader->error == mpack_ok) {
         reader->error = error;
+        reader->fetched -= reader->left; // latch the error position
         reader->left = 0;
         if (reader->error_fn)
             reader->error_fn(reader, error);
@@ -222,9 +274,12 @@ static size_t mpack_fill(mpack_reader_t* reader, char* p, size_t count) {
     mpack_assert(reader->fill != NULL, "mpack_fill() called with no fill function?");
 
     size_t ret = reader->fill(reader, p, count);
+    MPACK_STATS_ADD(reader->stats.fill_calls, 1);
     if (ret == ((size_t)(-1)))
         return 0;
 
+    MPACK_STATS_ADD(reader->stats.fill_bytes, ret);
+    reader->fetched += ret;
     return ret;
 }
 
@@ -260,6 +315,7 @@ bool mpack_reader_ensure_straddle(mpack_reader_t* reader, size_t count) {
 
     mpack_assert(count <= reader->size, "cannot ensure byte count %i larger than buffer size %i",
             (int)count, (int)reader->size);
+    MPACK_STATS_ADD(reader->stats.straddles, 1);
 
     // re-fill as much as possible
     mpack_partial_fill(reader);
@@ -315,6 +371,7 @@ void mpack_read_native_big(mpack_reader_t* reader, char* p, size_t count) {
         mpack_memset(p, 0, count);
         return;
     }
+    MPACK_STATS_ADD(reader->stats.straddles, 1);
 
     // flush what's left of the buffer
     if (reader->left > 0) {
@@ -395,6 +452,9 @@ void mpack_skip_bytes(mpack_reader_t* reader, size_t count) {
     // fill the buffer and skip from it instead of trying to seek.
     if (reader->skip && count > reader->size / 16) {
         mpack_log("calling skip function for %i bytes\n", (int)count);
+        MPACK_STATS_ADD(reader->stats.skip_calls, 1);
+        MPACK_STATS_ADD(reader->stats.skip_bytes, count);
+        reader->fetched += count;
         reader->skip(reader, count);
         return;
     }
@@ -555,6 +615,7 @@ static const char* mpack_read_bytes_inplace_big(mpack_reader_t* reader, size_t c
         mpack_reader_flag_error(reader, mpack_error_too_big);
         return NULL;
     }
+    MPACK_STATS_ADD(reader->stats.straddles, 1);
 
     // re-fill as much as possible
     mpack_partial_fill(reader);
@@ -1038,10 +1099,8 @@ mpack_tag_t mpack_peek_tag(mpack_reader_t* reader) {
     return tag;
 }
 
-void mpack_discard(mpack_reader_t* reader) {
-    mpack_tag_t var = mpack_read_tag(reader);
-    if (mpack_reader_error(reader))
-        return;
+// discards the contents of an element whose tag has already been read
+static void mpack_discard_contents(mpack_reader_t* reader, mpack_tag_t var) {
     switch (var.type) {
         case mpack_type_str:
             mpack_skip_bytes(reader, var.v.l);
@@ -1079,8 +1138,499 @@ void mpack_discard(mpack_reader_t* reader) {
     }
 }
 
+void mpack_discard(mpack_reader_t* reader) {
+    mpack_tag_t var = mpack_read_tag(reader);
+    if (mpack_reader_error(reader))
+        return;
+    mpack_discard_contents(reader, var);
+}
+
+void mpack_event_stack_init(mpack_event_stack_t* stack, mpack_event_level_t* local) {
+    stack->levels = local;
+    stack->depth = MPACK_EVENT_STACK_LOCAL_DEPTH;
+    stack->level = 0;
+    #ifdef MPACK_MALLOC
+    stack->owned = false;
+    #endif
+}
+
+mpack_error_t mpack_event_stack_push(mpack_event_stack_t* stack, mpack_type_t type, uint64_t left) {
+
+    // Make sure we have enough room in the stack
+    if (stack->level == stack->depth) {
+        #ifdef MPACK_MALLOC
+        size_t new_depth = stack->depth * 2;
+        mpack_log("growing event stack to depth %i\n", (int)new_depth);
+
+        // Replace the stack-allocated parsing stack
+        if (!stack->owned) {
+            mpack_event_level_t* new_levels = (mpack_event_level_t*)MPACK_MALLOC(
+                    sizeof(mpack_event_level_t) * new_depth);
+            if (!new_levels)
+                return mpack_error_memory;
+            mpack_memcpy(new_levels, stack->levels, sizeof(mpack_event_level_t) * stack->depth);
+            stack->levels = new_levels;
+            stack->owned = true;
+
+        // Realloc the allocated parsing stack
+        } else {
+            mpack_event_level_t* new_levels = (mpack_event_level_t*)mpack_realloc(stack->levels,
+                    sizeof(mpack_event_level_t) * stack->depth, sizeof(mpack_event_level_t) * new_depth);
+            if (!new_levels)
+                return mpack_error_memory;
+            stack->levels = new_levels;
+        }
+        stack->depth = new_depth;
+        #else
+        return mpack_error_too_big;
+        #endif
+    }
+
+    stack->levels[stack->level].type = type;
+    stack->levels[stack->level].left = left;
+    ++stack->level;
+    return mpack_ok;
+}
+
+void mpack_event_stack_destroy(mpack_event_stack_t* stack) {
+    #ifdef MPACK_MALLOC
+    if (stack->owned)
+        MPACK_FREE(stack->levels);
+    #else
+    MPACK_UNUSED(stack);
+    #endif
+}
+
+const char* mpack_read_bytes_chunk(mpack_reader_t* reader, size_t remaining, size_t* count) {
+
+    // a data reader (with size 0) has the whole object in its
+    // buffer. otherwise we take what's left in the buffer, or
+    // at most a full buffer if it needs to be refilled.
+    *count = remaining;
+    if (reader->size != 0) {
+        if (reader->left > 0) {
+            if (*count > reader->left)
+                *count = reader->left;
+        } else if (*count > reader->size) {
+            *count = reader->size;
+        }
+    }
+    return mpack_read_bytes_inplace(reader, *count);
+}
+
+// delivers the contents of a str, bin or ext as in-place chunks
+static void mpack_parse_events_bytes(mpack_reader_t* reader, const mpack_visitor_t* visitor,
+        void* context, mpack_tag_t tag)
+{
+    size_t remaining = tag.v.l;
+
+    if (visitor->bytes == NULL) {
+        mpack_skip_bytes(reader, remaining);
+    } else {
+        while (remaining > 0) {
+            size_t count;
+            const char* data = mpack_read_bytes_chunk(reader, remaining, &count);
+            if (mpack_reader_error(reader) != mpack_ok)
+                return;
+            visitor->bytes(reader, context, data, count);
+            if (mpack_reader_error(reader) != mpack_ok)
+                return;
+            remaining -= count;
+        }
+    }
+
+    mpack_done_type(reader, tag.type);
+    if (visitor->finish && mpack_reader_error(reader) == mpack_ok)
+        visitor->finish(reader, context, tag.type);
+}
+
+void mpack_parse_events(mpack_reader_t* reader, const mpack_visitor_t* visitor, void* context) {
+    mpack_assert(visitor != NULL, "visitor is NULL");
+
+    // As with the node parser, the initial parsing stack is allocated
+    // on the call stack, and replaced with a heap allocation if it
+    // needs to grow.
+    mpack_event_stack_t stack;
+    mpack_event_level_t stack_local[MPACK_EVENT_STACK_LOCAL_DEPTH]; // no VLAs in VS 2013
+    mpack_event_stack_init(&stack, stack_local);
+
+    while (mpack_reader_error(reader) == mpack_ok) {
+        mpack_tag_t tag = mpack_read_tag(reader);
+        if (mpack_reader_error(reader) != mpack_ok)
+            break;
+
+        switch (tag.type) {
+            case mpack_type_str:
+            case mpack_type_bin:
+            case mpack_type_ext:
+                if (visitor->start)
+                    visitor->start(reader, context, tag);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    mpack_parse_events_bytes(reader, visitor, context, tag);
+                break;
+
+            case mpack_type_array:
+            case mpack_type_map: {
+                if (visitor->start)
+                    visitor->start(reader, context, tag);
+                uint64_t left = tag.v.n;
+                if (tag.type == mpack_type_map)
+                    left *= 2;
+                if (left > 0) {
+                    mpack_error_t error = mpack_event_stack_push(&stack, tag.type, left);
+                    if (error != mpack_ok)
+                        mpack_reader_flag_error(reader, error);
+                    continue;
+                }
+                mpack_done_type(reader, tag.type);
+                if (visitor->finish && mpack_reader_error(reader) == mpack_ok)
+                    visitor->finish(reader, context, tag.type);
+                break;
+            }
+
+            default:
+                if (visitor->scalar)
+                    visitor->scalar(reader, context, tag);
+                break;
+        }
+
+        // An element is complete; finish any containers it completes
+        while (stack.level > 0 && mpack_reader_error(reader) == mpack_ok &&
+                --stack.levels[stack.level - 1].left == 0)
+        {
+            mpack_type_t type = stack.levels[--stack.level].type;
+            mpack_done_type(reader, type);
+            if (visitor->finish && mpack_reader_error(reader) == mpack_ok)
+                visitor->finish(reader, context, type);
+        }
+
+        if (stack.level == 0)
+            break;
+    }
+
+    mpack_event_stack_destroy(&stack);
+}
+
+// adds a path to the pathset trie
+static mpack_error_t mpack_pathset_add(mpack_pathset_t* pathset, size_t capacity,
+        const char* path, size_t index)
+{
+    mpack_path_node_t* nodes = pathset->nodes;
+    uint32_t node = 0;
+
+    for (;;) {
+        const char* end = path;
+        while (*end != '\0' && *end != '.')
+            ++end;
+        size_t len = (size_t)(end - path);
+
+        if (len == 0) {
+            mpack_break("path %i contains an empty key!", (int)index);
+            return mpack_error_bug;
+        }
+        if (len > UINT32_MAX)
+            return mpack_error_too_big;
+        if (nodes[node].path != 0) {
+            mpack_break("path %i passes through the end of path %i!", (int)index, (int)nodes[node].path - 1);
+            return mpack_error_bug;
+        }
+
+        // find the matching child, appending one if there is none
+        uint32_t* link = &nodes[node].child;
+        while (*link != 0 && (nodes[*link].key_len != len ||
+                    mpack_memcmp(nodes[*link].key, path, len) != 0))
+            link = &nodes[*link].sibling;
+
+        if (*link == 0) {
+            if (pathset->node_count == capacity)
+                return mpack_error_too_big;
+            mpack_path_node_t* child = &nodes[pathset->node_count];
+            mpack_memset(child, 0, sizeof(*child));
+            child->key = path;
+            child->key_len = (uint32_t)len;
+            *link = (uint32_t)pathset->node_count++;
+        }
+        node = *link;
+
+        if (*end == '\0')
+            break;
+        path = end + 1;
+    }
+
+    if (nodes[node].path != 0) {
+        mpack_break("path %i is a duplicate of path %i!", (int)index, (int)nodes[node].path - 1);
+        return mpack_error_bug;
+    }
+    if (nodes[node].child != 0) {
+        mpack_break("path %i is a prefix of another path!", (int)index);
+        return mpack_error_bug;
+    }
+    nodes[node].path = (uint32_t)(index + 1);
+    return mpack_ok;
+}
+
+mpack_error_t mpack_pathset_init(mpack_pathset_t* pathset, mpack_path_node_t* nodes,
+        size_t capacity, const char* paths[], size_t count)
+{
+    mpack_memset(pathset, 0, sizeof(*pathset));
+
+    if (count == 0) {
+        mpack_break("count cannot be zero; no paths are valid!");
+        return mpack_error_bug;
+    }
+    mpack_assert(paths != NULL, "paths cannot be NULL");
+    mpack_assert(nodes != NULL || capacity == 0, "nodes cannot be NULL");
+
+    // node indices and path indices are stored in 32 bits
+    if (count >= UINT32_MAX)
+        return mpack_error_too_big;
+    if (capacity > UINT32_MAX)
+        capacity = UINT32_MAX;
+    if (capacity == 0)
+        return mpack_error_too_big;
+
+    // node 0 is the root, the top-level map
+    mpack_memset(&nodes[0], 0, sizeof(nodes[0]));
+    pathset->nodes = nodes;
+    pathset->node_count = 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        mpack_assert(paths[i] != NULL, "path %i is NULL", (int)i);
+        mpack_error_t error = mpack_pathset_add(pathset, capacity, paths[i], i);
+        if (error != mpack_ok) {
+            mpack_memset(pathset, 0, sizeof(*pathset));
+            return error;
+        }
+    }
+
+    pathset->path_count = count;
+    return mpack_ok;
+}
+
+// reads a map key, returning the matching child of the given node, or
+// NULL if it doesn't match (in which case the key has been discarded.)
+static const mpack_path_node_t* mpack_project_key(mpack_reader_t* reader,
+        const mpack_pathset_t* pathset, const mpack_path_node_t* parent)
+{
+    mpack_tag_t tag = mpack_read_tag(reader);
+    if (mpack_reader_error(reader) != mpack_ok)
+        return NULL;
+    if (tag.type != mpack_type_str) {
+        mpack_discard_contents(reader, tag);
+        return NULL;
+    }
+
+    // we only read the key in place if a child has the same length.
+    // other keys are skipped without being looked at.
+    const mpack_path_node_t* nodes = pathset->nodes;
+    uint32_t child = parent->child;
+    while (child != 0 && nodes[child].key_len != tag.v.l)
+        child = nodes[child].sibling;
+
+    const mpack_path_node_t* match = NULL;
+    if (child == 0) {
+        mpack_skip_bytes(reader, tag.v.l);
+    } else {
+        const char* key = mpack_read_bytes_inplace(reader, tag.v.l);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return NULL;
+        for (; child != 0; child = nodes[child].sibling) {
+            if (nodes[child].key_len == tag.v.l &&
+                    mpack_memcmp(nodes[child].key, key, tag.v.l) == 0)
+            {
+                match = &nodes[child];
+                break;
+            }
+        }
+    }
+
+    mpack_done_str(reader);
+    return match;
+}
+
+static void mpack_project_value(mpack_reader_t* reader, const mpack_pathset_t* pathset,
+        const mpack_path_node_t* node, mpack_path_value_t values[])
+{
+    // a reader with a data buffer can return compound values in place
+    const char* start = NULL;
+    if (reader->size == 0 && mpack_reader_error(reader) == mpack_ok)
+        start = reader->buffer + reader->pos;
+
+    mpack_tag_t tag = mpack_read_tag(reader);
+    if (mpack_reader_error(reader) != mpack_ok)
+        return;
+
+    // intermediate nodes descend into maps. the recursion depth is
+    // bounded by the longest path.
+    if (node->path == 0) {
+        if (tag.type != mpack_type_map) {
+            mpack_discard_contents(reader, tag);
+            return;
+        }
+        for (uint32_t i = tag.v.n; i > 0 && mpack_reader_error(reader) == mpack_ok; --i) {
+            const mpack_path_node_t* child = mpack_project_key(reader, pathset, node);
+            if (child != NULL)
+                mpack_project_value(reader, pathset, child, values);
+            else
+                mpack_discard(reader);
+        }
+        mpack_done_map(reader);
+        return;
+    }
+
+    mpack_path_value_t* value = &values[node->path - 1];
+    if (value->found) {
+        mpack_reader_flag_error(reader, mpack_error_invalid);
+        return;
+    }
+    value->found = true;
+    value->tag = tag;
+
+    switch (tag.type) {
+        case mpack_type_str:
+        case mpack_type_bin:
+        case mpack_type_ext:
+            if (tag.v.l > 0) {
+                value->data = mpack_read_bytes_inplace(reader, tag.v.l);
+                value->size = tag.v.l;
+            }
+            mpack_done_type(reader, tag.type);
+            break;
+
+        case mpack_type_array:
+        case mpack_type_map:
+            mpack_discard_contents(reader, tag);
+            if (start != NULL && mpack_reader_error(reader) == mpack_ok) {
+                value->data = start;
+                value->size = (size_t)(reader->buffer + reader->pos - start);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void mpack_project(mpack_reader_t* reader, const mpack_pathset_t* pathset, mpack_path_value_t values[]) {
+    mpack_assert(pathset->nodes != NULL, "pathset is not initialized");
+    mpack_memset(values, 0, sizeof(*values) * pathset->path_count);
+    mpack_project_value(reader, pathset, &pathset->nodes[0], values);
+}
+
+mpack_error_t mpack_project_data(const char* data, size_t length,
+        const mpack_pathset_t* pathset, mpack_path_value_t values[])
+{
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, length);
+    mpack_project(&reader, pathset, values);
+    return mpack_reader_destroy(&reader);
+}
+
+// The total size of each type whose size is determined by its type byte
+// alone, or 0 for containers, types with a length field and 0xc1.
+static const uint8_t mpack_measure_sizes[256] = {
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x00
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x10
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x20
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x30
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x40
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x50
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x60
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0x70
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x80
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x90
+     1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, // 0xa0
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, // 0xb0
+     1,  0,  1,  1,  0,  0,  0,  0,  0,  0,  5,  9,  2,  3,  5,  9, // 0xc0
+     2,  3,  5,  9,  3,  4,  6, 10, 18,  0,  0,  0,  0,  0,  0,  0, // 0xd0
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0xe0
+     1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, // 0xf0
+};
+
+mpack_error_t mpack_measure_object(const char* data, size_t length, size_t* size) {
+    const uint8_t* p = (const uint8_t*)data;
+    size_t pos = 0;
+    *size = 0;
+
+    // the number of elements still to be skipped. each element is at least
+    // one byte, so it never needs to exceed the remaining length.
+    size_t pending = 1;
+
+    while (pending > 0) {
+        if (pos == length)
+            return mpack_error_io;
+        uint8_t type = p[pos];
+        --pending;
+
+        // scalars and fixstrs are skipped with a table lookup. this avoids
+        // branching on the type, which is mostly unpredictable.
+        size_t fixed = mpack_measure_sizes[type];
+        if (fixed != 0) {
+            if (length - pos < fixed)
+                return mpack_error_io;
+            pos += fixed;
+            continue;
+        }
+
+        // the size of the header, the number of bytes of its length field
+        // (if any), and whether the length counts bytes or elements
+        size_t header = 1;
+        size_t width = 0;
+        size_t elements = 0;
+        size_t bytes = 0;
+
+        if (type >= 0x80 && type <= 0x8f) {
+            elements = (size_t)(type & 0xf) * 2;
+        } else if (type >= 0x90 && type <= 0x9f) {
+            elements = type & 0xf;
+        } else switch (type) {
+            case 0xc4: case 0xd9: header = 2; width = 1; break;
+            case 0xc5: case 0xda: header = 3; width = 2; break;
+            case 0xc6: case 0xdb: header = 5; width = 4; break;
+            case 0xc7: header = 3; width = 1; break;
+            case 0xc8: header = 4; width = 2; break;
+            case 0xc9: header = 6; width = 4; break;
+            case 0xdc: case 0xde: header = 3; width = 2; break;
+            case 0xdd: case 0xdf: header = 5; width = 4; break;
+            default: return mpack_error_invalid; // 0xc1
+        }
+
+        if (length - pos < header)
+            return mpack_error_io;
+        if (width != 0) {
+            const char* field = data + pos + 1;
+            size_t count = (width == 1) ? p[pos + 1] :
+                    (width == 2) ? mpack_load_u16(field) : (size_t)mpack_load_u32(field);
+            if (type == 0xdc || type == 0xdd)
+                elements = count;
+            else if (type == 0xde || type == 0xdf)
+                elements = count > SIZE_MAX / 2 ? SIZE_MAX : count * 2;
+            else
+                bytes = count;
+        }
+        pos += header;
+
+        if (length - pos < bytes)
+            return mpack_error_io;
+        pos += bytes;
+        if (length - pos < elements || length - pos - elements < pending)
+            return mpack_error_io;
+        pending += elements;
+    }
+
+    *size = pos;
+    return mpack_ok;
+}
+
 #if MPACK_READ_TRACKING
-void mpack_done_type(mpack_reader_t* reader, mpack_type_t type) {
+#if MPACK_TRACKING_INLINE_DEPTH
+// the common case is handled inline in mpack-reader.h
+#define MPACK_DONE_TYPE_SLOW mpack_done_type_slow
+#else
+#define MPACK_DONE_TYPE_SLOW mpack_done_type
+#endif
+
+void MPACK_DONE_TYPE_SLOW(mpack_reader_t* reader, mpack_type_t type) {
     if (mpack_reader_error(reader) == mpack_ok)
         mpack_reader_flag_if_error(reader, mpack_track_pop(&reader->track, type));
 }
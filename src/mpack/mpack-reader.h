@@ -117,6 +117,24 @@ typedef void (*mpack_reader_error_t)(mpack_reader_t* reader, mpack_error_t error
  */
 typedef void (*mpack_reader_teardown_t)(mpack_reader_t* reader);
 
+#if MPACK_STATS
+/**
+ * Statistics counted by a reader when MPACK_STATS is enabled.
+ *
+ * The total number of bytes consumed by the reader is available from
+ * mpack_reader_error_position().
+ *
+ * @see mpack_reader_stats()
+ */
+typedef struct mpack_reader_stats_t {
+    uint64_t fill_calls; /**< Calls to the fill function. */
+    uint64_t fill_bytes; /**< Bytes returned by the fill function. */
+    uint64_t skip_calls; /**< Calls to the skip function. */
+    uint64_t skip_bytes; /**< Bytes skipped by the skip function. */
+    uint64_t straddles;  /**< Reads that did not fit in the data left in the buffer. */
+} mpack_reader_stats_t;
+#endif
+
 /* Hide internals from documentation */
 /** @cond */
 
@@ -136,11 +154,16 @@ struct mpack_reader_t {
     size_t size;        /* Size of the buffer, or zero if it's const */
     size_t left;        /* How many bytes are left in the buffer */
     size_t pos;         /* Position within the buffer */
+    uint64_t fetched;   /* Total bytes filled or skipped, less any left when an error was flagged */
     mpack_error_t error;  /* Error state */
 
     #if MPACK_READ_TRACKING
     mpack_track_t track; /* Stack of map/array/str/bin/ext reads */
     #endif
+
+    #if MPACK_STATS
+    mpack_reader_stats_t stats; /* Statistics counters */
+    #endif
 };
 
 /** @endcond */
@@ -185,6 +208,26 @@ void mpack_reader_init_data(mpack_reader_t* reader, const char* data, size_t cou
 void mpack_reader_init_file(mpack_reader_t* reader, const char* filename);
 #endif
 
+#if MPACK_MMAP
+/**
+ * Initializes an MPack reader that reads from a memory-mapped file.
+ *
+ * The entire file is presented to the reader as a single contiguous chunk
+ * of data, as with mpack_reader_init_data(). This means in-place reads such
+ * as mpack_read_bytes_inplace() and mpack_read_utf8_inplace() return pointers
+ * directly into the mapping regardless of their size, and skipping data
+ * requires no I/O. The returned pointers are valid until the reader is
+ * destroyed, at which point the file is unmapped.
+ *
+ * If the file cannot be opened or mapped, the reader is placed in the
+ * mpack_error_io error state.
+ *
+ * @param reader The MPack reader.
+ * @param filename The path of the file to map.
+ */
+void mpack_reader_init_mmap(mpack_reader_t* reader, const char* filename);
+#endif
+
 /**
  * @def mpack_reader_init_stack(reader)
  * @hideinitializer
@@ -329,6 +372,37 @@ MPACK_INLINE mpack_error_t mpack_reader_error(mpack_reader_t* reader) {
     return reader->error;
 }
 
+/**
+ * Returns the byte offset in the MessagePack stream at which the reader's
+ * error was flagged, or the current offset if the reader is not in an
+ * error state.
+ *
+ * The offset is that of the first byte that had not yet been consumed when
+ * the error was flagged. For example a type error from an expect function
+ * is flagged after its tag has been read, whereas invalid or truncated data
+ * is flagged at the start of the element that could not be read.
+ *
+ * The offset counts all bytes consumed from the data or fill function
+ * since the reader was initialized, so it also locates errors in streams
+ * of several messages. This costs nothing extra until an error is flagged.
+ * It is 64 bits wide so that it does not wrap in streams larger than
+ * 4 GiB on 32-bit platforms.
+ */
+MPACK_INLINE uint64_t mpack_reader_error_position(mpack_reader_t* reader) {
+    return reader->fetched - reader->left;
+}
+
+#if MPACK_STATS
+/**
+ * Returns the statistics counted by the reader since it was initialized.
+ *
+ * This is only available when MPACK_STATS is enabled.
+ */
+MPACK_INLINE const mpack_reader_stats_t* mpack_reader_stats(mpack_reader_t* reader) {
+    return &reader->stats;
+}
+#endif
+
 /**
  * Places the reader in the given error state, calling the error callback if one
  * is set.
@@ -655,7 +729,22 @@ MPACK_INLINE bool mpack_should_read_bytes_inplace(mpack_reader_t* reader, size_t
  * @{
  */
 
-#if MPACK_READ_TRACKING
+#if MPACK_READ_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+/** @cond */
+void mpack_done_type_slow(mpack_reader_t* reader, mpack_type_t type);
+/** @endcond */
+
+/**
+ * Finishes reading the given type.
+ *
+ * This will track reads to ensure that the correct number of elements
+ * or bytes are read.
+ */
+MPACK_INLINE void mpack_done_type(mpack_reader_t* reader, mpack_type_t type) {
+    if (!mpack_track_pop_fast(&reader->track, type))
+        mpack_done_type_slow(reader, type);
+}
+#elif MPACK_READ_TRACKING
 /**
  * Finishes reading the given type.
  *
@@ -729,6 +818,258 @@ MPACK_INLINE void mpack_done_ext(mpack_reader_t* reader) {
  */
 void mpack_discard(mpack_reader_t* reader);
 
+/**
+ * @}
+ */
+
+/**
+ * @name Event Parsing
+ * @{
+ */
+
+/**
+ * A set of callbacks for mpack_parse_events().
+ *
+ * Any callback may be NULL, in which case those events are skipped. A
+ * callback can stop parsing by flagging an error on the reader with
+ * mpack_reader_flag_error().
+ */
+typedef struct mpack_visitor_t {
+
+    /**
+     * Called for each nil, bool, int, uint, float or double.
+     */
+    void (*scalar)(mpack_reader_t* reader, void* context, mpack_tag_t tag);
+
+    /**
+     * Called at the start of each array, map, str, bin or ext. The tag
+     * contains the element count of an array or map (the number of
+     * key-value pairs for a map), or the byte length of a str, bin or
+     * ext.
+     */
+    void (*start)(mpack_reader_t* reader, void* context, mpack_tag_t tag);
+
+    /**
+     * Called with the data of a str, bin or ext between its start and
+     * finish events.
+     *
+     * The data points into the reader's buffer and is only valid until
+     * the callback returns. It is delivered in as few chunks as the
+     * reader's buffer allows: a reader initialized with a data buffer
+     * delivers the whole object at once, while a reader with a fill
+     * function may split it into several chunks. Nothing is delivered
+     * for zero-length data.
+     */
+    void (*bytes)(mpack_reader_t* reader, void* context, const char* data, size_t count);
+
+    /**
+     * Called at the end of each array, map, str, bin or ext, after all
+     * of its contents.
+     */
+    void (*finish)(mpack_reader_t* reader, void* context, mpack_type_t type);
+
+} mpack_visitor_t;
+
+/**
+ * Reads the next object (including all contained data if it is a
+ * compound type) and reports its contents to the given visitor as a
+ * sequence of events.
+ *
+ * The parser is iterative, so deeply nested data does not consume the
+ * call stack, and it does not allocate any memory per element. If
+ * MPACK_MALLOC is available, the nesting depth is unlimited; otherwise
+ * nesting deeper than MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC flags
+ * mpack_error_too_big.
+ *
+ * Parsing stops if an error is flagged on the reader, either by the
+ * data or by a callback. Events are delivered as data is read, so the
+ * visitor may receive events for part of a message before an error.
+ *
+ * @param reader The reader from which to parse the object
+ * @param visitor The callbacks to invoke
+ * @param context An arbitrary pointer passed to each callback
+ */
+void mpack_parse_events(mpack_reader_t* reader, const mpack_visitor_t* visitor, void* context);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Path Projection
+ * @{
+ */
+
+/**
+ * A node in the trie of a compiled path set. The caller provides an array
+ * of these to mpack_pathset_init().
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_path_node_t {
+    /** @cond */
+    const char* key;  /* Borrowed key segment (not null-terminated) */
+    uint32_t key_len; /* Length of the key segment */
+    uint32_t child;   /* Index of the first child, or zero if none */
+    uint32_t sibling; /* Index of the next sibling, or zero if none */
+    uint32_t path;    /* Index of the path ending here plus one, or zero */
+    /** @endcond */
+} mpack_path_node_t;
+
+/**
+ * A compiled set of map key paths to extract with mpack_project().
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_pathset_t {
+    /** @cond */
+    mpack_path_node_t* nodes; /* Borrowed node array; node 0 is the root */
+    size_t node_count;        /* Number of nodes in use */
+    size_t path_count;        /* Number of paths */
+    /** @endcond */
+} mpack_pathset_t;
+
+/**
+ * A value extracted by mpack_project().
+ */
+typedef struct mpack_path_value_t {
+
+    /** True if the path was found in the data. */
+    bool found;
+
+    /**
+     * The tag of the value. This contains the decoded value of a scalar,
+     * the byte length of a str, bin or ext, or the element count of an
+     * array or map.
+     */
+    mpack_tag_t tag;
+
+    /**
+     * For a str, bin or ext, the data of the value in place in the
+     * reader's buffer, or NULL if the length is zero.
+     *
+     * For an array or map read from a reader initialized with a data
+     * buffer, the complete encoded value (including its tag) in place.
+     * An array or map read from a reader with a fill function has no
+     * data, since it may not be in the buffer in its entirety.
+     *
+     * NULL for scalars.
+     */
+    const char* data;
+
+    /** The length of the data in bytes. */
+    size_t size;
+
+} mpack_path_value_t;
+
+/**
+ * Compiles a set of paths into a pathset for use with mpack_project().
+ *
+ * Each path is a sequence of string map keys separated by periods, such
+ * as "header.route". A path cannot contain empty keys, and no path may be
+ * a prefix of another (for example "header" and "header.route" cannot be
+ * used together.)
+ *
+ * No memory is allocated. The paths are not copied; they must outlive the
+ * pathset, as must the given node array. The pathset needs one node plus
+ * one more for each distinct key prefix, so the total number of keys in
+ * all paths plus one is always enough.
+ *
+ * @param pathset The pathset to initialize
+ * @param nodes An array of nodes used to store the compiled paths
+ * @param capacity The number of nodes in the array
+ * @param paths An array of paths of length count
+ * @param count The number of paths
+ * @return mpack_ok on success, mpack_error_too_big if there are not enough
+ *     nodes, or mpack_error_bug if the paths are invalid.
+ */
+mpack_error_t mpack_pathset_init(mpack_pathset_t* pathset, mpack_path_node_t* nodes,
+        size_t capacity, const char* paths[], size_t count);
+
+/**
+ * Returns the number of paths in the pathset.
+ */
+MPACK_INLINE size_t mpack_pathset_count(const mpack_pathset_t* pathset) {
+    return pathset->path_count;
+}
+
+/**
+ * Reads the next object, extracting the values at each path in the given
+ * pathset into the values array and skipping everything else.
+ *
+ * The values array must have one value for each path in the pathset, in
+ * the order of the paths given to mpack_pathset_init(). Values for paths
+ * not found in the data have found set to false.
+ *
+ * The object is walked only once and no memory is allocated. Only maps
+ * are descended; a path whose parent is not a map is not found.
+ * Non-string keys are skipped. If a path is found more than once (i.e. a
+ * map contains a duplicate key), mpack_error_invalid is flagged.
+ *
+ * The data of extracted values points into the reader's buffer, so it is
+ * only valid until the next read when the reader has a fill function
+ * (see mpack_read_bytes_inplace().) A reader initialized with a data
+ * buffer keeps its data valid as long as the buffer. With a fill
+ * function, an extracted str, bin or ext cannot be larger than the
+ * buffer, and only the last extracted value is guaranteed to be valid
+ * after this returns.
+ *
+ * @param reader The reader from which to read the object
+ * @param pathset The compiled paths to extract
+ * @param values An array of values of length mpack_pathset_count()
+ */
+void mpack_project(mpack_reader_t* reader, const mpack_pathset_t* pathset, mpack_path_value_t values[]);
+
+/**
+ * Extracts the values at each path in the given pathset from the
+ * MessagePack object at the start of the given data buffer. The data of
+ * extracted values points into the given buffer. As with a node tree, any
+ * data following the object is ignored.
+ *
+ * @return mpack_ok if the data started with a valid object, or the error
+ *     that occurred otherwise.
+ *
+ * @see mpack_project()
+ */
+mpack_error_t mpack_project_data(const char* data, size_t length,
+        const mpack_pathset_t* pathset, mpack_path_value_t values[]);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Message Boundaries
+ * @{
+ */
+
+/**
+ * Finds the size of the MessagePack object at the start of the given
+ * data buffer without parsing it.
+ *
+ * This is a structural skip: it only decodes type bytes and lengths,
+ * keeping a count of the elements still to come rather than a stack of
+ * containers. It uses constant memory regardless of nesting depth and is
+ * much faster than parsing, which makes it suitable for splitting a
+ * stream of concatenated messages before parsing each one.
+ *
+ * The contents are not validated beyond their structure, so an object
+ * found by this may still fail to parse (for example if it exceeds a
+ * tree's limits.)
+ *
+ * @param data The data to measure
+ * @param length The length of the data in bytes
+ * @param size Set to the size in bytes of the first object in the data,
+ *     or to 0 on error
+ * @return mpack_ok if the data starts with a complete object,
+ *     mpack_error_io if the data ends before the object does (so more
+ *     data is needed to measure it), or mpack_error_invalid if the data
+ *     is not valid MessagePack.
+ */
+mpack_error_t mpack_measure_object(const char* data, size_t length, size_t* size);
+
 /**
  * @}
  */
@@ -768,6 +1109,53 @@ MPACK_INLINE void mpack_print(const char* data, size_t len) {
 
 #if MPACK_INTERNAL
 
+#ifndef MPACK_EVENT_INITIAL_DEPTH
+// the depth of the event parsing stack allocated on the call stack
+// when MPACK_MALLOC is available. it grows on the heap as needed.
+#define MPACK_EVENT_INITIAL_DEPTH 8
+#endif
+
+#ifndef MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC
+#define MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC 32
+#endif
+
+// the depth of the stack that must be passed to mpack_event_stack_init()
+#ifdef MPACK_MALLOC
+#define MPACK_EVENT_STACK_LOCAL_DEPTH MPACK_EVENT_INITIAL_DEPTH
+#else
+#define MPACK_EVENT_STACK_LOCAL_DEPTH MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC
+#endif
+
+typedef struct mpack_event_level_t {
+    mpack_type_t type;
+    uint64_t left; // elements left to read (twice the pair count for maps)
+} mpack_event_level_t;
+
+// The stack of open containers of an iterative parser such as
+// mpack_parse_events(). It starts in the given local array and moves to
+// the heap if it needs to grow.
+typedef struct mpack_event_stack_t {
+    mpack_event_level_t* levels;
+    size_t depth;
+    size_t level;
+    #ifdef MPACK_MALLOC
+    bool owned;
+    #endif
+} mpack_event_stack_t;
+
+void mpack_event_stack_init(mpack_event_stack_t* stack, mpack_event_level_t* local);
+
+// Pushes a container onto the stack, returning mpack_error_memory or
+// mpack_error_too_big if the stack can't grow.
+mpack_error_t mpack_event_stack_push(mpack_event_stack_t* stack, mpack_type_t type, uint64_t left);
+
+void mpack_event_stack_destroy(mpack_event_stack_t* stack);
+
+// Reads the next in-place chunk of the remaining data of a str, bin or
+// ext, placing its size in count. The chunk is as large as the reader's
+// buffer allows, so a data reader returns all remaining data at once.
+const char* mpack_read_bytes_chunk(mpack_reader_t* reader, size_t remaining, size_t* count);
+
 bool mpack_reader_ensure_straddle(mpack_reader_t* reader, size_t count);
 
 // Ensures there are at least count bytes left in the buffer. This will
@@ -812,7 +1200,13 @@ MPACK_INLINE void mpack_read_native(mpack_reader_t* reader, char* p, size_t coun
 #endif
 
 MPACK_INLINE mpack_error_t mpack_reader_track_element(mpack_reader_t* reader) {
+    #if MPACK_READ_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+    // elements are only counted; they are checked by mpack_done_type()
+    mpack_track_element_fast(&reader->track);
+    return mpack_reader_error(reader);
+    #else
     return MPACK_READER_TRACK(reader, mpack_track_element(&reader->track, true));
+    #endif
 }
 
 MPACK_INLINE mpack_error_t mpack_reader_track_peek_element(mpack_reader_t* reader) {
@@ -0,0 +1,776 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define MPACK_INTERNAL 1
+
+#include "mpack-ring.h"
+
+#if MPACK_RING
+
+#include <sched.h>
+
+
+// Atomics
+
+#define MPACK_RING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MPACK_RING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#if defined(__i386__) || defined(__x86_64__)
+#define MPACK_RING_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define MPACK_RING_PAUSE() __asm__ __volatile__("yield")
+#else
+#define MPACK_RING_PAUSE() ((void)0)
+#endif
+
+// how long a thread spins before it starts yielding the processor
+#define MPACK_RING_SPINS 256
+
+// the header of a message holds its size, or this to skip to the start
+// of the buffer
+#define MPACK_RING_WRAP SIZE_MAX
+
+MPACK_STATIC_INLINE size_t mpack_ring_align(size_t size) {
+    return (size + MPACK_RING_HEADER_SIZE - 1) & ~(size_t)(MPACK_RING_HEADER_SIZE - 1);
+}
+
+static void mpack_ring_wait(size_t* spins) {
+    if (*spins < MPACK_RING_SPINS) {
+        ++*spins;
+        MPACK_RING_PAUSE();
+    } else {
+        sched_yield();
+    }
+}
+
+void mpack_ring_init(mpack_ring_t* ring, char* buffer, size_t size) {
+    mpack_assert(buffer != NULL, "cannot initialize ring with NULL buffer");
+    mpack_assert(((uintptr_t)buffer & (MPACK_RING_HEADER_SIZE - 1)) == 0,
+            "ring buffer %p is not aligned", buffer);
+    mpack_assert(size >= MPACK_RING_MINIMUM_SIZE && (size & (size - 1)) == 0,
+            "ring size %i is not a power of two of at least %i",
+            (int)size, (int)MPACK_RING_MINIMUM_SIZE);
+
+    mpack_memset(ring, 0, sizeof(*ring));
+    ring->buffer = buffer;
+    ring->mask = size - 1;
+}
+
+void mpack_ring_close(mpack_ring_t* ring) {
+    MPACK_RING_STORE(&ring->closed, 1);
+}
+
+
+// Producer
+
+#if MPACK_WRITER
+
+// Waits until the producer can use the buffer up to the given offset.
+static bool mpack_ring_wait_space(mpack_ring_t* ring, size_t end) {
+    size_t size = ring->mask + 1;
+    size_t spins = 0;
+    while (end - ring->producer_tail > size) {
+        if (MPACK_RING_LOAD(&ring->closed))
+            return false;
+        mpack_ring_wait(&spins);
+        ring->producer_tail = MPACK_RING_LOAD(&ring->tail);
+    }
+    return true;
+}
+
+// Makes room for at least the given number of bytes of the message being
+// produced, which already has used bytes at the given data. The message
+// is moved to the start of the buffer if it doesn't fit before the end.
+// Returns the new location of the message and its capacity in space.
+static mpack_error_t mpack_ring_reserve(void* context, const char* data, size_t used,
+        size_t need, char** message, size_t* space)
+{
+    mpack_ring_t* ring = (mpack_ring_t*)context;
+    size_t size = ring->mask + 1;
+    size_t index = ring->start & ring->mask;
+
+    if (need > size - index - MPACK_RING_HEADER_SIZE) {
+
+        // the message would overlap itself if it doesn't fit before its
+        // current location either
+        if (index == 0 || need > index - MPACK_RING_HEADER_SIZE)
+            return mpack_error_too_big;
+
+        size_t wrapped = ring->start + (size - index);
+        if (!mpack_ring_wait_space(ring, wrapped + MPACK_RING_HEADER_SIZE + need))
+            return mpack_error_io;
+
+        size_t wrap = MPACK_RING_WRAP;
+        mpack_memcpy(ring->buffer + index, &wrap, sizeof(wrap));
+        if (used > 0)
+            mpack_memcpy(ring->buffer + MPACK_RING_HEADER_SIZE, data, used);
+        ring->start = wrapped;
+        index = 0;
+
+    } else if (!mpack_ring_wait_space(ring, ring->start + MPACK_RING_HEADER_SIZE + need)) {
+        return mpack_error_io;
+    }
+
+    // the message gets all of the contiguous free space
+    size_t free_space = size - (ring->start - ring->producer_tail);
+    if (free_space > size - index)
+        free_space = size - index;
+    *message = ring->buffer + index + MPACK_RING_HEADER_SIZE;
+    *space = free_space - MPACK_RING_HEADER_SIZE;
+    return mpack_ok;
+}
+
+// Makes room in a ring for a message being written, in the same way for
+// both kinds of ring.
+typedef mpack_error_t (*mpack_ring_reserve_t)(void* ring, const char* data, size_t used,
+        size_t need, char** message, size_t* space);
+
+static void mpack_ring_flush(mpack_writer_t* writer, const char* data, size_t count,
+        mpack_ring_reserve_t reserve)
+{
+    // This is an intrusive flush function like the growable writer's: it
+    // makes room for more data in the ring rather than emptying the
+    // buffer. See mpack_growable_writer_flush() for how it's called.
+
+    size_t need;
+    if (data == writer->buffer) {
+
+        // finishing, the message is already in place
+        if (writer->used == count)
+            return;
+
+        // keep the data in the buffer and make room for more
+        writer->used = count;
+        count = 0;
+        need = writer->used + MPACK_WRITER_MINIMUM_BUFFER_SIZE;
+    } else {
+        need = writer->used + count;
+    }
+
+    char* message;
+    size_t space;
+    mpack_error_t error = reserve(writer->context, writer->buffer, writer->used, need, &message, &space);
+    if (error != mpack_ok) {
+        mpack_writer_flag_error(writer, error);
+        return;
+    }
+    writer->buffer = message;
+    writer->size = space;
+
+    if (count > 0) {
+        mpack_memcpy(writer->buffer + writer->used, data, count);
+        writer->used += count;
+    }
+}
+
+static void mpack_ring_writer_flush(mpack_writer_t* writer, const char* data, size_t count) {
+    mpack_ring_flush(writer, data, count, mpack_ring_reserve);
+}
+
+mpack_writer_t* mpack_ring_start(mpack_ring_t* ring) {
+    mpack_assert(!ring->producing, "a message is already being produced");
+    ring->producing = true;
+    ring->start = ring->produced;
+
+    if (MPACK_RING_LOAD(&ring->closed)) {
+        mpack_writer_init_error(&ring->writer, mpack_error_io);
+        return &ring->writer;
+    }
+
+    char* message;
+    size_t space;
+    mpack_error_t error = mpack_ring_reserve(ring, NULL, 0, MPACK_WRITER_MINIMUM_BUFFER_SIZE, &message, &space);
+    if (error != mpack_ok) {
+        mpack_writer_init_error(&ring->writer, error);
+        return &ring->writer;
+    }
+
+    mpack_writer_init(&ring->writer, message, space);
+    mpack_writer_set_context(&ring->writer, ring);
+    mpack_writer_set_flush(&ring->writer, mpack_ring_writer_flush);
+    return &ring->writer;
+}
+
+mpack_error_t mpack_ring_finish(mpack_ring_t* ring) {
+    mpack_assert(ring->producing, "no message is being produced");
+    ring->producing = false;
+
+    mpack_error_t error = mpack_writer_destroy(&ring->writer);
+    if (error != mpack_ok)
+        return error;
+
+    // the message is already in place; commit it after its header
+    size_t used = ring->writer.used;
+    mpack_memcpy(ring->buffer + (ring->start & ring->mask), &used, sizeof(used));
+    ring->produced = ring->start + MPACK_RING_HEADER_SIZE + mpack_ring_align(used);
+    MPACK_RING_STORE(&ring->head, ring->produced);
+    return mpack_ok;
+}
+
+#endif
+
+
+// Consumer
+
+const char* mpack_ring_next(mpack_ring_t* ring, size_t* size) {
+
+    // release the previous message before waiting so that the producer
+    // can reuse its space
+    if (ring->released != ring->consumed) {
+        ring->released = ring->consumed;
+        MPACK_RING_STORE(&ring->tail, ring->released);
+    }
+
+    size_t spins = 0;
+    for (;;) {
+        if (ring->consumed == ring->consumer_head) {
+            ring->consumer_head = MPACK_RING_LOAD(&ring->head);
+            if (ring->consumed == ring->consumer_head) {
+
+                // messages finished before the ring was closed are still
+                // consumed, so we check for new ones after seeing it closed
+                if (MPACK_RING_LOAD(&ring->closed)) {
+                    ring->consumer_head = MPACK_RING_LOAD(&ring->head);
+                    if (ring->consumed == ring->consumer_head) {
+                        *size = 0;
+                        return NULL;
+                    }
+                    continue;
+                }
+
+                mpack_ring_wait(&spins);
+                continue;
+            }
+        }
+
+        size_t index = ring->consumed & ring->mask;
+        size_t header;
+        mpack_memcpy(&header, ring->buffer + index, sizeof(header));
+
+        if (header == MPACK_RING_WRAP) {
+            ring->consumed += ring->mask + 1 - index;
+            continue;
+        }
+
+        ring->consumed += MPACK_RING_HEADER_SIZE + mpack_ring_align(header);
+        *size = header;
+        return ring->buffer + index + MPACK_RING_HEADER_SIZE;
+    }
+}
+
+#if MPACK_READER
+static void mpack_ring_reader_init(mpack_reader_t* reader, const char* data, size_t size) {
+    if (data == NULL) {
+        mpack_reader_init_error(reader, mpack_error_data);
+        return;
+    }
+    mpack_reader_init_data(reader, data, size);
+}
+
+void mpack_ring_next_reader(mpack_ring_t* ring, mpack_reader_t* reader) {
+    size_t size;
+    const char* data = mpack_ring_next(ring, &size);
+    mpack_ring_reader_init(reader, data, size);
+}
+#endif
+
+#if MPACK_NODE
+static void mpack_ring_tree_init(mpack_tree_t* tree, const char* data, size_t size,
+        mpack_node_data_t* node_pool, size_t node_pool_count)
+{
+    if (data == NULL) {
+        mpack_tree_init_error(tree, mpack_error_data);
+        return;
+    }
+
+    mpack_tree_init_pool(tree, data, size, node_pool, node_pool_count);
+    if (mpack_tree_error(tree) == mpack_ok && mpack_tree_size(tree) != size)
+        mpack_tree_flag_error(tree, mpack_error_invalid);
+}
+
+void mpack_ring_next_tree(mpack_ring_t* ring, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count)
+{
+    size_t size;
+    const char* data = mpack_ring_next(ring, &size);
+    mpack_ring_tree_init(tree, data, size, node_pool, node_pool_count);
+}
+#endif
+
+
+// Shared Memory Rings
+
+#if MPACK_SHARED_RING
+
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+
+#define MPACK_SHARED_RING_MAGIC UINT32_C(0x4752504D) /* "MPRG" */
+
+// the header of a message in a shared ring holds its size in its first
+// four bytes, or this to skip to the start of the buffer
+#define MPACK_SHARED_RING_WRAP UINT32_MAX
+
+// the producer lock holds the pid of the process holding it, or zero, with
+// this bit set when others may be waiting for it. pids are below 2^22.
+#define MPACK_SHARED_RING_LOCK_WAITERS UINT32_C(0x80000000)
+
+// how often a producer waiting for the lock checks that its holder is
+// still alive, in nanoseconds
+#define MPACK_SHARED_RING_LOCK_POLL 100000000
+
+// The control block at the start of the segment. Positions in the ring
+// are 32-bit so that the same segment works in 32-bit and 64-bit
+// processes; they wrap around, which works since the ring is at most
+// 2^30 bytes.
+//
+// The sequence numbers are the futex words of sleeping threads. They are
+// incremented (only if someone is waiting) after the head or tail moves
+// or the ring is closed.
+typedef struct mpack_shared_ring_control_t {
+    uint32_t magic;
+    uint32_t size;
+    char padding0[MPACK_RING_CACHE_LINE - 8];
+
+    // written by producers
+    uint32_t head;                 /* Bytes committed by the producers */
+    uint32_t data_sequence;        /* Futex word of the consumer */
+    char padding1[MPACK_RING_CACHE_LINE - 8];
+
+    // written by the consumer
+    uint32_t tail;                 /* Bytes released by the consumer */
+    uint32_t space_sequence;       /* Futex word of a producer */
+    uint32_t consumer_waiting;     /* Whether the consumer is sleeping */
+    char padding2[MPACK_RING_CACHE_LINE - 12];
+
+    uint32_t lock;                 /* Pid of the producer holding the lock, and the waiters bit */
+    uint32_t producer_waiting;     /* Whether a producer is sleeping for space */
+    char padding3[MPACK_RING_CACHE_LINE - 8];
+
+    uint32_t closed;
+    uint32_t error;                /* Error that closed the ring, if any */
+} mpack_shared_ring_control_t;
+
+// the ring buffer starts after the control block, on its own page when
+// possible
+#define MPACK_SHARED_RING_OFFSET 512
+
+MPACK_STATIC_INLINE mpack_shared_ring_control_t* mpack_shared_ring_control(mpack_shared_ring_t* ring) {
+    return (mpack_shared_ring_control_t*)(void*)ring->segment;
+}
+
+static void mpack_futex_wait(uint32_t* word, uint32_t value) {
+    syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void mpack_futex_wait_for(uint32_t* word, uint32_t value, long nanoseconds) {
+    struct timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = nanoseconds;
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void mpack_futex_wake(uint32_t* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Wakes the threads waiting on a sequence number if there are any. The
+// waker has already updated the position they are waiting for with a
+// sequentially consistent store, so either the waiter sees the new
+// position after registering itself or we see that it is registered.
+static void mpack_shared_ring_wake(uint32_t* sequence, uint32_t* waiting) {
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) != 0) {
+        __atomic_fetch_add(sequence, 1, __ATOMIC_SEQ_CST);
+        mpack_futex_wake(sequence);
+    }
+}
+
+// Sleeps on a sequence number until woken, unless the given position has
+// moved away from the given value or the ring has been closed in the
+// meantime.
+static void mpack_shared_ring_sleep(mpack_shared_ring_control_t* control, uint32_t* sequence,
+        uint32_t* waiting, uint32_t* position, uint32_t value)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    uint32_t seen = __atomic_load_n(sequence, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(position, __ATOMIC_SEQ_CST) == value &&
+            !__atomic_load_n(&control->closed, __ATOMIC_SEQ_CST))
+        mpack_futex_wait(sequence, seen);
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+// Takes the producer lock for the process with the given pid, or returns
+// false without it once the ring is closed.
+//
+// A producer that dies holding the lock would otherwise block the others
+// forever, so waiters sleep for a limited time and check whether the
+// holder is still alive. A waiter that finds it gone takes the lock over
+// from it; the dead producer never committed its message, so the new
+// holder simply overwrites it. This relies on the producers sharing a pid
+// namespace, and a dead holder counts as alive until it has been reaped.
+static bool mpack_shared_ring_lock(mpack_shared_ring_control_t* control, uint32_t pid) {
+    uint32_t seen = 0;
+    if (__atomic_compare_exchange_n(&control->lock, &seen, pid, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return true;
+
+    // once we've waited, we keep the waiters bit set when we take the lock
+    // since others may still be sleeping
+    uint32_t locked = pid | MPACK_SHARED_RING_LOCK_WAITERS;
+    for (;;) {
+        if (__atomic_load_n(&control->closed, __ATOMIC_SEQ_CST))
+            return false;
+
+        uint32_t holder = seen & ~MPACK_SHARED_RING_LOCK_WAITERS;
+        if (holder == 0 || (kill((pid_t)holder, 0) != 0 && errno == ESRCH)) {
+            if (__atomic_compare_exchange_n(&control->lock, &seen, locked, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return true;
+            continue;
+        }
+
+        if ((seen & MPACK_SHARED_RING_LOCK_WAITERS) == 0 &&
+                !__atomic_compare_exchange_n(&control->lock, &seen, seen | MPACK_SHARED_RING_LOCK_WAITERS,
+                    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            continue;
+        mpack_futex_wait_for(&control->lock, seen | MPACK_SHARED_RING_LOCK_WAITERS, MPACK_SHARED_RING_LOCK_POLL);
+        seen = __atomic_load_n(&control->lock, __ATOMIC_RELAXED);
+    }
+}
+
+static void mpack_shared_ring_unlock(mpack_shared_ring_control_t* control) {
+    if (__atomic_exchange_n(&control->lock, 0, __ATOMIC_RELEASE) & MPACK_SHARED_RING_LOCK_WAITERS)
+        mpack_futex_wake(&control->lock);
+}
+
+static mpack_error_t mpack_shared_ring_map(mpack_shared_ring_t* ring, int fd, size_t segment_size) {
+    void* map = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return mpack_error_io;
+    ring->segment = (char*)map;
+    ring->segment_size = segment_size;
+    ring->buffer = ring->segment + MPACK_SHARED_RING_OFFSET;
+    return mpack_ok;
+}
+
+mpack_error_t mpack_shared_ring_create(mpack_shared_ring_t* ring, int fd, size_t size) {
+    MPACK_STATIC_ASSERT(sizeof(mpack_shared_ring_control_t) <= MPACK_SHARED_RING_OFFSET,
+            "shared ring control block is too large");
+    mpack_assert(size >= MPACK_RING_MINIMUM_SIZE && size <= MPACK_SHARED_RING_MAXIMUM_SIZE &&
+            (size & (size - 1)) == 0,
+            "shared ring size %i is not a power of two of at least %i",
+            (int)size, (int)MPACK_RING_MINIMUM_SIZE);
+
+    mpack_memset(ring, 0, sizeof(*ring));
+    size_t segment_size = MPACK_SHARED_RING_OFFSET + size;
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)segment_size) != 0)
+        return mpack_error_io;
+    mpack_error_t error = mpack_shared_ring_map(ring, fd, segment_size);
+    if (error != mpack_ok)
+        return error;
+
+    // the segment is zero-filled, so the ring is empty. the magic number is
+    // stored last so that the ring can't be opened before it's ready.
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    control->size = (uint32_t)size;
+    __atomic_store_n(&control->magic, MPACK_SHARED_RING_MAGIC, __ATOMIC_RELEASE);
+    ring->mask = (uint32_t)size - 1;
+    ring->pid = (uint32_t)getpid();
+    return mpack_ok;
+}
+
+mpack_error_t mpack_shared_ring_open(mpack_shared_ring_t* ring, int fd) {
+    mpack_memset(ring, 0, sizeof(*ring));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return mpack_error_io;
+    if (st.st_size < (off_t)(MPACK_SHARED_RING_OFFSET + MPACK_RING_MINIMUM_SIZE) ||
+            (uint64_t)st.st_size > (uint64_t)(MPACK_SHARED_RING_OFFSET + MPACK_SHARED_RING_MAXIMUM_SIZE))
+        return mpack_error_invalid;
+    mpack_error_t error = mpack_shared_ring_map(ring, fd, (size_t)st.st_size);
+    if (error != mpack_ok)
+        return error;
+
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    uint32_t size = control->size;
+    if (__atomic_load_n(&control->magic, __ATOMIC_ACQUIRE) != MPACK_SHARED_RING_MAGIC ||
+            (size & (size - 1)) != 0 ||
+            (size_t)size + MPACK_SHARED_RING_OFFSET != ring->segment_size)
+        return mpack_error_invalid;
+
+    // a handle opened while messages are waiting consumes from the tail
+    uint32_t tail = __atomic_load_n(&control->tail, __ATOMIC_ACQUIRE);
+    if ((tail & (MPACK_RING_HEADER_SIZE - 1)) != 0)
+        return mpack_error_invalid;
+    ring->mask = size - 1;
+    ring->consumed = ring->released = ring->consumer_head = tail;
+    ring->pid = (uint32_t)getpid();
+    return mpack_ok;
+}
+
+void mpack_shared_ring_destroy(mpack_shared_ring_t* ring) {
+    mpack_assert(!ring->producing, "cannot destroy shared ring handle while producing");
+    if (ring->segment != NULL) {
+        munmap(ring->segment, ring->segment_size);
+        ring->segment = NULL;
+    }
+}
+
+mpack_error_t mpack_shared_ring_error(mpack_shared_ring_t* ring) {
+    return (mpack_error_t)MPACK_RING_LOAD(&mpack_shared_ring_control(ring)->error);
+}
+
+void mpack_shared_ring_close(mpack_shared_ring_t* ring) {
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    __atomic_store_n(&control->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&control->data_sequence, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&control->space_sequence, 1, __ATOMIC_SEQ_CST);
+    mpack_futex_wake(&control->data_sequence);
+    mpack_futex_wake(&control->space_sequence);
+
+    // producers waiting for the lock check whether the ring is closed when
+    // woken. one that misses the wake because it was about to sleep still
+    // checks when its wait times out.
+    mpack_futex_wake(&control->lock);
+}
+
+#if MPACK_WRITER
+
+// Waits until the producer can use the buffer up to the given offset.
+static bool mpack_shared_ring_wait_space(mpack_shared_ring_t* ring, uint32_t end) {
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    uint32_t size = ring->mask + 1;
+    size_t spins = 0;
+    while ((uint32_t)(end - ring->producer_tail) > size) {
+        if (MPACK_RING_LOAD(&control->closed))
+            return false;
+        if (spins < MPACK_RING_SPINS) {
+            ++spins;
+            MPACK_RING_PAUSE();
+        } else {
+            mpack_shared_ring_sleep(control, &control->space_sequence,
+                    &control->producer_waiting, &control->tail, ring->producer_tail);
+        }
+        ring->producer_tail = MPACK_RING_LOAD(&control->tail);
+    }
+    return true;
+}
+
+// Makes room in the shared ring for the message being produced. This works
+// like mpack_ring_reserve().
+static mpack_error_t mpack_shared_ring_reserve(void* context, const char* data, size_t used,
+        size_t need, char** message, size_t* space)
+{
+    mpack_shared_ring_t* ring = (mpack_shared_ring_t*)context;
+    size_t size = (size_t)ring->mask + 1;
+    size_t index = ring->start & ring->mask;
+
+    if (need > size - index - MPACK_RING_HEADER_SIZE) {
+        if (index == 0 || need > index - MPACK_RING_HEADER_SIZE)
+            return mpack_error_too_big;
+
+        uint32_t wrapped = ring->start + (uint32_t)(size - index);
+        if (!mpack_shared_ring_wait_space(ring, wrapped + (uint32_t)(MPACK_RING_HEADER_SIZE + need)))
+            return mpack_error_io;
+
+        uint32_t wrap = MPACK_SHARED_RING_WRAP;
+        mpack_memcpy(ring->buffer + index, &wrap, sizeof(wrap));
+        if (used > 0)
+            mpack_memcpy(ring->buffer + MPACK_RING_HEADER_SIZE, data, used);
+        ring->start = wrapped;
+        index = 0;
+
+    } else if (!mpack_shared_ring_wait_space(ring, ring->start + (uint32_t)(MPACK_RING_HEADER_SIZE + need))) {
+        return mpack_error_io;
+    }
+
+    size_t free_space = size - (uint32_t)(ring->start - ring->producer_tail);
+    if (free_space > size - index)
+        free_space = size - index;
+    *message = ring->buffer + index + MPACK_RING_HEADER_SIZE;
+    *space = free_space - MPACK_RING_HEADER_SIZE;
+    return mpack_ok;
+}
+
+static void mpack_shared_ring_writer_flush(mpack_writer_t* writer, const char* data, size_t count) {
+    mpack_ring_flush(writer, data, count, mpack_shared_ring_reserve);
+}
+
+mpack_writer_t* mpack_shared_ring_start(mpack_shared_ring_t* ring) {
+    mpack_assert(!ring->producing, "a message is already being produced");
+    ring->producing = true;
+
+    // the lock is held until the message is finished, even if it fails
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    ring->locked = mpack_shared_ring_lock(control, ring->pid);
+    if (!ring->locked || MPACK_RING_LOAD(&control->closed)) {
+        mpack_writer_init_error(&ring->writer, mpack_error_io);
+        return &ring->writer;
+    }
+
+    // the tail is reloaded since this handle may not have produced for a
+    // long time; positions wrap around, so an old value may look recent
+    ring->start = MPACK_RING_LOAD(&control->head);
+    ring->producer_tail = MPACK_RING_LOAD(&control->tail);
+
+    char* message;
+    size_t space;
+    mpack_error_t error = mpack_shared_ring_reserve(ring, NULL, 0, MPACK_WRITER_MINIMUM_BUFFER_SIZE, &message, &space);
+    if (error != mpack_ok) {
+        mpack_writer_init_error(&ring->writer, error);
+        return &ring->writer;
+    }
+
+    mpack_writer_init(&ring->writer, message, space);
+    mpack_writer_set_context(&ring->writer, ring);
+    mpack_writer_set_flush(&ring->writer, mpack_shared_ring_writer_flush);
+    return &ring->writer;
+}
+
+mpack_error_t mpack_shared_ring_finish(mpack_shared_ring_t* ring) {
+    mpack_assert(ring->producing, "no message is being produced");
+    ring->producing = false;
+
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    mpack_error_t error = mpack_writer_destroy(&ring->writer);
+    if (error == mpack_ok) {
+        uint32_t used = (uint32_t)ring->writer.used;
+        mpack_memcpy(ring->buffer + (ring->start & ring->mask), &used, sizeof(used));
+        uint32_t head = ring->start + (uint32_t)(MPACK_RING_HEADER_SIZE + mpack_ring_align(used));
+        __atomic_store_n(&control->head, head, __ATOMIC_SEQ_CST);
+        mpack_shared_ring_wake(&control->data_sequence, &control->consumer_waiting);
+    }
+
+    if (ring->locked)
+        mpack_shared_ring_unlock(control);
+    return error;
+}
+
+#endif
+
+// Closes the ring because the consumer found a message header that doesn't
+// fit in the data committed by the producers. The segment is writable by
+// every process that maps it, so the consumer can't trust it.
+static const char* mpack_shared_ring_corrupt(mpack_shared_ring_t* ring, size_t* size) {
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+    uint32_t none = mpack_ok;
+    __atomic_compare_exchange_n(&control->error, &none, (uint32_t)mpack_error_invalid,
+            false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    mpack_shared_ring_close(ring);
+    *size = 0;
+    return NULL;
+}
+
+const char* mpack_shared_ring_next(mpack_shared_ring_t* ring, size_t* size) {
+    mpack_shared_ring_control_t* control = mpack_shared_ring_control(ring);
+
+    if (ring->released != ring->consumed) {
+        ring->released = ring->consumed;
+        __atomic_store_n(&control->tail, ring->released, __ATOMIC_SEQ_CST);
+        mpack_shared_ring_wake(&control->space_sequence, &control->producer_waiting);
+    }
+
+    size_t spins = 0;
+    for (;;) {
+        if (ring->consumed == ring->consumer_head) {
+            ring->consumer_head = MPACK_RING_LOAD(&control->head);
+            if (ring->consumed == ring->consumer_head) {
+                if (MPACK_RING_LOAD(&control->closed)) {
+                    ring->consumer_head = MPACK_RING_LOAD(&control->head);
+                    if (ring->consumed == ring->consumer_head) {
+                        *size = 0;
+                        return NULL;
+                    }
+                    continue;
+                }
+
+                if (spins < MPACK_RING_SPINS) {
+                    ++spins;
+                    MPACK_RING_PAUSE();
+                } else {
+                    mpack_shared_ring_sleep(control, &control->data_sequence,
+                            &control->consumer_waiting, &control->head, ring->consumed);
+                }
+                continue;
+            }
+        }
+
+        // the header and the message or skip it describes must be within
+        // the committed data, and a message can't cross the end of the
+        // buffer. a wrap marker is never written at the start.
+        uint32_t committed = ring->consumer_head - ring->consumed;
+        uint32_t index = ring->consumed & ring->mask;
+        uint32_t left = ring->mask + 1 - index;
+        if (committed > ring->mask + 1 || committed < MPACK_RING_HEADER_SIZE)
+            return mpack_shared_ring_corrupt(ring, size);
+        uint32_t header;
+        mpack_memcpy(&header, ring->buffer + index, sizeof(header));
+
+        if (header == MPACK_SHARED_RING_WRAP) {
+            if (index == 0 || left > committed)
+                return mpack_shared_ring_corrupt(ring, size);
+            ring->consumed += left;
+            continue;
+        }
+
+        if (header > left - MPACK_RING_HEADER_SIZE ||
+                mpack_ring_align(header) > committed - MPACK_RING_HEADER_SIZE)
+            return mpack_shared_ring_corrupt(ring, size);
+        ring->consumed += (uint32_t)(MPACK_RING_HEADER_SIZE + mpack_ring_align(header));
+        *size = header;
+        return ring->buffer + index + MPACK_RING_HEADER_SIZE;
+    }
+}
+
+#if MPACK_READER
+void mpack_shared_ring_next_reader(mpack_shared_ring_t* ring, mpack_reader_t* reader) {
+    size_t size;
+    const char* data = mpack_shared_ring_next(ring, &size);
+    if (data == NULL && mpack_shared_ring_error(ring) != mpack_ok) {
+        mpack_reader_init_error(reader, mpack_shared_ring_error(ring));
+        return;
+    }
+    mpack_ring_reader_init(reader, data, size);
+}
+#endif
+
+#if MPACK_NODE
+void mpack_shared_ring_next_tree(mpack_shared_ring_t* ring, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count)
+{
+    size_t size;
+    const char* data = mpack_shared_ring_next(ring, &size);
+    if (data == NULL && mpack_shared_ring_error(ring) != mpack_ok) {
+        mpack_tree_init_error(tree, mpack_shared_ring_error(ring));
+        return;
+    }
+    mpack_ring_tree_init(tree, data, size, node_pool, node_pool_count);
+}
+#endif
+
+#endif
+
+#endif
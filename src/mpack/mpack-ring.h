@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file
+ *
+ * Declares the MPack message ring, which passes encoded messages from
+ * one thread to another without copying them.
+ */
+
+#ifndef MPACK_RING_H
+#define MPACK_RING_H 1
+
+#include "mpack-writer.h"
+#include "mpack-reader.h"
+#include "mpack-node.h"
+
+MPACK_HEADER_START
+
+#if MPACK_RING
+
+#if defined(_WIN32) || !defined(__ATOMIC_ACQUIRE)
+#error "MPACK_RING requires POSIX and GCC-compatible atomic builtins."
+#endif
+
+/**
+ * @defgroup ring Message Ring
+ *
+ * A message ring passes MessagePack messages from a single producer
+ * thread to a single consumer thread through a fixed circular buffer.
+ *
+ * The producer encodes each message with a writer whose buffer is the
+ * free space of the ring itself, and the consumer reads or parses each
+ * message in place where it was encoded. Messages are never allocated or
+ * copied (except for the part of a message already encoded when it
+ * reaches the end of the buffer, which is moved to the start.)
+ *
+ * Messages are kept contiguous so that they can be parsed in place. A
+ * message that does not fit before the end of the buffer is moved to
+ * the start, so a message of up to half the ring size (less
+ * MPACK_RING_HEADER_SIZE and MPACK_WRITER_MINIMUM_BUFFER_SIZE) always
+ * fits; larger messages may fail with mpack_error_too_big depending on
+ * where they start. The ring should be several times larger than the
+ * largest message so that the producer can keep encoding while the
+ * consumer reads.
+ *
+ * The ring is lock-free. The producer waits when the ring is full and
+ * the consumer waits when it is empty, spinning for a while and then
+ * yielding the processor until the other thread makes progress or the
+ * ring is closed.
+ *
+ * The message ring is available when MPACK_RING is enabled. It requires
+ * POSIX and GCC-compatible atomic builtins.
+ *
+ * @{
+ */
+
+/**
+ * The number of bytes in the ring taken by the header of each message.
+ */
+#define MPACK_RING_HEADER_SIZE 8
+
+/**
+ * The minimum size of the buffer of a message ring.
+ */
+#define MPACK_RING_MINIMUM_SIZE 128
+
+/** @cond */
+// counters written by different threads are kept on separate cache lines
+#define MPACK_RING_CACHE_LINE 64
+/** @endcond */
+
+/**
+ * A single-producer, single-consumer ring of MessagePack messages.
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_ring_t {
+    /** @cond */
+
+    // shared
+    char* buffer;              /* Borrowed circular buffer */
+    size_t mask;               /* Size of the buffer minus one */
+    char padding0[MPACK_RING_CACHE_LINE];
+    size_t head;               /* Bytes committed by the producer */
+    char padding1[MPACK_RING_CACHE_LINE];
+    size_t tail;               /* Bytes released by the consumer */
+    char padding2[MPACK_RING_CACHE_LINE];
+    int closed;                /* Whether the ring has been closed */
+    char padding3[MPACK_RING_CACHE_LINE];
+
+    // producer
+    #if MPACK_WRITER
+    mpack_writer_t writer;     /* Writer of the message being produced */
+    #endif
+    size_t start;              /* Offset of the message being produced */
+    size_t produced;           /* Local copy of head */
+    size_t producer_tail;      /* Last seen value of tail */
+    bool producing;            /* Whether a message is being produced */
+    char padding4[MPACK_RING_CACHE_LINE];
+
+    // consumer
+    size_t consumed;           /* Offset of the next message to consume */
+    size_t released;           /* Local copy of tail */
+    size_t consumer_head;      /* Last seen value of head */
+
+    /** @endcond */
+} mpack_ring_t;
+
+/**
+ * Initializes a message ring on the given buffer. The ring does not
+ * assume ownership of the buffer.
+ *
+ * @param ring The ring to initialize
+ * @param buffer The buffer of the ring. It must be aligned to at least 8
+ *     bytes.
+ * @param size The size of the buffer. It must be a power of two of at
+ *     least MPACK_RING_MINIMUM_SIZE.
+ */
+void mpack_ring_init(mpack_ring_t* ring, char* buffer, size_t size);
+
+/**
+ * Closes the ring. This can be called by either thread.
+ *
+ * The consumer still receives all messages finished before the ring was
+ * closed, after which it receives the end of the ring. If the producer
+ * is waiting for space, or starts a message after the ring is closed,
+ * the message fails with mpack_error_io.
+ */
+void mpack_ring_close(mpack_ring_t* ring);
+
+#if MPACK_WRITER
+/**
+ * Starts producing a message, returning a writer to which exactly one
+ * MessagePack object should be written. Call mpack_ring_finish() once
+ * the object is complete.
+ *
+ * The writer encodes directly into the free space of the ring, waiting
+ * for the consumer to release space as needed. Don't destroy it or
+ * change its callbacks.
+ *
+ * This must only be called by the producer thread.
+ */
+mpack_writer_t* mpack_ring_start(mpack_ring_t* ring);
+
+/**
+ * Finishes the message started with mpack_ring_start(), making it
+ * available to the consumer.
+ *
+ * If the writer is in an error state, the message is discarded and the
+ * ring is otherwise unaffected.
+ *
+ * This must only be called by the producer thread.
+ *
+ * @return The final error state of the message's writer.
+ */
+mpack_error_t mpack_ring_finish(mpack_ring_t* ring);
+#endif
+
+/**
+ * Waits for the next message from the producer and returns it in place
+ * in the ring, or returns NULL once the ring is closed and all messages
+ * have been consumed.
+ *
+ * The previous message returned to the consumer is released to the
+ * producer by this call, so it must no longer be used.
+ *
+ * This must only be called by the consumer thread.
+ *
+ * @param ring The ring
+ * @param size [out] The size of the message, or zero if none is returned
+ */
+const char* mpack_ring_next(mpack_ring_t* ring, size_t* size);
+
+#if MPACK_READER
+/**
+ * Waits for the next message from the producer and initializes the given
+ * reader to read it in place in the ring.
+ *
+ * The reader must be destroyed before the next message is consumed. At
+ * the end of the ring, the reader is placed in the mpack_error_data
+ * error state.
+ *
+ * @see mpack_ring_next()
+ */
+void mpack_ring_next_reader(mpack_ring_t* ring, mpack_reader_t* reader);
+#endif
+
+#if MPACK_NODE
+/**
+ * Waits for the next message from the producer and parses it in place
+ * in the ring into the given tree, using the given node pool.
+ *
+ * The tree must be destroyed with mpack_tree_destroy(), even if parsing
+ * fails, and before the next message is consumed. At the end of the
+ * ring, the tree is placed in the mpack_error_data error state. If the
+ * message is not exactly one MessagePack object, the tree is placed in
+ * the mpack_error_invalid error state.
+ *
+ * @see mpack_ring_next()
+ * @see mpack_tree_init_pool()
+ */
+void mpack_ring_next_tree(mpack_ring_t* ring, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count);
+#endif
+
+#if MPACK_SHARED_RING
+
+/**
+ * @name Shared Memory Rings
+ *
+ * A shared ring passes MessagePack messages from any number of producers
+ * to a single consumer through a shared memory segment, which may be
+ * mapped by several processes. It works like the message ring: producers
+ * encode directly into the segment and the consumer reads each message
+ * in place, so messages are never copied and no system calls are made
+ * while the ring is neither full nor empty.
+ *
+ * The segment is a file descriptor from memfd_create() or shm_open() (or
+ * any file that can be mapped shared.) One process creates the ring on it
+ * with mpack_shared_ring_create(), and the others open it with
+ * mpack_shared_ring_open() once they receive the descriptor, for example
+ * by inheriting it across fork() or through a Unix socket. Each thread or
+ * process uses its own mpack_shared_ring_t handle.
+ *
+ * Producers take turns: a producer holds a lock in the segment from
+ * mpack_shared_ring_start() to mpack_shared_ring_finish(), so messages
+ * should be encoded without waiting on anything else. The lock records the
+ * pid of its holder: if a process dies while producing a message, the
+ * next producer takes the lock over and the unfinished message is lost.
+ * Producers must therefore share a pid namespace, and a handle must not
+ * be used by a process forked after it was opened.
+ *
+ * Threads that must wait spin for a while and then sleep on a futex until
+ * they are woken. Shared rings are available on Linux when MPACK_RING is
+ * enabled, unless MPACK_SHARED_RING is pre-defined to 0.
+ *
+ * @{
+ */
+
+/**
+ * The largest size of the buffer of a shared ring.
+ */
+#define MPACK_SHARED_RING_MAXIMUM_SIZE ((size_t)1 << 30)
+
+/**
+ * A handle to a multi-producer, single-consumer ring of MessagePack
+ * messages in shared memory.
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_shared_ring_t {
+    /** @cond */
+
+    char* segment;             /* Mapping of the shared segment */
+    size_t segment_size;       /* Size of the mapping */
+    char* buffer;              /* Circular buffer in the segment */
+    uint32_t mask;             /* Size of the buffer minus one */
+
+    // producer
+    #if MPACK_WRITER
+    mpack_writer_t writer;     /* Writer of the message being produced */
+    #endif
+    uint32_t start;            /* Offset of the message being produced */
+    uint32_t producer_tail;    /* Last seen value of the tail */
+    uint32_t pid;              /* Process of the handle, recorded in the lock */
+    bool producing;            /* Whether a message is being produced */
+    bool locked;               /* Whether the producer lock is held */
+
+    // consumer
+    uint32_t consumed;         /* Offset of the next message to consume */
+    uint32_t released;         /* Offset released to the producers */
+    uint32_t consumer_head;    /* Last seen value of the head */
+
+    /** @endcond */
+} mpack_shared_ring_t;
+
+/**
+ * Creates a shared ring in the given file, resizing it to hold a ring
+ * buffer of the given size, and maps it into the given handle. The file
+ * descriptor is not closed by the ring.
+ *
+ * The handle must be destroyed with mpack_shared_ring_destroy(), even if
+ * this fails.
+ *
+ * @param ring The handle to initialize
+ * @param fd A file descriptor for the shared segment, opened for reading
+ *     and writing. Any existing contents are replaced.
+ * @param size The size of the ring buffer. It must be a power of two of at
+ *     least MPACK_RING_MINIMUM_SIZE and at most
+ *     MPACK_SHARED_RING_MAXIMUM_SIZE.
+ * @return mpack_ok, or mpack_error_io if the file could not be resized or
+ *     mapped.
+ */
+mpack_error_t mpack_shared_ring_create(mpack_shared_ring_t* ring, int fd, size_t size);
+
+/**
+ * Opens a shared ring previously created in the given file with
+ * mpack_shared_ring_create(), mapping it into the given handle. The file
+ * descriptor is not closed by the ring.
+ *
+ * The handle must be destroyed with mpack_shared_ring_destroy(), even if
+ * this fails.
+ *
+ * @return mpack_ok, mpack_error_io if the file could not be mapped, or
+ *     mpack_error_invalid if it does not contain a shared ring.
+ */
+mpack_error_t mpack_shared_ring_open(mpack_shared_ring_t* ring, int fd);
+
+/**
+ * Unmaps the shared segment from the given handle. The ring itself is
+ * unaffected and remains usable through other handles.
+ */
+void mpack_shared_ring_destroy(mpack_shared_ring_t* ring);
+
+/**
+ * Closes the shared ring. This can be called through any handle.
+ *
+ * The consumer still receives all messages finished before the ring was
+ * closed, after which it receives the end of the ring. Messages started
+ * after the ring is closed, or waiting for space when it is closed, fail
+ * with mpack_error_io.
+ */
+void mpack_shared_ring_close(mpack_shared_ring_t* ring);
+
+/**
+ * Returns the error that closed the shared ring, or mpack_ok if it is open
+ * or was closed with mpack_shared_ring_close().
+ *
+ * The ring is closed with mpack_error_invalid if the consumer finds a
+ * message in the segment whose size doesn't fit in the data committed by
+ * the producers.
+ */
+mpack_error_t mpack_shared_ring_error(mpack_shared_ring_t* ring);
+
+#if MPACK_WRITER
+/**
+ * Starts producing a message, returning a writer to which exactly one
+ * MessagePack object should be written. Call mpack_shared_ring_finish()
+ * once the object is complete.
+ *
+ * This waits for any other producer to finish its message. The writer
+ * encodes directly into the shared segment, waiting for the consumer to
+ * release space as needed. Don't destroy it or change its callbacks.
+ */
+mpack_writer_t* mpack_shared_ring_start(mpack_shared_ring_t* ring);
+
+/**
+ * Finishes the message started with mpack_shared_ring_start(), making it
+ * available to the consumer and letting the next producer start.
+ *
+ * If the writer is in an error state, the message is discarded and the
+ * ring is otherwise unaffected.
+ *
+ * @return The final error state of the message's writer.
+ */
+mpack_error_t mpack_shared_ring_finish(mpack_shared_ring_t* ring);
+#endif
+
+/**
+ * Waits for the next message from the producers and returns it in place
+ * in the shared segment, or returns NULL once the ring is closed and all
+ * messages have been consumed.
+ *
+ * Message sizes in the segment are checked before a message is returned.
+ * If one is invalid, the ring is closed with mpack_error_invalid and this
+ * returns NULL. See mpack_shared_ring_error().
+ *
+ * The previous message returned by this handle is released to the
+ * producers by this call, so it must no longer be used. Only one handle
+ * may consume messages from a shared ring.
+ *
+ * @param ring The handle of the consumer
+ * @param size [out] The size of the message, or zero if none is returned
+ */
+const char* mpack_shared_ring_next(mpack_shared_ring_t* ring, size_t* size);
+
+#if MPACK_READER
+/**
+ * Waits for the next message from the producers and initializes the given
+ * reader to read it in place in the shared segment.
+ *
+ * @see mpack_shared_ring_next()
+ * @see mpack_ring_next_reader()
+ */
+void mpack_shared_ring_next_reader(mpack_shared_ring_t* ring, mpack_reader_t* reader);
+#endif
+
+#if MPACK_NODE
+/**
+ * Waits for the next message from the producers and parses it in place
+ * in the shared segment into the given tree, using the given node pool.
+ *
+ * @see mpack_shared_ring_next()
+ * @see mpack_ring_next_tree()
+ */
+void mpack_shared_ring_next_tree(mpack_shared_ring_t* ring, mpack_tree_t* tree,
+        mpack_node_data_t* node_pool, size_t node_pool_count);
+#endif
+
+/**
+ * @}
+ */
+
+#endif
+
+/**
+ * @}
+ */
+
+#endif
+
+MPACK_HEADER_END
+
+#endif
+
@@ -31,22 +31,31 @@ static void mpack_writer_flag_if_error(mpack_writer_t* writer, mpack_error_t err
         mpack_writer_flag_error(writer, error);
 }
 
-void mpack_writer_track_push(mpack_writer_t* writer, mpack_type_t type, uint64_t count) {
+#if MPACK_TRACKING_INLINE_DEPTH
+// the common cases are handled inline in mpack-writer.h
+#define MPACK_WRITER_TRACK_SLOW(name) name##_slow
+#else
+#define MPACK_WRITER_TRACK_SLOW(name) name
+#endif
+
+void MPACK_WRITER_TRACK_SLOW(mpack_writer_track_push)(mpack_writer_t* writer, mpack_type_t type, uint64_t count) {
     if (writer->error == mpack_ok)
         mpack_writer_flag_if_error(writer, mpack_track_push(&writer->track, type, count));
 }
 
-void mpack_writer_track_pop(mpack_writer_t* writer, mpack_type_t type) {
+void MPACK_WRITER_TRACK_SLOW(mpack_writer_track_pop)(mpack_writer_t* writer, mpack_type_t type) {
     if (writer->error == mpack_ok)
         mpack_writer_flag_if_error(writer, mpack_track_pop(&writer->track, type));
 }
 
+#if !MPACK_TRACKING_INLINE_DEPTH
 void mpack_writer_track_element(mpack_writer_t* writer) {
     if (writer->error == mpack_ok)
         mpack_writer_flag_if_error(writer, mpack_track_element(&writer->track, false));
 }
+#endif
 
-void mpack_writer_track_bytes(mpack_writer_t* writer, size_t count) {
+void MPACK_WRITER_TRACK_SLOW(mpack_writer_track_bytes)(mpack_writer_t* writer, size_t count) {
     if (writer->error == mpack_ok)
         mpack_writer_flag_if_error(writer, mpack_track_bytes(&writer->track, false, count));
 }
@@ -66,6 +75,17 @@ static void mpack_writer_clear(mpack_writer_t* writer) {
     #if MPACK_WRITE_TRACKING
     mpack_memset(&writer->track, 0, sizeof(writer->track));
     #endif
+
+    #if MPACK_STATS
+    mpack_memset(&writer->stats, 0, sizeof(writer->stats));
+    #endif
+}
+
+// Calls the flush function, counting the flushed bytes.
+MPACK_STATIC_INLINE void mpack_writer_call_flush(mpack_writer_t* writer, const char* buffer, size_t count) {
+    MPACK_STATS_ADD(writer->stats.flush_calls, 1);
+    MPACK_STATS_ADD(writer->stats.flush_bytes, count);
+    writer->flush(writer, buffer, count);
 }
 
 void mpack_writer_init(mpack_writer_t* writer, char* buffer, size_t size) {
@@ -175,8 +195,9 @@ static void mpack_growable_writer_teardown(mpack_writer_t* writer) {
     if (mpack_writer_error(writer) == mpack_ok) {
 
         // shrink the buffer to an appropriate size if the data is
-        // much smaller than the buffer
-        if (writer->used < writer->size / 2) {
+        // much smaller than the buffer. empty data keeps its buffer
+        // since reallocating to zero bytes would free it.
+        if (writer->used != 0 && writer->used < writer->size / 2) {
             char* buffer = (char*)mpack_realloc(writer->buffer, writer->used, writer->used);
             if (!buffer) {
                 MPACK_FREE(writer->buffer);
@@ -296,7 +317,7 @@ MPACK_STATIC_INLINE void mpack_writer_flush_unchecked(mpack_writer_t* writer) {
     // versus flushing external data. see mpack_growable_writer_flush()
     size_t used = writer->used;
     writer->used = 0;
-    writer->flush(writer, writer->buffer, used);
+    mpack_writer_call_flush(writer, writer->buffer, used);
 }
 
 // Ensures there are at least count bytes free in the buffer. This
@@ -321,6 +342,7 @@ static bool mpack_writer_ensure(mpack_writer_t* writer, size_t count) {
         return false;
     }
 
+    MPACK_STATS_ADD(writer->stats.straddles, 1);
     mpack_writer_flush_unchecked(writer);
     if (mpack_writer_error(writer) != mpack_ok)
         return false;
@@ -336,7 +358,7 @@ static bool mpack_writer_ensure(mpack_writer_t* writer, size_t count) {
 // does not fit in the buffer (i.e. it straddles the edge of the
 // buffer.) If there is a flush function, it is guaranteed to be
 // called; otherwise mpack_error_too_big is raised.
-static void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, size_t count) {
+void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, size_t count) {
     mpack_assert(count == 0 || p != NULL, "data pointer for %i bytes is NULL", (int)count);
 
     if (mpack_writer_error(writer) != mpack_ok)
@@ -353,6 +375,7 @@ static void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, s
         mpack_writer_flag_error(writer, mpack_error_too_big);
         return;
     }
+    MPACK_STATS_ADD(writer->stats.straddles, 1);
 
     // flush the buffer
     mpack_writer_flush_unchecked(writer);
@@ -365,7 +388,7 @@ static void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, s
 
     // flush the extra data directly if it doesn't fit in the buffer
     if (count > writer->size - writer->used) {
-        writer->flush(writer, p, count);
+        mpack_writer_call_flush(writer, p, count);
         if (mpack_writer_error(writer) != mpack_ok)
             return;
     } else {
@@ -374,18 +397,6 @@ static void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, s
     }
 }
 
-// Writes encoded bytes to the buffer, flushing if necessary.
-MPACK_STATIC_INLINE void mpack_write_native(mpack_writer_t* writer, const char* p, size_t count) {
-    mpack_assert(count == 0 || p != NULL, "data pointer for %i bytes is NULL", (int)count);
-
-    if (writer->size - writer->used < count) {
-        mpack_write_native_straddle(writer, p, count);
-    } else {
-        mpack_memcpy(writer->buffer + writer->used, p, count);
-        writer->used += count;
-    }
-}
-
 mpack_error_t mpack_writer_destroy(mpack_writer_t* writer) {
 
     // clean up tracking, asserting if we're not already in an error state
@@ -395,7 +406,7 @@ mpack_error_t mpack_writer_destroy(mpack_writer_t* writer) {
 
     // flush any outstanding data
     if (mpack_writer_error(writer) == mpack_ok && writer->used != 0 && writer->flush != NULL) {
-        writer->flush(writer, writer->buffer, writer->used);
+        mpack_writer_call_flush(writer, writer->buffer, writer->used);
         writer->flush = NULL;
     }
 
@@ -861,9 +872,10 @@ void mpack_start_map(mpack_writer_t* writer, uint32_t count) {
     mpack_writer_track_push(writer, mpack_type_map, count);
 }
 
-void mpack_start_str(mpack_writer_t* writer, uint32_t count) {
-    mpack_writer_track_element(writer);
+// the tags of str, bin and ext are written without tracking so that
+// whole objects can be written with a single tracked element.
 
+static void mpack_write_str_tag(mpack_writer_t* writer, uint32_t count) {
     if (count <= 31) {
         MPACK_WRITE_ENCODED(mpack_encode_fixstr, MPACK_TAG_SIZE_FIXSTR, (uint8_t)count);
     } else if (count <= UINT8_MAX) {
@@ -875,13 +887,9 @@ void mpack_start_str(mpack_writer_t* writer, uint32_t count) {
     } else {
         MPACK_WRITE_ENCODED(mpack_encode_str32, MPACK_TAG_SIZE_STR32, (uint32_t)count);
     }
-
-    mpack_writer_track_push(writer, mpack_type_str, count);
 }
 
-void mpack_start_bin(mpack_writer_t* writer, uint32_t count) {
-    mpack_writer_track_element(writer);
-
+static void mpack_write_bin_tag(mpack_writer_t* writer, uint32_t count) {
     if (count <= UINT8_MAX) {
         MPACK_WRITE_ENCODED(mpack_encode_bin8, MPACK_TAG_SIZE_BIN8, (uint8_t)count);
     } else if (count <= UINT16_MAX) {
@@ -889,13 +897,9 @@ void mpack_start_bin(mpack_writer_t* writer, uint32_t count) {
     } else {
         MPACK_WRITE_ENCODED(mpack_encode_bin32, MPACK_TAG_SIZE_BIN32, (uint32_t)count);
     }
-
-    mpack_writer_track_push(writer, mpack_type_bin, count);
 }
 
-void mpack_start_ext(mpack_writer_t* writer, int8_t exttype, uint32_t count) {
-    mpack_writer_track_element(writer);
-
+static void mpack_write_ext_tag(mpack_writer_t* writer, int8_t exttype, uint32_t count) {
     if (count == 1) {
         MPACK_WRITE_ENCODED(mpack_encode_fixext1, MPACK_TAG_SIZE_FIXEXT1, exttype);
     } else if (count == 2) {
@@ -913,7 +917,23 @@ void mpack_start_ext(mpack_writer_t* writer, int8_t exttype, uint32_t count) {
     } else {
         MPACK_WRITE_ENCODED(mpack_encode_ext32, MPACK_TAG_SIZE_EXT32, exttype, (uint32_t)count);
     }
+}
+
+void mpack_start_str(mpack_writer_t* writer, uint32_t count) {
+    mpack_writer_track_element(writer);
+    mpack_write_str_tag(writer, count);
+    mpack_writer_track_push(writer, mpack_type_str, count);
+}
+
+void mpack_start_bin(mpack_writer_t* writer, uint32_t count) {
+    mpack_writer_track_element(writer);
+    mpack_write_bin_tag(writer, count);
+    mpack_writer_track_push(writer, mpack_type_bin, count);
+}
 
+void mpack_start_ext(mpack_writer_t* writer, int8_t exttype, uint32_t count) {
+    mpack_writer_track_element(writer);
+    mpack_write_ext_tag(writer, exttype, count);
     mpack_writer_track_push(writer, mpack_type_ext, count);
 }
 
@@ -923,25 +943,34 @@ void mpack_start_ext(mpack_writer_t* writer, int8_t exttype, uint32_t count) {
  * Compound helpers and other functions
  */
 
+// The data of str, bin and ext is skipped when it is empty or when the
+// writer has an error, since the writer may then have no buffer.
+
 void mpack_write_str(mpack_writer_t* writer, const char* data, uint32_t count) {
     mpack_assert(data != NULL, "data for string of length %i is NULL", (int)count);
-    mpack_start_str(writer, count);
-    mpack_write_bytes(writer, data, count);
-    mpack_finish_str(writer);
+    mpack_writer_track_element(writer);
+    mpack_write_str_tag(writer, count);
+    if (count == 0 || mpack_writer_error(writer) != mpack_ok)
+        return;
+    mpack_write_native(writer, data, count);
 }
 
 void mpack_write_bin(mpack_writer_t* writer, const char* data, uint32_t count) {
     mpack_assert(data != NULL, "data pointer for bin of %i bytes is NULL", (int)count);
-    mpack_start_bin(writer, count);
-    mpack_write_bytes(writer, data, count);
-    mpack_finish_bin(writer);
+    mpack_writer_track_element(writer);
+    mpack_write_bin_tag(writer, count);
+    if (count == 0 || mpack_writer_error(writer) != mpack_ok)
+        return;
+    mpack_write_native(writer, data, count);
 }
 
 void mpack_write_ext(mpack_writer_t* writer, int8_t exttype, const char* data, uint32_t count) {
     mpack_assert(data != NULL, "data pointer for ext of type %i and %i bytes is NULL", exttype, (int)count);
-    mpack_start_ext(writer, exttype, count);
-    mpack_write_bytes(writer, data, count);
-    mpack_finish_ext(writer);
+    mpack_writer_track_element(writer);
+    mpack_write_ext_tag(writer, exttype, count);
+    if (count == 0 || mpack_writer_error(writer) != mpack_ok)
+        return;
+    mpack_write_native(writer, data, count);
 }
 
 void mpack_write_bytes(mpack_writer_t* writer, const char* data, size_t count) {
@@ -950,6 +979,12 @@ void mpack_write_bytes(mpack_writer_t* writer, const char* data, size_t count) {
     mpack_write_native(writer, data, count);
 }
 
+void mpack_write_object_bytes(mpack_writer_t* writer, const char* data, size_t bytes) {
+    mpack_assert(data != NULL, "data pointer for %i bytes is NULL", (int)bytes);
+    mpack_writer_track_element(writer);
+    mpack_write_native(writer, data, bytes);
+}
+
 void mpack_write_cstr(mpack_writer_t* writer, const char* cstr) {
     mpack_assert(cstr != NULL, "cstr pointer is NULL");
     size_t length = mpack_strlen(cstr);
@@ -989,5 +1024,231 @@ void mpack_write_utf8_cstr_or_nil(mpack_writer_t* writer, const char* cstr) {
         mpack_write_nil(writer);
 }
 
+#define MPACK_WRITE_FIELD(ctype, suffix) do { \
+    mpack_assert(field->size == sizeof(ctype), "field %s has size %i, expected %i", \
+            field->name, (int)field->size, (int)sizeof(ctype)); \
+    ctype value; \
+    mpack_memcpy(&value, p, sizeof(value)); \
+    mpack_write_##suffix(writer, value); \
+} while (0)
+
+static void mpack_write_field(mpack_writer_t* writer, const mpack_field_t* field, const char* p) {
+    switch (field->type) {
+        case mpack_field_bool:   MPACK_WRITE_FIELD(bool, bool);       return;
+        case mpack_field_u8:     MPACK_WRITE_FIELD(uint8_t, u8);      return;
+        case mpack_field_u16:    MPACK_WRITE_FIELD(uint16_t, u16);    return;
+        case mpack_field_u32:    MPACK_WRITE_FIELD(uint32_t, u32);    return;
+        case mpack_field_u64:    MPACK_WRITE_FIELD(uint64_t, u64);    return;
+        case mpack_field_i8:     MPACK_WRITE_FIELD(int8_t, i8);       return;
+        case mpack_field_i16:    MPACK_WRITE_FIELD(int16_t, i16);     return;
+        case mpack_field_i32:    MPACK_WRITE_FIELD(int32_t, i32);     return;
+        case mpack_field_i64:    MPACK_WRITE_FIELD(int64_t, i64);     return;
+        case mpack_field_float:  MPACK_WRITE_FIELD(float, float);     return;
+        case mpack_field_double: MPACK_WRITE_FIELD(double, double);   return;
+
+        case mpack_field_cstr:
+        case mpack_field_utf8_cstr: {
+            // the string must be null-terminated within its buffer, so
+            // that it fits when read back with mpack_expect_struct()
+            size_t length = 0;
+            while (length < field->size && p[length] != '\0')
+                ++length;
+            if (length == field->size || length > UINT32_MAX) {
+                mpack_writer_flag_error(writer, mpack_error_too_big);
+                return;
+            }
+            if (field->type == mpack_field_utf8_cstr)
+                mpack_write_utf8(writer, p, (uint32_t)length);
+            else
+                mpack_write_str(writer, p, (uint32_t)length);
+            return;
+        }
+
+        case mpack_field_struct:
+            mpack_assert(field->desc != NULL, "field %s has no nested descriptor", field->name);
+            mpack_write_struct(writer, field->desc, p);
+            return;
+    }
+
+    mpack_break("field %s has invalid type %i", field->name, (int)field->type);
+    mpack_writer_flag_error(writer, mpack_error_bug);
+}
+
+#undef MPACK_WRITE_FIELD
+
+void mpack_write_struct(mpack_writer_t* writer, const mpack_struct_t* desc, const void* in) {
+    mpack_assert(desc != NULL, "desc cannot be NULL");
+    mpack_assert(in != NULL, "in cannot be NULL");
+
+    if (desc->count > UINT32_MAX) {
+        mpack_break("struct has too many fields!");
+        mpack_writer_flag_error(writer, mpack_error_bug);
+        return;
+    }
+
+    const char* base = (const char*)in;
+    mpack_start_map(writer, (uint32_t)desc->count);
+    for (size_t i = 0; i < desc->count; ++i) {
+        const mpack_field_t* field = &desc->fields[i];
+        mpack_write_str(writer, field->name, field->name_len);
+        mpack_write_field(writer, field, base + field->offset);
+    }
+    mpack_finish_map(writer);
+}
+
+#ifdef MPACK_MALLOC
+void mpack_sharded_array_init(mpack_sharded_array_t* array, uint32_t count, size_t shard_count) {
+    mpack_memset(array, 0, sizeof(*array));
+
+    if (shard_count == 0) {
+        mpack_break("a sharded array needs at least one shard");
+        array->error = mpack_error_bug;
+        return;
+    }
+
+    if (shard_count > SIZE_MAX / sizeof(mpack_shard_t)) {
+        array->error = mpack_error_memory;
+        return;
+    }
+    array->shards = (mpack_shard_t*)MPACK_MALLOC(sizeof(mpack_shard_t) * shard_count);
+    if (array->shards == NULL) {
+        array->error = mpack_error_memory;
+        return;
+    }
+    array->shard_count = shard_count;
+
+    // shard i covers elements [count * i / shards, count * (i + 1) / shards)
+    uint32_t first = 0;
+    for (size_t i = 0; i < shard_count; ++i) {
+        mpack_shard_t* shard = &array->shards[i];
+        uint32_t end = (uint32_t)((uint64_t)count * (i + 1) / shard_count);
+        shard->data = NULL;
+        shard->size = 0;
+        shard->first = first;
+        shard->elements = end - first;
+        shard->error = mpack_ok;
+        shard->started = false;
+        shard->finished = false;
+        first = end;
+    }
+
+    if (count <= 15) {
+        mpack_encode_fixarray(array->header, (uint8_t)count);
+        array->header_size = MPACK_TAG_SIZE_FIXARRAY;
+    } else if (count <= UINT16_MAX) {
+        mpack_encode_array16(array->header, (uint16_t)count);
+        array->header_size = MPACK_TAG_SIZE_ARRAY16;
+    } else {
+        mpack_encode_array32(array->header, (uint32_t)count);
+        array->header_size = MPACK_TAG_SIZE_ARRAY32;
+    }
+}
+
+mpack_writer_t* mpack_sharded_array_start(mpack_sharded_array_t* array, size_t shard_index) {
+    mpack_assert(shard_index < array->shard_count, "shard %i is out of bounds", (int)shard_index);
+    mpack_shard_t* shard = &array->shards[shard_index];
+    mpack_assert(!shard->started, "shard %i has already been started", (int)shard_index);
+
+    shard->started = true;
+    mpack_writer_init_growable(&shard->writer, &shard->data, &shard->size);
+    mpack_writer_track_push(&shard->writer, mpack_type_array, shard->elements);
+    return &shard->writer;
+}
+
+mpack_error_t mpack_sharded_array_finish(mpack_sharded_array_t* array, size_t shard_index) {
+    mpack_assert(shard_index < array->shard_count, "shard %i is out of bounds", (int)shard_index);
+    mpack_shard_t* shard = &array->shards[shard_index];
+
+    if (!shard->started || shard->finished) {
+        mpack_break("shard %i is not started or already finished", (int)shard_index);
+        // the shard may be in use by another thread, so it is left as is
+        return mpack_error_bug;
+    }
+
+    mpack_writer_track_pop(&shard->writer, mpack_type_array);
+    shard->error = mpack_writer_destroy(&shard->writer);
+    shard->finished = true;
+    return shard->error;
+}
+
+mpack_error_t mpack_sharded_array_error(mpack_sharded_array_t* array) {
+    if (array->error != mpack_ok)
+        return array->error;
+
+    for (size_t i = 0; i < array->shard_count; ++i) {
+        mpack_shard_t* shard = &array->shards[i];
+        if (!shard->finished) {
+            mpack_break("shard %i has not been finished", (int)i);
+            array->error = mpack_error_bug;
+            break;
+        }
+        if (shard->error != mpack_ok) {
+            array->error = shard->error;
+            break;
+        }
+    }
+
+    return array->error;
+}
+
+size_t mpack_sharded_array_buffer_count(mpack_sharded_array_t* array) {
+    if (mpack_sharded_array_error(array) != mpack_ok)
+        return 0;
+    return array->shard_count + 1;
+}
+
+const char* mpack_sharded_array_buffer(const mpack_sharded_array_t* array, size_t index, size_t* size) {
+    mpack_assert(array->error == mpack_ok, "sharded array is in an error state");
+    mpack_assert(index <= array->shard_count, "buffer %i is out of bounds", (int)index);
+
+    if (index == 0) {
+        *size = array->header_size;
+        return array->header;
+    }
+
+    const mpack_shard_t* shard = &array->shards[index - 1];
+    mpack_assert(shard->finished, "shard %i has not been finished", (int)(index - 1));
+    *size = shard->size;
+    return shard->data;
+}
+
+void mpack_sharded_array_write(mpack_sharded_array_t* array, mpack_writer_t* writer) {
+    mpack_error_t error = mpack_sharded_array_error(array);
+    if (error != mpack_ok) {
+        mpack_writer_flag_error(writer, error);
+        return;
+    }
+
+    mpack_writer_track_element(writer);
+    mpack_write_native(writer, array->header, array->header_size);
+    for (size_t i = 0; i < array->shard_count; ++i)
+        mpack_write_native(writer, array->shards[i].data, array->shards[i].size);
+}
+
+mpack_error_t mpack_sharded_array_destroy(mpack_sharded_array_t* array) {
+    for (size_t i = 0; i < array->shard_count; ++i) {
+        mpack_shard_t* shard = &array->shards[i];
+        if (shard->started && !shard->finished) {
+            mpack_writer_flag_error(&shard->writer, mpack_error_data);
+            shard->error = mpack_writer_destroy(&shard->writer);
+            shard->finished = true;
+        }
+        if (shard->data)
+            MPACK_FREE(shard->data);
+    }
+
+    // unstarted shards are not an error once the array is destroyed
+    mpack_error_t error = array->error;
+    for (size_t i = 0; error == mpack_ok && i < array->shard_count; ++i)
+        error = array->shards[i].error;
+
+    if (array->shards)
+        MPACK_FREE(array->shards);
+    array->shards = NULL;
+    array->shard_count = 0;
+    return error;
+}
+#endif
+
 #endif
 
@@ -104,6 +104,22 @@ typedef void (*mpack_writer_error_t)(mpack_writer_t* writer, mpack_error_t error
  */
 typedef void (*mpack_writer_teardown_t)(mpack_writer_t* writer);
 
+#if MPACK_STATS
+/**
+ * Statistics counted by a writer when MPACK_STATS is enabled.
+ *
+ * The total number of bytes written is flush_bytes plus
+ * mpack_writer_buffer_used().
+ *
+ * @see mpack_writer_stats()
+ */
+typedef struct mpack_writer_stats_t {
+    uint64_t flush_calls; /**< Calls to the flush function. */
+    uint64_t flush_bytes; /**< Bytes passed to the flush function. */
+    uint64_t straddles;   /**< Writes that did not fit in the space left in the buffer. */
+} mpack_writer_stats_t;
+#endif
+
 /* Hide internals from documentation */
 /** @cond */
 
@@ -122,6 +138,10 @@ struct mpack_writer_t {
     mpack_track_t track; /* Stack of map/array/str/bin/ext writes */
     #endif
 
+    #if MPACK_STATS
+    mpack_writer_stats_t stats; /* Statistics counters */
+    #endif
+
     #ifdef MPACK_MALLOC
     /* Reserved. You can use this space to allocate a custom
      * context in order to reduce heap allocations. */
@@ -129,7 +149,31 @@ struct mpack_writer_t {
     #endif
 };
 
-#if MPACK_WRITE_TRACKING
+#if MPACK_WRITE_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+// With an inline tracking stack, the common case is tracked inline. The
+// stack is not used once the writer has an error, so the fast paths
+// don't need to check for one. Elements are only counted; they are
+// checked when their compound type is closed.
+void mpack_writer_track_push_slow(mpack_writer_t* writer, mpack_type_t type, uint64_t count);
+void mpack_writer_track_pop_slow(mpack_writer_t* writer, mpack_type_t type);
+void mpack_writer_track_bytes_slow(mpack_writer_t* writer, size_t count);
+
+MPACK_INLINE void mpack_writer_track_push(mpack_writer_t* writer, mpack_type_t type, uint64_t count) {
+    if (!mpack_track_push_fast(&writer->track, type, count))
+        mpack_writer_track_push_slow(writer, type, count);
+}
+MPACK_INLINE void mpack_writer_track_pop(mpack_writer_t* writer, mpack_type_t type) {
+    if (!mpack_track_pop_fast(&writer->track, type))
+        mpack_writer_track_pop_slow(writer, type);
+}
+MPACK_INLINE void mpack_writer_track_element(mpack_writer_t* writer) {
+    mpack_track_element_fast(&writer->track);
+}
+MPACK_INLINE void mpack_writer_track_bytes(mpack_writer_t* writer, size_t count) {
+    if (!mpack_track_bytes_fast(&writer->track, count))
+        mpack_writer_track_bytes_slow(writer, count);
+}
+#elif MPACK_WRITE_TRACKING
 void mpack_writer_track_push(mpack_writer_t* writer, mpack_type_t type, uint64_t count);
 void mpack_writer_track_pop(mpack_writer_t* writer, mpack_type_t type);
 void mpack_writer_track_element(mpack_writer_t* writer);
@@ -379,6 +423,17 @@ MPACK_INLINE mpack_error_t mpack_writer_error(mpack_writer_t* writer) {
     return writer->error;
 }
 
+#if MPACK_STATS
+/**
+ * Returns the statistics counted by the writer since it was initialized.
+ *
+ * This is only available when MPACK_STATS is enabled.
+ */
+MPACK_INLINE const mpack_writer_stats_t* mpack_writer_stats(mpack_writer_t* writer) {
+    return &writer->stats;
+}
+#endif
+
 /**
  * Writes a MessagePack object header (an MPack Tag.)
  *
@@ -707,6 +762,20 @@ void mpack_start_ext(mpack_writer_t* writer, int8_t exttype, uint32_t count);
  */
 void mpack_write_bytes(mpack_writer_t* writer, const char* data, size_t count);
 
+/**
+ * Writes a complete MessagePack object that has already been encoded.
+ *
+ * This is typically used to write constant pre-encoded data such as map
+ * keys. The data is copied as-is and counts as a single element of the
+ * current map or array. It is not checked; it must contain exactly one
+ * complete, valid MessagePack object or the output will be corrupt.
+ *
+ * @param writer The writer
+ * @param data The encoded object
+ * @param bytes The size of the encoded object in bytes
+ */
+void mpack_write_object_bytes(mpack_writer_t* writer, const char* data, size_t bytes);
+
 /**
  * Finishes writing a string.
  *
@@ -769,10 +838,249 @@ MPACK_INLINE void mpack_finish_type(mpack_writer_t* writer, mpack_type_t type) {
  * @}
  */
 
+/**
+ * @name Struct Functions
+ * @{
+ */
+
+/**
+ * Writes the given struct as a map according to the given descriptor table.
+ *
+ * Every field in the descriptor is written in declared order, with the
+ * field's name as its key. Optional fields are written as well; the
+ * descriptor does not track whether a field is present. String fields
+ * are written up to their null-terminator, which must be within their
+ * char array.
+ *
+ * @throws mpack_error_invalid If a UTF-8 string field is not valid UTF-8
+ * @throws mpack_error_too_big If a string field has no null-terminator
+ *     within its char array
+ *
+ * @param writer The writer
+ * @param desc The descriptor of the struct
+ * @param in The struct to encode
+ *
+ * @see mpack_expect_struct()
+ */
+void mpack_write_struct(mpack_writer_t* writer, const mpack_struct_t* desc, const void* in);
+
+/**
+ * @}
+ */
+
+#ifdef MPACK_MALLOC
+
+/**
+ * @name Sharded Arrays
+ *
+ * A sharded array is a large array whose elements are encoded in
+ * parallel. The range of elements is split into shards, each of which
+ * is encoded into its own growable buffer, typically on its own thread.
+ * Once all shards are finished, the array header and the shard buffers
+ * together form the encoded array. They can be handed out as a list of
+ * buffers (for example to writev()) without copying them, or written
+ * into a writer as a single element.
+ *
+ * MPack does not start any threads; the caller distributes the shards
+ * as it sees fit. Each shard must only be used by one thread at a time,
+ * and the remaining functions must only be called once all shards are
+ * finished. MPACK_MALLOC() must be thread-safe.
+ *
+ * @code
+ * mpack_sharded_array_t array;
+ * mpack_sharded_array_init(&array, count, threads);
+ *
+ * // on each thread, for its shard:
+ * mpack_writer_t* writer = mpack_sharded_array_start(&array, shard);
+ * uint32_t first = mpack_sharded_array_first(&array, shard);
+ * uint32_t end = first + mpack_sharded_array_elements(&array, shard);
+ * for (uint32_t i = first; i < end; ++i)
+ *     mpack_write_double(writer, values[i]);
+ * mpack_sharded_array_finish(&array, shard);
+ *
+ * // once all threads are joined:
+ * mpack_sharded_array_write(&array, output);
+ * mpack_sharded_array_destroy(&array);
+ * @endcode
+ *
+ * @{
+ */
+
+/**
+ * A shard of a sharded array.
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_shard_t {
+    /** @cond */
+    mpack_writer_t writer; /* Writer of the shard's elements */
+    char* data;            /* Encoded elements once finished */
+    size_t size;           /* Size of the encoded elements */
+    uint32_t first;        /* Index of the first element */
+    uint32_t elements;     /* Number of elements */
+    mpack_error_t error;   /* Final error of the writer */
+    bool started;          /* Whether the writer has been initialized */
+    bool finished;         /* Whether the writer has been destroyed */
+    /** @endcond */
+} mpack_shard_t;
+
+/**
+ * An array whose elements are encoded in parallel shards.
+ *
+ * This structure is opaque; its fields should not be accessed outside
+ * of MPack.
+ */
+typedef struct mpack_sharded_array_t {
+    /** @cond */
+    mpack_shard_t* shards;                /* Allocated shards */
+    size_t shard_count;                   /* Number of shards */
+    char header[MPACK_TAG_SIZE_ARRAY32];  /* Encoded array header */
+    size_t header_size;                   /* Size of the array header */
+    mpack_error_t error;                  /* Error not belonging to a shard */
+    /** @endcond */
+} mpack_sharded_array_t;
+
+/**
+ * Initializes a sharded array of the given number of elements, splitting
+ * the elements as evenly as possible into the given number of shards.
+ *
+ * If there are more shards than elements, some shards are empty. They
+ * must still be started and finished.
+ *
+ * @throws mpack_error_memory if the shards cannot be allocated. The
+ *     array must still be destroyed.
+ *
+ * @param array The sharded array
+ * @param count The total number of elements in the array
+ * @param shard_count The number of shards, which must be at least 1
+ */
+void mpack_sharded_array_init(mpack_sharded_array_t* array, uint32_t count, size_t shard_count);
+
+/**
+ * Returns the number of shards in the sharded array, or 0 if it failed
+ * to initialize.
+ */
+MPACK_INLINE size_t mpack_sharded_array_shard_count(const mpack_sharded_array_t* array) {
+    return array->shard_count;
+}
+
+/**
+ * Returns the index of the first element of the given shard.
+ */
+MPACK_INLINE uint32_t mpack_sharded_array_first(const mpack_sharded_array_t* array, size_t shard) {
+    mpack_assert(shard < array->shard_count, "shard %i is out of bounds", (int)shard);
+    return array->shards[shard].first;
+}
+
+/**
+ * Returns the number of elements that must be written to the given
+ * shard.
+ */
+MPACK_INLINE uint32_t mpack_sharded_array_elements(const mpack_sharded_array_t* array, size_t shard) {
+    mpack_assert(shard < array->shard_count, "shard %i is out of bounds", (int)shard);
+    return array->shards[shard].elements;
+}
+
+/**
+ * Starts encoding the given shard, returning a writer into which its
+ * elements should be written.
+ *
+ * The writer writes to a growable buffer owned by the shard. Write
+ * exactly mpack_sharded_array_elements() elements to it (this is checked
+ * in tracking mode), then call mpack_sharded_array_finish(). To abandon
+ * the shard, flag an error on the writer before finishing it.
+ *
+ * The writer may already be in an error state if its buffer could not
+ * be allocated.
+ */
+mpack_writer_t* mpack_sharded_array_start(mpack_sharded_array_t* array, size_t shard);
+
+/**
+ * Finishes encoding the given shard, destroying its writer and keeping
+ * its encoded elements.
+ *
+ * @return The final error state of the shard's writer.
+ */
+mpack_error_t mpack_sharded_array_finish(mpack_sharded_array_t* array, size_t shard);
+
+/**
+ * Returns the error state of the sharded array, which is the first
+ * error of any of its shards, or mpack_error_bug if any shard has not
+ * been finished.
+ */
+mpack_error_t mpack_sharded_array_error(mpack_sharded_array_t* array);
+
+/**
+ * Returns the number of buffers that make up the encoded array: the
+ * array header, followed by the data of each shard in order.
+ *
+ * Returns 0 if the sharded array is in an error state.
+ */
+size_t mpack_sharded_array_buffer_count(mpack_sharded_array_t* array);
+
+/**
+ * Returns the given buffer of the encoded array and its size. Buffer 0
+ * is the array header, and buffer i + 1 is the data of shard i.
+ *
+ * The buffers remain valid until the sharded array is destroyed.
+ *
+ * @see mpack_sharded_array_buffer_count()
+ */
+const char* mpack_sharded_array_buffer(const mpack_sharded_array_t* array, size_t index, size_t* size);
+
+/**
+ * Writes the encoded array into the given writer as a single element.
+ *
+ * Shard buffers that do not fit in the writer's buffer are flushed
+ * directly rather than copied through it.
+ *
+ * If the sharded array is in an error state, its error is flagged on
+ * the writer.
+ */
+void mpack_sharded_array_write(mpack_sharded_array_t* array, mpack_writer_t* writer);
+
+/**
+ * Frees the shards of a sharded array, returning its final error state.
+ *
+ * Shards that were started but not finished are cancelled.
+ */
+mpack_error_t mpack_sharded_array_destroy(mpack_sharded_array_t* array);
+
+/**
+ * @}
+ */
+
+#endif
+
 /**
  * @}
  */
 
+#if MPACK_INTERNAL
+
+// Writes encoded bytes to the buffer when we already know the data
+// does not fit in the buffer (i.e. it straddles the edge of the
+// buffer.) If there is a flush function, it is guaranteed to be
+// called; otherwise mpack_error_too_big is raised.
+void mpack_write_native_straddle(mpack_writer_t* writer, const char* p, size_t count);
+
+// Writes encoded bytes to the buffer, flushing if necessary. The bytes
+// are not tracked, so this can also be used to write other formats
+// (such as JSON) to a writer's output.
+MPACK_INLINE void mpack_write_native(mpack_writer_t* writer, const char* p, size_t count) {
+    mpack_assert(count == 0 || p != NULL, "data pointer for %i bytes is NULL", (int)count);
+
+    if (writer->size - writer->used < count) {
+        mpack_write_native_straddle(writer, p, count);
+    } else {
+        mpack_memcpy(writer->buffer + writer->used, p, count);
+        writer->used += count;
+    }
+}
+
+#endif
+
 #endif
 
 MPACK_HEADER_END
@@ -34,6 +34,11 @@
 #include "mpack-reader.h"
 #include "mpack-expect.h"
 #include "mpack-node.h"
+#include "mpack-json.h"
+#include "mpack-journal.h"
+#include "mpack-pipeline.h"
+#include "mpack-ring.h"
+#include "mpack-frame.h"
 
 #endif
 
@@ -18,6 +18,13 @@
     #define MPACK_WRITER 1
     #define MPACK_EXPECT 1
     #define MPACK_NODE 1
+    #define MPACK_JSON 1
+    #define MPACK_JOURNAL 1
+    #define MPACK_FRAME 1
+    #ifndef _WIN32
+    #define MPACK_PIPELINE 1
+    #define MPACK_RING 1
+    #endif
 
     #define MPACK_STDLIB 1
     #define MPACK_STDIO 1
@@ -34,12 +41,20 @@
 #define fwrite test_fwrite
 #define fseek  test_fseek
 #define ftell  test_ftell
+#ifdef _WIN32
+#define _fseeki64 test_fseek64
+#define _ftelli64 test_ftell64
+#else
+#define fseeko test_fseek64
+#define ftello test_ftell64
+#endif
 #define ferror test_ferror
 #endif
 
 // Tracking matches the default config, except the test suite
-// also supports MPACK_NO_TRACKING to disable it.
-#if defined(MPACK_MALLOC) && !defined(MPACK_NO_TRACKING)
+// also supports MPACK_NO_TRACKING to disable it, and enables
+// it without malloc() when using an inline tracking stack.
+#if (defined(MPACK_MALLOC) || defined(MPACK_TRACKING_INLINE_DEPTH)) && !defined(MPACK_NO_TRACKING)
     #if defined(MPACK_DEBUG) && MPACK_DEBUG && defined(MPACK_READER) && MPACK_READER
         #define MPACK_READ_TRACKING 1
     #endif
@@ -65,8 +80,10 @@
 
 #ifdef MPACK_MALLOC
 #define MPACK_NODE_INITIAL_DEPTH 3
+#define MPACK_EVENT_INITIAL_DEPTH 3
 #else
 #define MPACK_NODE_MAX_DEPTH_WITHOUT_MALLOC 32
+#define MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC 32
 #endif
 
 #endif
@@ -0,0 +1,322 @@
+/* Generated by tools/gencodec.py from test-codec.schema. Do not edit. */
+#include "test-codec-gen.h"
+
+#include <string.h>
+
+#if MPACK_WRITER
+static void test_codec_write_cstr(mpack_writer_t* writer, const char* str, size_t size, bool utf8) {
+    size_t length = 0;
+    while (length < size && str[length] != '\0')
+        ++length;
+    if (length == size)
+        mpack_writer_flag_error(writer, mpack_error_too_big);
+    else if (utf8)
+        mpack_write_utf8(writer, str, (uint32_t)length);
+    else
+        mpack_write_str(writer, str, (uint32_t)length);
+}
+#endif
+
+#if MPACK_WRITER
+void test_codec_point_write(mpack_writer_t* writer, const test_codec_point_t* value) {
+    mpack_start_map(writer, 2);
+    mpack_write_object_bytes(writer, "\xa1\x78", 2);
+    mpack_write_i32(writer, value->x);
+    mpack_write_object_bytes(writer, "\xa1\x79", 2);
+    mpack_write_u8(writer, value->y);
+    mpack_finish_map(writer);
+}
+#endif
+
+#if MPACK_EXPECT
+static const char* const test_codec_point_keys[2] = {"x", "y"};
+static const uint8_t test_codec_point_key_lengths[2] = {1, 1};
+
+// returns the index of the given key, or 2 if it is unrecognized
+static size_t test_codec_point_find_key(const char* key, size_t length) {
+    switch (length) {
+        case 1:
+            if (memcmp(key, test_codec_point_keys[0], 1) == 0) return 0;
+            if (memcmp(key, test_codec_point_keys[1], 1) == 0) return 1;
+            break;
+        default:
+            break;
+    }
+    return 2;
+}
+
+void test_codec_point_expect(mpack_reader_t* reader, test_codec_point_t* value) {
+    bool found[2] = {false};
+    size_t next = 0;
+    for (uint32_t i = mpack_expect_map(reader); i > 0; --i) {
+        size_t index = 2;
+        if (mpack_peek_tag(reader).type == mpack_type_str) {
+            uint32_t length = mpack_expect_str(reader);
+            const char* key = mpack_read_bytes_inplace(reader, length);
+            mpack_done_str(reader);
+            if (mpack_reader_error(reader) != mpack_ok)
+                return;
+
+            // keys are usually in declared order
+            if (next < 2 && length == test_codec_point_key_lengths[next] && memcmp(key, test_codec_point_keys[next], length) == 0)
+                index = next;
+            else
+                index = test_codec_point_find_key(key, length);
+        } else {
+            mpack_discard(reader);
+        }
+
+        if (index < 2) {
+            if (found[index]) {
+                mpack_reader_flag_error(reader, mpack_error_invalid);
+                return;
+            }
+            found[index] = true;
+            next = index + 1;
+        }
+
+        switch (index) {
+            case 0: {
+                int32_t decoded = mpack_expect_i32(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->x = decoded;
+                break;
+            }
+            case 1: {
+                uint8_t decoded = mpack_expect_u8(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->y = decoded;
+                break;
+            }
+            default:
+                mpack_discard(reader);
+                break;
+        }
+
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+    }
+    mpack_done_map(reader);
+
+    // fields that are not optional must be present
+    if (!found[0] || !found[1])
+        mpack_reader_flag_error(reader, mpack_error_data);
+}
+#endif
+
+#if MPACK_WRITER
+void test_codec_record_write(mpack_writer_t* writer, const test_codec_record_t* value) {
+    mpack_start_map(writer, 16);
+    mpack_write_object_bytes(writer, "\xa4\x66\x6c\x61\x67", 5);
+    mpack_write_bool(writer, value->flag);
+    mpack_write_object_bytes(writer, "\xa5\x73\x6d\x61\x6c\x6c", 6);
+    mpack_write_u8(writer, value->small);
+    mpack_write_object_bytes(writer, "\xa6\x6d\x65\x64\x69\x75\x6d", 7);
+    mpack_write_u16(writer, value->medium);
+    mpack_write_object_bytes(writer, "\xa5\x6c\x61\x72\x67\x65", 6);
+    mpack_write_u32(writer, value->large);
+    mpack_write_object_bytes(writer, "\xa4\x68\x75\x67\x65", 5);
+    mpack_write_u64(writer, value->huge);
+    mpack_write_object_bytes(writer, "\xa4\x74\x69\x6e\x79", 5);
+    mpack_write_i8(writer, value->tiny);
+    mpack_write_object_bytes(writer, "\xa6\x6f\x66\x66\x73\x65\x74", 7);
+    mpack_write_i16(writer, value->offset);
+    mpack_write_object_bytes(writer, "\xa5\x64\x65\x6c\x74\x61", 6);
+    mpack_write_i32(writer, value->delta);
+    mpack_write_object_bytes(writer, "\xa4\x77\x69\x64\x65", 5);
+    mpack_write_i64(writer, value->wide);
+    mpack_write_object_bytes(writer, "\xa5\x72\x61\x74\x69\x6f", 6);
+    mpack_write_float(writer, value->ratio);
+    mpack_write_object_bytes(writer, "\xa7\x70\x72\x65\x63\x69\x73\x65", 8);
+    mpack_write_double(writer, value->precise);
+    mpack_write_object_bytes(writer, "\xa3\x74\x61\x67", 4);
+    test_codec_write_cstr(writer, value->tag, sizeof(value->tag), false);
+    mpack_write_object_bytes(writer, "\xa5\x6c\x61\x62\x65\x6c", 6);
+    test_codec_write_cstr(writer, value->label, sizeof(value->label), true);
+    mpack_write_object_bytes(writer, "\xa4\x6e\x6f\x74\x65", 5);
+    test_codec_write_cstr(writer, value->note, sizeof(value->note), true);
+    mpack_write_object_bytes(writer, "\xa6\x6f\x72\x69\x67\x69\x6e", 7);
+    test_codec_point_write(writer, &value->origin);
+    mpack_write_object_bytes(writer, "\xa5\x73\x63\x61\x6c\x65", 6);
+    mpack_write_double(writer, value->scale);
+    mpack_finish_map(writer);
+}
+#endif
+
+#if MPACK_EXPECT
+static const char* const test_codec_record_keys[16] = {"flag", "small", "medium", "large", "huge", "tiny", "offset", "delta", "wide", "ratio", "precise", "tag", "label", "note", "origin", "scale"};
+static const uint8_t test_codec_record_key_lengths[16] = {4, 5, 6, 5, 4, 4, 6, 5, 4, 5, 7, 3, 5, 4, 6, 5};
+
+// returns the index of the given key, or 16 if it is unrecognized
+static size_t test_codec_record_find_key(const char* key, size_t length) {
+    switch (length) {
+        case 3:
+            if (memcmp(key, test_codec_record_keys[11], 3) == 0) return 11;
+            break;
+        case 4:
+            if (memcmp(key, test_codec_record_keys[0], 4) == 0) return 0;
+            if (memcmp(key, test_codec_record_keys[4], 4) == 0) return 4;
+            if (memcmp(key, test_codec_record_keys[5], 4) == 0) return 5;
+            if (memcmp(key, test_codec_record_keys[8], 4) == 0) return 8;
+            if (memcmp(key, test_codec_record_keys[13], 4) == 0) return 13;
+            break;
+        case 5:
+            if (memcmp(key, test_codec_record_keys[1], 5) == 0) return 1;
+            if (memcmp(key, test_codec_record_keys[3], 5) == 0) return 3;
+            if (memcmp(key, test_codec_record_keys[7], 5) == 0) return 7;
+            if (memcmp(key, test_codec_record_keys[9], 5) == 0) return 9;
+            if (memcmp(key, test_codec_record_keys[12], 5) == 0) return 12;
+            if (memcmp(key, test_codec_record_keys[15], 5) == 0) return 15;
+            break;
+        case 6:
+            if (memcmp(key, test_codec_record_keys[2], 6) == 0) return 2;
+            if (memcmp(key, test_codec_record_keys[6], 6) == 0) return 6;
+            if (memcmp(key, test_codec_record_keys[14], 6) == 0) return 14;
+            break;
+        case 7:
+            if (memcmp(key, test_codec_record_keys[10], 7) == 0) return 10;
+            break;
+        default:
+            break;
+    }
+    return 16;
+}
+
+void test_codec_record_expect(mpack_reader_t* reader, test_codec_record_t* value) {
+    bool found[16] = {false};
+    size_t next = 0;
+    for (uint32_t i = mpack_expect_map(reader); i > 0; --i) {
+        size_t index = 16;
+        if (mpack_peek_tag(reader).type == mpack_type_str) {
+            uint32_t length = mpack_expect_str(reader);
+            const char* key = mpack_read_bytes_inplace(reader, length);
+            mpack_done_str(reader);
+            if (mpack_reader_error(reader) != mpack_ok)
+                return;
+
+            // keys are usually in declared order
+            if (next < 16 && length == test_codec_record_key_lengths[next] && memcmp(key, test_codec_record_keys[next], length) == 0)
+                index = next;
+            else
+                index = test_codec_record_find_key(key, length);
+        } else {
+            mpack_discard(reader);
+        }
+
+        if (index < 16) {
+            if (found[index]) {
+                mpack_reader_flag_error(reader, mpack_error_invalid);
+                return;
+            }
+            found[index] = true;
+            next = index + 1;
+        }
+
+        switch (index) {
+            case 0: {
+                bool decoded = mpack_expect_bool(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->flag = decoded;
+                break;
+            }
+            case 1: {
+                uint8_t decoded = mpack_expect_u8_range(reader, 1, 200);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->small = decoded;
+                break;
+            }
+            case 2: {
+                uint16_t decoded = mpack_expect_u16(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->medium = decoded;
+                break;
+            }
+            case 3: {
+                uint32_t decoded = mpack_expect_u32_range(reader, UINT32_C(0), UINT32_C(4000000000));
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->large = decoded;
+                break;
+            }
+            case 4: {
+                uint64_t decoded = mpack_expect_u64_range(reader, UINT64_C(0), UINT64_C(18446744073709551615));
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->huge = decoded;
+                break;
+            }
+            case 5: {
+                int8_t decoded = mpack_expect_i8_range(reader, -100, 100);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->tiny = decoded;
+                break;
+            }
+            case 6: {
+                int16_t decoded = mpack_expect_i16(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->offset = decoded;
+                break;
+            }
+            case 7: {
+                int32_t decoded = mpack_expect_i32_range(reader, INT32_MIN, 2147483647);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->delta = decoded;
+                break;
+            }
+            case 8: {
+                int64_t decoded = mpack_expect_i64_range(reader, INT64_MIN, INT64_C(9223372036854775807));
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->wide = decoded;
+                break;
+            }
+            case 9: {
+                float decoded = mpack_expect_float_range(reader, (float)0, (float)1);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->ratio = decoded;
+                break;
+            }
+            case 10: {
+                double decoded = mpack_expect_double(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->precise = decoded;
+                break;
+            }
+            case 11:
+                mpack_expect_cstr(reader, value->tag, sizeof(value->tag));
+                break;
+            case 12:
+                mpack_expect_utf8_cstr(reader, value->label, sizeof(value->label));
+                break;
+            case 13:
+                if (mpack_peek_tag(reader).type == mpack_type_nil) {
+                    mpack_expect_nil(reader);
+                    break;
+                }
+                mpack_expect_utf8_cstr(reader, value->note, sizeof(value->note));
+                break;
+            case 14:
+                test_codec_point_expect(reader, &value->origin);
+                break;
+            case 15: {
+                if (mpack_peek_tag(reader).type == mpack_type_nil) {
+                    mpack_expect_nil(reader);
+                    break;
+                }
+                double decoded = mpack_expect_double(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    value->scale = decoded;
+                break;
+            }
+            default:
+                mpack_discard(reader);
+                break;
+        }
+
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+    }
+    mpack_done_map(reader);
+
+    // fields that are not optional must be present
+    if (!found[0] || !found[1] || !found[2] || !found[3] || !found[4] || !found[5] || !found[6] || !found[7] || !found[8] || !found[9] || !found[10] || !found[11] || !found[12] || !found[14])
+        mpack_reader_flag_error(reader, mpack_error_data);
+}
+#endif
@@ -0,0 +1,53 @@
+/* Generated by tools/gencodec.py from test-codec.schema. Do not edit. */
+#ifndef TEST_CODEC_GEN_H
+#define TEST_CODEC_GEN_H 1
+
+#include "mpack/mpack.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct test_codec_point_t {
+    int32_t x;
+    uint8_t y;
+} test_codec_point_t;
+
+#if MPACK_WRITER
+void test_codec_point_write(mpack_writer_t* writer, const test_codec_point_t* value);
+#endif
+#if MPACK_EXPECT
+void test_codec_point_expect(mpack_reader_t* reader, test_codec_point_t* value);
+#endif
+
+typedef struct test_codec_record_t {
+    bool flag;
+    uint8_t small;
+    uint16_t medium;
+    uint32_t large;
+    uint64_t huge;
+    int8_t tiny;
+    int16_t offset;
+    int32_t delta;
+    int64_t wide;
+    float ratio;
+    double precise;
+    char tag[8];
+    char label[8];
+    char note[16];
+    test_codec_point_t origin;
+    double scale;
+} test_codec_record_t;
+
+#if MPACK_WRITER
+void test_codec_record_write(mpack_writer_t* writer, const test_codec_record_t* value);
+#endif
+#if MPACK_EXPECT
+void test_codec_record_expect(mpack_reader_t* reader, test_codec_record_t* value);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Tests the code generated by tools/gencodec.py from test-codec.schema.
+
+#include "test-codec.h"
+#include "test-codec-gen.h"
+#include "test-reader.h"
+#include "test-write.h"
+
+#if MPACK_WRITER && MPACK_EXPECT
+
+static void test_codec_record_init(test_codec_record_t* record) {
+    memset(record, 0, sizeof(*record));
+    record->flag = true;
+    record->small = 200;
+    record->medium = UINT16_MAX;
+    record->large = 4000000000u;
+    record->huge = UINT64_MAX;
+    record->tiny = -100;
+    record->offset = INT16_MIN;
+    record->delta = INT32_MIN;
+    record->wide = INT64_MIN;
+    record->ratio = 0.5f;
+    record->precise = -1.25;
+
+    // the longest strings that fit their buffers
+    strcpy(record->tag, "abcdefg");
+    strcpy(record->label, "\xC3\xA9tique");
+    strcpy(record->note, "short");
+
+    record->origin.x = -2;
+    record->origin.y = 200;
+    record->scale = 2.0;
+}
+
+static size_t test_codec_record_write_buffer(const test_codec_record_t* record, char* buf, size_t size) {
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buf, size);
+    test_codec_record_write(&writer, record);
+    size_t used = mpack_writer_buffer_used(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    return used;
+}
+
+static mpack_error_t test_codec_record_read_buffer(test_codec_record_t* record, const char* buf, size_t size) {
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, buf, size);
+    test_codec_record_expect(&reader, record);
+    return mpack_reader_destroy(&reader);
+}
+
+static void test_codec_round_trip(void) {
+    test_codec_record_t record;
+    test_codec_record_init(&record);
+    char buf[512];
+    size_t size = test_codec_record_write_buffer(&record, buf, sizeof(buf));
+
+    test_codec_record_t decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    TEST_TRUE(test_codec_record_read_buffer(&decoded, buf, size) == mpack_ok);
+    TEST_TRUE(decoded.flag == record.flag);
+    TEST_TRUE(decoded.small == record.small);
+    TEST_TRUE(decoded.medium == record.medium);
+    TEST_TRUE(decoded.large == record.large);
+    TEST_TRUE(decoded.huge == record.huge);
+    TEST_TRUE(decoded.tiny == record.tiny);
+    TEST_TRUE(decoded.offset == record.offset);
+    TEST_TRUE(decoded.delta == record.delta);
+    TEST_TRUE(decoded.wide == record.wide);
+    TEST_TRUE(decoded.ratio == record.ratio);
+    TEST_TRUE(decoded.precise == record.precise);
+    TEST_TRUE(strcmp(decoded.tag, record.tag) == 0);
+    TEST_TRUE(strcmp(decoded.label, record.label) == 0);
+    TEST_TRUE(strcmp(decoded.note, record.note) == 0);
+    TEST_TRUE(decoded.origin.x == record.origin.x);
+    TEST_TRUE(decoded.origin.y == record.origin.y);
+    TEST_TRUE(decoded.scale == record.scale);
+
+    // the generated writer matches the descriptor-based one
+    static const mpack_field_t point_fields[] = {
+        MPACK_FIELD(test_codec_point_t, x, mpack_field_i32, 0),
+        MPACK_FIELD(test_codec_point_t, y, mpack_field_u8, 0),
+    };
+    static const mpack_struct_t point_desc = MPACK_STRUCT(point_fields);
+    char expected[64];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, expected, sizeof(expected));
+    mpack_write_struct(&writer, &point_desc, &record.origin);
+    size_t expected_size = mpack_writer_buffer_used(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    test_codec_point_write(&writer, &record.origin);
+    TEST_TRUE(mpack_writer_buffer_used(&writer) == expected_size &&
+            memcmp(buf, expected, expected_size) == 0);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+}
+
+static void test_codec_point_read(void) {
+    test_codec_point_t point;
+
+    // keys in any order, with unknown keys
+    TEST_SIMPLE_READ("\x83\xA1y\x07\xA1z\xC0\xA1x\xFE",
+            (test_codec_point_expect(&reader, &point), true));
+    TEST_TRUE(point.x == -2 && point.y == 7);
+
+    // missing and duplicate keys
+    TEST_SIMPLE_READ_ERROR("\x81\xA1x\x01",
+            (test_codec_point_expect(&reader, &point), true), mpack_error_data);
+    TEST_SIMPLE_READ_ERROR("\x83\xA1x\x01\xA1y\x01\xA1x\x01",
+            (test_codec_point_expect(&reader, &point), true), mpack_error_invalid);
+
+    // a field is unchanged if its value is in error, as with mpack_expect_struct()
+    point.x = -2;
+    point.y = 7;
+    TEST_SIMPLE_READ_ERROR("\x82\xA1y\x08\xA1x\xA1z",
+            (test_codec_point_expect(&reader, &point), true), mpack_error_type);
+    TEST_TRUE(point.x == -2 && point.y == 8);
+}
+
+// finds the given bytes in the given data
+static char* test_codec_find(char* data, size_t size, const char* bytes, size_t count) {
+    for (size_t i = 0; i + count <= size; ++i)
+        if (memcmp(data + i, bytes, count) == 0)
+            return data + i;
+    return NULL;
+}
+
+static void test_codec_errors(void) {
+    test_codec_record_t record;
+    test_codec_record_t decoded;
+    char buf[512];
+    size_t size;
+
+    // values out of their ranges
+    test_codec_record_init(&record);
+    record.small = 0;
+    size = test_codec_record_write_buffer(&record, buf, sizeof(buf));
+    TEST_TRUE(test_codec_record_read_buffer(&decoded, buf, size) == mpack_error_type);
+    test_codec_record_init(&record);
+    record.ratio = 2.0f;
+    size = test_codec_record_write_buffer(&record, buf, sizeof(buf));
+    TEST_TRUE(test_codec_record_read_buffer(&decoded, buf, size) == mpack_error_type);
+
+    // a string can't contain a null byte, or invalid UTF-8
+    test_codec_record_init(&record);
+    size = test_codec_record_write_buffer(&record, buf, sizeof(buf));
+    char* tag = test_codec_find(buf, size, "abcdefg", 7);
+    TEST_TRUE(tag != NULL);
+    if (tag) {
+        tag[3] = '\0';
+        TEST_TRUE(test_codec_record_read_buffer(&decoded, buf, size) == mpack_error_type);
+        tag[3] = 'd';
+    }
+    char* label = test_codec_find(buf, size, "\xC3\xA9tique", 7);
+    TEST_TRUE(label != NULL);
+    if (label) {
+        label[1] = 'x';
+        TEST_TRUE(test_codec_record_read_buffer(&decoded, buf, size) == mpack_error_type);
+    }
+
+    // a string that fills its buffer has no room for a null-terminator
+    TEST_SIMPLE_READ_ERROR("\x81\xA3tag\xA8""abcdefgh",
+            (test_codec_record_expect(&reader, &decoded), true), mpack_error_too_big);
+    test_codec_record_init(&record);
+    memcpy(record.tag, "abcdefgh", sizeof(record.tag));
+    TEST_SIMPLE_WRITE_ERROR(test_codec_record_write(&writer, &record), mpack_error_too_big);
+}
+
+void test_codec(void) {
+    test_codec_round_trip();
+    test_codec_point_read();
+    test_codec_errors();
+}
+
+#endif
+
@@ -416,6 +416,70 @@ static void test_utf8_check(void) {
     TEST_TRUE(false == mpack_utf8_check(EXPAND_STR_ARGS("test\xFF""testtesttest")));
 }
 
+// places sequences at every offset of long ASCII strings to test that
+// the word-at-a-time ASCII skipping agrees with the byte-wise checks
+static void test_utf8_check_long(void) {
+    char str[64];
+    for (size_t len = 0; len <= sizeof(str); ++len) {
+        mpack_memset(str, 'a', sizeof(str));
+        TEST_TRUE(true == mpack_utf8_check(str, len));
+        TEST_TRUE(true == mpack_utf8_check_no_null(str, len));
+
+        for (size_t i = 0; i < len; ++i) {
+
+            // NUL
+            str[i] = '\0';
+            TEST_TRUE(true  == mpack_utf8_check(str, len));
+            TEST_TRUE(false == mpack_utf8_check_no_null(str, len), "len %i offset %i", (int)len, (int)i);
+
+            // lone continuation byte
+            str[i] = '\x80';
+            TEST_TRUE(false == mpack_utf8_check(str, len), "len %i offset %i", (int)len, (int)i);
+            TEST_TRUE(false == mpack_utf8_check_no_null(str, len));
+
+            // DEL is the last ASCII character
+            str[i] = '\x7F';
+            TEST_TRUE(true == mpack_utf8_check_no_null(str, len));
+
+            // 3-byte sequence, possibly truncated
+            str[i] = '\xE7';
+            if (i + 1 < len) str[i + 1] = '\xA0';
+            if (i + 2 < len) str[i + 2] = '\xBF';
+            TEST_TRUE((i + 3 <= len) == mpack_utf8_check(str, len), "len %i offset %i", (int)len, (int)i);
+            TEST_TRUE((i + 3 <= len) == mpack_utf8_check_no_null(str, len));
+
+            mpack_memset(str, 'a', sizeof(str));
+        }
+    }
+}
+
+// puts errors at offsets around and after a run of 2-byte characters,
+// which is validated byte-wise in growing windows before the checker
+// tries skipping ASCII words again
+static void test_utf8_check_mixed(void) {
+    char str[600];
+    for (size_t run = 0; run <= 520; run += 40) {
+        for (size_t i = 0; i < sizeof(str); i += 7) {
+            mpack_memset(str, 'a', sizeof(str));
+            for (size_t j = 0; j < run; j += 2) {
+                str[j] = '\xC3';
+                str[j + 1] = '\xA9';
+            }
+            TEST_TRUE(true == mpack_utf8_check(str, sizeof(str)));
+            TEST_TRUE(true == mpack_utf8_check_no_null(str, sizeof(str)));
+
+            str[i] = '\xFF';
+            TEST_TRUE(false == mpack_utf8_check(str, sizeof(str)), "run %i offset %i", (int)run, (int)i);
+
+            if (i >= run) {
+                str[i] = '\0';
+                TEST_TRUE(true  == mpack_utf8_check(str, sizeof(str)));
+                TEST_TRUE(false == mpack_utf8_check_no_null(str, sizeof(str)), "run %i offset %i", (int)run, (int)i);
+            }
+        }
+    }
+}
+
 void test_common() {
     test_tags_special();
     test_tags_simple();
@@ -424,5 +488,7 @@ void test_common() {
 
     test_strings();
     test_utf8_check();
+    test_utf8_check_long();
+    test_utf8_check_mixed();
 }
 
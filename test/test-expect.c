@@ -477,13 +477,24 @@ static void test_expect_tracking() {
     // reading elements in a string
     TEST_READER_INIT_STR(&reader, "\xa2""xx");
     mpack_expect_str(&reader);
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // elements are only checked when an inline tracked type is closed
+    mpack_read_tag(&reader);
+    TEST_BREAK((mpack_done_str(&reader), true));
+    #else
     TEST_BREAK((mpack_read_tag(&reader), true));
+    #endif
     TEST_READER_DESTROY_ERROR(&reader, mpack_error_bug);
 
     // reading too many elements
-    TEST_READER_INIT_STR(&reader, "\x90");
+    TEST_READER_INIT_STR(&reader, "\x90\xc0");
     mpack_expect_array(&reader);
+    #if MPACK_TRACKING_INLINE_DEPTH
+    mpack_read_tag(&reader);
+    TEST_BREAK((mpack_done_array(&reader), true));
+    #else
     TEST_BREAK((mpack_read_tag(&reader), true));
+    #endif
     TEST_READER_DESTROY_ERROR(&reader, mpack_error_bug);
 
     // reading bytes with nothing open
@@ -920,7 +931,12 @@ static void test_expect_maps() {
     TEST_SIMPLE_READ_CANCEL("\xdf\x00\x00\x00\x00", 0 == mpack_expect_map(&reader));
     TEST_SIMPLE_READ_CANCEL("\xdf\x00\x00\x01\x00", 0x100 == mpack_expect_map(&reader));
     TEST_SIMPLE_READ_CANCEL("\xdf\x00\x01\x00\x00", 0x10000 == mpack_expect_map(&reader));
+    #if MPACK_READ_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+    // the 32-bit counts of inline tracking can't track this many elements
+    TEST_SIMPLE_READ_ERROR("\xdf\xff\xff\xff\xff", 0 == mpack_expect_map(&reader), mpack_error_too_big);
+    #else
     TEST_SIMPLE_READ_CANCEL("\xdf\xff\xff\xff\xff", UINT32_MAX == mpack_expect_map(&reader));
+    #endif
     TEST_SIMPLE_READ_ERROR("\x00", 0 == mpack_expect_map(&reader), mpack_error_type);
 
     // map ranges
@@ -935,7 +951,11 @@ static void test_expect_maps() {
     TEST_SIMPLE_READ("\x80", (mpack_expect_map_match(&reader, 0), mpack_done_map(&reader), true));
     TEST_SIMPLE_READ_CANCEL("\x8f", (mpack_expect_map_match(&reader, 15), true));
     TEST_SIMPLE_READ_CANCEL("\xde\xff\xff", (mpack_expect_map_match(&reader, 0xffff), true));
+    #if MPACK_READ_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+    TEST_SIMPLE_READ_ERROR("\xdf\xff\xff\xff\xff", (mpack_expect_map_match(&reader, UINT32_MAX), true), mpack_error_too_big);
+    #else
     TEST_SIMPLE_READ_CANCEL("\xdf\xff\xff\xff\xff", (mpack_expect_map_match(&reader, UINT32_MAX), true));
+    #endif
     TEST_SIMPLE_READ_ERROR("\x81", (mpack_expect_map_match(&reader, 2), true), mpack_error_type);
 
     TEST_SIMPLE_READ_CANCEL("\x81", true == mpack_expect_map_or_nil(&reader, &count));
@@ -1022,6 +1042,185 @@ static void test_expect_key_cstr_duplicate() {
     #undef KEY_COUNT
 }
 
+#ifdef MPACK_MALLOC
+static void test_expect_key_set_basic() {
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, test_example, TEST_EXAMPLE_SIZE);
+
+    static const char* keys[] = {"schema","compact"};
+    mpack_keyset_t keyset;
+    TEST_TRUE(mpack_keyset_init(&keyset, keys, 2) == mpack_ok);
+    TEST_TRUE(mpack_keyset_count(&keyset) == 2);
+    bool found[2];
+    memset(found, 0, sizeof(found));
+
+    TEST_TRUE(2 == mpack_expect_map(&reader));
+    TEST_TRUE(1 == mpack_expect_key_set(&reader, &keyset, found));
+    TEST_TRUE(true == mpack_expect_bool(&reader));
+    TEST_TRUE(0 == mpack_expect_key_set(&reader, &keyset, found));
+    TEST_TRUE(0 == mpack_expect_u8(&reader));
+    mpack_done_map(&reader);
+
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_TRUE(found[0]);
+    TEST_TRUE(found[1]);
+    mpack_keyset_destroy(&keyset);
+}
+
+static void test_expect_key_set_mixed() {
+    static const char data[] = "\x84\xA3""dup\xC0\x01\xC0\xA7""unknown\xC0\xA3""dup\xC0";
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, sizeof(data)-1);
+
+    static const char* keys[] = { "valid", "dup", "" };
+    mpack_keyset_t keyset;
+    TEST_TRUE(mpack_keyset_init(&keyset, keys, 3) == mpack_ok);
+    bool found[3];
+    memset(found, 0, sizeof(found));
+
+    TEST_TRUE(4 == mpack_expect_map(&reader));
+    TEST_TRUE(1 == mpack_expect_key_set(&reader, &keyset, found));
+    mpack_expect_nil(&reader);
+    TEST_TRUE(3 == mpack_expect_key_set(&reader, &keyset, found)); // not a string
+    mpack_discard(&reader);
+    TEST_TRUE(3 == mpack_expect_key_set(&reader, &keyset, found)); // unknown
+    mpack_discard(&reader);
+    TEST_TRUE(mpack_reader_error(&reader) == mpack_ok);
+    TEST_TRUE(3 == mpack_expect_key_set(&reader, &keyset, found)); // duplicate
+
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_invalid);
+    TEST_TRUE(!found[0]);
+    TEST_TRUE(found[1]);
+    TEST_TRUE(!found[2]);
+    mpack_keyset_destroy(&keyset);
+}
+
+static void test_expect_key_set_large() {
+    // a keyset with many similar keys of various lengths
+    #define KEY_COUNT 100
+    char names[KEY_COUNT][8];
+    const char* keys[KEY_COUNT];
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        sprintf(names[i], "k%i", i * 7);
+        keys[i] = names[i];
+    }
+
+    mpack_keyset_t keyset;
+    TEST_TRUE(mpack_keyset_init(&keyset, keys, KEY_COUNT) == mpack_ok);
+    for (size_t i = 0; i < KEY_COUNT; ++i)
+        TEST_TRUE(i == mpack_keyset_find(&keyset, keys[i], strlen(keys[i])));
+    TEST_TRUE(KEY_COUNT == mpack_keyset_find(&keyset, "k1", 2));
+    TEST_TRUE(KEY_COUNT == mpack_keyset_find(&keyset, "k", 1));
+    TEST_TRUE(KEY_COUNT == mpack_keyset_find(&keyset, "k700", 4));
+    TEST_TRUE(1 == mpack_keyset_find(&keyset, "k700", 2)); // "k7"
+    TEST_TRUE(KEY_COUNT == mpack_keyset_find(&keyset, "", 0));
+    mpack_keyset_destroy(&keyset);
+    #undef KEY_COUNT
+}
+
+static void test_expect_key_set_errors() {
+    static const char* keys[] = { "a", "b", "a" };
+    mpack_keyset_t keyset;
+    TEST_BREAK(mpack_keyset_init(&keyset, keys, 3) == mpack_error_bug);
+    TEST_BREAK(mpack_keyset_init(&keyset, keys, 0) == mpack_error_bug);
+
+    // an empty keyset is a bug in the expect function as well
+    static const char data[] = "\xA1""a";
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, sizeof(data)-1);
+    bool found[1];
+    TEST_BREAK(0 == mpack_expect_key_set(&reader, &keyset, found));
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_bug);
+
+    // allocation failure
+    test_system_fail_after(0, false);
+    TEST_TRUE(mpack_keyset_init(&keyset, keys, 2) == mpack_error_memory);
+    test_system_fail_reset();
+}
+#endif
+
+typedef struct test_expect_point_t {
+    int32_t x;
+    uint8_t y;
+} test_expect_point_t;
+
+typedef struct test_expect_shape_t {
+    bool closed;
+    char name[8];
+    double scale;
+    test_expect_point_t origin;
+    uint16_t sides;
+} test_expect_shape_t;
+
+static const mpack_field_t test_expect_point_fields[] = {
+    MPACK_FIELD(test_expect_point_t, x, mpack_field_i32, 0),
+    MPACK_FIELD(test_expect_point_t, y, mpack_field_u8, 0),
+};
+static const mpack_struct_t test_expect_point_desc = MPACK_STRUCT(test_expect_point_fields);
+
+static const mpack_field_t test_expect_shape_fields[] = {
+    MPACK_FIELD(test_expect_shape_t, closed, mpack_field_bool, 0),
+    MPACK_FIELD(test_expect_shape_t, name, mpack_field_utf8_cstr, 0),
+    MPACK_FIELD(test_expect_shape_t, scale, mpack_field_double, MPACK_FIELD_OPTIONAL),
+    MPACK_FIELD_STRUCT(test_expect_shape_t, origin, test_expect_point_desc, 0),
+    MPACK_FIELD_RANGED(test_expect_shape_t, sides, mpack_field_u16, MPACK_FIELD_OPTIONAL, 3, 8),
+};
+static const mpack_struct_t test_expect_shape_desc = MPACK_STRUCT(test_expect_shape_fields);
+
+static void test_expect_struct() {
+    test_expect_shape_t shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.scale = 1.0;
+
+    // in order, with optional fields absent
+    TEST_SIMPLE_READ("\x83\xA6""closed\xC3\xA4name\xA3tri\xA6origin\x82\xA1x\xFE\xA1y\xCC\xC8",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true));
+    TEST_TRUE(shape.closed == true);
+    TEST_TRUE(strcmp(shape.name, "tri") == 0);
+    TEST_TRUE(shape.scale == 1.0);
+    TEST_TRUE(shape.origin.x == -2);
+    TEST_TRUE(shape.origin.y == 200);
+    TEST_TRUE(shape.sides == 0);
+
+    // reordered, with unknown keys, a nil optional and a ranged field
+    TEST_SIMPLE_READ("\x87\xA5sides\x04\xA6origin\x82\xA1y\x01\xA1x\x02\x01\xC0\xA5scale\xC0"
+            "\xA4name\xA4quad\xA5""extra\x91\x00\xA6""closed\xC2",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true));
+    TEST_TRUE(shape.closed == false);
+    TEST_TRUE(strcmp(shape.name, "quad") == 0);
+    TEST_TRUE(shape.scale == 1.0);
+    TEST_TRUE(shape.origin.x == 2);
+    TEST_TRUE(shape.origin.y == 1);
+    TEST_TRUE(shape.sides == 4);
+
+    // missing required field
+    TEST_SIMPLE_READ_ERROR("\x82\xA6""closed\xC3\xA4name\xA3tri",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true), mpack_error_data);
+    TEST_SIMPLE_READ_ERROR("\x81\xA1x\x00",
+            (mpack_expect_struct(&reader, &test_expect_point_desc, &shape.origin), true), mpack_error_data);
+
+    // duplicate key
+    TEST_SIMPLE_READ_ERROR("\x83\xA1x\x00\xA1y\x00\xA1x\x00",
+            (mpack_expect_struct(&reader, &test_expect_point_desc, &shape.origin), true), mpack_error_invalid);
+
+    // wrong types and ranges
+    TEST_SIMPLE_READ_ERROR("\x90",
+            (mpack_expect_struct(&reader, &test_expect_point_desc, &shape.origin), true), mpack_error_type);
+    TEST_SIMPLE_READ_ERROR("\x82\xA1x\x00\xA1y\xCD\x01\x00",
+            (mpack_expect_struct(&reader, &test_expect_point_desc, &shape.origin), true), mpack_error_type);
+    TEST_SIMPLE_READ_ERROR("\x81\xA5sides\x09",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true), mpack_error_type);
+    TEST_SIMPLE_READ_ERROR("\x81\xA4name\xA9too long!",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true), mpack_error_too_big);
+
+    // a string filling its buffer leaves no room for a null-terminator
+    TEST_SIMPLE_READ_ERROR("\x81\xA4name\xA8""abcdefgh",
+            (mpack_expect_struct(&reader, &test_expect_shape_desc, &shape), true), mpack_error_too_big);
+
+    // a field is unchanged if its value is in error
+    TEST_TRUE(shape.sides == 4);
+}
+
 static void test_expect_key_uint() {
     static const char data[] = "\x85\x02\xC0\x00\xC0\xC3\xC0\x03\xC0\x03\xC0";
     mpack_reader_t reader;
@@ -1052,6 +1251,25 @@ static void test_expect_key_uint() {
     #undef KEY_COUNT
 }
 
+static void test_expect_error_position() {
+    static const char data[] = "\x83\xa1" "a" "\x01\xa1" "b" "\xa1" "x" "\xa1" "c" "\x03";
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, sizeof(data)-1);
+
+    TEST_TRUE(3 == mpack_expect_map(&reader));
+    mpack_expect_cstr_match(&reader, "a");
+    TEST_TRUE(1 == mpack_expect_uint(&reader));
+    mpack_expect_cstr_match(&reader, "b");
+    TEST_TRUE(mpack_reader_error_position(&reader) == 6);
+
+    // the type error is flagged after the tag of the str
+    mpack_expect_uint(&reader);
+    TEST_TRUE(mpack_reader_error_position(&reader) == 7);
+    mpack_expect_cstr_match(&reader, "c");
+    TEST_TRUE(mpack_reader_error_position(&reader) == 7);
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_type);
+}
+
 void test_expect() {
     test_expect_example_read();
 
@@ -1080,6 +1298,15 @@ void test_expect() {
     test_expect_key_cstr_mixed();
     test_expect_key_cstr_duplicate();
     test_expect_key_uint();
+    #ifdef MPACK_MALLOC
+    test_expect_key_set_basic();
+    test_expect_key_set_mixed();
+    test_expect_key_set_large();
+    test_expect_key_set_errors();
+    #endif
+
+    // structs
+    test_expect_struct();
 
     // other
     test_expect_misc();
@@ -1090,6 +1317,7 @@ void test_expect() {
     test_expect_reals_range();
     test_expect_bad_type();
     test_expect_pre_error();
+    test_expect_error_position();
 }
 
 #endif
@@ -309,6 +309,54 @@ static void test_file_discard(void) {
 }
 #endif
 
+#if MPACK_READER && MPACK_MMAP
+static void test_file_mmap(void) {
+    mpack_reader_t reader;
+    mpack_reader_init_mmap(&reader, test_filename);
+    TEST_TRUE(mpack_reader_error(&reader) == mpack_ok, "file map failed with %s",
+            mpack_error_to_string(mpack_reader_error(&reader)));
+
+    mpack_tag_t tag = mpack_read_tag(&reader);
+    TEST_TRUE(mpack_tag_equal(tag, mpack_tag_array(7)));
+
+    // lipsum is much larger than the buffer size, but is still read in place
+    size_t len = mpack_strlen(lipsum);
+    tag = mpack_read_tag(&reader);
+    TEST_TRUE(mpack_tag_equal(tag, mpack_tag_str((uint32_t)len)));
+    const char* str = mpack_read_utf8_inplace(&reader, len);
+    TEST_TRUE(str != NULL && memcmp(str, lipsum, len) == 0);
+    mpack_done_str(&reader);
+
+    // the strings array contains one larger than UINT16_MAX
+    mpack_discard(&reader);
+
+    tag = mpack_read_tag(&reader);
+    TEST_TRUE(mpack_tag_equal(tag, mpack_tag_array(5)));
+    for (size_t i = 0; i < 4; ++i)
+        mpack_discard(&reader);
+    tag = mpack_read_tag(&reader);
+    TEST_TRUE(mpack_tag_equal(tag, mpack_tag_bin(UINT16_MAX + 1)));
+    const char* bin = mpack_read_bytes_inplace(&reader, UINT16_MAX + 1);
+    TEST_TRUE(bin != NULL && bin > str);
+    mpack_done_bin(&reader);
+    mpack_done_array(&reader);
+
+    for (size_t i = 0; i < 4; ++i)
+        mpack_discard(&reader);
+    mpack_done_array(&reader);
+    TEST_TRUE(mpack_reader_remaining(&reader, NULL) == 0);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // test blank and missing files
+    mpack_reader_init_mmap(&reader, test_blank_filename);
+    TEST_TRUE(mpack_reader_error(&reader) == mpack_ok);
+    mpack_discard(&reader);
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_invalid);
+    mpack_reader_init_mmap(&reader, "invalid-filename");
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_io);
+}
+#endif
+
 #if MPACK_EXPECT
 static void test_file_expect_bytes(mpack_reader_t* reader, mpack_tag_t tag) {
     mpack_expect_tag(reader, tag);
@@ -691,6 +739,23 @@ static bool test_file_node_failure(void) {
 }
 #endif
 
+// seeks past 4 GiB and writes a byte, leaving a sparse file whose size
+// doesn't fit in a 32-bit long
+static void test_file_offsets(void) {
+    static const char* filename = "mpack-test-large-file";
+    uint64_t offset = UINT64_C(5) << 30;
+    FILE* file = fopen(filename, "w+b");
+    TEST_TRUE(file != NULL, "failed to create %s", filename);
+    uint64_t size = 1;
+    TEST_TRUE(mpack_file_size(file, &size) == mpack_ok && size == 0);
+    TEST_TRUE(mpack_file_seek(file, offset) == mpack_ok);
+    TEST_TRUE(fwrite("x", 1, 1, file) == 1);
+    TEST_TRUE(mpack_file_size(file, &size) == mpack_ok && size == offset + 1);
+    TEST_TRUE(mpack_file_seek(file, UINT64_MAX) == mpack_error_too_big);
+    fclose(file);
+    TEST_TRUE(remove(filename) == 0, "failed to delete %s", filename);
+}
+
 void test_file(void) {
     // write a blank file for test purposes
     FILE* blank = fopen(test_blank_filename, "wb");
@@ -704,10 +769,14 @@ void test_file(void) {
     #endif
 
     test_file_write();
+    test_file_offsets();
 
     #if MPACK_READER
     test_file_discard();
     #endif
+    #if MPACK_READER && MPACK_MMAP
+    test_file_mmap();
+    #endif
     #if MPACK_EXPECT
     test_file_read();
     #endif
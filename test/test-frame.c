@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-frame.h"
+#include "test-system.h"
+
+#if MPACK_FRAME && defined(MPACK_MALLOC) && MPACK_NODE
+
+#define TEST_FRAME_COUNT 500
+#define TEST_FRAME_TEXT 300
+#define TEST_FRAME_NODES 8
+
+// a stream written by a frame writer and read back by a frame reader,
+// up to a given number of bytes per fill like a socket
+typedef struct test_frame_stream_t {
+    char data[1 << 18];
+    size_t size;
+    size_t pos;
+    size_t chunk;
+    size_t flushes;
+    size_t fills;
+    bool fail;
+} test_frame_stream_t;
+
+static test_frame_stream_t test_frame_stream;
+
+static void test_frame_stream_reset(size_t chunk) {
+    test_frame_stream.size = 0;
+    test_frame_stream.pos = 0;
+    test_frame_stream.chunk = chunk;
+    test_frame_stream.flushes = 0;
+    test_frame_stream.fills = 0;
+    test_frame_stream.fail = false;
+}
+
+static bool test_frame_flush(void* context, const char* data, size_t count) {
+    test_frame_stream_t* stream = (test_frame_stream_t*)context;
+    if (stream->fail || count > sizeof(stream->data) - stream->size)
+        return false;
+    memcpy(stream->data + stream->size, data, count);
+    stream->size += count;
+    ++stream->flushes;
+    return true;
+}
+
+static size_t test_frame_fill(void* context, char* buffer, size_t count) {
+    test_frame_stream_t* stream = (test_frame_stream_t*)context;
+    size_t left = stream->size - stream->pos;
+    if (count > left)
+        count = left;
+    if (count > stream->chunk)
+        count = stream->chunk;
+    memcpy(buffer, stream->data + stream->pos, count);
+    stream->pos += count;
+    ++stream->fills;
+    return count;
+}
+
+static size_t test_frame_fill_broken(void* context, char* buffer, size_t count) {
+    MPACK_UNUSED(context);
+    MPACK_UNUSED(buffer);
+    return count + 1;
+}
+
+// message i is a map of its id and a string whose length varies up to
+// several times the buffer size of the test config
+static void test_frame_write_message(mpack_writer_t* writer, uint32_t i) {
+    char text[TEST_FRAME_TEXT];
+    mpack_memset(text, 'a' + (int)(i % 26), sizeof(text));
+    mpack_start_map(writer, 2);
+    mpack_write_cstr(writer, "id");
+    mpack_write_u32(writer, i);
+    mpack_write_cstr(writer, "text");
+    mpack_write_str(writer, text, (i * 37) % TEST_FRAME_TEXT);
+    mpack_finish_map(writer);
+}
+
+static bool test_frame_tree_matches(mpack_tree_t* tree, uint32_t i) {
+    mpack_node_t root = mpack_tree_root(tree);
+    bool matches = mpack_node_u32(mpack_node_map_cstr(root, "id")) == i &&
+        mpack_node_strlen(mpack_node_map_cstr(root, "text")) == (i * 37) % TEST_FRAME_TEXT;
+    return mpack_tree_destroy(tree) == mpack_ok && matches;
+}
+
+static bool test_frame_data_matches(const char* data, size_t size, uint32_t i) {
+    mpack_tree_t tree;
+    mpack_tree_init(&tree, data, size);
+    return test_frame_tree_matches(&tree, i);
+}
+
+static void test_frame_write_stream(mpack_frame_mode_t mode, size_t batch) {
+    mpack_frame_writer_t writer;
+    mpack_frame_writer_init(&writer, mode, test_frame_flush, &test_frame_stream);
+    mpack_frame_writer_set_batch(&writer, batch);
+    for (uint32_t i = 0; i < TEST_FRAME_COUNT; ++i) {
+        test_frame_write_message(mpack_frame_start(&writer), i);
+        TEST_TRUE(mpack_frame_finish(&writer) == mpack_ok);
+    }
+    TEST_TRUE(mpack_frame_writer_destroy(&writer) == mpack_ok);
+}
+
+static void test_frame_read_stream(mpack_frame_mode_t mode, size_t chunk) {
+
+    // frames are read one at a time in several ways
+    test_frame_stream.pos = 0;
+    test_frame_stream.chunk = chunk;
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mode, 0, test_frame_fill, &test_frame_stream);
+    mpack_node_data_t pool[TEST_FRAME_NODES];
+    for (uint32_t i = 0; i < TEST_FRAME_COUNT; ++i) {
+        if (i % 3 == 0) {
+            size_t size;
+            const char* data = mpack_frame_next(&reader, &size);
+            TEST_TRUE(data != NULL && test_frame_data_matches(data, size, i),
+                    "frame %u does not match", (unsigned)i);
+        } else if (i % 3 == 1) {
+            mpack_tree_t tree;
+            mpack_frame_next_tree(&reader, &tree, (i % 2) ? pool : NULL, TEST_FRAME_NODES);
+            TEST_TRUE(test_frame_tree_matches(&tree, i), "frame %u does not match", (unsigned)i);
+        } else {
+            mpack_reader_t message;
+            mpack_frame_next_reader(&reader, &message);
+            TEST_TRUE(mpack_expect_map(&message) == 2);
+            mpack_expect_cstr_match(&message, "id");
+            TEST_TRUE(mpack_expect_u32(&message) == i);
+            mpack_discard(&message);
+            mpack_discard(&message);
+            mpack_done_map(&message);
+            TEST_TRUE(mpack_reader_destroy(&message) == mpack_ok);
+        }
+    }
+
+    // then the end of the stream is reported without an error
+    size_t size = 1;
+    TEST_TRUE(mpack_frame_next(&reader, &size) == NULL && size == 0);
+    mpack_tree_t tree;
+    mpack_frame_next_tree(&reader, &tree, NULL, 0);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_data);
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_ok);
+}
+
+static void test_frame_round_trip(mpack_frame_mode_t mode) {
+    test_frame_stream_reset(0);
+    test_frame_write_stream(mode, 0);
+    TEST_TRUE(test_frame_stream.flushes == TEST_FRAME_COUNT);
+
+    // each frame of a prefixed stream starts with its size
+    if (mode == mpack_frame_prefixed) {
+        size_t size = mpack_load_u32(test_frame_stream.data);
+        TEST_TRUE(test_frame_data_matches(test_frame_stream.data + MPACK_FRAME_PREFIX_SIZE, size, 0));
+    }
+
+    test_frame_read_stream(mode, 1);
+    test_frame_read_stream(mode, 7);
+    test_frame_read_stream(mode, 100);
+    test_frame_read_stream(mode, SIZE_MAX);
+
+    // batching frames produces the same stream with fewer flushes
+    size_t size = test_frame_stream.size;
+    test_frame_stream_reset(0);
+    test_frame_write_stream(mode, 4096);
+    TEST_TRUE(test_frame_stream.size == size);
+    TEST_TRUE(test_frame_stream.flushes < size / 4096 + 2);
+    test_frame_read_stream(mode, SIZE_MAX);
+}
+
+static void test_frame_batches(mpack_frame_mode_t mode) {
+    test_frame_stream_reset(SIZE_MAX);
+    test_frame_write_stream(mode, 0);
+
+    // a large buffer receives many frames per fill
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mode, 8192, test_frame_fill, &test_frame_stream);
+    mpack_frame_t frames[64];
+    uint32_t count = 0;
+    size_t calls = 0;
+    size_t found;
+    while ((found = mpack_frame_next_batch(&reader, frames, sizeof(frames) / sizeof(*frames))) > 0) {
+        for (size_t i = 0; i < found; ++i, ++count)
+            TEST_TRUE(test_frame_data_matches(frames[i].data, frames[i].size, count),
+                    "frame %u does not match", (unsigned)count);
+        ++calls;
+    }
+    TEST_TRUE(count == TEST_FRAME_COUNT);
+    TEST_TRUE(calls < TEST_FRAME_COUNT / 8);
+    TEST_TRUE(test_frame_stream.fills <= test_frame_stream.size / 4096 + 2);
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_ok);
+}
+
+static void test_frame_writer_errors(void) {
+    test_frame_stream_reset(SIZE_MAX);
+    mpack_frame_writer_t writer;
+    mpack_frame_writer_init(&writer, mpack_frame_prefixed, test_frame_flush, &test_frame_stream);
+    mpack_frame_writer_set_max_size(&writer, 100);
+
+    // frames over the maximum size are discarded, whether they are found
+    // while writing or when finishing
+    static const char bin[200] = {0};
+    mpack_write_bin(mpack_frame_start(&writer), bin, sizeof(bin));
+    TEST_TRUE(mpack_frame_finish(&writer) == mpack_error_too_big);
+    mpack_write_bin(mpack_frame_start(&writer), bin, 99);
+    TEST_TRUE(mpack_frame_finish(&writer) == mpack_error_too_big);
+
+    // as are frames with errors
+    mpack_writer_t* message = mpack_frame_start(&writer);
+    mpack_write_cstr(message, "discarded");
+    mpack_writer_flag_error(message, mpack_error_data);
+    TEST_TRUE(mpack_frame_finish(&writer) == mpack_error_data);
+
+    // the stream is unaffected
+    char data[] = {'\x92', '\x01', '\x02'};
+    TEST_TRUE(mpack_frame_append(&writer, data, sizeof(data)) == mpack_ok);
+    TEST_TRUE(test_frame_stream.size == MPACK_FRAME_PREFIX_SIZE + sizeof(data));
+    TEST_TRUE(mpack_load_u32(test_frame_stream.data) == sizeof(data));
+    TEST_TRUE(memcmp(test_frame_stream.data + MPACK_FRAME_PREFIX_SIZE, data, sizeof(data)) == 0);
+
+    // misuse
+    TEST_BREAK(mpack_frame_finish(&writer) == mpack_error_bug);
+    mpack_frame_start(&writer);
+    TEST_BREAK(mpack_frame_finish(&writer) == mpack_error_bug);
+
+    // errors sending frames are sticky
+    test_frame_stream.fail = true;
+    TEST_TRUE(mpack_frame_append(&writer, data, sizeof(data)) == mpack_error_io);
+    TEST_TRUE(mpack_frame_writer_error(&writer) == mpack_error_io);
+    TEST_TRUE(mpack_writer_error(mpack_frame_start(&writer)) == mpack_error_io);
+    TEST_TRUE(mpack_frame_finish(&writer) == mpack_error_io);
+    TEST_TRUE(mpack_frame_writer_destroy(&writer) == mpack_error_io);
+
+    // batched frames are sent on destroy, and errors are reported there
+    test_frame_stream_reset(SIZE_MAX);
+    mpack_frame_writer_init(&writer, mpack_frame_delimited, test_frame_flush, &test_frame_stream);
+    mpack_frame_writer_set_batch(&writer, 1000);
+    TEST_TRUE(mpack_frame_append(&writer, data, sizeof(data)) == mpack_ok);
+    TEST_TRUE(mpack_frame_append(&writer, data, sizeof(data)) == mpack_ok);
+    TEST_TRUE(test_frame_stream.flushes == 0);
+    test_frame_stream.fail = true;
+    TEST_TRUE(mpack_frame_writer_destroy(&writer) == mpack_error_io);
+}
+
+static mpack_error_t test_frame_read_error(mpack_frame_mode_t mode, const char* data, size_t size,
+        size_t max_size, size_t* frames)
+{
+    test_frame_stream_reset(SIZE_MAX);
+    memcpy(test_frame_stream.data, data, size);
+    test_frame_stream.size = size;
+
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mode, 16, test_frame_fill, &test_frame_stream);
+    mpack_frame_reader_set_max_size(&reader, max_size);
+    size_t frame_size;
+    *frames = 0;
+    while (mpack_frame_next(&reader, &frame_size) != NULL)
+        ++*frames;
+    return mpack_frame_reader_destroy(&reader);
+}
+
+static void test_frame_reader_errors(void) {
+    size_t frames;
+
+    // frames before an error are still returned
+    TEST_TRUE(test_frame_read_error(mpack_frame_prefixed, "\0\0\0\1\xc0\0\0\0\2\xc0", 10, 0, &frames) == mpack_error_io);
+    TEST_TRUE(frames == 1);
+    TEST_TRUE(test_frame_read_error(mpack_frame_prefixed, "\0\0\0", 3, 0, &frames) == mpack_error_io);
+    TEST_TRUE(frames == 0);
+    TEST_TRUE(test_frame_read_error(mpack_frame_delimited, "\xc0\x92\xc0", 3, 0, &frames) == mpack_error_io);
+    TEST_TRUE(frames == 1);
+    TEST_TRUE(test_frame_read_error(mpack_frame_delimited, "\xc0\xc1", 2, 0, &frames) == mpack_error_invalid);
+    TEST_TRUE(frames == 1);
+
+    // an empty frame in prefixed mode is allowed
+    TEST_TRUE(test_frame_read_error(mpack_frame_prefixed, "\0\0\0\0\0\0\0\0", 8, 0, &frames) == mpack_ok);
+    TEST_TRUE(frames == 2);
+
+    // frames over the maximum size fail as soon as their size is known
+    TEST_TRUE(test_frame_read_error(mpack_frame_prefixed, "\0\0\0\1\xc0\xff\xff\xff\xff", 9, 100, &frames) == mpack_error_too_big);
+    TEST_TRUE(frames == 1);
+    TEST_TRUE(test_frame_read_error(mpack_frame_prefixed, "\0\0\0\3\xc0\xc0\xc0", 7, 2, &frames) == mpack_error_too_big);
+    TEST_TRUE(frames == 0);
+    TEST_TRUE(test_frame_read_error(mpack_frame_delimited, "\x93\xc0\xc0\xc0", 4, 3, &frames) == mpack_error_too_big);
+    TEST_TRUE(frames == 0);
+    TEST_TRUE(test_frame_read_error(mpack_frame_delimited, "\x93\xc0\xc0\xc0", 4, 4, &frames) == mpack_ok);
+    TEST_TRUE(frames == 1);
+    char str[40] = {'\xd9', 36};
+    TEST_TRUE(test_frame_read_error(mpack_frame_delimited, str, sizeof(str), 20, &frames) == mpack_error_too_big);
+    TEST_TRUE(frames == 0);
+
+    // a frame that isn't exactly one object is invalid as a tree
+    test_frame_stream_reset(SIZE_MAX);
+    memcpy(test_frame_stream.data, "\0\0\0\2\xc0\xc0", 6);
+    test_frame_stream.size = 6;
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mpack_frame_prefixed, 0, test_frame_fill, &test_frame_stream);
+    mpack_tree_t tree;
+    mpack_frame_next_tree(&reader, &tree, NULL, 0);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_invalid);
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_ok);
+
+    // a fill function returning an error code
+    mpack_frame_reader_init(&reader, mpack_frame_prefixed, 0, test_frame_fill_broken, NULL);
+    mpack_reader_t message;
+    mpack_frame_next_reader(&reader, &message);
+    TEST_TRUE(mpack_reader_destroy(&message) == mpack_error_io);
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_error_io);
+}
+
+// a large stream in memory, read up to a given number of bytes per fill
+typedef struct test_frame_source_t {
+    const char* data;
+    size_t size;
+    size_t pos;
+    size_t chunk;
+} test_frame_source_t;
+
+static size_t test_frame_source_fill(void* context, char* buffer, size_t count) {
+    test_frame_source_t* source = (test_frame_source_t*)context;
+    size_t left = source->size - source->pos;
+    if (count > left)
+        count = left;
+    if (count > source->chunk)
+        count = source->chunk;
+    memcpy(buffer, source->data + source->pos, count);
+    source->pos += count;
+    return count;
+}
+
+// A large delimited frame received in small fills is read in linear time.
+// It can only be measured once it has been received completely, so it
+// must not be measured from its start after every fill. Measuring it
+// each time its data doubles measures at most three times its size.
+static void test_frame_large_delimited(void) {
+    const uint32_t elements = 300000;
+    size_t size = 5 + (size_t)elements * 3;
+    char* data = (char*)malloc(size + 1);
+    TEST_TRUE(data != NULL);
+    if (!data)
+        return;
+    data[0] = '\xdd';
+    mpack_store_u32(data + 1, elements);
+    for (uint32_t i = 0; i < elements; ++i)
+        memcpy(data + 5 + (size_t)i * 3, "\x91\x91\xc0", 3);
+    data[size] = '\xc0'; // a small frame after it
+
+    mpack_frame_test_measured = 0;
+
+    test_frame_source_t source = {data, size + 1, 0, 4096};
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mpack_frame_delimited, 0, test_frame_source_fill, &source);
+    size_t frame_size;
+    const char* frame = mpack_frame_next(&reader, &frame_size);
+    TEST_TRUE(frame != NULL && frame_size == size && memcmp(frame, data, size) == 0);
+    frame = mpack_frame_next(&reader, &frame_size);
+    TEST_TRUE(frame != NULL && frame_size == 1 && *frame == '\xc0');
+    TEST_TRUE(mpack_frame_next(&reader, &frame_size) == NULL);
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_ok);
+
+    TEST_TRUE(mpack_frame_test_measured <= 3 * (size + 1), "reading a frame of %i bytes measured %i bytes",
+            (int)size, (int)mpack_frame_test_measured);
+    free(data);
+}
+
+static bool test_frame_failure(void) {
+
+    // allocation can fail in the frame writer or reader. we allow
+    // mpack_error_memory as an error (since it will be simulated by the
+    // failure system.)
+
+    test_frame_stream_reset(3);
+    mpack_frame_writer_t writer;
+    mpack_frame_writer_init(&writer, mpack_frame_prefixed, test_frame_flush, &test_frame_stream);
+    for (uint32_t i = 0; i < 20; ++i) {
+        test_frame_write_message(mpack_frame_start(&writer), i * 10);
+        mpack_error_t error = mpack_frame_finish(&writer);
+        if (error != mpack_ok) {
+            mpack_frame_writer_destroy(&writer);
+            TEST_TRUE(error == mpack_error_memory);
+            return false;
+        }
+    }
+    TEST_TRUE(mpack_frame_writer_destroy(&writer) == mpack_ok);
+
+    mpack_frame_reader_t reader;
+    mpack_frame_reader_init(&reader, mpack_frame_prefixed, 0, test_frame_fill, &test_frame_stream);
+    for (uint32_t i = 0; i < 20; ++i) {
+        mpack_tree_t tree;
+        mpack_frame_next_tree(&reader, &tree, NULL, 0);
+        mpack_error_t error = mpack_tree_error(&tree);
+        if (error != mpack_ok) {
+            mpack_tree_destroy(&tree);
+            mpack_frame_reader_destroy(&reader);
+            TEST_TRUE(error == mpack_error_memory);
+            return false;
+        }
+        TEST_TRUE(test_frame_tree_matches(&tree, i * 10));
+    }
+    TEST_TRUE(mpack_frame_reader_destroy(&reader) == mpack_ok);
+    return true;
+}
+
+void test_frame(void) {
+    test_frame_round_trip(mpack_frame_prefixed);
+    test_frame_round_trip(mpack_frame_delimited);
+    test_frame_batches(mpack_frame_prefixed);
+    test_frame_batches(mpack_frame_delimited);
+    test_frame_writer_errors();
+    test_frame_reader_errors();
+    test_frame_large_delimited();
+    test_system_fail_until_ok(&test_frame_failure);
+}
+
+#endif
+
@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-journal.h"
+#include "test-system.h"
+
+#if MPACK_JOURNAL && MPACK_STDIO
+
+static const char* test_journal_filename = "mpack-test-journal";
+static const char* test_journal_index_filename = "mpack-test-journal.idx";
+
+// record i is a map with an id and a string whose length varies. some are
+// larger than the writer's buffer so that they are flushed in pieces.
+static void test_journal_write_record(mpack_writer_t* writer, uint32_t i) {
+    static const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. "
+        "Sed nec justo purus. Nunc finibus dolor id lorem sagittis, euismod efficitur arcu aliquam.";
+    mpack_start_map(writer, 2);
+    mpack_write_cstr(writer, "id");
+    mpack_write_u32(writer, i);
+    mpack_write_cstr(writer, "text");
+    mpack_write_str(writer, text, 1 + (i * 37) % (uint32_t)(sizeof(text) - 1));
+    mpack_finish_map(writer);
+}
+
+static size_t test_journal_encode_record(char* buffer, size_t size, uint32_t i) {
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, size);
+    test_journal_write_record(&writer, i);
+    size_t used = mpack_writer_buffer_used(&writer);
+    TEST_TRUE(mpack_writer_destroy(&writer) == mpack_ok);
+    return used;
+}
+
+static void test_journal_remove(void) {
+    remove(test_journal_filename);
+    remove(test_journal_index_filename);
+}
+
+// appends records [first, last), alternating between the record writer
+// and pre-encoded data
+static void test_journal_append(uint32_t interval, uint32_t first, uint32_t last) {
+    mpack_journal_writer_t journal;
+    mpack_journal_writer_init(&journal, test_journal_filename, interval);
+    TEST_TRUE(mpack_journal_writer_error(&journal) == mpack_ok);
+    TEST_TRUE(mpack_journal_writer_count(&journal) == first);
+
+    for (uint32_t i = first; i < last; ++i) {
+        if (i % 2 == 0) {
+            test_journal_write_record(mpack_journal_start(&journal), i);
+            mpack_journal_finish(&journal);
+        } else {
+            char buffer[256];
+            size_t size = test_journal_encode_record(buffer, sizeof(buffer), i);
+            mpack_journal_append(&journal, buffer, size);
+        }
+        if (i % 7 == 0)
+            mpack_journal_flush(&journal);
+    }
+
+    TEST_TRUE(mpack_journal_writer_count(&journal) == last);
+    TEST_TRUE(mpack_journal_writer_destroy(&journal) == mpack_ok);
+}
+
+#if MPACK_MMAP
+static void test_journal_check_record(const char* data, size_t size, uint32_t i) {
+    char buffer[256];
+    size_t expected = test_journal_encode_record(buffer, sizeof(buffer), i);
+    TEST_TRUE(data != NULL && size == expected && memcmp(data, buffer, size) == 0,
+            "record %u does not match", (unsigned)i);
+}
+
+// reads all records sequentially, then each record after seeking to it
+static void test_journal_check(uint32_t count, bool verify) {
+    mpack_journal_t journal;
+    mpack_journal_init(&journal, test_journal_filename, verify);
+    TEST_TRUE(mpack_journal_error(&journal) == mpack_ok);
+    TEST_TRUE(mpack_journal_count(&journal) == count);
+
+    size_t size;
+    for (uint32_t i = 0; i < count; ++i) {
+        const char* data = mpack_journal_next(&journal, &size);
+        test_journal_check_record(data, size, i);
+    }
+    TEST_TRUE(mpack_journal_next(&journal, &size) == NULL);
+    TEST_TRUE(size == 0);
+
+    for (uint32_t i = count; i > 0; --i) {
+        mpack_journal_seek(&journal, i - 1);
+        const char* data = mpack_journal_next(&journal, &size);
+        test_journal_check_record(data, size, i - 1);
+    }
+
+    mpack_journal_seek(&journal, count);
+    TEST_TRUE(mpack_journal_next(&journal, &size) == NULL);
+    TEST_TRUE(mpack_journal_error(&journal) == mpack_ok);
+
+    mpack_journal_seek(&journal, count + 1);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_error_data);
+}
+
+#if MPACK_NODE
+static void test_journal_trees(uint32_t first, uint32_t count) {
+    mpack_journal_t journal;
+    mpack_journal_init(&journal, test_journal_filename, true);
+    mpack_journal_seek(&journal, first);
+
+    for (uint32_t i = first; i < count; ++i) {
+        mpack_tree_t tree;
+        mpack_journal_next_tree(&journal, &tree);
+        mpack_node_t root = mpack_tree_root(&tree);
+        TEST_TRUE(mpack_node_u32(mpack_node_map_cstr(root, "id")) == i);
+        TEST_TRUE(mpack_tree_destroy(&tree) == mpack_ok);
+    }
+
+    // past the end, the tree is flagged but not the journal
+    mpack_tree_t tree;
+    mpack_journal_next_tree(&journal, &tree);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_data);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_ok);
+}
+#endif
+
+// overwrites a byte of the given file
+static void test_journal_corrupt(const char* filename, long offset, char c) {
+    FILE* file = fopen(filename, "r+b");
+    TEST_TRUE(file != NULL);
+    if (file == NULL)
+        return;
+    fseek(file, offset, SEEK_SET);
+    fwrite(&c, 1, 1, file);
+    fclose(file);
+}
+#endif
+
+static void test_journal_basic(void) {
+    test_journal_remove();
+
+    // a journal can be empty
+    test_journal_append(4, 0, 0);
+    #if MPACK_MMAP
+    test_journal_check(0, true);
+    #endif
+
+    // the journal is extended in partial blocks, continuing each block
+    // and its checksum
+    test_journal_append(4, 0, 10);
+    test_journal_append(100, 10, 11);
+    test_journal_append(4, 11, 20);
+
+    #if MPACK_MMAP
+    test_journal_check(20, true);
+    test_journal_check(20, false);
+    #if MPACK_NODE
+    test_journal_trees(0, 20);
+    test_journal_trees(13, 20);
+    #endif
+    #endif
+
+    test_journal_remove();
+}
+
+static void test_journal_pending(void) {
+    test_journal_remove();
+
+    // more blocks than fit in the pending entries, with no explicit
+    // flushes between records
+    uint32_t count = MPACK_JOURNAL_PENDING_ENTRIES * 3 + 5;
+    mpack_journal_writer_t journal;
+    mpack_journal_writer_init(&journal, test_journal_filename, 1);
+    for (uint32_t i = 0; i < count; ++i) {
+        char buffer[256];
+        size_t size = test_journal_encode_record(buffer, sizeof(buffer), i);
+        mpack_journal_append(&journal, buffer, size);
+    }
+    TEST_TRUE(mpack_journal_writer_destroy(&journal) == mpack_ok);
+
+    #if MPACK_MMAP
+    test_journal_check(count, true);
+    #endif
+    test_journal_remove();
+}
+
+static void test_journal_unindexed(void) {
+    test_journal_remove();
+    test_journal_append(3, 0, 8);
+
+    // data past the indexed records (for example from an interrupted
+    // append) is ignored, and overwritten by the next append
+    FILE* file = fopen(test_journal_filename, "ab");
+    TEST_TRUE(file != NULL);
+    if (file) {
+        fwrite("\x92\x01", 1, 2, file);
+        fclose(file);
+    }
+    #if MPACK_MMAP
+    test_journal_check(8, true);
+    #endif
+
+    test_journal_append(3, 8, 12);
+    #if MPACK_MMAP
+    test_journal_check(12, true);
+    #endif
+    test_journal_remove();
+}
+
+static void test_journal_errors(void) {
+    test_journal_remove();
+    mpack_journal_writer_t writer;
+
+    // a log without an index is not truncated
+    FILE* file = fopen(test_journal_filename, "wb");
+    TEST_TRUE(file != NULL);
+    if (file) {
+        fwrite("\xc0", 1, 1, file);
+        fclose(file);
+    }
+    mpack_journal_writer_init(&writer, test_journal_filename, 4);
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_invalid);
+    test_journal_remove();
+
+    // the interval cannot be zero
+    TEST_BREAK((mpack_journal_writer_init(&writer, test_journal_filename, 0), true));
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_bug);
+
+    // a record must contain an object
+    mpack_journal_writer_init(&writer, test_journal_filename, 4);
+    mpack_journal_start(&writer);
+    TEST_BREAK((mpack_journal_finish(&writer), true));
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_bug);
+    test_journal_remove();
+
+    #if MPACK_WRITE_TRACKING
+    // a record must be complete
+    mpack_journal_writer_init(&writer, test_journal_filename, 4);
+    mpack_start_array(mpack_journal_start(&writer), 1);
+    TEST_BREAK((mpack_journal_finish(&writer), true));
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_bug);
+    test_journal_remove();
+    #endif
+
+    // errors flagged on the record writer are flagged on the journal, and
+    // the records before them are kept
+    mpack_journal_writer_init(&writer, test_journal_filename, 4);
+    mpack_journal_append(&writer, "\xc0", 1);
+    mpack_writer_flag_error(mpack_journal_start(&writer), mpack_error_too_big);
+    mpack_journal_finish(&writer);
+    TEST_TRUE(mpack_journal_writer_error(&writer) == mpack_error_too_big);
+    mpack_journal_append(&writer, "\xc0", 1);
+    TEST_TRUE(mpack_journal_writer_count(&writer) == 1);
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_too_big);
+
+    #if MPACK_MMAP
+    mpack_journal_t journal;
+    mpack_journal_init(&journal, test_journal_filename, true);
+    TEST_TRUE(mpack_journal_count(&journal) == 0);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_ok);
+    #endif
+    test_journal_remove();
+
+    #if MPACK_MMAP
+    // missing files
+    mpack_journal_init(&journal, test_journal_filename, true);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_error_io);
+
+    // a corrupt block fails its checksum only if it is verified
+    test_journal_append(4, 0, 10);
+    test_journal_corrupt(test_journal_filename, 100, 'X');
+
+    size_t size;
+    mpack_journal_init(&journal, test_journal_filename, false);
+    mpack_journal_seek(&journal, 9);
+    TEST_TRUE(mpack_journal_next(&journal, &size) != NULL);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_ok);
+
+    mpack_journal_init(&journal, test_journal_filename, true);
+    mpack_journal_seek(&journal, 9);
+    TEST_TRUE(mpack_journal_next(&journal, &size) != NULL);
+    while (mpack_journal_next(&journal, &size) != NULL)
+        ;
+    mpack_journal_seek(&journal, 0);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_error_invalid);
+
+    test_journal_remove();
+
+    // a corrupt entry is found when it is used
+    test_journal_append(2, 0, 10);
+    test_journal_corrupt(test_journal_index_filename, MPACK_JOURNAL_HEADER_SIZE + MPACK_JOURNAL_ENTRY_SIZE + 15, 1);
+    mpack_journal_init(&journal, test_journal_filename, false);
+    TEST_TRUE(mpack_journal_count(&journal) == 10);
+    mpack_journal_seek(&journal, 7);
+    mpack_journal_seek(&journal, 1);
+    TEST_TRUE(mpack_journal_error(&journal) == mpack_ok);
+    mpack_journal_seek(&journal, 2);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_error_invalid);
+
+    // a corrupt header is found when the journal is opened
+    test_journal_corrupt(test_journal_index_filename, 3, 'X');
+    mpack_journal_init(&journal, test_journal_filename, false);
+    TEST_TRUE(mpack_journal_destroy(&journal) == mpack_error_invalid);
+    mpack_journal_writer_init(&writer, test_journal_filename, 4);
+    TEST_TRUE(mpack_journal_writer_destroy(&writer) == mpack_error_invalid);
+    test_journal_remove();
+    #endif
+}
+
+static bool test_journal_failure(void) {
+    test_journal_remove();
+
+    mpack_journal_writer_t writer;
+    mpack_journal_writer_init(&writer, test_journal_filename, 2);
+    for (uint32_t i = 0; i < 5; ++i) {
+        test_journal_write_record(mpack_journal_start(&writer), i);
+        mpack_journal_finish(&writer);
+    }
+    mpack_journal_flush(&writer);
+
+    mpack_error_t error = mpack_journal_writer_destroy(&writer);
+    if (error == mpack_error_io || error == mpack_error_memory)
+        return false;
+    TEST_TRUE(error == mpack_ok, "unexpected error state %i (%s)", (int)error,
+            mpack_error_to_string(error));
+
+    #if MPACK_MMAP
+    mpack_journal_t journal;
+    mpack_journal_init(&journal, test_journal_filename, true);
+    TEST_TRUE(mpack_journal_count(&journal) == 5 || mpack_journal_error(&journal) == mpack_error_memory);
+    size_t size;
+    for (uint32_t i = 0; i < 5; ++i)
+        mpack_journal_next(&journal, &size);
+    error = mpack_journal_destroy(&journal);
+    if (error == mpack_error_memory)
+        return false;
+    TEST_TRUE(error == mpack_ok, "unexpected error state %i (%s)", (int)error,
+            mpack_error_to_string(error));
+    #endif
+
+    return true;
+}
+
+static const char* test_array_filename = "mpack-test-array";
+static const char* test_array_index_filename = "mpack-test-array.idx";
+
+static void test_array_remove(void) {
+    remove(test_array_filename);
+    remove(test_array_index_filename);
+}
+
+// writes an array of count records
+static void test_array_write(uint32_t count) {
+    mpack_writer_t writer;
+    mpack_writer_init_file(&writer, test_array_filename);
+    mpack_start_array(&writer, count);
+    for (uint32_t i = 0; i < count; ++i)
+        test_journal_write_record(&writer, i);
+    mpack_finish_array(&writer);
+    TEST_TRUE(mpack_writer_destroy(&writer) == mpack_ok);
+}
+
+static void test_array_write_raw(const char* data, size_t size) {
+    FILE* file = fopen(test_array_filename, "wb");
+    TEST_TRUE(file != NULL);
+    if (file) {
+        fwrite(data, 1, size, file);
+        fclose(file);
+    }
+}
+
+#if MPACK_MMAP
+static void test_array_check(uint32_t count) {
+    mpack_array_index_t index;
+    mpack_array_index_init(&index, test_array_filename);
+    TEST_TRUE(mpack_array_index_error(&index) == mpack_ok);
+    TEST_TRUE(mpack_array_index_count(&index) == count);
+
+    // in reverse so that each lookup is independent of the last
+    size_t size;
+    for (uint32_t i = count; i > 0; --i) {
+        const char* data = mpack_array_index_element(&index, i - 1, &size);
+        test_journal_check_record(data, size, i - 1);
+    }
+
+    #if MPACK_NODE
+    for (uint32_t i = 0; i < count; i += 3) {
+        mpack_tree_t tree;
+        mpack_tree_init_element(&tree, &index, i);
+        TEST_TRUE(mpack_node_u32(mpack_node_map_cstr(mpack_tree_root(&tree), "id")) == i);
+        TEST_TRUE(mpack_tree_destroy(&tree) == mpack_ok);
+    }
+    #endif
+
+    TEST_TRUE(mpack_array_index_element(&index, count, &size) == NULL);
+    TEST_TRUE(size == 0);
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_data);
+}
+#endif
+
+static void test_array_index(void) {
+    test_array_remove();
+
+    test_array_write(0);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1) == mpack_ok);
+    #if MPACK_MMAP
+    test_array_check(0);
+    #endif
+
+    test_array_write(100);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1) == mpack_ok);
+    #if MPACK_MMAP
+    test_array_check(100);
+    #endif
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 7) == mpack_ok);
+    #if MPACK_MMAP
+    test_array_check(100);
+    #endif
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1000) == mpack_ok);
+    #if MPACK_MMAP
+    test_array_check(100);
+
+    // an index of a file that has been replaced is stale
+    test_array_write(99);
+    mpack_array_index_t index;
+    mpack_array_index_init(&index, test_array_filename);
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_invalid);
+
+    // a journal index is not an array index
+    test_journal_remove();
+    test_journal_append(4, 0, 10);
+    mpack_array_index_init(&index, test_journal_filename);
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_invalid);
+    test_journal_remove();
+
+    // a corrupt entry is found when it is used
+    test_array_write(10);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 2) == mpack_ok);
+    test_journal_corrupt(test_array_index_filename, MPACK_ARRAY_INDEX_HEADER_SIZE + MPACK_ARRAY_INDEX_ENTRY_SIZE * 3 + 2, 1);
+    size_t size;
+    mpack_array_index_init(&index, test_array_filename);
+    TEST_TRUE(mpack_array_index_element(&index, 9, &size) != NULL);
+    TEST_TRUE(mpack_array_index_element(&index, 1, &size) != NULL);
+    TEST_TRUE(mpack_array_index_element(&index, 4, &size) == NULL);
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_invalid);
+
+    // missing files
+    mpack_array_index_init(&index, "invalid-filename");
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_io);
+    remove(test_array_index_filename);
+    mpack_array_index_init(&index, test_array_filename);
+    TEST_TRUE(mpack_array_index_destroy(&index) == mpack_error_io);
+    #endif
+
+    // the file must be a single array
+    test_array_write_raw("\x81\xa1" "a" "\x01", 4);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1) == mpack_error_type);
+    test_array_write_raw("\x92\x01\x02\x03", 4);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1) == mpack_error_invalid);
+    test_array_write_raw("\x93\x01\x02", 3);
+    TEST_TRUE(mpack_array_index_build(test_array_filename, 1) == mpack_error_io);
+    TEST_TRUE(remove(test_array_index_filename) != 0, "an incomplete index was left behind");
+    TEST_TRUE(mpack_array_index_build("invalid-filename", 1) == mpack_error_io);
+    TEST_BREAK(mpack_array_index_build(test_array_filename, 0) == mpack_error_bug);
+
+    test_array_remove();
+}
+
+static bool test_array_index_failure(void) {
+    mpack_error_t error = mpack_array_index_build(test_array_filename, 2);
+    if (error == mpack_error_io || error == mpack_error_memory)
+        return false;
+    TEST_TRUE(error == mpack_ok, "unexpected error state %i (%s)", (int)error,
+            mpack_error_to_string(error));
+
+    #if MPACK_MMAP
+    size_t size;
+    mpack_array_index_t index;
+    mpack_array_index_init(&index, test_array_filename);
+    TEST_TRUE(mpack_array_index_count(&index) == 5 || mpack_array_index_error(&index) == mpack_error_memory);
+    mpack_array_index_element(&index, 3, &size);
+    error = mpack_array_index_destroy(&index);
+    if (error == mpack_error_memory)
+        return false;
+    TEST_TRUE(error == mpack_ok, "unexpected error state %i (%s)", (int)error,
+            mpack_error_to_string(error));
+    #endif
+
+    return true;
+}
+
+void test_journal(void) {
+    test_journal_basic();
+    test_journal_pending();
+    test_journal_unindexed();
+    test_journal_errors();
+    test_array_index();
+
+    test_system_fail_until_ok(&test_journal_failure);
+    test_journal_remove();
+
+    test_array_write(5);
+    test_system_fail_until_ok(&test_array_index_failure);
+    test_array_remove();
+}
+
+#endif
+
@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-json.h"
+#include "test-reader.h"
+#include "test-write.h"
+
+#if MPACK_JSON
+
+// converts the given MessagePack to JSON in a fixed buffer and compares it
+static void test_json_match_impl(const char* data, size_t length,
+        const mpack_json_options_t* options, const char* expected, int line)
+{
+    char buffer[4096];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    mpack_error_t error = mpack_to_json_data(data, length, &writer, options);
+    size_t used = mpack_writer_buffer_used(&writer);
+    TEST_TRUE(mpack_writer_destroy(&writer) == mpack_ok, "writer error at line %i", line);
+    TEST_TRUE(error == mpack_ok, "conversion error %s at line %i", mpack_error_to_string(error), line);
+    TEST_TRUE(used == strlen(expected) && memcmp(buffer, expected, used) == 0,
+            "JSON at line %i does not match: expected %s, got %.*s", line, expected, (int)used, buffer);
+}
+
+static mpack_error_t test_json_error(const char* data, size_t length, const mpack_json_options_t* options) {
+    char buffer[4096];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    mpack_error_t error = mpack_to_json_data(data, length, &writer, options);
+    mpack_writer_destroy(&writer);
+    return error;
+}
+
+#define TEST_JSON(data, expected) \
+    test_json_match_impl(data, sizeof(data) - 1, NULL, expected, __LINE__)
+#define TEST_JSON_OPTIONS(data, options, expected) \
+    test_json_match_impl(data, sizeof(data) - 1, options, expected, __LINE__)
+#define TEST_JSON_ERROR(data, options, error) \
+    TEST_TRUE(test_json_error(data, sizeof(data) - 1, options) == error)
+
+static void test_json_scalars(void) {
+    TEST_JSON("\xc0", "null");
+    TEST_JSON("\xc3", "true");
+    TEST_JSON("\xc2", "false");
+
+    TEST_JSON("\x00", "0");
+    TEST_JSON("\x7f", "127");
+    TEST_JSON("\xe0", "-32");
+    TEST_JSON("\xcc\xff", "255");
+    TEST_JSON("\xcd\x30\x39", "12345");
+    TEST_JSON("\xd2\xff\xff\xcf\xc7", "-12345");
+    TEST_JSON("\xce\x00\x01\x00\x00", "65536");
+    TEST_JSON("\xcf\xff\xff\xff\xff\xff\xff\xff\xff", "18446744073709551615");
+    TEST_JSON("\xd3\x80\x00\x00\x00\x00\x00\x00\x00", "-9223372036854775808");
+
+    // reals are written with the shortest digits that round-trip
+    TEST_JSON("\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00", "1.5");
+    TEST_JSON("\xcb\x3f\xf0\x00\x00\x00\x00\x00\x00", "1.0");
+    TEST_JSON("\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a", "0.1");
+    TEST_JSON("\xcb\x41\x9d\x6f\x34\x54\x80\x00\x00", "123456789.125");
+    TEST_JSON("\xcb\x7e\x37\xe4\x3c\x88\x00\x75\x9c", "1e300");
+    TEST_JSON("\xcb\x80\x00\x00\x00\x00\x00\x00\x00", "-0.0");
+    TEST_JSON("\xca\x3d\xcc\xcc\xcd", "0.1");
+    TEST_JSON("\xca\x7f\x7f\xff\xff", "3.4028235e38");
+    TEST_JSON("\xcb\x3e\x7a\xd7\xf2\x9a\xbc\xaf\x48", "1e-7");
+    TEST_JSON("\xcb\x3e\xb0\xc6\xf7\xa0\xb5\xed\x8d", "0.000001");
+    TEST_JSON("\xcb\x44\x4b\x1a\xe4\xd6\xe2\xef\x50", "1e21");
+    TEST_JSON("\xcb\x00\x00\x00\x00\x00\x00\x00\x01", "5e-324");
+    TEST_JSON("\xcb\x7f\xef\xff\xff\xff\xff\xff\xff", "1.7976931348623157e308");
+
+    // JSON has no infinities or NaN
+    TEST_JSON("\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", "null");
+    TEST_JSON("\xcb\x7f\xf0\x00\x00\x00\x00\x00\x00", "null");
+    TEST_JSON("\xca\xff\x80\x00\x00", "null");
+}
+
+static void test_json_strings(void) {
+    TEST_JSON("\xa0", "\"\"");
+    TEST_JSON("\xa5hello", "\"hello\"");
+    TEST_JSON("\xa9\x22\x5c\x08\x0c\x0a\x0d\x09\x01\x1f", "\"\\\"\\\\\\b\\f\\n\\r\\t\\u0001\\u001f\"");
+
+    // escapes at every position of a multi-word string
+    TEST_JSON("\xb2" "abcdefg\"ijklmnopqr", "\"abcdefg\\\"ijklmnopqr\"");
+    TEST_JSON("\xb2" "abcdefgh\"jklmnopqr", "\"abcdefgh\\\"jklmnopqr\"");
+    TEST_JSON("\xb2" "abcdefghijklmnopq\\", "\"abcdefghijklmnopq\\\\\"");
+    TEST_JSON("\xb2" "\nbcdefghijklmnopqr", "\"\\nbcdefghijklmnopqr\"");
+
+    // bytes that are safe next to unsafe bytes, and multi-byte UTF-8
+    // characters, are copied unchanged
+    TEST_JSON("\xb0" "\x7f\x21\x23\x5b\x5d\x20\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\x7e", "\"\x7f!#[] \xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80~\"");
+}
+
+static void test_json_bytes(void) {
+    TEST_JSON("\xc4\x00", "\"\"");
+    TEST_JSON("\xc4\x01" "f", "\"Zg==\"");
+    TEST_JSON("\xc4\x02" "fo", "\"Zm8=\"");
+    TEST_JSON("\xc4\x03" "foo", "\"Zm9v\"");
+    TEST_JSON("\xc4\x04" "foob", "\"Zm9vYg==\"");
+    TEST_JSON("\xc4\x06" "foobar", "\"Zm9vYmFy\"");
+    TEST_JSON("\xc4\x03\xfb\xff\x00", "\"+/8A\"");
+    TEST_JSON("\xd4\xfb\x01", "{\"ext\":-5,\"data\":\"AQ==\"}");
+    TEST_JSON("\xc7\x00\x7f", "{\"ext\":127,\"data\":\"\"}");
+
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.bytes = mpack_json_bytes_hex;
+    TEST_JSON_OPTIONS("\xc4\x04\x01\xab\x00\xff", &options, "\"01ab00ff\"");
+    TEST_JSON_OPTIONS("\xd5\x02\xfe\xdc", &options, "{\"ext\":2,\"data\":\"fedc\"}");
+}
+
+static void test_json_containers(void) {
+    TEST_JSON("\x90", "[]");
+    TEST_JSON("\x80", "{}");
+    TEST_JSON("\x93\x01\x92\x02\x80\x90", "[1,[2,{}],[]]");
+    TEST_JSON("\x82\xa1" "a\x01\xa1" "b\x92\xc3\xc0", "{\"a\":1,\"b\":[true,null]}");
+    TEST_JSON("\x81\xa0\x81\xa0\x81\xa0\x90", "{\"\":{\"\":{\"\":[]}}}");
+
+    // data after the object is ignored
+    TEST_JSON("\x91\x01\x02", "[1]");
+
+    // newlines separate objects for JSON lines
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.newline = true;
+    TEST_JSON_OPTIONS("\x92\x01\x02", &options, "[1,2]\n");
+
+    // deep nesting grows the stack, which is limited without malloc
+    char data[150];
+    memset(data, '\x91', sizeof(data) - 1);
+    data[149] = '\x90';
+    #ifdef MPACK_MALLOC
+    char expected[301];
+    memset(expected, '[', 150);
+    memset(expected + 150, ']', 150);
+    expected[300] = '\0';
+    test_json_match_impl(data, sizeof(data), NULL, expected, __LINE__);
+    #else
+    TEST_TRUE(test_json_error(data, sizeof(data), NULL) == mpack_error_too_big);
+    #endif
+}
+
+static void test_json_keys(void) {
+    TEST_JSON("\x84\x01\x02\xc0\xc3\xc3\xc2\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00\x00",
+            "{\"1\":2,\"null\":true,\"true\":false,\"1.5\":0}");
+    TEST_JSON("\x82\xd0\x85\x00\xc4\x01" "a\x00", "{\"-123\":0,\"YQ==\":0}");
+
+    // containers and ext can't be converted to strings
+    TEST_JSON_ERROR("\x81\x90\x00", NULL, mpack_error_type);
+    TEST_JSON_ERROR("\x81\x80\x00", NULL, mpack_error_type);
+    TEST_JSON_ERROR("\x81\xd4\x01\x00\x00", NULL, mpack_error_type);
+
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.keys = mpack_json_keys_error;
+    TEST_JSON_OPTIONS("\x81\xa1" "a\x01", &options, "{\"a\":1}");
+    TEST_JSON_ERROR("\x81\x01\x02", &options, mpack_error_type);
+    TEST_JSON_ERROR("\x82\xa1" "a\x01\xc0\x02", &options, mpack_error_type);
+}
+
+static void test_json_errors(void) {
+    TEST_JSON_ERROR("", NULL, mpack_error_invalid);
+    TEST_JSON_ERROR("\x92\x01", NULL, mpack_error_invalid);
+    TEST_JSON_ERROR("\xa5" "abc", NULL, mpack_error_invalid);
+    TEST_JSON_ERROR("\xc1", NULL, mpack_error_invalid);
+
+    // a write error stops the conversion and is flagged on the reader
+    char buffer[8];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    static const char data[] = "\x92\xa9" "abcdefghi\x01";
+    TEST_TRUE(mpack_to_json_data(data, sizeof(data) - 1, &writer, NULL) == mpack_error_too_big);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_too_big);
+}
+
+// converts the given JSON to MessagePack in a fixed buffer and compares it
+static void test_from_json_match_impl(const char* json, size_t json_length,
+        const mpack_json_options_t* options, const char* expected, size_t expected_length, int line)
+{
+    char buffer[4096];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    mpack_error_t error = mpack_from_json(json, json_length, &writer, options);
+    size_t used = mpack_writer_buffer_used(&writer);
+    TEST_TRUE(mpack_writer_destroy(&writer) == mpack_ok, "writer error at line %i", line);
+    TEST_TRUE(error == mpack_ok, "conversion error %s at line %i", mpack_error_to_string(error), line);
+    TEST_TRUE(used == expected_length && memcmp(buffer, expected, used) == 0,
+            "MessagePack at line %i does not match", line);
+}
+
+static mpack_error_t test_from_json_error(const char* json, size_t length, const mpack_json_options_t* options) {
+    char buffer[4096];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    mpack_error_t error = mpack_from_json(json, length, &writer, options);
+    TEST_TRUE(mpack_writer_destroy(&writer) == error);
+    return error;
+}
+
+#define TEST_FROM_JSON(json, expected) \
+    test_from_json_match_impl(json, sizeof(json) - 1, NULL, expected, sizeof(expected) - 1, __LINE__)
+#define TEST_FROM_JSON_OPTIONS(json, options, expected) \
+    test_from_json_match_impl(json, sizeof(json) - 1, options, expected, sizeof(expected) - 1, __LINE__)
+#define TEST_FROM_JSON_ERROR(json, options, error) \
+    TEST_TRUE(test_from_json_error(json, sizeof(json) - 1, options) == error)
+
+static void test_from_json_scalars(void) {
+    TEST_FROM_JSON("null", "\xc0");
+    TEST_FROM_JSON("true", "\xc3");
+    TEST_FROM_JSON("false", "\xc2");
+
+    // integers are written in their smallest encoding
+    TEST_FROM_JSON("0", "\x00");
+    TEST_FROM_JSON("-0", "\x00");
+    TEST_FROM_JSON("127", "\x7f");
+    TEST_FROM_JSON("128", "\xcc\x80");
+    TEST_FROM_JSON("-1", "\xff");
+    TEST_FROM_JSON("-33", "\xd0\xdf");
+    TEST_FROM_JSON("65536", "\xce\x00\x01\x00\x00");
+    TEST_FROM_JSON("18446744073709551615", "\xcf\xff\xff\xff\xff\xff\xff\xff\xff");
+    TEST_FROM_JSON("-9223372036854775808", "\xd3\x80\x00\x00\x00\x00\x00\x00\x00");
+
+    // reals are floats when that's exact, and doubles otherwise
+    TEST_FROM_JSON("1.5", "\xca\x3f\xc0\x00\x00");
+    TEST_FROM_JSON("1E+2", "\xca\x42\xc8\x00\x00");
+    TEST_FROM_JSON("-0.0", "\xca\x80\x00\x00\x00");
+    TEST_FROM_JSON("0.1", "\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a");
+    TEST_FROM_JSON("1e300", "\xcb\x7e\x37\xe4\x3c\x88\x00\x75\x9c");
+    TEST_FROM_JSON("18446744073709551616", "\xca\x5f\x80\x00\x00");
+    TEST_FROM_JSON("-9223372036854775809", "\xca\xdf\x00\x00\x00");
+    TEST_FROM_JSON("2.2250738585072011e-308", "\xcb\x00\x0f\xff\xff\xff\xff\xff\xff");
+    TEST_FROM_JSON("1e400", "\xcb\x7f\xf0\x00\x00\x00\x00\x00\x00");
+    TEST_FROM_JSON("1e-400", "\xca\x00\x00\x00\x00");
+
+    // halfway between 1 and the next double, so it rounds to even unless
+    // any later digit is non-zero
+    TEST_FROM_JSON("1.00000000000000011102230246251565404236316680908203125",
+            "\xca\x3f\x80\x00\x00");
+    TEST_FROM_JSON("1.000000000000000111022302462515654042363166809082031250001",
+            "\xcb\x3f\xf0\x00\x00\x00\x00\x00\x01");
+
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.floats = false;
+    TEST_FROM_JSON_OPTIONS("1.5", &options, "\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00");
+    TEST_FROM_JSON_OPTIONS("1", &options, "\x01");
+}
+
+static void test_from_json_strings(void) {
+    TEST_FROM_JSON("\"\"", "\xa0");
+    TEST_FROM_JSON("\"abc\"", "\xa3" "abc");
+    TEST_FROM_JSON("\"0123456789012345678901234567890123456789\"",
+            "\xd9\x28" "0123456789012345678901234567890123456789");
+    TEST_FROM_JSON("\"a\\nb\\\"\\\\\\/\\b\\f\\r\\t\"", "\xaa" "a\nb\"\\/\b\f\r\t");
+    TEST_FROM_JSON("\"\\u0000\\u00e9\\u20AC\"", "\xa6" "\x00\xc3\xa9\xe2\x82\xac");
+    TEST_FROM_JSON("\"\\ud83d\\ude00\"", "\xa4" "\xf0\x9f\x98\x80");
+    TEST_FROM_JSON("\"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\"", "\xa9" "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+
+    // unterminated strings, control characters and bad escapes
+    TEST_FROM_JSON_ERROR("\"abc", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"a\\\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\x01\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\\x\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\\u12\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\\u12g4\"", NULL, mpack_error_invalid);
+
+    // unpaired surrogates and invalid UTF-8
+    TEST_FROM_JSON_ERROR("\"\\ud83d\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\\ud83d\\u0041\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\\ude00\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\xff\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\xc0\x80\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\xe2\x82\"", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("\"\xed\xa0\x80\"", NULL, mpack_error_invalid);
+}
+
+static void test_from_json_containers(void) {
+    TEST_FROM_JSON("[]", "\x90");
+    TEST_FROM_JSON("{}", "\x80");
+    TEST_FROM_JSON("[1,[2,3],{},[]]", "\x94\x01\x92\x02\x03\x80\x90");
+    TEST_FROM_JSON("{\"a\":1,\"b\":[true],\"a\":{}}", "\x83\xa1" "a\x01\xa1" "b\x91\xc3\xa1" "a\x80");
+    TEST_FROM_JSON(" \r\n\t[ 1 ,\n\"[,]\" , { \"}\" : [ ] } ] \n", "\x93\x01\xa3" "[,]\x81\xa1" "}\x90");
+
+    // more containers than are counted in one scan ahead
+    char json[2048];
+    char expected[1024];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, expected, sizeof(expected));
+    mpack_start_array(&writer, 200);
+    size_t length = 0;
+    json[length++] = '[';
+    for (int i = 0; i < 200; ++i) {
+        if (i > 0)
+            json[length++] = ',';
+        if (i % 3 == 0) {
+            memcpy(json + length, "{\"a\":[1]}", 9);
+            length += 9;
+            mpack_start_map(&writer, 1);
+            mpack_write_cstr(&writer, "a");
+            mpack_start_array(&writer, 1);
+            mpack_write_int(&writer, 1);
+            mpack_finish_array(&writer);
+            mpack_finish_map(&writer);
+        } else {
+            json[length++] = '[';
+            json[length++] = ']';
+            mpack_start_array(&writer, 0);
+            mpack_finish_array(&writer);
+        }
+    }
+    json[length++] = ']';
+    mpack_finish_array(&writer);
+    size_t expected_length = mpack_writer_buffer_used(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    test_from_json_match_impl(json, length, NULL, expected, expected_length, __LINE__);
+
+    // deep nesting grows the stack, which is limited without malloc
+    memset(json, '[', 150);
+    memset(json + 150, ']', 150);
+    #ifdef MPACK_MALLOC
+    memset(expected, '\x91', 149);
+    expected[149] = '\x90';
+    test_from_json_match_impl(json, 300, NULL, expected, 150, __LINE__);
+    #else
+    TEST_TRUE(test_from_json_error(json, 300, NULL) == mpack_error_too_big);
+    #endif
+}
+
+// Converts JSON nested to the given depth, with the given number of empty
+// arrays before the child at each level, checking that the scan that
+// counts elements examines each byte at most once. The element counts of
+// the containers are only known at the end of the data, so the scan must
+// not start over at each level.
+static void test_from_json_deep_impl(size_t depth, size_t siblings) {
+    size_t level_length = 1 + siblings * 3;
+    size_t length = depth * (level_length + 1) + 2;
+    char* json = (char*)malloc(length);
+    TEST_TRUE(json != NULL);
+    if (!json)
+        return;
+    char* p = json;
+    for (size_t i = 0; i < depth; ++i) {
+        *p++ = '[';
+        for (size_t j = 0; j < siblings; ++j) {
+            memcpy(p, "[],", 3);
+            p += 3;
+        }
+    }
+    memcpy(p, "[]", 2);
+    p += 2;
+    memset(p, ']', depth);
+
+    mpack_json_test_scanned = 0;
+
+    // without malloc, or with inline write tracking, the depth is limited
+    #if defined(MPACK_MALLOC) && !(MPACK_WRITE_TRACKING && MPACK_TRACKING_INLINE_DEPTH)
+    char* output;
+    size_t size;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &output, &size);
+    TEST_TRUE(mpack_from_json(json, length, &writer, NULL) == mpack_ok);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    TEST_TRUE(size == depth * (siblings + 1) + 1);
+    bool match = size == depth * (siblings + 1) + 1;
+    for (size_t i = 0; match && i < size; ++i) {
+        uint8_t expected = (i % (siblings + 1) == 0 && i != size - 1) ?
+                (uint8_t)(0x91 + siblings) : 0x90;
+        match = (uint8_t)output[i] == expected;
+    }
+    TEST_TRUE(match, "deep MessagePack does not match");
+    MPACK_FREE(output);
+    #else
+    TEST_TRUE(test_from_json_error(json, length, NULL) == mpack_error_too_big);
+    #endif
+
+    // without malloc, the scan starts over whenever the parser goes deeper
+    // than the counts it could keep, which is bounded by the parser's depth
+    #ifdef MPACK_MALLOC
+    size_t limit = length;
+    #else
+    size_t limit = length * MPACK_EVENT_MAX_DEPTH_WITHOUT_MALLOC;
+    #endif
+    TEST_TRUE(mpack_json_test_scanned <= limit, "converting JSON nested %i deep scanned %i bytes of %i",
+            (int)depth, (int)mpack_json_test_scanned, (int)length);
+    free(json);
+}
+
+static void test_from_json_deep(void) {
+    test_from_json_deep_impl(100000, 0);
+    test_from_json_deep_impl(20000, 3);
+}
+
+static void test_from_json_errors(void) {
+    TEST_FROM_JSON_ERROR("", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR(" ", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("1 2", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("tru", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("nul", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("truex", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("undefined", NULL, mpack_error_invalid);
+
+    // numbers
+    TEST_FROM_JSON_ERROR("01", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("1.", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR(".5", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("-", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("+1", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("1e", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("1e+", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("0x10", NULL, mpack_error_invalid);
+
+    // containers
+    TEST_FROM_JSON_ERROR("[", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("[1,]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("[,1]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("[1 2]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("[1]]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("[}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{]", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{1:2}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{\"a\" 1}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{\"a\":}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{\"a\":1,}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{\"a\":1:2}", NULL, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("{\"a\"}", NULL, mpack_error_invalid);
+
+    // a write error stops the conversion
+    char buffer[8];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    static const char json[] = "[\"abcdefghi\",1]";
+    TEST_TRUE(mpack_from_json(json, sizeof(json) - 1, &writer, NULL) == mpack_error_too_big);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_too_big);
+}
+
+static void test_from_json_lines(void) {
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.newline = true;
+    TEST_FROM_JSON_OPTIONS("", &options, "");
+    TEST_FROM_JSON_OPTIONS("1\n[2]\n{}\n", &options, "\x01\x91\x02\x80");
+    TEST_FROM_JSON_OPTIONS("\"a\" \"b\"", &options, "\xa1" "a\xa1" "b");
+    TEST_FROM_JSON_ERROR("1[2]", &options, mpack_error_invalid);
+    TEST_FROM_JSON_ERROR("1\n[2\n", &options, mpack_error_invalid);
+}
+
+// MessagePack in canonical form converts to JSON and back unchanged
+static void test_json_round_trip(void) {
+    static const char data[] =
+        "\x86\xa3" "int\x93\x00\xd0\x80\xcf\xff\xff\xff\xff\xff\xff\xff\xff"
+        "\xa4" "real\x93\xca\x3f\xc0\x00\x00\xcb\x3f\xb9\x99\x99\x99\x99\x99\x9a\xcb\x7e\x37\xe4\x3c\x88\x00\x75\x9c"
+        "\xa3" "str\xa8" "a\"b\\\n\xc3\xa9\x01"
+        "\xa3" "nil\xc0"
+        "\xa4" "bool\x92\xc3\xc2"
+        "\xa5" "empty\x92\x80\x90";
+
+    char json[512];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, json, sizeof(json));
+    TEST_TRUE(mpack_to_json_data(data, sizeof(data) - 1, &writer, NULL) == mpack_ok);
+    size_t length = mpack_writer_buffer_used(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    test_from_json_match_impl(json, length, NULL, data, sizeof(data) - 1, __LINE__);
+}
+
+#ifdef MPACK_MALLOC
+typedef struct test_json_source_t {
+    const char* data;
+    size_t remaining;
+} test_json_source_t;
+
+static size_t test_json_fill(mpack_reader_t* reader, char* buffer, size_t count) {
+    test_json_source_t* source = (test_json_source_t*)reader->context;
+    if (count > source->remaining)
+        count = source->remaining;
+    memcpy(buffer, source->data, count);
+    source->data += count;
+    source->remaining -= count;
+    return count;
+}
+
+// converts with a small reader buffer and a growable writer, so that
+// str and bin data is split into chunks and the output is flushed
+static void test_json_streams(void) {
+    static const char data[] =
+        "\x93\xda\x00\x64"
+        "0123456789\"123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789\n123456789"
+        "\xc4\x28"
+        "0123456789012345678901234567890123456789"
+        "\xa1\x5c";
+    static const char expected[] =
+        "[\"0123456789\\\"123456789012345678901234567890123456789"
+        "0123456789012345678901234567890123456789\\n123456789\","
+        "\"MDEyMzQ1Njc4OTAxMjM0NTY3ODkwMTIzNDU2Nzg5MDEyMzQ1Njc4OQ==\","
+        "\"\\\\\"]\n";
+
+    char buffer[MPACK_READER_MINIMUM_BUFFER_SIZE];
+    test_json_source_t source = {data, sizeof(data) - 1};
+    mpack_reader_t reader;
+    mpack_reader_init(&reader, buffer, sizeof(buffer), 0);
+    mpack_reader_set_fill(&reader, test_json_fill);
+    mpack_reader_set_context(&reader, &source);
+
+    char* output;
+    size_t size;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &output, &size);
+
+    mpack_json_options_t options;
+    mpack_json_options_init(&options);
+    options.newline = true;
+    mpack_to_json(&reader, &writer, &options);
+
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == sizeof(expected) - 1 && memcmp(output, expected, size) == 0,
+            "JSON does not match: got %.*s", (int)size, output);
+    MPACK_FREE(output);
+}
+#endif
+
+void test_json(void) {
+    test_json_scalars();
+    test_json_strings();
+    test_json_bytes();
+    test_json_containers();
+    test_json_keys();
+    test_json_errors();
+    #ifdef MPACK_MALLOC
+    test_json_streams();
+    #endif
+
+    test_from_json_scalars();
+    test_from_json_strings();
+    test_from_json_containers();
+    test_from_json_deep();
+    test_from_json_errors();
+    test_from_json_lines();
+    test_json_round_trip();
+}
+
+#endif
+
@@ -951,6 +951,206 @@ static void test_node_read_deep_stack(void) {
     #endif
 }
 
+static void test_node_read_validated(void) {
+    mpack_node_data_t pool[16];
+    mpack_tree_t tree;
+    mpack_tree_validation_t utf8, no_null, limits;
+    mpack_memset(&utf8, 0, sizeof(utf8));
+    mpack_memset(&no_null, 0, sizeof(no_null));
+    mpack_memset(&limits, 0, sizeof(limits));
+    utf8.utf8 = true;
+    no_null.utf8_no_null = true;
+    limits.max_depth = 2;
+    limits.max_length = 3;
+
+    #define TEST_VALIDATED_TREE(data, validation, error) do { \
+        mpack_tree_init_pool_validated(&tree, data, sizeof(data) - 1, pool, \
+                sizeof(pool) / sizeof(*pool), &validation); \
+        TEST_TREE_DESTROY_ERROR(&tree, error); \
+    } while (0)
+
+    // utf8
+    TEST_VALIDATED_TREE("\x92\xa2" "hi" "\xc4\x01\xff", utf8, mpack_ok);
+    TEST_VALIDATED_TREE("\x92\xa2" "hi" "\xa1\xff", utf8, mpack_error_type);
+    TEST_VALIDATED_TREE("\x81\xa2\xc3\x28\x01", utf8, mpack_error_type); // keys too
+    TEST_VALIDATED_TREE("\xa3" "a\x00" "b", utf8, mpack_ok);
+    TEST_VALIDATED_TREE("\xa3" "a\x00" "b", no_null, mpack_error_type);
+    TEST_VALIDATED_TREE("\xa3" "abc", no_null, mpack_ok);
+
+    // depth
+    TEST_VALIDATED_TREE("\x91\x81\x01\x02", limits, mpack_ok);
+    TEST_VALIDATED_TREE("\x91\x91\x91\xc0", limits, mpack_error_too_big);
+    TEST_VALIDATED_TREE("\x91\x91\x90", limits, mpack_error_too_big); // empty containers count
+    TEST_VALIDATED_TREE("\x91\xa1" "a", limits, mpack_ok); // strings don't
+
+    // length
+    TEST_VALIDATED_TREE("\x93\x01\x02\x03", limits, mpack_ok);
+    TEST_VALIDATED_TREE("\x94\x01\x02\x03\x04", limits, mpack_error_too_big);
+    TEST_VALIDATED_TREE("\x83\x01\x01\x02\x02\x03\x03", limits, mpack_ok);
+    TEST_VALIDATED_TREE("\x84\x01\x01\x02\x02\x03\x03\x04\x04", limits, mpack_error_too_big);
+    TEST_VALIDATED_TREE("\xa3" "abc", limits, mpack_ok);
+    TEST_VALIDATED_TREE("\xa4" "abcd", limits, mpack_error_too_big);
+    TEST_VALIDATED_TREE("\xc4\x04" "abcd", limits, mpack_error_too_big);
+    TEST_VALIDATED_TREE("\xd6\x01" "abcd", limits, mpack_error_too_big);
+
+    #undef TEST_VALIDATED_TREE
+
+    // checks that were performed by the parse are not repeated, but
+    // others still are
+    static const char data[] = "\x92\xa3" "a\x00" "b\xa1" "c";
+    mpack_tree_init_pool_validated(&tree, data, sizeof(data) - 1, pool, sizeof(pool) / sizeof(*pool), &utf8);
+    mpack_node_t root = mpack_tree_root(&tree);
+    mpack_node_check_utf8(mpack_node_array_at(root, 0));
+    mpack_node_check_utf8(mpack_node_array_at(root, 1));
+    mpack_node_check_utf8_cstr(mpack_node_array_at(root, 1));
+    TEST_TRUE(mpack_tree_error(&tree) == mpack_ok);
+    mpack_node_check_utf8_cstr(mpack_node_array_at(root, 0));
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_type);
+
+    #ifdef MPACK_MALLOC
+    mpack_tree_init_validated(&tree, data, sizeof(data) - 1, &no_null);
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_type);
+    mpack_tree_init_validated(&tree, data, sizeof(data) - 1, &utf8);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    #endif
+}
+
+static void test_node_read_unchecked(void) {
+    mpack_node_data_t pool[32];
+
+    {
+        // [true, 1, -1, 0x7f as int16, 1.5f, 2.5, "str", bin "bi", [4], {5: 6}]
+        static const char data[] =
+                "\x9a\xc3\x01\xff\xd1\x00\x7f\xca\x3f\xc0\x00\x00"
+                "\xcb\x40\x04\x00\x00\x00\x00\x00\x00"
+                "\xa3" "str" "\xc4\x02" "bi" "\x91\x04\x81\x05\x06";
+        mpack_tree_t tree;
+        mpack_tree_init_pool(&tree, data, sizeof(data) - 1, pool, sizeof(pool) / sizeof(*pool));
+        mpack_node_t root = mpack_tree_root(&tree);
+
+        TEST_TRUE(mpack_node_array_length_unchecked(root) == 10);
+        TEST_TRUE(mpack_node_bool_unchecked(mpack_node_array_at_unchecked(root, 0)) == true);
+        TEST_TRUE(mpack_node_u64_unchecked(mpack_node_array_at_unchecked(root, 1)) == 1);
+        TEST_TRUE(mpack_node_i64_unchecked(mpack_node_array_at_unchecked(root, 1)) == 1);
+        TEST_TRUE(mpack_node_i64_unchecked(mpack_node_array_at_unchecked(root, 2)) == -1);
+        TEST_TRUE(mpack_node_u64_unchecked(mpack_node_array_at_unchecked(root, 3)) == 0x7f);
+        TEST_TRUE(mpack_node_double_unchecked(mpack_node_array_at_unchecked(root, 4)) == 1.5);
+        TEST_TRUE(mpack_node_double_unchecked(mpack_node_array_at_unchecked(root, 5)) == 2.5);
+
+        mpack_node_t str = mpack_node_array_at_unchecked(root, 6);
+        TEST_TRUE(mpack_node_data_len_unchecked(str) == 3);
+        TEST_TRUE(memcmp(mpack_node_data_unchecked(str), "str", 3) == 0);
+        mpack_node_t bin = mpack_node_array_at_unchecked(root, 7);
+        TEST_TRUE(mpack_node_data_len_unchecked(bin) == 2);
+        TEST_TRUE(memcmp(mpack_node_data_unchecked(bin), "bi", 2) == 0);
+
+        mpack_node_t array = mpack_node_array_at_unchecked(root, 8);
+        TEST_TRUE(mpack_node_array_length_unchecked(array) == 1);
+        TEST_TRUE(mpack_node_u64_unchecked(mpack_node_array_at_unchecked(array, 0)) == 4);
+        mpack_node_t map = mpack_node_array_at_unchecked(root, 9);
+        TEST_TRUE(mpack_node_map_count_unchecked(map) == 1);
+        TEST_TRUE(mpack_node_u64_unchecked(mpack_node_map_key_at_unchecked(map, 0)) == 5);
+        TEST_TRUE(mpack_node_u64_unchecked(mpack_node_map_value_at_unchecked(map, 0)) == 6);
+
+        TEST_TREE_DESTROY_NOERROR(&tree);
+    }
+
+    // misuse is caught by asserts in debug builds
+    TEST_SIMPLE_TREE_READ_ASSERT("\xc0", mpack_node_bool_unchecked(node));
+    TEST_SIMPLE_TREE_READ_ASSERT("\xff", mpack_node_u64_unchecked(node));
+    TEST_SIMPLE_TREE_READ_ASSERT("\xcf\xff\xff\xff\xff\xff\xff\xff\xff", mpack_node_i64_unchecked(node));
+    TEST_SIMPLE_TREE_READ_ASSERT("\x01", mpack_node_double_unchecked(node));
+    TEST_SIMPLE_TREE_READ_ASSERT("\x91\x01", mpack_node_array_at_unchecked(node, 1));
+    TEST_SIMPLE_TREE_READ_ASSERT("\x81\x01\x01", mpack_node_map_value_at_unchecked(node, 1));
+    TEST_SIMPLE_TREE_READ_ASSERT("\x90", mpack_node_data_unchecked(node));
+}
+
+static void test_node_read_error_location(void) {
+    mpack_node_data_t pool[32];
+    mpack_tree_t tree;
+
+    // no error
+    mpack_tree_init_pool(&tree, "\x91\x01", 2, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error_position(&tree) == 0);
+    TEST_TRUE(strcmp(mpack_tree_error_path(&tree), "") == 0);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // an invalid root
+    mpack_tree_init_pool(&tree, "\xc1", 1, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error_position(&tree) == 1);
+    TEST_TRUE(strcmp(mpack_tree_error_path(&tree), "") == 0);
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_invalid);
+
+    // {"items": [1, 2, <invalid>]}
+    static const char items[] = "\x81\xa5" "items" "\x93\x01\x02\xc1";
+    mpack_tree_init_pool(&tree, items, sizeof(items) - 1, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error_position(&tree) == 11);
+    TEST_TRUE(strcmp(mpack_tree_error_path(&tree), ".items[2]") == 0, "path is %s", mpack_tree_error_path(&tree));
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_invalid);
+
+    // [{1: nil, 2: [truncated str]}]
+    static const char truncated[] = "\x91\x82\x01\xc0\x02\x91\xa4" "ab";
+    mpack_tree_init_pool(&tree, truncated, sizeof(truncated) - 1, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error_position(&tree) == 7);
+    TEST_TRUE(strcmp(mpack_tree_error_path(&tree), "[0]{1}[0]") == 0, "path is %s", mpack_tree_error_path(&tree));
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_invalid);
+
+    // an invalid key in the second pair
+    static const char key[] = "\x82\xa1" "a" "\xc0\xc1\xc0";
+    mpack_tree_init_pool(&tree, key, sizeof(key) - 1, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error_position(&tree) == 5);
+    TEST_TRUE(strcmp(mpack_tree_error_path(&tree), "{1}") == 0, "path is %s", mpack_tree_error_path(&tree));
+    TEST_TREE_DESTROY_ERROR(&tree, mpack_error_invalid);
+
+    // long paths are truncated
+    char deep[MPACK_TREE_ERROR_PATH_SIZE + 1];
+    mpack_memset(deep, '\x91', sizeof(deep));
+    deep[sizeof(deep) - 1] = '\xc1';
+    mpack_tree_init_pool(&tree, deep, sizeof(deep), pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_error(&tree) != mpack_ok);
+    TEST_TRUE(strlen(mpack_tree_error_path(&tree)) < MPACK_TREE_ERROR_PATH_SIZE);
+    mpack_tree_destroy(&tree);
+}
+
+#if MPACK_STATS
+static void test_node_read_stats(void) {
+    mpack_node_data_t pool[32];
+    mpack_tree_t tree;
+
+    // [[1], []] parsed into a pool allocates no pages
+    mpack_tree_init_pool(&tree, "\x92\x91\x01\x90", 4, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_stats(&tree)->nodes == 4);
+    TEST_TRUE(mpack_tree_stats(&tree)->max_depth == 2);
+    TEST_TRUE(mpack_tree_stats(&tree)->pages == 0);
+    TEST_TRUE(mpack_tree_stats(&tree)->page_bytes == 0);
+    TEST_TRUE(mpack_tree_stats(&tree)->wasted_nodes == 0);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // a scalar root has no depth
+    mpack_tree_init_pool(&tree, "\x01", 1, pool, sizeof(pool) / sizeof(*pool));
+    TEST_TRUE(mpack_tree_stats(&tree)->nodes == 1);
+    TEST_TRUE(mpack_tree_stats(&tree)->max_depth == 0);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    #ifdef MPACK_MALLOC
+    // an array of 40 nils is larger than a test page, so it gets its own page
+    char data[43];
+    mpack_memset(data, '\xc0', sizeof(data));
+    data[0] = '\xdc';
+    data[1] = 0;
+    data[2] = 40;
+    mpack_tree_init(&tree, data, sizeof(data));
+    if (mpack_tree_error(&tree) != mpack_error_memory) {
+        TEST_TRUE(mpack_tree_stats(&tree)->nodes == 41);
+        TEST_TRUE(mpack_tree_stats(&tree)->max_depth == 1);
+        TEST_TRUE(mpack_tree_stats(&tree)->pages == 2);
+        TEST_TRUE(mpack_tree_stats(&tree)->page_bytes >= 2 * sizeof(mpack_tree_page_t) + 39 * sizeof(mpack_node_data_t));
+    }
+    mpack_tree_destroy(&tree);
+    #endif
+}
+#endif
+
 void test_node(void) {
     test_example_node();
 
@@ -980,6 +1180,14 @@ void test_node(void) {
     test_node_read_compound_errors();
     test_node_read_data();
     test_node_read_deep_stack();
+
+    // validation
+    test_node_read_validated();
+    test_node_read_unchecked();
+    test_node_read_error_location();
+    #if MPACK_STATS
+    test_node_read_stats();
+    #endif
 }
 
 #endif
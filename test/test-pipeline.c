@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-pipeline.h"
+#include "test-system.h"
+
+#if MPACK_PIPELINE && defined(MPACK_MALLOC) && MPACK_WRITER
+
+#define TEST_PIPELINE_COUNT 2000
+
+typedef struct test_pipeline_t {
+    // the stream
+    char* data;
+    size_t size;
+    size_t pos; // the position of the fill function
+
+    bool ordered;
+    bool reject; // whether the decoder rejects every seventh message
+    uint64_t next; // the next index expected in order
+    bool in_order;
+    size_t delivered;
+    uintptr_t results[TEST_PIPELINE_COUNT];
+    mpack_error_t errors[TEST_PIPELINE_COUNT];
+} test_pipeline_t;
+
+static test_pipeline_t test_pipeline_state;
+
+// message i is an array of its id, a string whose length varies, and
+// either a small map or (every 97th message) an array of 100 elements.
+// many are larger than the chunks used in the fill tests, and the arrays
+// are larger than the maximum size used in the fill tests.
+static void test_pipeline_write(char** data, size_t* size, uint32_t count) {
+    static const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. "
+        "Sed nec justo purus. Nunc finibus dolor id lorem sagittis, euismod efficitur arcu aliquam.";
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, data, size);
+    for (uint32_t i = 0; i < count; ++i) {
+        mpack_start_array(&writer, 3);
+        mpack_write_u32(&writer, i);
+        mpack_write_str(&writer, text, 1 + (i * 37) % (uint32_t)(sizeof(text) - 1));
+        if (i % 97 == 96) {
+            mpack_start_array(&writer, 100);
+            for (uint32_t j = 0; j < 100; ++j)
+                mpack_write_u32(&writer, j * 1000);
+            mpack_finish_array(&writer);
+        } else {
+            mpack_start_map(&writer, 1);
+            mpack_write_cstr(&writer, "k");
+            mpack_write_u32(&writer, i * 2);
+            mpack_finish_map(&writer);
+        }
+        mpack_finish_array(&writer);
+    }
+    TEST_TRUE(mpack_writer_destroy(&writer) == mpack_ok);
+}
+
+static void test_pipeline_reset(test_pipeline_t* state, bool ordered) {
+    state->pos = 0;
+    state->ordered = ordered;
+    state->reject = false;
+    state->next = 0;
+    state->in_order = true;
+    state->delivered = 0;
+    mpack_memset(state->results, 0, sizeof(state->results));
+    mpack_memset(state->errors, 0, sizeof(state->errors));
+}
+
+// called on the workers, so this records results rather than testing them
+static void* test_pipeline_decode(void* context, mpack_tree_t* tree) {
+    test_pipeline_t* state = (test_pipeline_t*)context;
+    mpack_node_t root = mpack_tree_root(tree);
+    uint32_t id = mpack_node_u32(mpack_node_array_at(root, 0));
+    if (state->reject && id % 7 == 3)
+        mpack_node_str(mpack_node_array_at(root, 0));
+    return (void*)(uintptr_t)(id + 1);
+}
+
+static void test_pipeline_deliver(void* context, uint64_t index, void* result, mpack_error_t error) {
+    test_pipeline_t* state = (test_pipeline_t*)context;
+    if (index >= TEST_PIPELINE_COUNT) {
+        state->in_order = false;
+        return;
+    }
+    state->results[index] = (uintptr_t)result;
+    state->errors[index] = error;
+    if (state->ordered) {
+        if (index != state->next)
+            state->in_order = false;
+        state->next = index + 1;
+    }
+    __atomic_add_fetch(&state->delivered, 1, __ATOMIC_RELAXED);
+}
+
+// returns the stream in pieces of varying sizes
+static size_t test_pipeline_fill(void* context, char* buffer, size_t count) {
+    test_pipeline_t* state = (test_pipeline_t*)context;
+    size_t piece = 1 + (state->pos * 7) % 29;
+    if (piece > count)
+        piece = count;
+    if (piece > state->size - state->pos)
+        piece = state->size - state->pos;
+    mpack_memcpy(buffer, state->data + state->pos, piece);
+    state->pos += piece;
+    return piece;
+}
+
+// checks that the first count messages were delivered correctly
+static void test_pipeline_check(test_pipeline_t* state, size_t count) {
+    TEST_TRUE(state->delivered == count, "%i of %i delivered", (int)state->delivered, (int)count);
+    TEST_TRUE(state->in_order);
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) {
+        mpack_error_t expected = (state->reject && i % 7 == 3) ? mpack_error_type : mpack_ok;
+        ok = ok && state->results[i] == i + 1 && state->errors[i] == expected;
+    }
+    TEST_TRUE(ok, "wrong results delivered");
+}
+
+static void test_pipeline_options(mpack_pipeline_options_t* options,
+        size_t threads, size_t capacity, size_t batch, bool ordered)
+{
+    mpack_pipeline_options_init(options);
+    options->threads = threads;
+    options->capacity = capacity;
+    options->batch = batch;
+    options->ordered = ordered;
+}
+
+static void test_pipeline_data(test_pipeline_t* state) {
+    static const struct {
+        size_t threads, capacity, batch;
+        bool ordered;
+    } configs[] = {
+        {1, 1024, 8, true},
+        {4, 16, 3, true},
+        {4, 64, 8, false},
+        {8, 4, 1, true},
+        {3, 2, 5, false},
+    };
+    for (size_t i = 0; i < sizeof(configs) / sizeof(*configs); ++i) {
+        mpack_pipeline_options_t options;
+        test_pipeline_options(&options, configs[i].threads, configs[i].capacity,
+                configs[i].batch, configs[i].ordered);
+        test_pipeline_reset(state, configs[i].ordered);
+        TEST_TRUE(mpack_ok == mpack_pipeline_run(state->data, state->size,
+                    test_pipeline_decode, test_pipeline_deliver, state, &options));
+        test_pipeline_check(state, TEST_PIPELINE_COUNT);
+    }
+
+    // default options
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_ok == mpack_pipeline_run(state->data, state->size,
+                test_pipeline_decode, test_pipeline_deliver, state, NULL));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT);
+
+    // errors flagged by the decoder are delivered with the message
+    test_pipeline_reset(state, true);
+    state->reject = true;
+    TEST_TRUE(mpack_ok == mpack_pipeline_run(state->data, state->size,
+                test_pipeline_decode, test_pipeline_deliver, state, NULL));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT);
+
+    // without a decoder, results are NULL
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_ok == mpack_pipeline_run(state->data, state->size,
+                NULL, test_pipeline_deliver, state, NULL));
+    TEST_TRUE(state->delivered == TEST_PIPELINE_COUNT && state->in_order);
+    TEST_TRUE(state->results[0] == 0 && state->results[TEST_PIPELINE_COUNT - 1] == 0);
+
+    // an empty stream
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_ok == mpack_pipeline_run(NULL, 0,
+                test_pipeline_decode, test_pipeline_deliver, state, NULL));
+    TEST_TRUE(state->delivered == 0);
+}
+
+static void test_pipeline_fill_stream(test_pipeline_t* state) {
+    for (int ordered = 0; ordered < 2; ++ordered) {
+        mpack_pipeline_options_t options;
+        test_pipeline_options(&options, 3, 32, 4, ordered != 0);
+        options.chunk_size = 64;
+        test_pipeline_reset(state, ordered != 0);
+        TEST_TRUE(mpack_ok == mpack_pipeline_run_fill(test_pipeline_fill,
+                    test_pipeline_decode, test_pipeline_deliver, state, &options));
+        test_pipeline_check(state, TEST_PIPELINE_COUNT);
+        TEST_TRUE(state->pos == state->size);
+    }
+
+    // default options
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_ok == mpack_pipeline_run_fill(test_pipeline_fill,
+                test_pipeline_decode, test_pipeline_deliver, state, NULL));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT);
+
+    // a message larger than the maximum size stops the stream. message 96
+    // is the first with 100 elements.
+    mpack_pipeline_options_t options;
+    test_pipeline_options(&options, 2, 16, 2, true);
+    options.chunk_size = 64;
+    options.max_size = 250;
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_error_too_big == mpack_pipeline_run_fill(test_pipeline_fill,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, 96);
+    options.chunk_size = 4096;
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_error_too_big == mpack_pipeline_run_fill(test_pipeline_fill,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, 96);
+}
+
+static void test_pipeline_errors(test_pipeline_t* state) {
+    mpack_pipeline_options_t options;
+    test_pipeline_options(&options, 4, 16, 2, true);
+    size_t size = state->size;
+
+    // a truncated stream delivers the complete messages
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_error_io == mpack_pipeline_run(state->data, size - 1,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT - 1);
+
+    test_pipeline_reset(state, true);
+    state->size = size - 1;
+    options.chunk_size = 64;
+    TEST_TRUE(mpack_error_io == mpack_pipeline_run_fill(test_pipeline_fill,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT - 1);
+    state->size = size;
+
+    // invalid data stops the stream after the messages before it
+    test_pipeline_reset(state, true);
+    static const char invalid[] = "\x91\x00\xc1";
+    TEST_TRUE(mpack_error_invalid == mpack_pipeline_run(invalid, sizeof(invalid) - 1,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, 1);
+}
+
+// the node pool is too small for some messages, which are parsed
+// into allocated pages instead. (this uses one worker since the test
+// allocator isn't thread-safe.)
+static void test_pipeline_small_pool(test_pipeline_t* state) {
+    mpack_pipeline_options_t options;
+    test_pipeline_options(&options, 1, 16, 4, true);
+    options.nodes = 8;
+    test_pipeline_reset(state, true);
+    TEST_TRUE(mpack_ok == mpack_pipeline_run(state->data, state->size,
+                test_pipeline_decode, test_pipeline_deliver, state, &options));
+    test_pipeline_check(state, TEST_PIPELINE_COUNT);
+}
+
+static bool test_pipeline_failure(void) {
+    test_pipeline_t* state = &test_pipeline_state;
+    mpack_pipeline_options_t options;
+    test_pipeline_options(&options, 2, 16, 2, true);
+    test_pipeline_reset(state, true);
+    mpack_error_t error = mpack_pipeline_run(state->data, state->size,
+            test_pipeline_decode, test_pipeline_deliver, state, &options);
+    if (error == mpack_error_memory)
+        return false;
+    TEST_TRUE(error == mpack_ok);
+    test_pipeline_check(state, TEST_PIPELINE_COUNT);
+    return true;
+}
+
+void test_pipeline(void) {
+    test_pipeline_t* state = &test_pipeline_state;
+    test_pipeline_write(&state->data, &state->size, TEST_PIPELINE_COUNT);
+
+    test_pipeline_data(state);
+    test_pipeline_fill_stream(state);
+    test_pipeline_errors(state);
+    test_pipeline_small_pool(state);
+
+    // the stream is allocated, so it is copied out of the test allocator
+    // for the failure test
+    char* data = (char*)malloc(state->size);
+    TEST_TRUE(data != NULL);
+    if (data != NULL) {
+        mpack_memcpy(data, state->data, state->size);
+        MPACK_FREE(state->data);
+        state->data = data;
+        test_system_fail_until_ok(&test_pipeline_failure);
+        free(data);
+    } else {
+        MPACK_FREE(state->data);
+    }
+    state->data = NULL;
+}
+
+#endif
+
@@ -70,9 +70,579 @@ static void test_reader_miscellaneous() {
     TEST_SIMPLE_READ_ERROR("\x81", (mpack_discard(&reader), true), mpack_error_invalid); // map
 }
 
+// records parsing events as a compact transcript
+typedef struct test_events_t {
+    char text[256];
+    size_t len;
+    size_t chunks;
+    size_t limit; // flags mpack_error_data after this many events
+} test_events_t;
+
+static void test_events_append(mpack_reader_t* reader, test_events_t* events, const char* data, size_t count) {
+    TEST_TRUE(events->len + count < sizeof(events->text), "event transcript is too long");
+    if (events->len + count >= sizeof(events->text))
+        return;
+    memcpy(events->text + events->len, data, count);
+    events->len += count;
+    events->text[events->len] = '\0';
+
+    if (events->limit > 0 && --events->limit == 0)
+        mpack_reader_flag_error(reader, mpack_error_data);
+}
+
+static void test_events_scalar(mpack_reader_t* reader, void* context, mpack_tag_t tag) {
+    char buf[32];
+    switch (tag.type) {
+        case mpack_type_nil:    sprintf(buf, "n "); break;
+        case mpack_type_bool:   sprintf(buf, "%s ", tag.v.b ? "t" : "f"); break;
+        case mpack_type_int:    sprintf(buf, "%i ", (int)tag.v.i); break;
+        case mpack_type_uint:   sprintf(buf, "%u ", (unsigned)tag.v.u); break;
+        case mpack_type_float:  sprintf(buf, "%gf ", (double)tag.v.f); break;
+        case mpack_type_double: sprintf(buf, "%gd ", tag.v.d); break;
+        default:
+            TEST_TRUE(false, "unexpected scalar type %s", mpack_type_to_string(tag.type));
+            return;
+    }
+    test_events_append(reader, (test_events_t*)context, buf, strlen(buf));
+}
+
+static void test_events_start(mpack_reader_t* reader, void* context, mpack_tag_t tag) {
+    char buf[32];
+    switch (tag.type) {
+        case mpack_type_array: sprintf(buf, "[%u ", (unsigned)tag.v.n); break;
+        case mpack_type_map:   sprintf(buf, "{%u ", (unsigned)tag.v.n); break;
+        case mpack_type_str:   sprintf(buf, "s%u\"", (unsigned)tag.v.l); break;
+        case mpack_type_bin:   sprintf(buf, "b%u\"", (unsigned)tag.v.l); break;
+        case mpack_type_ext:   sprintf(buf, "e%i:%u\"", (int)tag.exttype, (unsigned)tag.v.l); break;
+        default:
+            TEST_TRUE(false, "unexpected start type %s", mpack_type_to_string(tag.type));
+            return;
+    }
+    test_events_append(reader, (test_events_t*)context, buf, strlen(buf));
+}
+
+static void test_events_bytes(mpack_reader_t* reader, void* context, const char* data, size_t count) {
+    test_events_t* events = (test_events_t*)context;
+    TEST_TRUE(count > 0, "empty chunk delivered");
+    ++events->chunks;
+    test_events_append(reader, events, data, count);
+}
+
+static void test_events_finish(mpack_reader_t* reader, void* context, mpack_type_t type) {
+    const char* text;
+    switch (type) {
+        case mpack_type_array: text = "] "; break;
+        case mpack_type_map:   text = "} "; break;
+        default:               text = "\" "; break;
+    }
+    test_events_append(reader, (test_events_t*)context, text, strlen(text));
+}
+
+static const mpack_visitor_t test_events_visitor = {
+    test_events_scalar,
+    test_events_start,
+    test_events_bytes,
+    test_events_finish,
+};
+
+static const char test_events_data[] =
+        "\x94\xc0\xd9\x28" "0123456789012345678901234567890123456789"
+        "\x83\x01\x92\xc3\xc2\xa1x\x90\xc4\x02\x00\x01\x80"
+        "\xd6\x07" "abcd"
+        "\xd0\xfb";
+
+static const char test_events_expected[] =
+        "[4 n s40\"0123456789012345678901234567890123456789\" "
+        "{3 1 [2 t f ] s1\"x\" [0 ] b2\"\x00\x01\" {0 } } "
+        "e7:4\"abcd\" ] ";
+
+static void test_reader_events_data(void) {
+    test_events_t events;
+    mpack_memset(&events, 0, sizeof(events));
+
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, test_events_data, sizeof(test_events_data) - 1);
+    mpack_parse_events(&reader, &test_events_visitor, &events);
+
+    // a data reader delivers each str/bin/ext in one chunk, and
+    // parsing stops after a single top-level object
+    TEST_TRUE(events.len == sizeof(test_events_expected) - 1);
+    TEST_TRUE(memcmp(events.text, test_events_expected, events.len) == 0, "wrong events: %s", events.text);
+    TEST_TRUE(events.chunks == 4);
+    TEST_TRUE(mpack_tag_equal(mpack_read_tag(&reader), mpack_tag_int(-5)));
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+
+typedef struct test_events_fill_t {
+    const char* data;
+    size_t remaining;
+} test_events_fill_t;
+
+static size_t test_events_fill(mpack_reader_t* reader, char* buffer, size_t count) {
+    test_events_fill_t* state = (test_events_fill_t*)reader->context;
+    if (state->remaining < count)
+        count = state->remaining;
+    memcpy(buffer, state->data, count);
+    state->data += count;
+    state->remaining -= count;
+    return count;
+}
+
+static void test_reader_events_fill(void) {
+    static const size_t sizes[] = {MPACK_READER_MINIMUM_BUFFER_SIZE, 33, 37};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        test_events_t events;
+        mpack_memset(&events, 0, sizeof(events));
+
+        char buffer[37];
+        test_events_fill_t state = {test_events_data, sizeof(test_events_data) - 1};
+        mpack_reader_t reader;
+        mpack_reader_init(&reader, buffer, sizes[i], 0);
+        mpack_reader_set_fill(&reader, test_events_fill);
+        mpack_reader_set_context(&reader, &state);
+
+        mpack_parse_events(&reader, &test_events_visitor, &events);
+        TEST_TRUE(events.len == sizeof(test_events_expected) - 1);
+        TEST_TRUE(memcmp(events.text, test_events_expected, events.len) == 0, "wrong events: %s", events.text);
+        TEST_TRUE(events.chunks > 4, "long str was not split into chunks");
+        TEST_TRUE(mpack_tag_equal(mpack_read_tag(&reader), mpack_tag_int(-5)));
+        TEST_READER_DESTROY_NOERROR(&reader);
+    }
+}
+
+static void test_reader_events_errors(void) {
+    test_events_t events;
+    const mpack_visitor_t empty = {NULL, NULL, NULL, NULL};
+
+    // NULL callbacks skip their events
+    TEST_SIMPLE_READ(test_events_data, (mpack_parse_events(&reader, &empty, NULL),
+                mpack_tag_equal(mpack_read_tag(&reader), mpack_tag_int(-5))));
+
+    // truncated data
+    mpack_memset(&events, 0, sizeof(events));
+    TEST_SIMPLE_READ_ERROR("\x92\xa3" "ab", (mpack_parse_events(&reader, &test_events_visitor, &events),
+                true), mpack_error_invalid);
+    TEST_TRUE(events.len == 6 && memcmp(events.text, "[2 s3\"", 6) == 0, "wrong events: %s", events.text);
+    TEST_SIMPLE_READ_ERROR("\x81\x01", (mpack_parse_events(&reader, &empty, NULL), true), mpack_error_invalid);
+    TEST_SIMPLE_READ_ERROR("\xc1", (mpack_parse_events(&reader, &empty, NULL), true), mpack_error_invalid);
+
+    // a callback flagging an error stops parsing immediately
+    mpack_memset(&events, 0, sizeof(events));
+    events.limit = 3;
+    TEST_SIMPLE_READ_ERROR("\x94\xc0\x01\x02\x03", (mpack_parse_events(&reader, &test_events_visitor, &events),
+                true), mpack_error_data);
+    TEST_TRUE(events.len == 7 && memcmp(events.text, "[4 n 1 ", 7) == 0, "wrong events: %s", events.text);
+}
+
+static bool test_reader_events_deep(void) {
+
+    // nesting far deeper than the initial stack. we allow
+    // mpack_error_memory since it will be simulated by the
+    // failure system.
+    #define TEST_EVENTS_DEPTH 100
+    char data[TEST_EVENTS_DEPTH + 1];
+    mpack_memset(data, '\x91', TEST_EVENTS_DEPTH);
+    data[TEST_EVENTS_DEPTH] = '\xc0';
+
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, data, sizeof(data));
+    const mpack_visitor_t empty = {NULL, NULL, NULL, NULL};
+    mpack_parse_events(&reader, &empty, NULL);
+
+    #ifdef MPACK_MALLOC
+    if (mpack_reader_destroy(&reader) == mpack_error_memory)
+        return false;
+    #if MPACK_READ_TRACKING && MPACK_TRACKING_INLINE_DEPTH && MPACK_TRACKING_INLINE_DEPTH <= TEST_EVENTS_DEPTH
+    // inline tracking has a fixed depth
+    TEST_TRUE(mpack_reader_error(&reader) == mpack_error_too_big);
+    #else
+    TEST_TRUE(mpack_reader_error(&reader) == mpack_ok);
+    #endif
+    #else
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_too_big);
+    #endif
+    #undef TEST_EVENTS_DEPTH
+    return true;
+}
+
+static const char* test_project_paths[] = {
+    "header.route",
+    "meta.tenant",
+    "meta.tags",
+    "header.missing",
+    "body",
+    "id",
+};
+
+#define TEST_PROJECT_COUNT (sizeof(test_project_paths) / sizeof(test_project_paths[0]))
+
+// {"header": {1: "one", "id": 7, "route": "a/b"}, "body": [1, 2, 3],
+//  "meta": {"tags": {"x": 1}, "tenant": "acme"}, "extra": nil}
+static const char test_project_data[] =
+        "\x84"
+        "\xa6" "header" "\x83" "\x01\xa3" "one" "\xa2" "id" "\x07" "\xa5" "route" "\xa3" "a/b"
+        "\xa4" "body" "\x93\x01\x02\x03"
+        "\xa4" "meta" "\x82" "\xa4" "tags" "\x81\xa1" "x" "\x01" "\xa6" "tenant" "\xa4" "acme"
+        "\xa5" "extra" "\xc0";
+
+static void test_reader_project_pathset(mpack_pathset_t* pathset, mpack_path_node_t* nodes, size_t capacity) {
+    TEST_TRUE(mpack_ok == mpack_pathset_init(pathset, nodes, capacity,
+                test_project_paths, TEST_PROJECT_COUNT));
+    TEST_TRUE(mpack_pathset_count(pathset) == TEST_PROJECT_COUNT);
+}
+
+static void test_reader_project_check(mpack_path_value_t* values, bool spans) {
+    TEST_TRUE(values[0].found && values[0].tag.type == mpack_type_str && values[0].tag.v.l == 3);
+    TEST_TRUE(values[1].found && values[1].tag.type == mpack_type_str && values[1].tag.v.l == 4);
+    TEST_TRUE(values[2].found && values[2].tag.type == mpack_type_map && values[2].tag.v.n == 1);
+    TEST_TRUE(!values[3].found);
+    TEST_TRUE(values[4].found && values[4].tag.type == mpack_type_array && values[4].tag.v.n == 3);
+    TEST_TRUE(!values[5].found); // "id" is only in the header
+
+    if (spans) {
+        TEST_TRUE(values[0].size == 3 && memcmp(values[0].data, "a/b", 3) == 0);
+        TEST_TRUE(values[1].size == 4 && memcmp(values[1].data, "acme", 4) == 0);
+        TEST_TRUE(values[2].size == 4 && memcmp(values[2].data, "\x81\xa1x\x01", 4) == 0);
+        TEST_TRUE(values[4].size == 4 && memcmp(values[4].data, "\x93\x01\x02\x03", 4) == 0);
+    } else {
+        TEST_TRUE(values[2].data == NULL && values[2].size == 0);
+        TEST_TRUE(values[4].data == NULL && values[4].size == 0);
+    }
+}
+
+static void test_reader_project_basic(void) {
+    mpack_path_node_t nodes[9];
+    mpack_pathset_t pathset;
+    mpack_path_value_t values[TEST_PROJECT_COUNT];
+
+    // the paths need exactly the root plus eight distinct keys
+    TEST_TRUE(mpack_error_too_big == mpack_pathset_init(&pathset, nodes, 8,
+                test_project_paths, TEST_PROJECT_COUNT));
+    test_reader_project_pathset(&pathset, nodes, 9);
+
+    // data in place, followed by an extra value which is left unread
+    static const char data[] = "\x93\x01\x02\x03";
+    char buf[sizeof(test_project_data) + 1];
+    memcpy(buf, test_project_data, sizeof(test_project_data) - 1);
+    buf[sizeof(test_project_data) - 1] = '\xc0';
+    TEST_TRUE(mpack_ok == mpack_project_data(buf, sizeof(buf), &pathset, values));
+    test_reader_project_check(values, true);
+
+    // a fill reader doesn't return compound spans
+    {
+        char buffer[MPACK_READER_MINIMUM_BUFFER_SIZE];
+        test_events_fill_t state = {test_project_data, sizeof(test_project_data) - 1};
+        mpack_reader_t fill_reader;
+        mpack_reader_init(&fill_reader, buffer, sizeof(buffer), 0);
+        mpack_reader_set_fill(&fill_reader, test_events_fill);
+        mpack_reader_set_context(&fill_reader, &state);
+        mpack_project(&fill_reader, &pathset, values);
+        TEST_READER_DESTROY_NOERROR(&fill_reader);
+        test_reader_project_check(values, false);
+    }
+
+    // a non-map object has none of the paths
+    TEST_SIMPLE_READ(data, (mpack_project(&reader, &pathset, values), !values[0].found && !values[4].found));
+
+    // intermediate keys that aren't maps are skipped
+    TEST_SIMPLE_READ("\x82\xa6" "header" "\x92\xc0\xc0\xa4" "body" "\xa0",
+            (mpack_project(&reader, &pathset, values), !values[0].found &&
+             values[4].found && values[4].tag.type == mpack_type_str && values[4].data == NULL));
+}
+
+static void test_reader_project_errors(void) {
+    mpack_path_node_t nodes[9];
+    mpack_pathset_t pathset;
+    mpack_path_value_t values[TEST_PROJECT_COUNT];
+
+    static const char* empty[] = {"a..b"};
+    static const char* prefix[] = {"a.b", "a"};
+    static const char* prefix2[] = {"a", "a.b"};
+    static const char* duplicate[] = {"a.b", "c", "a.b"};
+    TEST_BREAK(mpack_error_bug == mpack_pathset_init(&pathset, nodes, 8, empty, 1));
+    TEST_BREAK(mpack_error_bug == mpack_pathset_init(&pathset, nodes, 8, prefix, 2));
+    TEST_BREAK(mpack_error_bug == mpack_pathset_init(&pathset, nodes, 8, prefix2, 2));
+    TEST_BREAK(mpack_error_bug == mpack_pathset_init(&pathset, nodes, 8, duplicate, 3));
+    TEST_BREAK(mpack_error_bug == mpack_pathset_init(&pathset, nodes, 8, duplicate, 0));
+    TEST_TRUE(mpack_pathset_count(&pathset) == 0);
+
+    test_reader_project_pathset(&pathset, nodes, 9);
+
+    // duplicate projected keys
+    TEST_SIMPLE_READ_ERROR("\x82\xa4" "body" "\x01\xa4" "body" "\x02",
+            (mpack_project(&reader, &pathset, values), true), mpack_error_invalid);
+
+    // duplicate keys elsewhere are fine, as are non-string keys
+    TEST_SIMPLE_READ("\x84\xa2" "zz" "\x01\xa2" "zz" "\x02\x91\x01\xc0\xa4" "body" "\x03",
+            (mpack_project(&reader, &pathset, values), values[4].found && values[4].tag.v.u == 3));
+
+    // truncated data
+    TEST_TRUE(mpack_error_invalid == mpack_project_data(test_project_data,
+                sizeof(test_project_data) - 2, &pathset, values));
+}
+
+static void test_reader_error_position(void) {
+
+    // no error reports the number of bytes consumed
+    TEST_SIMPLE_READ("\x01\x02", (mpack_read_tag(&reader), mpack_read_tag(&reader),
+                mpack_reader_error_position(&reader) == 2));
+
+    // an invalid tag is reported at its start
+    TEST_SIMPLE_READ_ERROR("\x93\x01\x02\xc1\x03", (mpack_read_tag(&reader), mpack_read_tag(&reader),
+                mpack_read_tag(&reader), mpack_read_tag(&reader),
+                mpack_reader_error_position(&reader) == 3), mpack_error_invalid);
+
+    // truncated data is reported at the start of the partial element
+    TEST_SIMPLE_READ_ERROR("\x92\x01\xcd\x00", (mpack_read_tag(&reader), mpack_read_tag(&reader),
+                mpack_read_tag(&reader), mpack_reader_error_position(&reader) == 2), mpack_error_invalid);
+
+    // errors flagged by the user are reported at the current position
+    TEST_SIMPLE_READ_ERROR("\x01\x02\x03", (mpack_read_tag(&reader),
+                mpack_reader_flag_error(&reader, mpack_error_data),
+                mpack_read_tag(&reader), mpack_reader_error_position(&reader) == 1), mpack_error_data);
+
+    // with a fill function, the offset is in the stream rather than the buffer
+    static const char data[] = "\xa9" "abcdefghi" "\xa9" "jklmnopqr"
+            "\xa9" "stuvwxyz0" "\xa9" "123456789" "\xc1";
+    char buffer[MPACK_READER_MINIMUM_BUFFER_SIZE];
+    char str[9];
+    test_events_fill_t state = {data, sizeof(data) - 1};
+    mpack_reader_t fill_reader;
+    mpack_reader_init(&fill_reader, buffer, sizeof(buffer), 0);
+    mpack_reader_set_fill(&fill_reader, test_events_fill);
+    mpack_reader_set_context(&fill_reader, &state);
+    for (int i = 0; i < 4; ++i) {
+        TEST_TRUE(mpack_read_tag(&fill_reader).type == mpack_type_str);
+        mpack_read_bytes(&fill_reader, str, sizeof(str));
+        mpack_done_str(&fill_reader);
+    }
+    TEST_TRUE(mpack_reader_error_position(&fill_reader) == 40);
+    mpack_read_tag(&fill_reader);
+    TEST_TRUE(mpack_reader_error_position(&fill_reader) == 40);
+    TEST_READER_DESTROY_ERROR(&fill_reader, mpack_error_invalid);
+}
+
+#if !MPACK_OPTIMIZE_FOR_SIZE
+// a stream of two 3.75 GiB bins followed by an invalid byte. the bin
+// contents are skipped rather than read, so they are never generated.
+#define TEST_HUGE_BIN UINT32_C(0xF0000000)
+
+typedef struct test_huge_stream_t {
+    uint64_t offset;
+} test_huge_stream_t;
+
+static char test_huge_stream_byte(uint64_t offset) {
+    static const char header[] = "\xc6\xf0\x00\x00\x00";
+    uint64_t element = 5 + (uint64_t)TEST_HUGE_BIN;
+    if (offset == 2 * element)
+        return (char)0xc1;
+    offset %= element;
+    return offset < 5 ? header[offset] : 0;
+}
+
+static size_t test_huge_stream_fill(mpack_reader_t* reader, char* buffer, size_t count) {
+    test_huge_stream_t* state = (test_huge_stream_t*)reader->context;
+    for (size_t i = 0; i < count; ++i)
+        buffer[i] = test_huge_stream_byte(state->offset++);
+    return count;
+}
+
+static void test_huge_stream_skip(mpack_reader_t* reader, size_t count) {
+    test_huge_stream_t* state = (test_huge_stream_t*)reader->context;
+    state->offset += count;
+}
+
+static void test_reader_error_position_huge(void) {
+    char buffer[MPACK_READER_MINIMUM_BUFFER_SIZE];
+    test_huge_stream_t state = {0};
+    mpack_reader_t reader;
+    mpack_reader_init(&reader, buffer, sizeof(buffer), 0);
+    mpack_reader_set_fill(&reader, test_huge_stream_fill);
+    mpack_reader_set_skip(&reader, test_huge_stream_skip);
+    mpack_reader_set_context(&reader, &state);
+    for (int i = 0; i < 2; ++i) {
+        mpack_tag_t tag = mpack_read_tag(&reader);
+        TEST_TRUE(tag.type == mpack_type_bin && tag.v.l == TEST_HUGE_BIN);
+        mpack_skip_bytes(&reader, tag.v.l);
+        mpack_done_bin(&reader);
+    }
+
+    // the offset is past 4 GiB, so it must not wrap even where size_t is 32 bits
+    uint64_t end = 2 * (5 + (uint64_t)TEST_HUGE_BIN);
+    TEST_TRUE(mpack_reader_error_position(&reader) == end);
+    mpack_read_tag(&reader);
+    TEST_TRUE(mpack_reader_error_position(&reader) == end);
+    TEST_READER_DESTROY_ERROR(&reader, mpack_error_invalid);
+}
+#endif
+
+// measures an object both as a whole and truncated at each byte
+#define TEST_MEASURE(data) do { \
+    size_t size_; \
+    TEST_TRUE(mpack_ok == mpack_measure_object(data "\xc0", sizeof(data), &size_)); \
+    TEST_TRUE(size_ == sizeof(data) - 1); \
+    for (size_t i_ = 0; i_ < sizeof(data) - 1; ++i_) { \
+        TEST_TRUE(mpack_error_io == mpack_measure_object(data, i_, &size_), \
+                "truncated at %i of %i", (int)i_, (int)(sizeof(data) - 1)); \
+        TEST_TRUE(size_ == 0); \
+    } \
+} while (0)
+
+static void test_reader_measure(void) {
+
+    // scalars
+    TEST_MEASURE("\x00");
+    TEST_MEASURE("\x7f");
+    TEST_MEASURE("\xe0");
+    TEST_MEASURE("\xc0");
+    TEST_MEASURE("\xc3");
+    TEST_MEASURE("\xcc\xff");
+    TEST_MEASURE("\xd1\x80\x00");
+    TEST_MEASURE("\xca\x00\x00\x00\x00");
+    TEST_MEASURE("\xcf\x00\x00\x00\x00\x00\x00\x00\x01");
+
+    // str, bin and ext
+    TEST_MEASURE("\xa3" "abc");
+    TEST_MEASURE("\xd9\x02" "ab");
+    TEST_MEASURE("\xda\x00\x02" "ab");
+    TEST_MEASURE("\xdb\x00\x00\x00\x02" "ab");
+    TEST_MEASURE("\xc4\x01" "a");
+    TEST_MEASURE("\xc5\x00\x00");
+    TEST_MEASURE("\xc6\x00\x00\x00\x01" "a");
+    TEST_MEASURE("\xd4\x01" "a");
+    TEST_MEASURE("\xd8\x01" "0123456789abcdef");
+    TEST_MEASURE("\xc7\x02\x01" "ab");
+    TEST_MEASURE("\xc8\x00\x02\x01" "ab");
+    TEST_MEASURE("\xc9\x00\x00\x00\x02\x01" "ab");
+
+    // containers
+    TEST_MEASURE("\x90");
+    TEST_MEASURE("\x80");
+    TEST_MEASURE("\x93\x01\xa1" "a" "\x91\x90");
+    TEST_MEASURE("\x82\xa1" "a" "\x01\xa1" "b" "\x81\x00\x92\xc2\xc3");
+    TEST_MEASURE("\xdc\x00\x02\x01\x02");
+    TEST_MEASURE("\xdd\x00\x00\x00\x01\xc0");
+    TEST_MEASURE("\xde\x00\x01\x01\x02");
+    TEST_MEASURE("\xdf\x00\x00\x00\x01\x01\xdc\x00\x00");
+    TEST_MEASURE("\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x91\x90");
+
+    // only the first object is measured
+    size_t size;
+    TEST_TRUE(mpack_ok == mpack_measure_object("\x92\x01\x02\x03\x04", 5, &size));
+    TEST_TRUE(size == 3);
+
+    // invalid data
+    TEST_TRUE(mpack_error_invalid == mpack_measure_object("\xc1", 1, &size));
+    TEST_TRUE(size == 0);
+    TEST_TRUE(mpack_error_invalid == mpack_measure_object("\x92\x01\xc1", 3, &size));
+    TEST_TRUE(size == 0);
+
+    // huge declared sizes are reported as truncated without overflowing
+    TEST_TRUE(mpack_error_io == mpack_measure_object("\xdd\xff\xff\xff\xff\x01", 6, &size));
+    TEST_TRUE(mpack_error_io == mpack_measure_object("\xdf\xff\xff\xff\xff\x01", 6, &size));
+    TEST_TRUE(mpack_error_io == mpack_measure_object("\xdb\xff\xff\xff\xff" "a", 6, &size));
+    TEST_TRUE(mpack_error_io == mpack_measure_object(NULL, 0, &size));
+}
+
+#if MPACK_NODE && defined(MPACK_MALLOC)
+// the measured size of each object in a stream matches its parsed size
+static void test_reader_measure_tree(void) {
+    static const char data[] =
+            "\x93\xa5" "hello" "\xcb\x3f\xf0\x00\x00\x00\x00\x00\x00" "\x81\x01\x92\xc0\xc2"
+            "\xc7\x03\x05" "abc" "\xd0\x80"
+            "\xde\x00\x02\xa1" "k" "\x90\xa1" "l" "\xc4\x02" "xy";
+    size_t pos = 0;
+    int objects = 0;
+    while (pos < sizeof(data) - 1) {
+        size_t size;
+        TEST_TRUE(mpack_ok == mpack_measure_object(data + pos, sizeof(data) - 1 - pos, &size));
+        mpack_tree_t tree;
+        mpack_tree_init(&tree, data + pos, sizeof(data) - 1 - pos);
+        TEST_TRUE(mpack_tree_error(&tree) == mpack_ok);
+        TEST_TRUE(mpack_tree_size(&tree) == size);
+        TEST_TRUE(mpack_tree_destroy(&tree) == mpack_ok);
+        pos += size;
+        ++objects;
+    }
+    TEST_TRUE(objects == 4);
+}
+#endif
+
+#if MPACK_STATS
+static void test_events_skip(mpack_reader_t* reader, size_t count) {
+    test_events_fill_t* state = (test_events_fill_t*)reader->context;
+    state->data += count;
+    state->remaining -= count;
+}
+
+static void test_reader_stats(void) {
+
+    // a data reader never fills
+    TEST_SIMPLE_READ("\x01", (mpack_read_tag(&reader),
+                mpack_reader_stats(&reader)->fill_calls == 0 &&
+                mpack_reader_stats(&reader)->straddles == 0));
+
+    static const char data[] = "\xa9" "abcdefghi" "\xa9" "jklmnopqr"
+            "\xd9\x28" "0123456789" "0123456789" "0123456789" "0123456789" "\x01";
+    char buffer[MPACK_READER_MINIMUM_BUFFER_SIZE];
+    char str[9];
+    test_events_fill_t state = {data, sizeof(data) - 1};
+    mpack_reader_t reader;
+    mpack_reader_init(&reader, buffer, sizeof(buffer), 0);
+    mpack_reader_set_fill(&reader, test_events_fill);
+    mpack_reader_set_skip(&reader, test_events_skip);
+    mpack_reader_set_context(&reader, &state);
+    for (int i = 0; i < 2; ++i) {
+        mpack_read_tag(&reader);
+        mpack_read_bytes(&reader, str, sizeof(str));
+        mpack_done_str(&reader);
+    }
+    TEST_TRUE(mpack_reader_stats(&reader)->fill_calls == 1);
+    TEST_TRUE(mpack_reader_stats(&reader)->fill_bytes == sizeof(buffer));
+    TEST_TRUE(mpack_reader_stats(&reader)->straddles == 1); // the first tag found an empty buffer
+
+    // the long str straddles the end of the buffer and is skipped
+    mpack_tag_t tag = mpack_read_tag(&reader);
+    TEST_TRUE(tag.type == mpack_type_str && tag.v.l == 40);
+    mpack_skip_bytes(&reader, tag.v.l);
+    mpack_done_str(&reader);
+    TEST_TRUE(mpack_tag_equal(mpack_read_tag(&reader), mpack_tag_uint(1)));
+    #if MPACK_OPTIMIZE_FOR_SIZE
+    // the skip is done by filling the buffer, which also fetches the next tag
+    TEST_TRUE(mpack_reader_stats(&reader)->straddles == 1);
+    TEST_TRUE(mpack_reader_stats(&reader)->skip_calls == 0);
+    TEST_TRUE(mpack_reader_stats(&reader)->fill_bytes == sizeof(data) - 1);
+    #else
+    TEST_TRUE(mpack_reader_stats(&reader)->straddles == 2);
+    TEST_TRUE(mpack_reader_stats(&reader)->skip_calls == 1);
+    TEST_TRUE(mpack_reader_stats(&reader)->fill_bytes + mpack_reader_stats(&reader)->skip_bytes == sizeof(data) - 1);
+    #endif
+    TEST_TRUE(mpack_reader_error_position(&reader) == sizeof(data) - 1);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
 void test_reader() {
     test_reader_should_inplace();
     test_reader_miscellaneous();
+    test_reader_events_data();
+    test_reader_events_fill();
+    test_reader_events_errors();
+    test_system_fail_until_ok(&test_reader_events_deep);
+    test_reader_project_basic();
+    test_reader_project_errors();
+    test_reader_error_position();
+    #if !MPACK_OPTIMIZE_FOR_SIZE
+    test_reader_error_position_huge();
+    #endif
+    test_reader_measure();
+    #if MPACK_NODE && defined(MPACK_MALLOC)
+    test_reader_measure_tree();
+    #endif
+    #if MPACK_STATS
+    test_reader_stats();
+    #endif
 }
 
 #endif
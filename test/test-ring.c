@@ -0,0 +1,597 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-ring.h"
+#include "test-system.h"
+
+#if MPACK_RING && MPACK_WRITER && MPACK_NODE
+
+#include <pthread.h>
+
+#if MPACK_SHARED_RING
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define TEST_RING_SIZE 512
+#define TEST_RING_NODES 16
+
+// message i is an array of its id, a string whose length varies, and
+// either nil or (every 13th message) a bin of 150 bytes. the bins are
+// larger than the space left at the end of the ring for many messages,
+// so they are often moved to the start.
+static void test_ring_write(mpack_writer_t* writer, uint32_t i) {
+    static const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.";
+    char bin[150];
+    mpack_start_array(writer, 3);
+    mpack_write_u32(writer, i);
+    mpack_write_str(writer, text, (i * 7) % (uint32_t)(sizeof(text) - 1));
+    if (i % 13 == 12) {
+        mpack_memset(bin, (int)(i & 0xff), sizeof(bin));
+        mpack_write_bin(writer, bin, sizeof(bin));
+    } else {
+        mpack_write_nil(writer);
+    }
+    mpack_finish_array(writer);
+}
+
+static bool test_ring_produce(mpack_ring_t* ring, uint32_t i) {
+    test_ring_write(mpack_ring_start(ring), i);
+    return mpack_ring_finish(ring) == mpack_ok;
+}
+
+// checks message i without the test framework, so that it can be used
+// from another thread
+static bool test_ring_tree_matches(mpack_tree_t* tree, uint32_t i) {
+    mpack_node_t root = mpack_tree_root(tree);
+    bool matches = mpack_node_array_length(root) == 3 &&
+        mpack_node_u32(mpack_node_array_at(root, 0)) == i &&
+        mpack_node_strlen(mpack_node_array_at(root, 1)) == (i * 7) % 56;
+    mpack_node_t last = mpack_node_array_at(root, 2);
+    if (i % 13 == 12) {
+        matches = matches && mpack_node_type(last) == mpack_type_bin &&
+            mpack_node_data_len(last) == 150 &&
+            (uint8_t)mpack_node_data(last)[149] == (uint8_t)(i & 0xff);
+    } else {
+        mpack_node_nil(last);
+    }
+    return mpack_tree_destroy(tree) == mpack_ok && matches;
+}
+
+static void test_ring_consume_tree(mpack_ring_t* ring, uint32_t i) {
+    mpack_node_data_t pool[TEST_RING_NODES];
+    mpack_tree_t tree;
+    mpack_ring_next_tree(ring, &tree, pool, TEST_RING_NODES);
+    TEST_TRUE(test_ring_tree_matches(&tree, i), "message %u does not match", (unsigned)i);
+}
+
+static void test_ring_consume_reader(mpack_ring_t* ring, uint32_t i) {
+    mpack_reader_t reader;
+    mpack_ring_next_reader(ring, &reader);
+    mpack_tag_t tag = mpack_read_tag(&reader);
+    TEST_TRUE(tag.type == mpack_type_array && tag.v.n == 3);
+    tag = mpack_read_tag(&reader);
+    TEST_TRUE(tag.type == mpack_type_uint && tag.v.u == i);
+    mpack_discard(&reader);
+    mpack_discard(&reader);
+    mpack_done_array(&reader);
+    TEST_TRUE(mpack_reader_remaining(&reader, NULL) == 0);
+    TEST_TRUE(mpack_reader_destroy(&reader) == mpack_ok);
+}
+
+static void test_ring_interleaved(void) {
+    uint64_t storage[TEST_RING_SIZE / sizeof(uint64_t)];
+    char* buffer = (char*)storage;
+    mpack_ring_t ring;
+    mpack_ring_init(&ring, buffer, TEST_RING_SIZE);
+
+    // each message is consumed as soon as it is produced
+    for (uint32_t i = 0; i < 2000; ++i) {
+        TEST_TRUE(test_ring_produce(&ring, i));
+        if (i % 2 == 0)
+            test_ring_consume_tree(&ring, i);
+        else
+            test_ring_consume_reader(&ring, i);
+    }
+
+    mpack_ring_close(&ring);
+    size_t size = 1;
+    TEST_TRUE(mpack_ring_next(&ring, &size) == NULL);
+    TEST_TRUE(size == 0);
+}
+
+static void test_ring_batches(void) {
+    uint64_t storage[TEST_RING_SIZE / sizeof(uint64_t)];
+    char* buffer = (char*)storage;
+    mpack_ring_t ring;
+    mpack_ring_init(&ring, buffer, TEST_RING_SIZE);
+
+    // several small messages are in the ring at once
+    uint32_t produced = 0, consumed = 0;
+    for (int batch = 0; batch < 500; ++batch) {
+        for (int j = 0; j < 1 + batch % 5; ++j) {
+            while (produced % 13 == 12)
+                ++produced; // skip the big ones
+            TEST_TRUE(test_ring_produce(&ring, produced++));
+        }
+        while (consumed < produced) {
+            if (consumed % 13 != 12)
+                test_ring_consume_tree(&ring, consumed);
+            ++consumed;
+        }
+    }
+
+    // messages finished before closing are still consumed
+    TEST_TRUE(test_ring_produce(&ring, 1000));
+    TEST_TRUE(test_ring_produce(&ring, 1001));
+    mpack_ring_close(&ring);
+    test_ring_consume_tree(&ring, 1000);
+    test_ring_consume_reader(&ring, 1001);
+
+    // then the end of the ring is reported
+    mpack_node_data_t pool[TEST_RING_NODES];
+    mpack_tree_t tree;
+    mpack_ring_next_tree(&ring, &tree, pool, TEST_RING_NODES);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_data);
+    mpack_reader_t reader;
+    mpack_ring_next_reader(&ring, &reader);
+    TEST_TRUE(mpack_reader_destroy(&reader) == mpack_error_data);
+
+    // and no more messages can be produced
+    mpack_writer_t* writer = mpack_ring_start(&ring);
+    TEST_TRUE(mpack_writer_error(writer) == mpack_error_io);
+    TEST_TRUE(mpack_ring_finish(&ring) == mpack_error_io);
+}
+
+static void test_ring_sizes(void) {
+    uint64_t storage[TEST_RING_SIZE / sizeof(uint64_t)];
+    char* buffer = (char*)storage;
+    mpack_ring_t ring;
+    mpack_ring_init(&ring, buffer, TEST_RING_SIZE);
+
+    // the largest guaranteed message fits wherever it starts
+    static const char bin[TEST_RING_SIZE] = {0};
+    size_t largest = TEST_RING_SIZE / 2 - MPACK_RING_HEADER_SIZE - MPACK_WRITER_MINIMUM_BUFFER_SIZE;
+    for (uint32_t i = 0; i < 200; ++i) {
+        mpack_writer_t* writer = mpack_ring_start(&ring);
+        mpack_write_u32(writer, i);
+        TEST_TRUE(mpack_ring_finish(&ring) == mpack_ok);
+
+        writer = mpack_ring_start(&ring);
+        mpack_write_bin(writer, bin, (uint32_t)largest - 2);
+        TEST_TRUE(mpack_ring_finish(&ring) == mpack_ok);
+
+        size_t size;
+        const char* data = mpack_ring_next(&ring, &size);
+        TEST_TRUE(data != NULL && size == (i < 128 ? 1u : 2u));
+        data = mpack_ring_next(&ring, &size);
+        TEST_TRUE(data != NULL && size == largest);
+    }
+
+    // a message larger than the ring fails without affecting the ring
+    mpack_writer_t* writer = mpack_ring_start(&ring);
+    mpack_write_bin(writer, bin, TEST_RING_SIZE);
+    TEST_TRUE(mpack_writer_error(writer) == mpack_error_too_big);
+    TEST_TRUE(mpack_ring_finish(&ring) == mpack_error_too_big);
+
+    // so does a message with an error
+    writer = mpack_ring_start(&ring);
+    mpack_write_cstr(writer, "discarded");
+    mpack_writer_flag_error(writer, mpack_error_data);
+    TEST_TRUE(mpack_ring_finish(&ring) == mpack_error_data);
+
+    TEST_TRUE(test_ring_produce(&ring, 7));
+    test_ring_consume_tree(&ring, 7);
+
+    // a message that isn't exactly one object is invalid as a tree
+    writer = mpack_ring_start(&ring);
+    mpack_write_nil(writer);
+    mpack_write_nil(writer);
+    TEST_TRUE(mpack_ring_finish(&ring) == mpack_ok);
+    mpack_node_data_t pool[TEST_RING_NODES];
+    mpack_tree_t tree;
+    mpack_ring_next_tree(&ring, &tree, pool, TEST_RING_NODES);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_invalid);
+
+    // a message waiting for space fails once the ring is closed
+    for (int i = 0; i < 3; ++i) {
+        writer = mpack_ring_start(&ring);
+        mpack_write_bin(writer, bin, 100);
+        TEST_TRUE(mpack_ring_finish(&ring) == mpack_ok);
+    }
+    writer = mpack_ring_start(&ring);
+    mpack_ring_close(&ring);
+    mpack_write_bin(writer, bin, 200);
+    TEST_TRUE(mpack_ring_finish(&ring) == mpack_error_io);
+    size_t size;
+    for (int i = 0; i < 3; ++i)
+        TEST_TRUE(mpack_ring_next(&ring, &size) != NULL && size == 102);
+    TEST_TRUE(mpack_ring_next(&ring, &size) == NULL);
+}
+
+#define TEST_RING_THREAD_COUNT 20000
+
+static void* test_ring_producer(void* context) {
+    mpack_ring_t* ring = (mpack_ring_t*)context;
+    uintptr_t failures = 0;
+    for (uint32_t i = 0; i < TEST_RING_THREAD_COUNT; ++i)
+        if (!test_ring_produce(ring, i))
+            ++failures;
+    mpack_ring_close(ring);
+    return (void*)failures;
+}
+
+static void test_ring_threads(void) {
+    uint64_t storage[1024 / sizeof(uint64_t)];
+    char* buffer = (char*)storage;
+    mpack_ring_t ring;
+    mpack_ring_init(&ring, buffer, 1024);
+
+    // the producer allocates (for write tracking), which counts test
+    // checks, so the consumer doesn't run any checks until it is joined
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, test_ring_producer, &ring) != 0) {
+        TEST_TRUE(false, "failed to start producer thread");
+        return;
+    }
+
+    mpack_node_data_t pool[TEST_RING_NODES];
+    uint32_t consumed = 0;
+    bool matches = true;
+    for (;;) {
+        mpack_tree_t tree;
+        mpack_ring_next_tree(&ring, &tree, pool, TEST_RING_NODES);
+        if (mpack_tree_error(&tree) == mpack_error_data) {
+            mpack_tree_destroy(&tree);
+            break;
+        }
+        if (!test_ring_tree_matches(&tree, consumed++))
+            matches = false;
+    }
+
+    void* failures;
+    TEST_TRUE(pthread_join(thread, &failures) == 0);
+    TEST_TRUE(failures == NULL);
+    TEST_TRUE(matches);
+    TEST_TRUE(consumed == TEST_RING_THREAD_COUNT);
+}
+
+#if MPACK_SHARED_RING
+
+#define TEST_SHARED_RING_PRODUCERS 3
+#define TEST_SHARED_RING_COUNT 3000
+
+static int test_shared_ring_fd(void) {
+    return (int)syscall(SYS_memfd_create, "mpack-test-ring", 0);
+}
+
+static bool test_shared_ring_produce(mpack_shared_ring_t* ring, uint32_t i) {
+    test_ring_write(mpack_shared_ring_start(ring), i);
+    return mpack_shared_ring_finish(ring) == mpack_ok;
+}
+
+static void test_shared_ring_sleep(void) {
+    struct timespec duration = {0, 50 * 1000 * 1000};
+    nanosleep(&duration, NULL);
+}
+
+static void test_shared_ring_single(void) {
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+
+    // separate handles for the producer and consumer of one segment
+    mpack_shared_ring_t producer, consumer;
+    TEST_TRUE(mpack_shared_ring_create(&producer, fd, TEST_RING_SIZE) == mpack_ok);
+    TEST_TRUE(mpack_shared_ring_open(&consumer, fd) == mpack_ok);
+
+    mpack_node_data_t pool[TEST_RING_NODES];
+    for (uint32_t i = 0; i < 2000; ++i) {
+        TEST_TRUE(test_shared_ring_produce(&producer, i));
+        if (i % 2 == 0) {
+            mpack_tree_t tree;
+            mpack_shared_ring_next_tree(&consumer, &tree, pool, TEST_RING_NODES);
+            TEST_TRUE(test_ring_tree_matches(&tree, i), "message %u does not match", (unsigned)i);
+        } else {
+            mpack_reader_t reader;
+            mpack_shared_ring_next_reader(&consumer, &reader);
+            TEST_TRUE(mpack_expect_array(&reader) == 3);
+            TEST_TRUE(mpack_expect_u32(&reader) == i);
+            mpack_discard(&reader);
+            mpack_discard(&reader);
+            mpack_done_array(&reader);
+            TEST_TRUE(mpack_reader_destroy(&reader) == mpack_ok);
+        }
+    }
+
+    // a message larger than the ring fails without affecting the ring
+    static const char bin[TEST_RING_SIZE] = {0};
+    mpack_writer_t* writer = mpack_shared_ring_start(&producer);
+    mpack_write_bin(writer, bin, TEST_RING_SIZE);
+    TEST_TRUE(mpack_shared_ring_finish(&producer) == mpack_error_too_big);
+
+    // messages finished before closing are still consumed
+    TEST_TRUE(test_shared_ring_produce(&producer, 5000));
+    mpack_shared_ring_close(&consumer);
+    size_t size;
+    TEST_TRUE(mpack_shared_ring_next(&consumer, &size) != NULL && size > 0);
+    TEST_TRUE(mpack_shared_ring_next(&consumer, &size) == NULL && size == 0);
+    mpack_tree_t tree;
+    mpack_shared_ring_next_tree(&consumer, &tree, pool, TEST_RING_NODES);
+    TEST_TRUE(mpack_tree_destroy(&tree) == mpack_error_data);
+    TEST_TRUE(mpack_shared_ring_error(&consumer) == mpack_ok);
+
+    writer = mpack_shared_ring_start(&producer);
+    TEST_TRUE(mpack_writer_error(writer) == mpack_error_io);
+    TEST_TRUE(mpack_shared_ring_finish(&producer) == mpack_error_io);
+
+    mpack_shared_ring_destroy(&producer);
+    mpack_shared_ring_destroy(&consumer);
+    close(fd);
+}
+
+// Overwrites the size header of a committed message with the given value
+// and checks that the consumer closes the ring rather than returning it.
+static void test_shared_ring_corrupt_header(uint32_t header) {
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+    mpack_shared_ring_t producer, consumer;
+    TEST_TRUE(mpack_shared_ring_create(&producer, fd, TEST_RING_SIZE) == mpack_ok);
+    TEST_TRUE(mpack_shared_ring_open(&consumer, fd) == mpack_ok);
+
+    // the second message's header follows the first message
+    TEST_TRUE(test_shared_ring_produce(&producer, 1));
+    TEST_TRUE(test_shared_ring_produce(&producer, 2));
+    size_t size;
+    const char* first = mpack_shared_ring_next(&consumer, &size);
+    TEST_TRUE(first != NULL);
+    size_t aligned = (size + MPACK_RING_HEADER_SIZE - 1) & ~(size_t)(MPACK_RING_HEADER_SIZE - 1);
+    mpack_memcpy((char*)first + aligned, &header, sizeof(header));
+
+    TEST_TRUE(mpack_shared_ring_error(&consumer) == mpack_ok);
+    TEST_TRUE(mpack_shared_ring_next(&consumer, &size) == NULL && size == 0);
+    TEST_TRUE(mpack_shared_ring_error(&consumer) == mpack_error_invalid);
+    TEST_TRUE(mpack_shared_ring_error(&producer) == mpack_error_invalid);
+    mpack_reader_t reader;
+    mpack_shared_ring_next_reader(&consumer, &reader);
+    TEST_TRUE(mpack_reader_destroy(&reader) == mpack_error_invalid);
+
+    mpack_writer_t* writer = mpack_shared_ring_start(&producer);
+    TEST_TRUE(mpack_writer_error(writer) == mpack_error_io);
+    TEST_TRUE(mpack_shared_ring_finish(&producer) == mpack_error_io);
+
+    mpack_shared_ring_destroy(&producer);
+    mpack_shared_ring_destroy(&consumer);
+    close(fd);
+}
+
+static void test_shared_ring_corrupt(void) {
+    test_shared_ring_corrupt_header(UINT32_MAX - 1); // past the end of the buffer
+    test_shared_ring_corrupt_header(TEST_RING_SIZE / 2); // past the committed data
+    test_shared_ring_corrupt_header(UINT32_MAX); // wrap marker before the end
+}
+
+static void test_shared_ring_open_invalid(void) {
+    mpack_shared_ring_t ring;
+    TEST_TRUE(mpack_shared_ring_open(&ring, -1) == mpack_error_io);
+    mpack_shared_ring_destroy(&ring);
+
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+
+    // too small
+    TEST_TRUE(ftruncate(fd, 100) == 0);
+    TEST_TRUE(mpack_shared_ring_open(&ring, fd) == mpack_error_invalid);
+    mpack_shared_ring_destroy(&ring);
+
+    // not a ring
+    TEST_TRUE(ftruncate(fd, 4096) == 0);
+    TEST_TRUE(mpack_shared_ring_open(&ring, fd) == mpack_error_invalid);
+    mpack_shared_ring_destroy(&ring);
+
+    // a ring whose segment was truncated
+    TEST_TRUE(mpack_shared_ring_create(&ring, fd, 4096) == mpack_ok);
+    mpack_shared_ring_destroy(&ring);
+    TEST_TRUE(ftruncate(fd, 4096) == 0);
+    TEST_TRUE(mpack_shared_ring_open(&ring, fd) == mpack_error_invalid);
+    mpack_shared_ring_destroy(&ring);
+
+    close(fd);
+}
+
+// Runs the given function in a child process, returning its pid. The
+// child opens its own handle on the ring, and exits with a status of
+// zero if the function returns true.
+static pid_t test_shared_ring_fork(int fd, uint32_t id, bool (*child)(mpack_shared_ring_t* ring, uint32_t id)) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        mpack_shared_ring_t ring;
+        bool ok = mpack_shared_ring_open(&ring, fd) == mpack_ok && child(&ring, id);
+        mpack_shared_ring_destroy(&ring);
+        _exit(ok ? 0 : 1);
+    }
+    return pid;
+}
+
+static bool test_shared_ring_wait(pid_t pid) {
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static bool test_shared_ring_producer(mpack_shared_ring_t* ring, uint32_t id) {
+    bool ok = true;
+    for (uint32_t i = 0; i < TEST_SHARED_RING_COUNT; ++i)
+        if (!test_shared_ring_produce(ring, id * TEST_SHARED_RING_COUNT + i))
+            ok = false;
+    return ok;
+}
+
+static void test_shared_ring_processes(void) {
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+    mpack_shared_ring_t ring;
+    TEST_TRUE(mpack_shared_ring_create(&ring, fd, 1024) == mpack_ok);
+
+    // several processes produce into a small ring at once, so they wait
+    // on each other and on the consumer
+    pid_t pids[TEST_SHARED_RING_PRODUCERS];
+    for (uint32_t i = 0; i < TEST_SHARED_RING_PRODUCERS; ++i)
+        pids[i] = test_shared_ring_fork(fd, i, test_shared_ring_producer);
+
+    // messages from each producer arrive in order
+    uint32_t next[TEST_SHARED_RING_PRODUCERS] = {0};
+    mpack_node_data_t pool[TEST_RING_NODES];
+    bool matches = true;
+    for (int i = 0; i < TEST_SHARED_RING_PRODUCERS * TEST_SHARED_RING_COUNT; ++i) {
+        mpack_tree_t tree;
+        mpack_shared_ring_next_tree(&ring, &tree, pool, TEST_RING_NODES);
+        uint32_t id = mpack_node_u32(mpack_node_array_at(mpack_tree_root(&tree), 0));
+        uint32_t producer = id / TEST_SHARED_RING_COUNT;
+        if (mpack_tree_error(&tree) != mpack_ok || producer >= TEST_SHARED_RING_PRODUCERS ||
+                id != producer * TEST_SHARED_RING_COUNT + next[producer]++ ||
+                !test_ring_tree_matches(&tree, id))
+        {
+            mpack_tree_destroy(&tree);
+            matches = false;
+            break;
+        }
+    }
+    TEST_TRUE(matches);
+
+    // the producers have finished all of their messages, so closing the
+    // ring only stops them on failure
+    mpack_shared_ring_close(&ring);
+    for (int i = 0; i < TEST_SHARED_RING_PRODUCERS; ++i)
+        TEST_TRUE(test_shared_ring_wait(pids[i]));
+
+    size_t size;
+    TEST_TRUE(mpack_shared_ring_next(&ring, &size) == NULL);
+    mpack_shared_ring_destroy(&ring);
+    close(fd);
+}
+
+static bool test_shared_ring_closer(mpack_shared_ring_t* ring, uint32_t id) {
+    MPACK_UNUSED(id);
+    test_shared_ring_sleep();
+    mpack_shared_ring_close(ring);
+    return true;
+}
+
+// produces until the ring is closed
+static bool test_shared_ring_flood(mpack_shared_ring_t* ring, uint32_t id) {
+    for (uint32_t i = id;; ++i) {
+        mpack_writer_t* writer = mpack_shared_ring_start(ring);
+        test_ring_write(writer, i);
+        mpack_error_t error = mpack_shared_ring_finish(ring);
+        if (error != mpack_ok)
+            return error == mpack_error_io;
+    }
+}
+
+static void test_shared_ring_close(void) {
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+    mpack_shared_ring_t ring;
+    TEST_TRUE(mpack_shared_ring_create(&ring, fd, 1024) == mpack_ok);
+
+    // a consumer sleeping on an empty ring is woken when it's closed
+    pid_t pid = test_shared_ring_fork(fd, 0, test_shared_ring_closer);
+    size_t size;
+    TEST_TRUE(mpack_shared_ring_next(&ring, &size) == NULL);
+    TEST_TRUE(test_shared_ring_wait(pid));
+    mpack_shared_ring_destroy(&ring);
+
+    // and so is a producer sleeping on a full ring
+    TEST_TRUE(mpack_shared_ring_create(&ring, fd, 1024) == mpack_ok);
+    pid = test_shared_ring_fork(fd, 0, test_shared_ring_flood);
+    TEST_TRUE(mpack_shared_ring_next(&ring, &size) != NULL);
+    test_shared_ring_sleep();
+    mpack_shared_ring_close(&ring);
+    TEST_TRUE(test_shared_ring_wait(pid));
+    mpack_shared_ring_destroy(&ring);
+
+    close(fd);
+}
+
+// starts a message and dies without finishing it, leaving the ring locked
+static bool test_shared_ring_abandon(mpack_shared_ring_t* ring, uint32_t id) {
+    test_ring_write(mpack_shared_ring_start(ring), id);
+    _exit(0);
+}
+
+// waits for the lock until the ring is closed
+static bool test_shared_ring_blocked(mpack_shared_ring_t* ring, uint32_t id) {
+    test_ring_write(mpack_shared_ring_start(ring), id);
+    return mpack_shared_ring_finish(ring) == mpack_error_io;
+}
+
+static void test_shared_ring_dead_producer(void) {
+    int fd = test_shared_ring_fd();
+    TEST_TRUE(fd != -1);
+    mpack_shared_ring_t ring;
+    TEST_TRUE(mpack_shared_ring_create(&ring, fd, 1024) == mpack_ok);
+
+    // the lock of a producer that died is taken over, and its unfinished
+    // message is dropped
+    TEST_TRUE(test_shared_ring_wait(test_shared_ring_fork(fd, 1, test_shared_ring_abandon)));
+    TEST_TRUE(test_shared_ring_produce(&ring, 2));
+    mpack_node_data_t pool[TEST_RING_NODES];
+    mpack_tree_t tree;
+    mpack_shared_ring_next_tree(&ring, &tree, pool, TEST_RING_NODES);
+    TEST_TRUE(test_ring_tree_matches(&tree, 2));
+
+    // a producer waiting for the lock held by a live one is woken when the
+    // ring is closed
+    mpack_writer_t* writer = mpack_shared_ring_start(&ring);
+    pid_t pid = test_shared_ring_fork(fd, 3, test_shared_ring_blocked);
+    test_shared_ring_sleep();
+    mpack_shared_ring_close(&ring);
+    TEST_TRUE(test_shared_ring_wait(pid));
+    test_ring_write(writer, 4);
+    TEST_TRUE(mpack_shared_ring_finish(&ring) == mpack_ok);
+
+    size_t size;
+    TEST_TRUE(mpack_shared_ring_next(&ring, &size) != NULL);
+    TEST_TRUE(mpack_shared_ring_next(&ring, &size) == NULL);
+    mpack_shared_ring_destroy(&ring);
+    close(fd);
+}
+
+#endif
+
+void test_ring(void) {
+    test_ring_interleaved();
+    test_ring_batches();
+    test_ring_sizes();
+    test_ring_threads();
+    #if MPACK_SHARED_RING
+    test_shared_ring_single();
+    test_shared_ring_corrupt();
+    test_shared_ring_open_invalid();
+    test_shared_ring_processes();
+    test_shared_ring_close();
+    test_shared_ring_dead_producer();
+    #endif
+}
+
+#endif
+
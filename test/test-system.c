@@ -19,6 +19,11 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+// test_fseek64() needs a 64-bit off_t for fseeko() on 32-bit platforms
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
 // We need to include test.h here instead of test-system.h because
 // test-system.h is included within the mpack-config.h.
 #include "test.h"
@@ -171,6 +176,13 @@ void test_free(void* p) {
 #undef fwrite
 #undef fseek
 #undef ftell
+#ifdef _WIN32
+#undef _fseeki64
+#undef _ftelli64
+#else
+#undef fseeko
+#undef ftello
+#endif
 #undef ferror
 
 static size_t test_files_active = 0;
@@ -252,6 +264,36 @@ long test_ftell(FILE* stream) {
     return ftell(stream);
 }
 
+int test_fseek64(FILE* stream, int64_t offset, int whence) {
+    TEST_TRUE(stream != NULL);
+
+    if (test_system_should_fail()) {
+        errno = EACCES;
+        return -1;
+    }
+
+    #ifdef _WIN32
+    return _fseeki64(stream, offset, whence);
+    #else
+    return fseeko(stream, (off_t)offset, whence);
+    #endif
+}
+
+int64_t test_ftell64(FILE* stream) {
+    TEST_TRUE(stream != NULL);
+
+    if (test_system_should_fail()) {
+        errno = EACCES;
+        return -1;
+    }
+
+    #ifdef _WIN32
+    return _ftelli64(stream);
+    #else
+    return ftello(stream);
+    #endif
+}
+
 int test_ferror(FILE * stream) {
     TEST_TRUE(stream != NULL);
 
@@ -24,6 +24,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +72,8 @@ size_t test_fread(void* ptr, size_t size, size_t nmemb, FILE* stream);
 size_t test_fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream);
 int test_fseek(FILE* stream, long offset, int whence);
 long test_ftell(FILE* stream);
+int test_fseek64(FILE* stream, int64_t offset, int whence);
+int64_t test_ftell64(FILE* stream);
 int test_ferror(FILE* stream);
 
 // Returns the number of files that have not yet been closed.
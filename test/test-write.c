@@ -20,6 +20,7 @@
  */
 
 #include "test-write.h"
+#include "test-reader.h"
 #include "test.h"
 
 #if MPACK_WRITER
@@ -679,7 +680,12 @@ static bool test_write_deep_growth(void) {
     TEST_TRUE(test_write_error == mpack_ok);
     mpack_writer_set_error_handler(&writer, test_write_error_handler);
 
+    #if MPACK_WRITE_TRACKING && MPACK_TRACKING_INLINE_DEPTH
+    // stay within the fixed depth of the inline tracking stack
+    const int depth = MPACK_TRACKING_INLINE_DEPTH - 1;
+    #else
     const int depth = 40;
+    #endif
     const int nums = 1000;
 
     for (int i = 0; i < depth; ++i) {
@@ -716,6 +722,178 @@ static bool test_write_deep_growth(void) {
     return true;
 
 }
+
+// encodes the given range of a sharded array's elements
+static void test_write_sharded_elements(mpack_writer_t* writer, uint32_t first, uint32_t elements) {
+    for (uint32_t i = first; i < first + elements; ++i) {
+        if (i % 3 == 0)
+            mpack_write_u32(writer, i);
+        else
+            mpack_write_cstr(writer, "element");
+    }
+}
+
+static void test_write_sharded_array_case(uint32_t count, size_t shard_count) {
+
+    // encode the expected array directly
+    char* expected;
+    size_t expected_size;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &expected, &expected_size);
+    mpack_start_array(&writer, count);
+    test_write_sharded_elements(&writer, 0, count);
+    mpack_finish_array(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    // encode it in shards, finishing them out of order
+    mpack_sharded_array_t array;
+    mpack_sharded_array_init(&array, count, shard_count);
+    TEST_TRUE(mpack_sharded_array_shard_count(&array) == shard_count);
+    uint32_t first = 0;
+    for (size_t i = 0; i < shard_count; ++i) {
+        TEST_TRUE(mpack_sharded_array_first(&array, i) == first);
+        first += mpack_sharded_array_elements(&array, i);
+        mpack_writer_t* shard_writer = mpack_sharded_array_start(&array, i);
+        test_write_sharded_elements(shard_writer, mpack_sharded_array_first(&array, i),
+                mpack_sharded_array_elements(&array, i));
+    }
+    TEST_TRUE(first == count);
+    for (size_t i = shard_count; i > 0; --i)
+        TEST_TRUE(mpack_sharded_array_finish(&array, i - 1) == mpack_ok);
+
+    // the buffers concatenate to the expected array
+    TEST_TRUE(mpack_sharded_array_buffer_count(&array) == shard_count + 1);
+    size_t offset = 0;
+    for (size_t i = 0; i < shard_count + 1; ++i) {
+        size_t size;
+        const char* data = mpack_sharded_array_buffer(&array, i, &size);
+        TEST_TRUE(size <= expected_size - offset);
+        if (size > 0)
+            TEST_TRUE(memcmp(data, expected + offset, size) == 0);
+        offset += size;
+    }
+    TEST_TRUE(offset == expected_size);
+
+    // writing it as an element matches as well
+    char* buf;
+    size_t size;
+    mpack_writer_init_growable(&writer, &buf, &size);
+    mpack_start_array(&writer, 2);
+    mpack_sharded_array_write(&array, &writer);
+    mpack_write_nil(&writer);
+    mpack_finish_array(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == expected_size + 2);
+    TEST_TRUE(memcmp(buf + 1, expected, expected_size) == 0);
+    MPACK_FREE(buf);
+
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_ok);
+    MPACK_FREE(expected);
+}
+
+static void test_write_sharded_array(void) {
+    static const uint32_t counts[] = {0, 1, 15, 16, 1000, 70000};
+    static const size_t shard_counts[] = {1, 3, 7, 20};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+        for (size_t j = 0; j < sizeof(shard_counts) / sizeof(shard_counts[0]); ++j)
+            test_write_sharded_array_case(counts[i], shard_counts[j]);
+
+    char buf[64];
+    mpack_writer_t writer;
+    mpack_sharded_array_t array;
+
+    // an error in a shard is the error of the array
+    mpack_sharded_array_init(&array, 10, 2);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 0), 0, 5);
+    mpack_writer_flag_error(mpack_sharded_array_start(&array, 1), mpack_error_data);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 0) == mpack_ok);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 1) == mpack_error_data);
+    TEST_TRUE(mpack_sharded_array_error(&array) == mpack_error_data);
+    TEST_TRUE(mpack_sharded_array_buffer_count(&array) == 0);
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    mpack_sharded_array_write(&array, &writer);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_data);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_error_data);
+
+    // unfinished shards are cancelled on destroy
+    mpack_sharded_array_init(&array, 10, 3);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 1), 3, 2);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_error_data);
+
+    // a shard that doesn't fit in the output writer's buffer
+    mpack_sharded_array_init(&array, 100, 1);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 0), 0, 100);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 0) == mpack_ok);
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    mpack_sharded_array_write(&array, &writer);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_too_big);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_ok);
+
+    // writing before all shards are finished
+    mpack_sharded_array_init(&array, 10, 2);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 0), 0, 5);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 0) == mpack_ok);
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    TEST_BREAK((mpack_sharded_array_write(&array, &writer), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_bug);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_error_bug);
+
+    // finishing a shard twice
+    mpack_sharded_array_init(&array, 10, 1);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 0), 0, 10);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 0) == mpack_ok);
+    TEST_BREAK(mpack_sharded_array_finish(&array, 0) == mpack_error_bug);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_ok);
+
+    // no shards
+    TEST_BREAK((mpack_sharded_array_init(&array, 10, 0), true));
+    TEST_TRUE(mpack_sharded_array_shard_count(&array) == 0);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_error_bug);
+
+    #if MPACK_WRITE_TRACKING
+    // writing the wrong number of elements to a shard
+    mpack_sharded_array_init(&array, 10, 2);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 0), 0, 4);
+    TEST_BREAK(mpack_sharded_array_finish(&array, 0) == mpack_error_bug);
+    test_write_sharded_elements(mpack_sharded_array_start(&array, 1), 5, 5);
+    TEST_TRUE(mpack_sharded_array_finish(&array, 1) == mpack_ok);
+    TEST_TRUE(mpack_sharded_array_error(&array) == mpack_error_bug);
+    TEST_TRUE(mpack_sharded_array_destroy(&array) == mpack_error_bug);
+    #endif
+}
+
+static bool test_write_sharded_array_failure(void) {
+
+    // the array and every shard must handle allocation failure. we allow
+    // mpack_error_memory as an error (since it will be simulated by the
+    // failure system.)
+
+    mpack_sharded_array_t array;
+    mpack_sharded_array_init(&array, 300, 3);
+    for (size_t i = 0; i < mpack_sharded_array_shard_count(&array); ++i) {
+        test_write_sharded_elements(mpack_sharded_array_start(&array, i),
+                mpack_sharded_array_first(&array, i), mpack_sharded_array_elements(&array, i));
+        mpack_sharded_array_finish(&array, i);
+    }
+
+    char* buf;
+    size_t size;
+    mpack_writer_t writer;
+    mpack_writer_init_growable(&writer, &buf, &size);
+    mpack_sharded_array_write(&array, &writer);
+    mpack_error_t writer_error = mpack_writer_destroy(&writer);
+    mpack_error_t error = mpack_sharded_array_destroy(&array);
+
+    if (error == mpack_error_memory || writer_error == mpack_error_memory) {
+        TEST_TRUE(buf == NULL);
+        return false;
+    }
+    TEST_TRUE(error == mpack_ok, "unexpected error state %i (%s)", (int)error, mpack_error_to_string(error));
+    TEST_TRUE(writer_error == mpack_ok, "unexpected error state %i (%s)",
+            (int)writer_error, mpack_error_to_string(writer_error));
+    MPACK_FREE(buf);
+    return true;
+}
 #endif
 
 #if MPACK_WRITE_TRACKING
@@ -744,13 +922,24 @@ static void test_write_tracking() {
     // writing elements in a string
     mpack_writer_init(&writer, buf, sizeof(buf));
     mpack_start_str(&writer, 50);
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // elements are only checked when an inline tracked type is closed
+    mpack_write_nil(&writer);
+    TEST_BREAK((mpack_finish_str(&writer), true));
+    #else
     TEST_BREAK((mpack_write_nil(&writer), true));
+    #endif
     TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_bug);
 
     // writing too many elements
     mpack_writer_init(&writer, buf, sizeof(buf));
     mpack_start_array(&writer, 0);
+    #if MPACK_TRACKING_INLINE_DEPTH
+    mpack_write_nil(&writer);
+    TEST_BREAK((mpack_finish_array(&writer), true));
+    #else
     TEST_BREAK((mpack_write_nil(&writer), true));
+    #endif
     TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_bug);
 
     // writing bytes with nothing open
@@ -770,6 +959,24 @@ static void test_write_tracking() {
     TEST_BREAK((mpack_write_bytes(&writer, "test", 4), true));
     TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_bug);
 
+    #if MPACK_TRACKING_INLINE_DEPTH
+    // an element too many in a nested array is not counted by its parent
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    mpack_start_array(&writer, 2);
+    mpack_start_array(&writer, 1);
+    mpack_write_nil(&writer);
+    mpack_write_nil(&writer);
+    TEST_BREAK((mpack_finish_array(&writer), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_bug);
+
+    // nesting deeper than the inline stack
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    for (int i = 0; i < MPACK_TRACKING_INLINE_DEPTH; ++i)
+        mpack_start_array(&writer, 1);
+    TEST_TRUE(mpack_writer_error(&writer) == mpack_ok);
+    mpack_start_array(&writer, 1);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_too_big);
+    #endif
 }
 #endif
 
@@ -856,8 +1063,170 @@ static void test_misc(void) {
     mpack_write_cstr(&writer, "The quick brown fox jumps over the lazy dog.");
     TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_too_big);
 
+    // a writer in an error state has no buffer, so empty and non-empty
+    // data must both be skipped
+    mpack_writer_init_error(&writer, mpack_error_io);
+    mpack_write_str(&writer, "", 0);
+    mpack_write_bin(&writer, "", 0);
+    mpack_write_ext(&writer, 1, "", 0);
+    mpack_write_str(&writer, "abc", 3);
+    mpack_write_bin(&writer, "abc", 3);
+    mpack_write_ext(&writer, 1, "abc", 3);
+    TEST_WRITER_DESTROY_ERROR(&writer, mpack_error_io);
+
+}
+
+typedef struct test_write_point_t {
+    int32_t x;
+    uint8_t y;
+} test_write_point_t;
+
+typedef struct test_write_shape_t {
+    bool closed;
+    char name[8];
+    double scale;
+    test_write_point_t origin;
+} test_write_shape_t;
+
+static const mpack_field_t test_write_point_fields[] = {
+    MPACK_FIELD(test_write_point_t, x, mpack_field_i32, 0),
+    MPACK_FIELD(test_write_point_t, y, mpack_field_u8, 0),
+};
+static const mpack_struct_t test_write_point_desc = MPACK_STRUCT(test_write_point_fields);
+
+static const mpack_field_t test_write_shape_fields[] = {
+    MPACK_FIELD(test_write_shape_t, closed, mpack_field_bool, 0),
+    MPACK_FIELD(test_write_shape_t, name, mpack_field_utf8_cstr, 0),
+    MPACK_FIELD(test_write_shape_t, scale, mpack_field_double, MPACK_FIELD_OPTIONAL),
+    MPACK_FIELD_STRUCT(test_write_shape_t, origin, test_write_point_desc, 0),
+};
+static const mpack_struct_t test_write_shape_desc = MPACK_STRUCT(test_write_shape_fields);
+
+static void test_write_object_bytes(void) {
+    char buf[4096];
+
+    // pre-encoded objects count as one element each
+    TEST_SIMPLE_WRITE("\x82\xA3""key\x91\xC0\xA1k\x01", (
+                mpack_start_map(&writer, 2),
+                mpack_write_object_bytes(&writer, "\xA3""key", 4),
+                mpack_write_object_bytes(&writer, "\x91\xC0", 2),
+                mpack_write_object_bytes(&writer, "\xA1k", 2),
+                mpack_write_u8(&writer, 1),
+                mpack_finish_map(&writer)));
+}
+
+// writes the given shape and, if possible, reads it back unchanged
+static void test_write_struct_round_trip(const test_write_shape_t* shape) {
+    char buf[256];
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buf, sizeof(buf));
+    mpack_write_struct(&writer, &test_write_shape_desc, shape);
+    size_t used = mpack_writer_buffer_used(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    #if MPACK_EXPECT
+    test_write_shape_t decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    mpack_reader_t reader;
+    mpack_reader_init_data(&reader, buf, used);
+    mpack_expect_struct(&reader, &test_write_shape_desc, &decoded);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_TRUE(memcmp(decoded.name, shape->name, sizeof(shape->name)) == 0);
+    TEST_TRUE(decoded.closed == shape->closed && decoded.scale == shape->scale);
+    TEST_TRUE(decoded.origin.x == shape->origin.x && decoded.origin.y == shape->origin.y);
+    #else
+    MPACK_UNUSED(used);
+    #endif
+}
+
+static void test_write_struct(void) {
+    char buf[4096];
+
+    test_write_point_t point;
+    point.x = -2;
+    point.y = 200;
+    TEST_SIMPLE_WRITE("\x82\xA1x\xFE\xA1y\xCC\xC8",
+            mpack_write_struct(&writer, &test_write_point_desc, &point));
+
+    test_write_shape_t shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.closed = true;
+    strcpy(shape.name, "tri");
+    shape.scale = 0.5;
+    shape.origin = point;
+    TEST_SIMPLE_WRITE("\x84\xA6""closed\xC3\xA4name\xA3tri\xA5scale\xCB\x3F\xE0\0\0\0\0\0\0"
+            "\xA6origin\x82\xA1x\xFE\xA1y\xCC\xC8",
+            mpack_write_struct(&writer, &test_write_shape_desc, &shape));
+
+    // the longest string that fits its buffer is read back unchanged
+    strcpy(shape.name, "abcdefg");
+    TEST_SIMPLE_WRITE("\x84\xA6""closed\xC3\xA4name\xA7""abcdefg\xA5scale\xCB\x3F\xE0\0\0\0\0\0\0"
+            "\xA6origin\x82\xA1x\xFE\xA1y\xCC\xC8",
+            mpack_write_struct(&writer, &test_write_shape_desc, &shape));
+    test_write_struct_round_trip(&shape);
+
+    // a string filling its buffer has no null-terminator
+    memcpy(shape.name, "abcdefgh", sizeof(shape.name));
+    TEST_SIMPLE_WRITE_ERROR(mpack_write_struct(&writer, &test_write_shape_desc, &shape),
+            mpack_error_too_big);
+
+    // invalid UTF-8
+    strcpy(shape.name, "\xC0\x80");
+    TEST_SIMPLE_WRITE_ERROR(mpack_write_struct(&writer, &test_write_shape_desc, &shape),
+            mpack_error_invalid);
 }
 
+#if MPACK_STATS
+typedef struct test_write_stats_output_t {
+    char data[64];
+    size_t used;
+} test_write_stats_output_t;
+
+static void test_write_stats_flush(mpack_writer_t* writer, const char* buffer, size_t count) {
+    test_write_stats_output_t* output = (test_write_stats_output_t*)writer->context;
+    if (count > sizeof(output->data) - output->used) {
+        mpack_writer_flag_error(writer, mpack_error_io);
+        return;
+    }
+    memcpy(output->data + output->used, buffer, count);
+    output->used += count;
+}
+
+static void test_write_stats(void) {
+    char buffer[MPACK_WRITER_MINIMUM_BUFFER_SIZE];
+    char bin[40];
+    mpack_memset(bin, 0x42, sizeof(bin));
+
+    test_write_stats_output_t output;
+    output.used = 0;
+    mpack_writer_t writer;
+    mpack_writer_init(&writer, buffer, sizeof(buffer));
+    mpack_writer_set_context(&writer, &output);
+    mpack_writer_set_flush(&writer, test_write_stats_flush);
+
+    // small writes fit in the buffer
+    mpack_start_array(&writer, 12);
+    for (int i = 0; i < 10; ++i)
+        mpack_write_u8(&writer, (uint8_t)i);
+    TEST_TRUE(mpack_writer_stats(&writer)->flush_calls == 0);
+    TEST_TRUE(mpack_writer_stats(&writer)->straddles == 0);
+
+    // a bin larger than the buffer flushes the buffer, then flushes its data directly
+    mpack_write_bin(&writer, bin, sizeof(bin));
+    TEST_TRUE(mpack_writer_stats(&writer)->straddles == 1);
+    TEST_TRUE(mpack_writer_stats(&writer)->flush_calls == 2);
+    TEST_TRUE(mpack_writer_stats(&writer)->flush_bytes == 13 + sizeof(bin));
+
+    // the rest is flushed on destroy
+    mpack_write_nil(&writer);
+    mpack_finish_array(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(mpack_writer_stats(&writer)->flush_calls == 3);
+    TEST_TRUE(mpack_writer_stats(&writer)->flush_bytes == output.used);
+    TEST_TRUE(output.used == 14 + sizeof(bin));
+}
+#endif
+
 void test_writes() {
     /*
     const char c[] =
@@ -874,11 +1243,18 @@ void test_writes() {
     test_write_simple_tag_int();
     test_write_simple_misc();
     test_write_utf8();
+    test_write_object_bytes();
+    test_write_struct();
+    #if MPACK_STATS
+    test_write_stats();
+    #endif
 
     #ifdef MPACK_MALLOC
     test_write_basic_structures();
     test_write_small_structure_trees();
     test_system_fail_until_ok(&test_write_deep_growth);
+    test_write_sharded_array();
+    test_system_fail_until_ok(&test_write_sharded_array_failure);
     #endif
 
     #if MPACK_WRITE_TRACKING
@@ -31,6 +31,12 @@
 #include "test-common.h"
 #include "test-node.h"
 #include "test-file.h"
+#include "test-json.h"
+#include "test-journal.h"
+#include "test-pipeline.h"
+#include "test-ring.h"
+#include "test-frame.h"
+#include "test-codec.h"
 
 mpack_tag_t (*fn_mpack_tag_nil)(void) = &mpack_tag_nil;
 
@@ -99,6 +105,24 @@ int main(void) {
     #if MPACK_STDIO
     test_file();
     #endif
+    #if MPACK_JSON
+    test_json();
+    #endif
+    #if MPACK_JOURNAL && MPACK_STDIO
+    test_journal();
+    #endif
+    #if MPACK_PIPELINE && defined(MPACK_MALLOC) && MPACK_WRITER
+    test_pipeline();
+    #endif
+    #if MPACK_RING && MPACK_WRITER && MPACK_NODE
+    test_ring();
+    #endif
+    #if MPACK_FRAME && defined(MPACK_MALLOC) && MPACK_NODE
+    test_frame();
+    #endif
+    #if MPACK_WRITER && MPACK_EXPECT
+    test_codec();
+    #endif
 
     test_buffers();
 
@@ -11,7 +11,12 @@ FILES="\
     mpack-writer \
     mpack-reader \
     mpack-expect \
-    mpack-node"
+    mpack-node \
+    mpack-json \
+    mpack-journal \
+    mpack-pipeline \
+    mpack-ring \
+    mpack-frame"
 
 TOOLS="\
     tools/clean.sh \
@@ -25,5 +25,8 @@ elif [[ "$CC" == "gcc" ]] && [[ "$STANDARD" == "1" ]]; then
 
 else
     scons all=1 || exit $?
+    if [[ "$AMALGAMATED" != "1" ]]; then
+        scons tools || exit $?
+    fi
 
 fi
@@ -0,0 +1,357 @@
+#!/usr/bin/env python3
+# This script generates specialized C encode and decode functions from a
+# small schema file. The generated code uses the MPack Writer and Expect
+# APIs directly, so it needs no descriptor tables or runtime setup.
+#
+# Usage: tools/gencodec.py <schema> <output-basename>
+#
+# This writes <output-basename>.h and <output-basename>.c. The schema is a
+# list of structs, each a list of fields in declared order:
+#
+#     # comments start with a hash
+#     prefix example_
+#     include "mpack/mpack.h"
+#
+#     struct point
+#         i32 x
+#         u8 y
+#     end
+#
+#     struct shape
+#         bool closed
+#         utf8[16] name
+#         optional double scale
+#         point origin
+#         u16 sides 3..8
+#     end
+#
+# Field types are bool, u8, u16, u32, u64, i8, i16, i32, i64, float,
+# double, str[N] and utf8[N] (null-terminated strings in char arrays of
+# size N, so at most N-1 bytes long), or the name of a previously
+# declared struct. Numeric fields can have an inclusive range min..max,
+# which must fit in the field's type. Optional fields may be missing or
+# nil in decoded maps, in which case they are left unchanged.
+#
+# For each struct, this generates a typedef <prefix><name>_t and the
+# functions <prefix><name>_write() and <prefix><name>_expect(). The writer
+# emits keys as pre-encoded byte constants. The decoder first checks each
+# key against the next field in declared order, and falls back to a switch
+# on the key length for reordered maps.
+
+import os
+import re
+import sys
+
+SCALARS = {
+    "bool":   ("bool",     "bool"),
+    "u8":     ("uint8_t",  "u8"),
+    "u16":    ("uint16_t", "u16"),
+    "u32":    ("uint32_t", "u32"),
+    "u64":    ("uint64_t", "u64"),
+    "i8":     ("int8_t",   "i8"),
+    "i16":    ("int16_t",  "i16"),
+    "i32":    ("int32_t",  "i32"),
+    "i64":    ("int64_t",  "i64"),
+    "float":  ("float",    "float"),
+    "double": ("double",   "double"),
+}
+
+# the limits of the integer types, for checking ranges
+LIMITS = {
+    "u8":  (0, 2**8 - 1),
+    "u16": (0, 2**16 - 1),
+    "u32": (0, 2**32 - 1),
+    "u64": (0, 2**64 - 1),
+    "i8":  (-2**7, 2**7 - 1),
+    "i16": (-2**15, 2**15 - 1),
+    "i32": (-2**31, 2**31 - 1),
+    "i64": (-2**63, 2**63 - 1),
+}
+
+IDENT = r"[A-Za-z_][A-Za-z0-9_]*"
+FIELD_RE = re.compile(r"^(optional\s+)?(" + IDENT + r")(?:\[(\d+)\])?\s+(" + IDENT +
+        r")(?:\s+(-?[0-9.eE+-]+)\.\.(-?[0-9.eE+-]+))?$")
+
+
+class Field:
+    def __init__(self, name, kind, size, optional, range_):
+        self.name = name
+        self.kind = kind
+        self.size = size
+        self.optional = optional
+        self.range = range_
+
+
+class Struct:
+    def __init__(self, name):
+        self.name = name
+        self.fields = []
+
+
+def fail(filename, line, message):
+    sys.stderr.write("%s:%i: error: %s\n" % (filename, line, message))
+    sys.exit(1)
+
+
+def parse(filename):
+    prefix = ""
+    includes = []
+    structs = []
+    current = None
+
+    with open(filename) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            words = line.split()
+
+            if current is None:
+                if words[0] == "prefix" and len(words) == 2:
+                    prefix = words[1]
+                elif words[0] == "include" and len(words) == 2:
+                    includes.append(words[1])
+                elif words[0] == "struct" and len(words) == 2 and re.match(IDENT + "$", words[1]):
+                    if any(s.name == words[1] for s in structs):
+                        fail(filename, number, "duplicate struct " + words[1])
+                    current = Struct(words[1])
+                else:
+                    fail(filename, number, "expected struct, prefix or include")
+                continue
+
+            if line == "end":
+                if not current.fields:
+                    fail(filename, number, "struct %s has no fields" % current.name)
+                structs.append(current)
+                current = None
+                continue
+
+            m = FIELD_RE.match(line)
+            if not m:
+                fail(filename, number, "invalid field")
+            optional, kind, size, name, lo, hi = m.groups()
+
+            if kind in ("str", "utf8"):
+                if size is None or int(size) < 1:
+                    fail(filename, number, "%s fields need a buffer size, e.g. %s[16]" % (kind, kind))
+                size = int(size)
+            elif size is not None:
+                fail(filename, number, "only str and utf8 fields have a size")
+            elif kind not in SCALARS and not any(s.name == kind for s in structs):
+                fail(filename, number, "unknown type " + kind)
+
+            range_ = None
+            if lo is not None:
+                if kind not in SCALARS or kind == "bool":
+                    fail(filename, number, "only numeric fields can have a range")
+                try:
+                    numbers = [float(lo), float(hi)] if kind in ("float", "double") else [int(lo), int(hi)]
+                except ValueError:
+                    fail(filename, number, "invalid range for %s field" % kind)
+                if numbers[0] > numbers[1]:
+                    fail(filename, number, "range minimum is larger than maximum")
+                if kind in LIMITS and (numbers[0] < LIMITS[kind][0] or numbers[1] > LIMITS[kind][1]):
+                    fail(filename, number, "range does not fit in a %s field" % kind)
+                range_ = (lo, hi)
+
+            if any(f.name == name for f in current.fields):
+                fail(filename, number, "duplicate field " + name)
+            if len(name.encode()) > 31:
+                fail(filename, number, "field names are limited to 31 bytes")
+            current.fields.append(Field(name, kind, size, optional is not None, range_))
+
+    if current is not None:
+        fail(filename, number, "missing end for struct " + current.name)
+    if not includes:
+        includes.append('"mpack/mpack.h"')
+    return prefix, includes, structs
+
+
+def c_bytes(data):
+    return '"' + "".join("\\x%02x" % b for b in data) + '"'
+
+
+def c_number(kind, value):
+    # numeric literals must have the type of the field to avoid warnings
+    if kind in ("float", "double"):
+        return "(%s)%s" % (kind, value)
+    value = int(value)
+    if kind == "u64":
+        return "UINT64_C(%i)" % value
+    if kind == "i64":
+        # the minimum can't be written as a negated literal
+        if value == LIMITS["i64"][0]:
+            return "INT64_MIN"
+        return "INT64_C(%i)" % value
+    if kind == "u32":
+        return "UINT32_C(%i)" % value
+    if kind == "i32" and value == LIMITS["i32"][0]:
+        return "INT32_MIN"
+    return "%i" % value
+
+
+def key_bytes(name):
+    # field names are at most 31 bytes, so keys are always fixstrs
+    data = name.encode()
+    return bytes([0xa0 | len(data)]) + data
+
+
+def generate(prefix, includes, structs, schema, basename):
+    guard = re.sub(r"[^A-Za-z0-9]", "_", os.path.basename(basename)).upper() + "_H"
+    banner = "/* Generated by tools/gencodec.py from %s. Do not edit. */\n" % os.path.basename(schema)
+
+    h = [banner, "#ifndef %s\n#define %s 1\n\n" % (guard, guard)]
+    for include in includes:
+        h.append("#include %s\n" % include)
+    h.append("\n#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n")
+
+    c = [banner, '#include "%s.h"\n\n#include <string.h>\n\n' % os.path.basename(basename)]
+
+    # strings must be null-terminated within their arrays, as with
+    # mpack_write_struct() and mpack_expect_struct()
+    has_strings = any(f.kind in ("str", "utf8") for s in structs for f in s.fields)
+    if has_strings:
+        c.append("#if MPACK_WRITER\n")
+        c.append("static void %swrite_cstr(mpack_writer_t* writer, const char* str, size_t size, bool utf8) {\n" % prefix)
+        c.append("    size_t length = 0;\n")
+        c.append("    while (length < size && str[length] != '\\0')\n        ++length;\n")
+        c.append("    if (length == size)\n        mpack_writer_flag_error(writer, mpack_error_too_big);\n")
+        c.append("    else if (utf8)\n        mpack_write_utf8(writer, str, (uint32_t)length);\n")
+        c.append("    else\n        mpack_write_str(writer, str, (uint32_t)length);\n")
+        c.append("}\n#endif\n\n")
+
+    for s in structs:
+        ctype = "%s%s_t" % (prefix, s.name)
+        fn = prefix + s.name
+        count = len(s.fields)
+
+        h.append("typedef struct %s {\n" % ctype)
+        for f in s.fields:
+            if f.kind in SCALARS:
+                h.append("    %s %s;\n" % (SCALARS[f.kind][0], f.name))
+            elif f.kind in ("str", "utf8"):
+                h.append("    char %s[%i];\n" % (f.name, f.size))
+            else:
+                h.append("    %s%s_t %s;\n" % (prefix, f.kind, f.name))
+        h.append("} %s;\n\n" % ctype)
+        h.append("#if MPACK_WRITER\nvoid %s_write(mpack_writer_t* writer, const %s* value);\n#endif\n" % (fn, ctype))
+        h.append("#if MPACK_EXPECT\nvoid %s_expect(mpack_reader_t* reader, %s* value);\n#endif\n\n" % (fn, ctype))
+
+        # writer
+        c.append("#if MPACK_WRITER\n")
+        c.append("void %s_write(mpack_writer_t* writer, const %s* value) {\n" % (fn, ctype))
+        c.append("    mpack_start_map(writer, %i);\n" % count)
+        for f in s.fields:
+            key = key_bytes(f.name)
+            c.append("    mpack_write_object_bytes(writer, %s, %i);\n" % (c_bytes(key), len(key)))
+            if f.kind in SCALARS:
+                c.append("    mpack_write_%s(writer, value->%s);\n" % (SCALARS[f.kind][1], f.name))
+            elif f.kind in ("str", "utf8"):
+                c.append("    %swrite_cstr(writer, value->%s, sizeof(value->%s), %s);\n" %
+                        (prefix, f.name, f.name, "true" if f.kind == "utf8" else "false"))
+            else:
+                c.append("    %s%s_write(writer, &value->%s);\n" % (prefix, f.kind, f.name))
+        c.append("    mpack_finish_map(writer);\n}\n#endif\n\n")
+
+        # decoder
+        c.append("#if MPACK_EXPECT\n")
+        c.append("static const char* const %s_keys[%i] = {%s};\n" %
+                (fn, count, ", ".join('"%s"' % f.name for f in s.fields)))
+        c.append("static const uint8_t %s_key_lengths[%i] = {%s};\n\n" %
+                (fn, count, ", ".join(str(len(f.name.encode())) for f in s.fields)))
+
+        c.append("// returns the index of the given key, or %i if it is unrecognized\n" % count)
+        c.append("static size_t %s_find_key(const char* key, size_t length) {\n" % fn)
+        c.append("    switch (length) {\n")
+        by_length = {}
+        for i, f in enumerate(s.fields):
+            by_length.setdefault(len(f.name.encode()), []).append((i, f))
+        for length in sorted(by_length):
+            c.append("        case %i:\n" % length)
+            for i, f in by_length[length]:
+                c.append("            if (memcmp(key, %s_keys[%i], %i) == 0) return %i;\n" % (fn, i, length, i))
+            c.append("            break;\n")
+        c.append("        default:\n            break;\n    }\n    return %i;\n}\n\n" % count)
+
+        c.append("void %s_expect(mpack_reader_t* reader, %s* value) {\n" % (fn, ctype))
+        c.append("    bool found[%i] = {false};\n" % count)
+        c.append("    size_t next = 0;\n")
+        c.append("    for (uint32_t i = mpack_expect_map(reader); i > 0; --i) {\n")
+        c.append("        size_t index = %i;\n" % count)
+        c.append("        if (mpack_peek_tag(reader).type == mpack_type_str) {\n")
+        c.append("            uint32_t length = mpack_expect_str(reader);\n")
+        c.append("            const char* key = mpack_read_bytes_inplace(reader, length);\n")
+        c.append("            mpack_done_str(reader);\n")
+        c.append("            if (mpack_reader_error(reader) != mpack_ok)\n                return;\n\n")
+        c.append("            // keys are usually in declared order\n")
+        c.append("            if (next < %i && length == %s_key_lengths[next] && memcmp(key, %s_keys[next], length) == 0)\n" %
+                (count, fn, fn))
+        c.append("                index = next;\n            else\n")
+        c.append("                index = %s_find_key(key, length);\n" % fn)
+        c.append("        } else {\n            mpack_discard(reader);\n        }\n\n")
+        c.append("        if (index < %i) {\n" % count)
+        c.append("            if (found[index]) {\n")
+        c.append("                mpack_reader_flag_error(reader, mpack_error_invalid);\n")
+        c.append("                return;\n            }\n")
+        c.append("            found[index] = true;\n            next = index + 1;\n        }\n\n")
+        c.append("        switch (index) {\n")
+        for i, f in enumerate(s.fields):
+            # scalars are decoded into a local and stored only without an
+            # error, so that a field in error is left unchanged as with
+            # mpack_expect_struct()
+            scalar = f.kind in SCALARS
+            c.append("            case %i:%s\n" % (i, " {" if scalar else ""))
+            indent = "                "
+            if f.optional:
+                c.append(indent + "if (mpack_peek_tag(reader).type == mpack_type_nil) {\n")
+                c.append(indent + "    mpack_expect_nil(reader);\n")
+                c.append(indent + "    break;\n")
+                c.append(indent + "}\n")
+            if scalar:
+                ctype, suffix = SCALARS[f.kind]
+                if f.range:
+                    c.append(indent + "%s decoded = mpack_expect_%s_range(reader, %s, %s);\n" %
+                            (ctype, suffix, c_number(f.kind, f.range[0]), c_number(f.kind, f.range[1])))
+                else:
+                    c.append(indent + "%s decoded = mpack_expect_%s(reader);\n" % (ctype, suffix))
+                c.append(indent + "if (mpack_reader_error(reader) == mpack_ok)\n")
+                c.append(indent + "    value->%s = decoded;\n" % f.name)
+            elif f.kind in ("str", "utf8"):
+                c.append(indent + "mpack_expect_%s(reader, value->%s, sizeof(value->%s));\n" %
+                        ("utf8_cstr" if f.kind == "utf8" else "cstr", f.name, f.name))
+            else:
+                c.append(indent + "%s%s_expect(reader, &value->%s);\n" % (prefix, f.kind, f.name))
+            c.append(indent + "break;\n")
+            if scalar:
+                c.append("            }\n")
+        c.append("            default:\n                mpack_discard(reader);\n                break;\n")
+        c.append("        }\n\n")
+        c.append("        if (mpack_reader_error(reader) != mpack_ok)\n            return;\n")
+        c.append("    }\n")
+        c.append("    mpack_done_map(reader);\n")
+
+        required = [i for i, f in enumerate(s.fields) if not f.optional]
+        if required:
+            c.append("\n    // fields that are not optional must be present\n")
+            c.append("    if (%s)\n" % " || ".join("!found[%i]" % i for i in required))
+            c.append("        mpack_reader_flag_error(reader, mpack_error_data);\n")
+        c.append("}\n#endif\n\n")
+
+    h.append("#ifdef __cplusplus\n}\n#endif\n\n#endif\n")
+
+    with open(basename + ".h", "w") as f:
+        f.write("".join(h))
+    with open(basename + ".c", "w") as f:
+        f.write("".join(c).rstrip("\n") + "\n")
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write("Usage: %s <schema> <output-basename>\n" % sys.argv[0])
+        sys.exit(2)
+    prefix, includes, structs = parse(sys.argv[1])
+    generate(prefix, includes, structs, sys.argv[1], sys.argv[2])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * This is mpack-index, a tool that builds the array index of a file that
+ * contains one large array, and that extracts single elements from it in
+ * constant time. Run it with -h for options.
+ */
+
+#include "tools.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void index_usage(const char* program) {
+    printf("Usage: %s [options] file\n", program);
+    printf("  Builds the index of a file that contains a single MessagePack array,\n");
+    printf("  writing it to the filename plus .idx.\n");
+    printf("  -i interval index every interval'th element (default 1)\n");
+    #if MPACK_MMAP
+    printf("  -e element  write the element at this index to stdout instead, using\n");
+    printf("              an index built earlier\n");
+    printf("  -c          print the number of elements instead, using an index built\n");
+    printf("              earlier\n");
+    #endif
+}
+
+static const char* index_error_name(mpack_error_t error) {
+    switch (error) {
+        case mpack_error_io:       return "I/O error or truncated data";
+        case mpack_error_invalid:  return "invalid data or index";
+        case mpack_error_type:     return "the file does not contain an array";
+        case mpack_error_data:     return "element out of range";
+        case mpack_error_memory:   return "out of memory";
+        default:                   return tools_error_name(error);
+    }
+}
+
+#if MPACK_MMAP
+static mpack_error_t index_read(const char* filename, bool count, uint64_t element) {
+    mpack_array_index_t index;
+    mpack_array_index_init(&index, filename);
+
+    if (count) {
+        if (mpack_array_index_error(&index) == mpack_ok)
+            printf("%" PRIu64 "\n", mpack_array_index_count(&index));
+    } else {
+        size_t size;
+        const char* data = mpack_array_index_element(&index, element, &size);
+        if (data != NULL && fwrite(data, 1, size, stdout) != size)
+            mpack_array_index_flag_error(&index, mpack_error_io);
+    }
+
+    return mpack_array_index_destroy(&index);
+}
+#endif
+
+int main(int argc, char** argv) {
+    uint64_t interval = 1;
+    uint64_t element = 0;
+    bool extract = false;
+    bool count = false;
+    const char* filename = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0';
+
+        if (!ok && filename == NULL && i == argc - 1) {
+            filename = arg;
+            continue;
+        }
+
+        #if MPACK_MMAP
+        if (ok && arg[1] == 'c') {
+            count = true;
+            continue;
+        }
+        #endif
+
+        ok = ok && value != NULL;
+        if (ok) {
+            switch (arg[1]) {
+                case 'i':
+                    ok = tools_parse_uint(value, &interval) && interval != 0 && interval <= UINT32_MAX;
+                    break;
+                #if MPACK_MMAP
+                case 'e':
+                    ok = tools_parse_uint(value, &element);
+                    extract = true;
+                    break;
+                #endif
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+
+        if (!ok) {
+            index_usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    if (filename == NULL || (extract && count)) {
+        index_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    mpack_error_t error;
+    #if MPACK_MMAP
+    if (extract || count)
+        error = index_read(filename, count, element);
+    else
+    #endif
+        error = mpack_array_index_build(filename, (uint32_t)interval);
+
+    if (error != mpack_ok) {
+        fflush(stdout);
+        fprintf(stderr, "%s: %s\n", filename, index_error_name(error));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,864 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * This is mpack-inspect, a tool that prints MessagePack files of any size.
+ * Unlike mpack_print(), it streams the file with a reader instead of
+ * loading it, and it walks the data iteratively so deep nesting doesn't
+ * consume the call stack. Run it with -h for options.
+ */
+
+#include "tools.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INSPECT_CHUNK_SIZE 4096
+#define INSPECT_PREVIEW_SIZE 32
+
+typedef struct inspect_options_t {
+    uint64_t max_depth;    // containers nested deeper are summarized, or 0 for no limit
+    uint64_t max_items;    // elements printed per array or pairs per map, or 0 for no limit
+    uint64_t max_length;   // bytes printed per str, bin or ext, or 0 for no limit
+    uint64_t skip;         // messages to skip at the start of the file
+    uint64_t count;        // messages to inspect, or 0 for all
+    uint64_t top;          // number of largest strings to list in stats
+    const char* path;      // the path of the element to select, or NULL
+    bool stats;            // print summary statistics instead of the data
+    bool mmap;             // map the file instead of reading it
+} inspect_options_t;
+
+// A segment of a path selector. It matches a str map key with the same
+// bytes, an int or uint map key with the same value, or an array index.
+typedef struct inspect_segment_t {
+    const char* key;
+    size_t length;
+    bool number;  // whether the key is a decimal integer
+    bool index;   // whether the key is a non-negative integer
+    int64_t value;
+} inspect_segment_t;
+
+// An open array or map
+typedef struct inspect_level_t {
+    mpack_type_t type;
+    uint64_t left;   // elements left to read (twice the pairs for maps)
+    uint64_t index;  // elements read so far
+    bool open;       // whether the opening bracket was printed
+    bool print;      // whether the remaining elements are printed
+} inspect_level_t;
+
+// One of the largest strings found by the statistics
+typedef struct inspect_string_t {
+    uint32_t length;
+    uint64_t offset;
+    uint64_t message;
+    char preview[INSPECT_PREVIEW_SIZE];
+    size_t preview_length;
+} inspect_string_t;
+
+typedef struct inspect_t {
+    inspect_options_t options;
+    mpack_reader_t reader;
+    FILE* out;
+
+    // the end of the input, or UINT64_MAX if it is read from a pipe
+    uint64_t end;
+    uint64_t piped;
+    bool piped_eof;
+    bool piped_end;
+    char* buffer;
+
+    // the walk stack
+    inspect_level_t* levels;
+    size_t level;
+    size_t capacity;
+
+    // the path selector
+    inspect_segment_t* segments;
+    inspect_level_t* path;
+    size_t segment_count;
+
+    // statistics
+    uint64_t message;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t type_counts[mpack_type_map + 1];
+    uint64_t type_sizes[mpack_type_map + 1];
+    uint64_t max_nesting;
+    inspect_string_t* strings;
+    size_t string_count;
+} inspect_t;
+
+static const char* inspect_type_names[mpack_type_map + 1] = {
+    "", "nil", "bool", "float", "double", "int", "uint", "str", "bin", "ext", "array", "map"
+};
+
+static void inspect_usage(const char* program) {
+    printf("Usage: %s [options] file\n", program);
+    printf("  Prints a file of concatenated MessagePack messages. Use - for stdin.\n");
+    printf("  -d depth    print containers nested at most this deep (default 8)\n");
+    printf("  -n count    elements printed per array or pairs per map (default 16)\n");
+    printf("  -l length   bytes printed per str, bin or ext (default 64)\n");
+    printf("  -p path     print only the element at a path of map keys and array\n");
+    printf("              indices separated by periods, e.g. users.3.name\n");
+    printf("  -k count    skip this many messages first\n");
+    printf("  -c count    stop after this many messages\n");
+    printf("  -s          print summary statistics instead of the data\n");
+    printf("  -t count    number of largest strings listed by -s (default 10)\n");
+    #if MPACK_MMAP
+    printf("  -m          map the file into memory instead of reading it\n");
+    #endif
+    printf("  A depth, count or length of 0 means no limit.\n");
+}
+
+
+
+/*
+ * Input
+ */
+
+static size_t inspect_stdin_fill(mpack_reader_t* reader, char* buffer, size_t count) {
+    inspect_t* in = (inspect_t*)reader->context;
+    size_t step = fread(buffer, 1, count, stdin);
+    in->piped += step;
+    if (step == 0)
+        in->piped_eof = true;
+    return step;
+}
+
+static uint64_t inspect_position(inspect_t* in) {
+    return mpack_reader_error_position(&in->reader);
+}
+
+static bool inspect_open(inspect_t* in, const char* filename) {
+    in->end = UINT64_MAX;
+
+    if (strcmp(filename, "-") == 0) {
+        in->buffer = (char*)malloc(MPACK_BUFFER_SIZE);
+        if (in->buffer == NULL) {
+            mpack_reader_init_error(&in->reader, mpack_error_memory);
+            return false;
+        }
+        mpack_reader_init(&in->reader, in->buffer, MPACK_BUFFER_SIZE, 0);
+        mpack_reader_set_context(&in->reader, in);
+        mpack_reader_set_fill(&in->reader, inspect_stdin_fill);
+        return true;
+    }
+
+    #if MPACK_MMAP
+    if (in->options.mmap) {
+        mpack_reader_init_mmap(&in->reader, filename);
+        in->end = mpack_reader_remaining(&in->reader, NULL);
+        return mpack_reader_error(&in->reader) == mpack_ok;
+    }
+    #endif
+
+    // the size of the file tells us where the last message should end
+    if (!tools_file_size(filename, &in->end)) {
+        mpack_reader_init_error(&in->reader, mpack_error_io);
+        return false;
+    }
+
+    mpack_reader_init_file(&in->reader, filename);
+    return mpack_reader_error(&in->reader) == mpack_ok;
+}
+
+// Returns true if the input ended cleanly at a message boundary
+static bool inspect_at_end(inspect_t* in) {
+    if (in->end != UINT64_MAX)
+        return inspect_position(in) >= in->end;
+
+    // the end of a pipe is only found by trying to read past it, which
+    // leaves the reader in an error state
+    mpack_peek_tag(&in->reader);
+    in->piped_end = mpack_reader_error(&in->reader) != mpack_ok && in->piped_eof &&
+            inspect_position(in) == in->piped;
+    return in->piped_end;
+}
+
+
+
+/*
+ * Printing
+ */
+
+static void inspect_indent(inspect_t* in, size_t depth) {
+    putc('\n', in->out);
+    for (size_t i = 0; i < depth; ++i)
+        fputs("    ", in->out);
+}
+
+static void inspect_print_scalar(inspect_t* in, mpack_tag_t tag) {
+    switch (tag.type) {
+        case mpack_type_nil:    fputs("null", in->out); break;
+        case mpack_type_bool:   fputs(tag.v.b ? "true" : "false", in->out); break;
+        case mpack_type_int:    fprintf(in->out, "%" PRIi64, tag.v.i); break;
+        case mpack_type_uint:   fprintf(in->out, "%" PRIu64, tag.v.u); break;
+        case mpack_type_float:  fprintf(in->out, "%.9g", (double)tag.v.f); break;
+        case mpack_type_double: fprintf(in->out, "%.17g", tag.v.d); break;
+        default:
+            break;
+    }
+}
+
+static void inspect_print_str(inspect_t* in, const char* data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char c = (unsigned char)data[i];
+        switch (c) {
+            case '"':  fputs("\\\"", in->out); break;
+            case '\\': fputs("\\\\", in->out); break;
+            case '\n': fputs("\\n", in->out); break;
+            case '\r': fputs("\\r", in->out); break;
+            case '\t': fputs("\\t", in->out); break;
+            default:
+                if (c < 0x20 || c == 0x7f)
+                    fprintf(in->out, "\\u%04x", (unsigned)c);
+                else
+                    putc(c, in->out);
+                break;
+        }
+    }
+}
+
+static void inspect_print_hex(inspect_t* in, const char* data, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        fprintf(in->out, "%02x", (unsigned)(unsigned char)data[i]);
+}
+
+// Returns the length of the given truncated str without any incomplete
+// UTF-8 sequence at its end.
+static size_t inspect_utf8_trim(const char* data, size_t count) {
+    size_t i = count;
+    while (i > 0 && count - i < 3 && ((unsigned char)data[i - 1] & 0xc0) == 0x80)
+        --i;
+    if (i == 0)
+        return count;
+    unsigned char lead = (unsigned char)data[i - 1];
+    size_t needed = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+    return (count - (i - 1) < needed) ? i - 1 : count;
+}
+
+
+
+/*
+ * Statistics
+ */
+
+static void inspect_count_string(inspect_t* in, uint32_t length, uint64_t offset,
+        const char* preview, size_t preview_length)
+{
+    size_t i = in->string_count;
+    if (i == in->options.top)
+        --i;
+    while (i > 0 && in->strings[i - 1].length < length) {
+        in->strings[i] = in->strings[i - 1];
+        --i;
+    }
+    inspect_string_t* string = &in->strings[i];
+    string->length = length;
+    string->offset = offset;
+    string->message = in->message;
+    string->preview_length = preview_length;
+    memcpy(string->preview, preview, preview_length);
+    if (in->string_count < in->options.top)
+        ++in->string_count;
+}
+
+// Returns true if a str of the given length is among the largest so far
+static bool inspect_is_large_string(inspect_t* in, uint32_t length) {
+    if (in->string_count < in->options.top)
+        return true;
+    return in->string_count > 0 && in->strings[in->string_count - 1].length < length;
+}
+
+static void inspect_count(inspect_t* in, mpack_tag_t tag) {
+    ++in->type_counts[tag.type];
+    switch (tag.type) {
+        case mpack_type_str:
+        case mpack_type_bin:
+        case mpack_type_ext:
+            in->type_sizes[tag.type] += tag.v.l;
+            break;
+        case mpack_type_array:
+        case mpack_type_map:
+            in->type_sizes[tag.type] += tag.v.n;
+            break;
+        default:
+            break;
+    }
+}
+
+static void inspect_print_stats(inspect_t* in) {
+    FILE* out = in->out;
+    fprintf(out, "Messages    %" PRIu64 "\n", in->messages);
+    fprintf(out, "Bytes       %" PRIu64 "\n", in->bytes);
+    fprintf(out, "Max depth   %" PRIu64 "\n", in->max_nesting);
+
+    fprintf(out, "\n%-8s %14s %16s\n", "Type", "Count", "Size");
+    for (int type = mpack_type_nil; type <= mpack_type_map; ++type) {
+        fprintf(out, "%-8s %14" PRIu64, inspect_type_names[type], in->type_counts[type]);
+        if (type == mpack_type_str || type == mpack_type_bin || type == mpack_type_ext)
+            fprintf(out, " %16" PRIu64 " bytes", in->type_sizes[type]);
+        else if (type == mpack_type_array)
+            fprintf(out, " %16" PRIu64 " elements", in->type_sizes[type]);
+        else if (type == mpack_type_map)
+            fprintf(out, " %16" PRIu64 " pairs", in->type_sizes[type]);
+        putc('\n', out);
+    }
+
+    if (in->string_count == 0)
+        return;
+    fprintf(out, "\nLargest strings\n%12s %16s %12s  %s\n", "Length", "Offset", "Message", "Preview");
+    for (size_t i = 0; i < in->string_count; ++i) {
+        const inspect_string_t* string = &in->strings[i];
+        fprintf(out, "%12u %16" PRIu64 " %12" PRIu64 "  \"", (unsigned)string->length,
+                string->offset, string->message);
+        size_t length = string->preview_length;
+        bool truncated = length < string->length;
+        if (truncated)
+            length = inspect_utf8_trim(string->preview, length);
+        inspect_print_str(in, string->preview, length);
+        fputs(truncated ? "\"...\n" : "\"\n", out);
+    }
+}
+
+
+
+/*
+ * Walking
+ */
+
+// Reads the data of a str, bin or ext whose tag has already been read,
+// printing up to the maximum length if print is set. Only the bytes that
+// are needed are read; the rest are skipped.
+static void inspect_data(inspect_t* in, mpack_tag_t tag, uint64_t offset, bool print, bool count) {
+    mpack_reader_t* reader = &in->reader;
+    uint32_t length = tag.v.l;
+
+    size_t printable = 0;
+    if (print)
+        printable = (in->options.max_length == 0 || in->options.max_length > length) ?
+                length : (size_t)in->options.max_length;
+    bool truncated = printable < length;
+
+    // the largest strs also need a preview for the statistics
+    size_t wanted = printable;
+    bool large = count && tag.type == mpack_type_str && inspect_is_large_string(in, length);
+    if (large && wanted < INSPECT_PREVIEW_SIZE)
+        wanted = length < INSPECT_PREVIEW_SIZE ? length : INSPECT_PREVIEW_SIZE;
+
+    if (print) {
+        if (tag.type == mpack_type_str)
+            putc('"', in->out);
+        else if (tag.type == mpack_type_bin)
+            fprintf(in->out, "<bin of length %u", (unsigned)length);
+        else
+            fprintf(in->out, "<ext of type %i and length %u", (int)tag.exttype, (unsigned)length);
+        if (tag.type != mpack_type_str && length > 0)
+            fputs(": ", in->out);
+    }
+
+    // read and print the wanted bytes in chunks, keeping a preview
+    char chunk[INSPECT_CHUNK_SIZE];
+    char preview[INSPECT_PREVIEW_SIZE];
+    size_t preview_length = 0;
+    size_t done = 0;
+    while (done < wanted && mpack_reader_error(reader) == mpack_ok) {
+        size_t step = wanted - done;
+        if (step > sizeof(chunk))
+            step = sizeof(chunk);
+        mpack_read_bytes(reader, chunk, step);
+        if (mpack_reader_error(reader) != mpack_ok)
+            return;
+        if (preview_length < INSPECT_PREVIEW_SIZE) {
+            size_t copy = INSPECT_PREVIEW_SIZE - preview_length;
+            if (copy > step)
+                copy = step;
+            memcpy(preview + preview_length, chunk, copy);
+            preview_length += copy;
+        }
+        if (done < printable) {
+            size_t shown = printable - done < step ? printable - done : step;
+            if (tag.type == mpack_type_str) {
+                if (truncated && done + shown == printable)
+                    shown = inspect_utf8_trim(chunk, shown);
+                inspect_print_str(in, chunk, shown);
+            } else {
+                inspect_print_hex(in, chunk, shown);
+            }
+        }
+        done += step;
+    }
+    mpack_skip_bytes(reader, length - done);
+
+    if (print) {
+        if (tag.type != mpack_type_str)
+            fputs(truncated ? "...>" : ">", in->out);
+        else if (truncated)
+            fprintf(in->out, "\"... (%u bytes)", (unsigned)length);
+        else
+            putc('"', in->out);
+    }
+    if (large && mpack_reader_error(reader) == mpack_ok)
+        inspect_count_string(in, length, offset, preview, preview_length);
+
+    if (tag.type == mpack_type_str)
+        mpack_done_str(reader);
+    else if (tag.type == mpack_type_bin)
+        mpack_done_bin(reader);
+    else
+        mpack_done_ext(reader);
+}
+
+static bool inspect_push(inspect_t* in, mpack_type_t type, uint64_t left, bool open, bool print) {
+    if (in->level == in->capacity) {
+        size_t capacity = in->capacity * 2;
+        inspect_level_t* levels = (inspect_level_t*)realloc(in->levels, sizeof(inspect_level_t) * capacity);
+        if (levels == NULL) {
+            mpack_reader_flag_error(&in->reader, mpack_error_memory);
+            return false;
+        }
+        in->levels = levels;
+        in->capacity = capacity;
+    }
+    inspect_level_t* level = &in->levels[in->level++];
+    level->type = type;
+    level->left = left;
+    level->index = 0;
+    level->open = open;
+    level->print = print;
+    return true;
+}
+
+// Prints the separator before the next element of the given container,
+// and stops printing the container if it has reached the item limit.
+static void inspect_separate(inspect_t* in, inspect_level_t* top) {
+    bool map = top->type == mpack_type_map;
+    if (map && (top->index & 1)) {
+        fputs(": ", in->out);
+        return;
+    }
+
+    uint64_t items = map ? top->index / 2 : top->index;
+    if (items > 0)
+        putc(',', in->out);
+    inspect_indent(in, in->level);
+    if (in->options.max_items != 0 && items == in->options.max_items) {
+        uint64_t more = map ? top->left / 2 : top->left;
+        fprintf(in->out, "... %" PRIu64 " more", more);
+        top->print = false;
+    }
+}
+
+// Reads the contents of an element whose tag has already been read,
+// printing it if print is set and counting it in the statistics if
+// count is set. The walk is iterative, so nesting depth is limited only
+// by memory.
+static void inspect_walk(inspect_t* in, mpack_tag_t tag, uint64_t offset, bool print, bool count) {
+    mpack_reader_t* reader = &in->reader;
+    mpack_assert(in->level == 0, "walk is not reentrant");
+
+    for (;;) {
+        if (count)
+            inspect_count(in, tag);
+
+        switch (tag.type) {
+            case mpack_type_str:
+            case mpack_type_bin:
+            case mpack_type_ext:
+                inspect_data(in, tag, offset, print, count);
+                break;
+
+            case mpack_type_array:
+            case mpack_type_map: {
+                bool map = tag.type == mpack_type_map;
+                uint64_t left = map ? (uint64_t)tag.v.n * 2 : tag.v.n;
+                bool open = print && left > 0 && (in->options.max_depth == 0 ||
+                        in->level < in->options.max_depth);
+                if (print) {
+                    if (left == 0)
+                        fputs(map ? "{}" : "[]", in->out);
+                    else if (!open)
+                        fprintf(in->out, map ? "{...%u pairs}" : "[...%u elements]", (unsigned)tag.v.n);
+                    else
+                        putc(map ? '{' : '[', in->out);
+                }
+                if (left == 0) {
+                    if (map)
+                        mpack_done_map(reader);
+                    else
+                        mpack_done_array(reader);
+                    break;
+                }
+                if (!inspect_push(in, tag.type, left, open, open))
+                    return;
+                if (count && in->level > in->max_nesting)
+                    in->max_nesting = in->level;
+                break;
+            }
+
+            default:
+                if (print)
+                    inspect_print_scalar(in, tag);
+                break;
+        }
+
+        // close finished containers
+        while (in->level > 0 && in->levels[in->level - 1].left == 0 &&
+                mpack_reader_error(reader) == mpack_ok)
+        {
+            inspect_level_t* top = &in->levels[--in->level];
+            if (top->open) {
+                inspect_indent(in, in->level);
+                putc(top->type == mpack_type_map ? '}' : ']', in->out);
+            }
+            if (top->type == mpack_type_map)
+                mpack_done_map(reader);
+            else
+                mpack_done_array(reader);
+        }
+        if (in->level == 0 || mpack_reader_error(reader) != mpack_ok)
+            break;
+
+        // read the next element
+        inspect_level_t* top = &in->levels[in->level - 1];
+        if (top->print)
+            inspect_separate(in, top);
+        print = top->print;
+        --top->left;
+        ++top->index;
+        offset = inspect_position(in);
+        tag = mpack_read_tag(reader);
+        if (mpack_reader_error(reader) != mpack_ok)
+            break;
+    }
+
+    in->level = 0;
+}
+
+// Reads and discards the next element without printing or counting it
+static void inspect_skip(inspect_t* in) {
+    mpack_tag_t tag = mpack_read_tag(&in->reader);
+    if (mpack_reader_error(&in->reader) == mpack_ok)
+        inspect_walk(in, tag, 0, false, false);
+}
+
+
+
+/*
+ * Path selection
+ */
+
+static bool inspect_parse_path(inspect_t* in, const char* path) {
+    size_t count = 1;
+    for (const char* p = path; *p; ++p)
+        if (*p == '.')
+            ++count;
+
+    in->segments = (inspect_segment_t*)malloc(sizeof(inspect_segment_t) * count);
+    in->path = (inspect_level_t*)malloc(sizeof(inspect_level_t) * count);
+    if (in->segments == NULL || in->path == NULL)
+        return false;
+    in->segment_count = count;
+
+    const char* key = path;
+    for (size_t i = 0; i < count; ++i) {
+        const char* end = strchr(key, '.');
+        if (end == NULL)
+            end = key + strlen(key);
+        if (end == key)
+            return false;
+
+        inspect_segment_t* segment = &in->segments[i];
+        segment->key = key;
+        segment->length = (size_t)(end - key);
+
+        // keys of digits with an optional minus sign also match ints
+        const char* digits = (*key == '-') ? key + 1 : key;
+        segment->number = digits != end && end - digits <= 18;
+        uint64_t value = 0;
+        for (const char* p = digits; p != end && segment->number; ++p) {
+            segment->number = *p >= '0' && *p <= '9';
+            value = value * 10 + (uint64_t)(*p - '0');
+        }
+        segment->index = segment->number && digits == key;
+        segment->value = (digits == key) ? (int64_t)value : -(int64_t)value;
+
+        key = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+// Reads the contents of a map key whose tag has already been read,
+// returning true if it matches the given path segment
+static bool inspect_match_key(inspect_t* in, mpack_tag_t key, const inspect_segment_t* segment) {
+    mpack_reader_t* reader = &in->reader;
+
+    if (key.type == mpack_type_int)
+        return segment->number && key.v.i == segment->value;
+    if (key.type == mpack_type_uint)
+        return segment->index && key.v.u == (uint64_t)segment->value;
+    if (key.type != mpack_type_str || key.v.l != segment->length) {
+        inspect_walk(in, key, 0, false, false);
+        return false;
+    }
+
+    // compare the key in chunks in case the segment is long
+    bool match = true;
+    size_t done = 0;
+    char chunk[INSPECT_CHUNK_SIZE];
+    while (done < segment->length && mpack_reader_error(reader) == mpack_ok) {
+        size_t step = segment->length - done;
+        if (step > sizeof(chunk))
+            step = sizeof(chunk);
+        mpack_read_bytes(reader, chunk, step);
+        match = match && memcmp(chunk, segment->key + done, step) == 0;
+        done += step;
+    }
+    mpack_done_str(reader);
+    return match && mpack_reader_error(reader) == mpack_ok;
+}
+
+// Reads the next message, walking the element at the selected path and
+// skipping everything else. Returns true if the path was found.
+static bool inspect_select(inspect_t* in, bool print, bool count) {
+    mpack_reader_t* reader = &in->reader;
+    size_t depth = 0;
+    bool found = false;
+
+    uint64_t offset = inspect_position(in);
+    mpack_tag_t tag = mpack_read_tag(reader);
+    while (mpack_reader_error(reader) == mpack_ok) {
+        if (depth == in->segment_count) {
+            found = true;
+            break;
+        }
+        const inspect_segment_t* segment = &in->segments[depth];
+        inspect_level_t* level = &in->path[depth];
+        level->type = tag.type;
+
+        if (tag.type == mpack_type_array) {
+            level->left = tag.v.n;
+            ++depth;
+            if (!segment->index || (uint64_t)segment->value >= tag.v.n)
+                break;
+            for (int64_t i = 0; i < segment->value && mpack_reader_error(reader) == mpack_ok; ++i)
+                inspect_skip(in);
+            level->left -= (uint64_t)segment->value + 1;
+
+        } else if (tag.type == mpack_type_map) {
+            level->left = (uint64_t)tag.v.n * 2;
+            ++depth;
+            bool match = false;
+            while (!match && level->left > 0 && mpack_reader_error(reader) == mpack_ok) {
+                mpack_tag_t key = mpack_read_tag(reader);
+                --level->left;
+                if (mpack_reader_error(reader) != mpack_ok)
+                    break;
+                match = inspect_match_key(in, key, segment);
+                if (!match) {
+                    inspect_skip(in);
+                    --level->left;
+                }
+            }
+            if (!match)
+                break;
+            --level->left;
+
+        } else {
+            inspect_walk(in, tag, offset, false, false);
+            break;
+        }
+
+        offset = inspect_position(in);
+        tag = mpack_read_tag(reader);
+    }
+
+    if (found) {
+        inspect_walk(in, tag, offset, print, count);
+        if (print)
+            putc('\n', in->out);
+    }
+
+    // skip the rest of the containers around the path
+    while (depth > 0) {
+        inspect_level_t* level = &in->path[--depth];
+        for (; level->left > 0 && mpack_reader_error(reader) == mpack_ok; --level->left)
+            inspect_skip(in);
+        if (level->type == mpack_type_map)
+            mpack_done_map(reader);
+        else
+            mpack_done_array(reader);
+    }
+
+    return found && mpack_reader_error(reader) == mpack_ok;
+}
+
+
+
+/*
+ * Main
+ */
+
+static int inspect_file(inspect_t* in, const char* filename) {
+    mpack_reader_t* reader = &in->reader;
+    bool print = !in->options.stats;
+    uint64_t matched = 0;
+
+    while (mpack_reader_error(reader) == mpack_ok && !inspect_at_end(in)) {
+        if (in->options.count != 0 && in->messages == in->options.count)
+            break;
+        uint64_t start = inspect_position(in);
+
+        if (in->message < in->options.skip) {
+            inspect_skip(in);
+        } else {
+            if (in->segment_count > 0) {
+                if (inspect_select(in, print, in->options.stats))
+                    ++matched;
+            } else {
+                mpack_tag_t tag = mpack_read_tag(reader);
+                if (mpack_reader_error(reader) == mpack_ok)
+                    inspect_walk(in, tag, start, print, in->options.stats);
+                if (print)
+                    putc('\n', in->out);
+            }
+            ++in->messages;
+            in->bytes += inspect_position(in) - start;
+        }
+        ++in->message;
+    }
+
+    uint64_t position = inspect_position(in);
+    mpack_error_t error = mpack_reader_destroy(reader);
+    if (in->piped_end)
+        error = mpack_ok;
+
+    if (error != mpack_ok) {
+        fflush(in->out);
+        fprintf(stderr, "%s: %s at offset %" PRIu64 " in message %" PRIu64 "\n",
+                filename, tools_error_name(error), position, in->message);
+        return EXIT_FAILURE;
+    }
+
+    if (in->options.stats)
+        inspect_print_stats(in);
+    if (in->segment_count > 0 && matched == 0) {
+        fprintf(stderr, "%s: path %s not found\n", filename, in->options.path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    inspect_t in;
+    memset(&in, 0, sizeof(in));
+    in.out = stdout;
+    inspect_options_t* options = &in.options;
+    options->max_depth = 8;
+    options->max_items = 16;
+    options->max_length = 64;
+    options->top = 10;
+    const char* filename = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0';
+
+        if (!ok && filename == NULL && i == argc - 1) {
+            filename = arg;
+            continue;
+        }
+
+        // flags without a value
+        if (ok && (arg[1] == 's' || arg[1] == 'm')) {
+            if (arg[1] == 's')
+                options->stats = true;
+            else
+                options->mmap = true;
+            #if !MPACK_MMAP
+            ok = arg[1] != 'm';
+            #endif
+            if (ok)
+                continue;
+        }
+
+        ok = ok && value != NULL;
+        if (ok) {
+            switch (arg[1]) {
+                case 'd': ok = tools_parse_uint(value, &options->max_depth); break;
+                case 'n': ok = tools_parse_uint(value, &options->max_items); break;
+                case 'l': ok = tools_parse_uint(value, &options->max_length); break;
+                case 'k': ok = tools_parse_uint(value, &options->skip); break;
+                case 'c': ok = tools_parse_uint(value, &options->count); break;
+                case 't': ok = tools_parse_uint(value, &options->top); break;
+                case 'p': options->path = value; break;
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+
+        if (!ok) {
+            inspect_usage(argv[0]);
+            return strcmp(arg, "-h") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        ++i;
+    }
+
+    if (filename == NULL) {
+        inspect_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options->path != NULL && !inspect_parse_path(&in, options->path)) {
+        fprintf(stderr, "invalid path: %s\n", options->path);
+        return EXIT_FAILURE;
+    }
+
+    in.capacity = 64;
+    in.levels = (inspect_level_t*)malloc(sizeof(inspect_level_t) * in.capacity);
+    if (options->stats && options->top > 0)
+        in.strings = (inspect_string_t*)malloc(sizeof(inspect_string_t) * (size_t)options->top);
+    if (in.levels == NULL || (options->stats && options->top > 0 && in.strings == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    int result;
+    if (!inspect_open(&in, filename)) {
+        fprintf(stderr, "%s: could not open file\n", filename);
+        mpack_reader_destroy(&in.reader);
+        result = EXIT_FAILURE;
+    } else {
+        result = inspect_file(&in, filename);
+    }
+
+    free(in.buffer);
+    free(in.levels);
+    free(in.strings);
+    free(in.segments);
+    free(in.path);
+    return result;
+}
+
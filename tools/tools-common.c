@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "tools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool tools_parse_uint(const char* value, uint64_t* out) {
+    char* end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (end == value || *end != '\0' || *value == '-')
+        return false;
+    *out = parsed;
+    return true;
+}
+
+const char* tools_error_name(mpack_error_t error) {
+    switch (error) {
+        case mpack_ok:             return "ok";
+        case mpack_error_io:       return "I/O error or truncated data";
+        case mpack_error_invalid:  return "invalid data";
+        case mpack_error_type:     return "type error";
+        case mpack_error_too_big:  return "data too big";
+        case mpack_error_memory:   return "out of memory";
+        case mpack_error_bug:      return "bug";
+        case mpack_error_data:     return "data error";
+    }
+    return "unknown error";
+}
+
+bool tools_file_size(const char* filename, uint64_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+        return false;
+    mpack_error_t error = mpack_file_size(file, size);
+    fclose(file);
+    return error == mpack_ok;
+}
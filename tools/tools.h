@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2015 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Helpers shared by the command-line tools in this directory.
+ */
+
+#ifndef MPACK_TOOLS_H
+#define MPACK_TOOLS_H 1
+
+#include "mpack/mpack.h"
+
+// Parses a non-negative decimal integer option value.
+bool tools_parse_uint(const char* value, uint64_t* out);
+
+// Returns a short description of an error for messages printed to stderr.
+const char* tools_error_name(mpack_error_t error);
+
+// Gets the size of a file in bytes. This uses 64-bit offsets so it works
+// for files over 2 GB, including on platforms where long is 32 bits.
+bool tools_file_size(const char* filename, uint64_t* size);
+
+#endif